@@ -9,6 +9,7 @@
 #define CCmsMessage_h_
 
 #include <openssl/ssl.h>
+#include <sys/types.h>
 
 #include "Memory/DynamicArray/DynamicArrayInc.h"
 
@@ -24,6 +25,20 @@ public:
 			const std::string& appId,
 			const std::string& pmeId);
 
+	/**
+	 * Initializes from a local directory holding cert.pem and privateKey.pem and a
+	 * remote one holding cmsCert.pem, cmsCipherName.txt and cmsCertCollection.
+	 */
+	void initializeFromDirs(
+			const std::string& locDir,
+			const std::string& rmtCertsDir);
+
+	/**
+	 * Keys and certificates are loaded once and reused for every message. Returns
+	 * false if any of their files was replaced, changed or removed since.
+	 */
+	bool isCurrent() const;
+
 public:
 	void signBufferToBuffer(
 			const SmartPtrCDynamicByteArray& inputBuffer,
@@ -178,6 +193,30 @@ private:
 			const std::string& direction,
 			const std::string& path) const;
 
+private:
+	void loadCredentials(
+			const std::string& locDir,
+			const std::string& rmtCertsDir);
+
+	void freeCredentials();
+
+	struct CFileStamp {
+		bool exists;
+		time_t mtime;
+		off_t size;
+		ino_t ino;
+
+		bool operator==(const CFileStamp& rhs) const {
+			return (exists == rhs.exists) && (mtime == rhs.mtime) &&
+				(size == rhs.size) && (ino == rhs.ino);
+		}
+	};
+
+	typedef std::deque<CFileStamp> CFileStamps;
+
+	static CFileStamps getFileStamps(
+			const Cdeqstr& paths);
+
 private:
 	std::string getReqDirPath(
 			const std::string& directory,
@@ -218,6 +257,21 @@ private:
 	std::string _signPrivateKeyPath;
 	Cdeqstr _caCertificatePaths;
 
+	/*
+	 * Shared by every message that uses this instance. The lazily computed
+	 * X509 fields are filled in by loadCredentials, so sign, verify, encrypt
+	 * and decrypt can use these concurrently.
+	 */
+	X509* _signPublicKey;
+	EVP_PKEY* _signPrivateKey;
+	X509* _decryptPublicKey;
+	EVP_PKEY* _decryptPrivateKey;
+	STACK_OF(X509)* _encryptPublicKeyStack;
+	X509_STORE* _caCertStore;
+
+	Cdeqstr _credentialPaths;
+	CFileStamps _credentialStamps;
+
 	bool _checkCrlf;
 
 private:
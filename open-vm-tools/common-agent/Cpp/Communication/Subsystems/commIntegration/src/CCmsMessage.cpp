@@ -12,17 +12,25 @@
 #include "Exception/CCafException.h"
 #include "CCmsMessageUtils.h"
 #include <fstream>
+#include <sys/stat.h>
 
 using namespace Caf;
 
 CCmsMessage::CCmsMessage() :
 	_isInitialized(false),
 	_cipher(NULL),
+	_signPublicKey(NULL),
+	_signPrivateKey(NULL),
+	_decryptPublicKey(NULL),
+	_decryptPrivateKey(NULL),
+	_encryptPublicKeyStack(NULL),
+	_caCertStore(NULL),
 	_checkCrlf(false),
 	CAF_CM_INIT_LOG("CCmsMessage") {
 }
 
 CCmsMessage::~CCmsMessage() {
+	freeCredentials();
 }
 
 void CCmsMessage::initialize(
@@ -39,10 +47,48 @@ void CCmsMessage::initialize(
 	_persistenceDir = AppConfigUtils::getRequiredString("persistence_dir");
 
 	const std::string locDir = getReqDirPath(_persistenceDir, "local");
+	const std::string rmtCertsDir = getReqRmtCertsDir(appId, pmeId);
+
+	_checkCrlf = AppConfigUtils::getOptionalBoolean("security", "check_crlf");
+
+	loadCredentials(locDir, rmtCertsDir);
+
+	_isInitialized = true;
+}
+
+void CCmsMessage::initializeFromDirs(
+		const std::string& locDir,
+		const std::string& rmtCertsDir) {
+	CAF_CM_FUNCNAME_VALIDATE("initializeFromDirs");
+	CAF_CM_PRECOND_ISNOTINITIALIZED(_isInitialized);
+	CAF_CM_VALIDATE_STRING(locDir);
+	CAF_CM_VALIDATE_STRING(rmtCertsDir);
+
+	SSL_library_init();
+	SSL_load_error_strings();
+
+	loadCredentials(locDir, rmtCertsDir);
+
+	_isInitialized = true;
+}
+
+bool CCmsMessage::isCurrent() const {
+	CAF_CM_FUNCNAME_VALIDATE("isCurrent");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	return getFileStamps(_credentialPaths) == _credentialStamps;
+}
+
+void CCmsMessage::loadCredentials(
+		const std::string& locDir,
+		const std::string& rmtCertsDir) {
+	CAF_CM_FUNCNAME_VALIDATE("loadCredentials");
+	CAF_CM_VALIDATE_STRING(locDir);
+	CAF_CM_VALIDATE_STRING(rmtCertsDir);
+
 	const std::string locPublicKeyPath = getReqFilePath(locDir, "cert.pem");
 	const std::string locPrivateKeyPath = getReqFilePath(locDir, "privateKey.pem");
 
-	const std::string rmtCertsDir = getReqRmtCertsDir(appId, pmeId);
 	const std::string rmtPublicKeyPath = getReqFilePath(rmtCertsDir, "cmsCert.pem");
 	const std::string rmtCmsCipherNamePath = getReqFilePath(rmtCertsDir, "cmsCipherName.txt");
 	const std::string rmtCipherName = FileSystemUtils::loadTextFile(rmtCmsCipherNamePath);
@@ -66,9 +112,99 @@ void CCmsMessage::initialize(
 	CAF_CM_LOG_DEBUG_VA1("Initializing - signPrivateKeyPath: %s", _signPrivateKeyPath.c_str());
 	CAF_CM_LOG_DEBUG_VA2("Initializing - caCertificatePath: %s, %s", rmtCertsDir.c_str(), "cmsCertCollection");
 
-	_checkCrlf = AppConfigUtils::getOptionalBoolean("security", "check_crlf");
+	// The directory is included so that added or removed CA certificates are noticed
+	_credentialPaths.clear();
+	_credentialPaths.push_back(locPublicKeyPath);
+	_credentialPaths.push_back(locPrivateKeyPath);
+	_credentialPaths.push_back(rmtPublicKeyPath);
+	_credentialPaths.push_back(rmtCmsCipherNamePath);
+	_credentialPaths.push_back(FileSystemUtils::buildPath(rmtCertsDir, "cmsCertCollection"));
+	_credentialPaths.insert(_credentialPaths.end(),
+			_caCertificatePaths.begin(), _caCertificatePaths.end());
+	_credentialStamps = getFileStamps(_credentialPaths);
 
-	_isInitialized = true;
+	std::deque<X509*> caCertX509s;
+	try {
+		_signPublicKey = CCmsMessageUtils::fileToX509(_signPublicKeyPath);
+		_signPrivateKey = CCmsMessageUtils::fileToPrivateKey(_signPrivateKeyPath);
+		_decryptPublicKey = CCmsMessageUtils::fileToX509(_decryptPublicKeyPath);
+		_decryptPrivateKey = CCmsMessageUtils::fileToPrivateKey(_decryptPrivateKeyPath);
+
+		/*
+		 * sk_X509_pop_free will free up the recipient STACK and its contents,
+		 * so the certificate is owned by the stack as soon as it is created.
+		 */
+		X509* encryptPublicKey = CCmsMessageUtils::fileToX509(_encryptPublicKeyPath);
+		try {
+			_encryptPublicKeyStack = CCmsMessageUtils::createX509Stack(encryptPublicKey);
+		} catch (...) {
+			CCmsMessageUtils::free(encryptPublicKey);
+			throw;
+		}
+
+		for (TConstIterator<Cdeqstr> pathIter(_caCertificatePaths); pathIter; pathIter++) {
+			caCertX509s.push_back(CCmsMessageUtils::fileToX509(*pathIter));
+		}
+		_caCertStore = CCmsMessageUtils::createX509Store(caCertX509s);
+
+		/*
+		 * OpenSSL caches some X509 extension fields the first time a certificate
+		 * is used. Fill them in now so that concurrent operations on the shared
+		 * certificates only read them.
+		 */
+		X509_check_purpose(_signPublicKey, -1, 0);
+		X509_check_purpose(_decryptPublicKey, -1, 0);
+		X509_check_purpose(encryptPublicKey, -1, 0);
+		for (std::deque<X509*>::const_iterator caCertIter = caCertX509s.begin();
+				caCertIter != caCertX509s.end(); caCertIter++) {
+			X509_check_purpose(*caCertIter, -1, 0);
+		}
+	} catch (...) {
+		CCmsMessageUtils::free(caCertX509s);
+		freeCredentials();
+		throw;
+	}
+
+	/*
+	 * X509_STORE_add_cert takes its own reference, so the loaded CA certificates
+	 * are released here and live on in the store.
+	 */
+	CCmsMessageUtils::free(caCertX509s);
+}
+
+void CCmsMessage::freeCredentials() {
+	CCmsMessageUtils::free(_signPublicKey);
+	CCmsMessageUtils::free(_signPrivateKey);
+	CCmsMessageUtils::free(_decryptPublicKey);
+	CCmsMessageUtils::free(_decryptPrivateKey);
+	CCmsMessageUtils::free(_encryptPublicKeyStack);
+	CCmsMessageUtils::free(_caCertStore);
+
+	_signPublicKey = NULL;
+	_signPrivateKey = NULL;
+	_decryptPublicKey = NULL;
+	_decryptPrivateKey = NULL;
+	_encryptPublicKeyStack = NULL;
+	_caCertStore = NULL;
+}
+
+CCmsMessage::CFileStamps CCmsMessage::getFileStamps(
+		const Cdeqstr& paths) {
+	// A file replaced by one with an older mtime still has another inode or size
+	CFileStamps rc;
+	for (TConstIterator<Cdeqstr> pathIter(paths); pathIter; pathIter++) {
+		struct stat statBuf;
+		CFileStamp stamp = { false, 0, 0, 0 };
+		if (::stat((*pathIter).c_str(), &statBuf) == 0) {
+			stamp.exists = true;
+			stamp.mtime = statBuf.st_mtime;
+			stamp.size = statBuf.st_size;
+			stamp.ino = statBuf.st_ino;
+		}
+		rc.push_back(stamp);
+	}
+
+	return rc;
 }
 
 void CCmsMessage::signBufferToBuffer(
@@ -412,26 +548,13 @@ void CCmsMessage::sign(
 
 	const uint32 flags = CMS_STREAM | CMS_BINARY;
 
-	BIO* signPublicKeyBio = NULL;
-	BIO* signPrivateKeyBio = NULL;
-	X509* signPublicKey = NULL;
-	EVP_PKEY* signPrivateKey = NULL;
-
 	BIO* outputBio = NULL;
 	BIO* inputBufferBio = NULL;
 	CMS_ContentInfo* contentInfo = NULL;
 	try {
-		signPublicKeyBio = CCmsMessageUtils::inputFileToBio(_signPublicKeyPath);
-		signPrivateKeyBio = CCmsMessageUtils::inputFileToBio(_signPrivateKeyPath);
-
-		signPublicKey = CCmsMessageUtils::bioToX509(signPublicKeyBio);
-		// Casting to void to ignore return value and eliminate compiler warning
-		(void) BIO_reset(signPublicKeyBio);
-		signPrivateKey = CCmsMessageUtils::bioToPrivateKey(signPrivateKeyBio);
-
 		inputBufferBio = CCmsMessageUtils::inputToBio(inputBuffer, inputPath);
 
-		contentInfo = CMS_sign(signPublicKey, signPrivateKey, NULL, inputBufferBio,
+		contentInfo = CMS_sign(_signPublicKey, _signPrivateKey, NULL, inputBufferBio,
 				flags);
 		if (! contentInfo) {
 			CCmsMessageUtils::logSslErrors();
@@ -453,12 +576,8 @@ void CCmsMessage::sign(
 	CAF_CM_CATCH_DEFAULT;
 
 	CCmsMessageUtils::free(contentInfo);
-	CCmsMessageUtils::free(signPublicKey);
-	CCmsMessageUtils::free(signPrivateKey);
 	CCmsMessageUtils::free(inputBufferBio);
 	CCmsMessageUtils::free(outputBio);
-	CCmsMessageUtils::free(signPublicKeyBio);
-	CCmsMessageUtils::free(signPrivateKeyBio);
 
 	CAF_CM_THROWEXCEPTION;
 
@@ -474,25 +593,11 @@ void CCmsMessage::verify(
 
 	checkCrlf(CAF_CM_GET_FUNCNAME, "input", inputBuffer, inputPath);
 
-	std::deque<BIO*> caCertBios;
-	std::deque<X509*> caCertX509s;
-	X509_STORE* caCertStore = NULL;
-
 	BIO* inputBufferBio = NULL;
 	BIO* inputParsedBio = NULL;
 	BIO* outputBio = NULL;
 	CMS_ContentInfo* contentInfo = NULL;
 	try {
-		caCertBios = CCmsMessageUtils::inputFilesToBio(_caCertificatePaths);
-		caCertX509s = CCmsMessageUtils::biosToX509(caCertBios);
-		caCertStore = CCmsMessageUtils::createX509Store(caCertX509s);
-
-		/*
-		 * X509_STORE_free will free up recipient Store and its contents so set
-		 * caCerts to NULL so it isn't freed up twice.
-		 */
-		caCertX509s.clear();
-
 		inputBufferBio = CCmsMessageUtils::inputToBio(inputBuffer, inputPath);
 
 		/* parse message */
@@ -504,7 +609,7 @@ void CCmsMessage::verify(
 
 		outputBio = CCmsMessageUtils::outputToBio(outputBuffer, outputPath);
 
-		if (! CMS_verify(contentInfo, NULL, caCertStore, inputParsedBio, outputBio, 0)) {
+		if (! CMS_verify(contentInfo, NULL, _caCertStore, inputParsedBio, outputBio, 0)) {
 			CCmsMessageUtils::logSslErrors();
 			CAF_CM_EXCEPTION_VA0(E_FAIL, "CMS_verify Failed");
 		}
@@ -515,12 +620,9 @@ void CCmsMessage::verify(
 	CAF_CM_CATCH_DEFAULT;
 
 	CCmsMessageUtils::free(contentInfo);
-	CCmsMessageUtils::free(caCertX509s);
-	CCmsMessageUtils::free(caCertStore);
 	CCmsMessageUtils::free(inputBufferBio);
 	CCmsMessageUtils::free(outputBio);
 	CCmsMessageUtils::free(inputParsedBio);
-	CCmsMessageUtils::free(caCertBios);
 
 	CAF_CM_THROWEXCEPTION;
 
@@ -538,28 +640,14 @@ void CCmsMessage::encrypt(
 
 	const uint32 flags = CMS_STREAM | CMS_BINARY;
 
-	BIO* encryptPublicKeyBio = NULL;
-	X509* encryptPublicKey = NULL;
-	STACK_OF(X509)* encryptPublicKeyStack = NULL;
-
 	BIO* outputBio = NULL;
 	BIO* inputBufferBio = NULL;
 	CMS_ContentInfo* contentInfo = NULL;
 	try {
-		encryptPublicKeyBio = CCmsMessageUtils::inputFileToBio(_encryptPublicKeyPath);
-		encryptPublicKey = CCmsMessageUtils::bioToX509(encryptPublicKeyBio);
-		encryptPublicKeyStack = CCmsMessageUtils::createX509Stack(encryptPublicKey);
-
-		/*
-		 * sk_X509_pop_free will CCmsMessageUtils::free up recipient STACK and its contents so set
-		 * encryptPublicKey to NULL so it isn't freed up twice.
-		 */
-		encryptPublicKey = NULL;
-
 		inputBufferBio = CCmsMessageUtils::inputToBio(inputBuffer, inputPath);
 
 		/* encrypt content */
-		contentInfo = CMS_encrypt(encryptPublicKeyStack, inputBufferBio, _cipher, flags);
+		contentInfo = CMS_encrypt(_encryptPublicKeyStack, inputBufferBio, _cipher, flags);
 		if (! contentInfo) {
 			CCmsMessageUtils::logSslErrors();
 			CAF_CM_EXCEPTION_VA0(E_FAIL, "CMS_encrypt Failed");
@@ -579,11 +667,8 @@ void CCmsMessage::encrypt(
 	CAF_CM_CATCH_DEFAULT;
 
 	CCmsMessageUtils::free(contentInfo);
-	CCmsMessageUtils::free(encryptPublicKey);
-	CCmsMessageUtils::free(encryptPublicKeyStack);
 	CCmsMessageUtils::free(inputBufferBio);
 	CCmsMessageUtils::free(outputBio);
-	CCmsMessageUtils::free(encryptPublicKeyBio);
 
 	CAF_CM_THROWEXCEPTION;
 
@@ -599,21 +684,10 @@ void CCmsMessage::decrypt(
 
 	checkCrlf(CAF_CM_GET_FUNCNAME, "input", inputBuffer, inputPath);
 
-	BIO* decryptPublicKeyBio = NULL;
-	BIO* decryptPrivateKeyBio = NULL;
-	X509* decryptPublicKey = NULL;
-	EVP_PKEY* decryptPrivateKey = NULL;
-
 	BIO* outputBio = NULL;
 	BIO* inputBufferBio = NULL;
 	CMS_ContentInfo* contentInfo = NULL;
 	try {
-		decryptPublicKeyBio = CCmsMessageUtils::inputFileToBio(_decryptPublicKeyPath);
-		decryptPrivateKeyBio = CCmsMessageUtils::inputFileToBio(_decryptPrivateKeyPath);
-
-		decryptPublicKey = CCmsMessageUtils::bioToX509(decryptPublicKeyBio);
-		decryptPrivateKey = CCmsMessageUtils::bioToPrivateKey(decryptPrivateKeyBio);
-
 		inputBufferBio = CCmsMessageUtils::inputToBio(inputBuffer, inputPath);
 
 		contentInfo = SMIME_read_CMS(inputBufferBio, NULL);
@@ -624,7 +698,7 @@ void CCmsMessage::decrypt(
 
 		outputBio = CCmsMessageUtils::outputToBio(outputBuffer, outputPath);
 
-		if (!CMS_decrypt(contentInfo, decryptPrivateKey, decryptPublicKey,
+		if (!CMS_decrypt(contentInfo, _decryptPrivateKey, _decryptPublicKey,
 				NULL, outputBio, 0)) {
 			CCmsMessageUtils::logSslErrors();
 			CAF_CM_EXCEPTION_VA0(E_FAIL, "CMS_decrypt Failed");
@@ -636,12 +710,8 @@ void CCmsMessage::decrypt(
 	CAF_CM_CATCH_DEFAULT;
 
 	CCmsMessageUtils::free(contentInfo);
-	CCmsMessageUtils::free(decryptPublicKey);
-	CCmsMessageUtils::free(decryptPrivateKey);
 	CCmsMessageUtils::free(inputBufferBio);
 	CCmsMessageUtils::free(outputBio);
-	CCmsMessageUtils::free(decryptPublicKeyBio);
-	CCmsMessageUtils::free(decryptPrivateKeyBio);
 
 	CAF_CM_THROWEXCEPTION;
 
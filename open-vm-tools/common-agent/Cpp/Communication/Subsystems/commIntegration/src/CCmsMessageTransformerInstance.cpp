@@ -24,11 +24,15 @@
 
 using namespace Caf;
 
+// Most agents talk to a handful of clients, so this is only a safety net
+static const size_t MAX_CACHED_CMS_MESSAGES = 64;
+
 CCmsMessageTransformerInstance::CCmsMessageTransformerInstance() :
 		_isInitialized(false),
 		_isSigningEnforced(true),
 		_isEncryptionEnforced(true),
 		CAF_CM_INIT("CCmsMessageTransformerInstance") {
+	CAF_CM_INIT_THREADSAFE;
 }
 
 CCmsMessageTransformerInstance::~CCmsMessageTransformerInstance() {
@@ -86,9 +90,7 @@ SmartPtrIIntMessage CCmsMessageTransformerInstance::transformMessage(
 	const SmartPtrCPayloadEnvelopeDoc payloadEnvelope =
 			CCafMessagePayloadParser::getPayloadEnvelope(message->getPayload());
 
-	SmartPtrCCmsMessage cmsMessage;
-	cmsMessage.CreateInstance();
-	cmsMessage->initialize(
+	const SmartPtrCCmsMessage cmsMessage = getCmsMessage(
 			BasePlatform::UuidToString(payloadEnvelope->getClientId()),
 			payloadEnvelope->getPmeId());
 
@@ -109,6 +111,53 @@ SmartPtrIIntMessage CCmsMessageTransformerInstance::transformMessage(
 	return rc;
 }
 
+SmartPtrCCmsMessage CCmsMessageTransformerInstance::getCmsMessage(
+		const std::string& appId,
+		const std::string& pmeId) {
+	CAF_CM_FUNCNAME_VALIDATE("getCmsMessage");
+	CAF_CM_VALIDATE_STRING(appId);
+	CAF_CM_VALIDATE_STRING(pmeId);
+
+	const std::string cacheKey = appId + "/" + pmeId;
+
+	// Loading the keys and certificates is the expensive part, so the
+	// instance is kept until its files change
+	CAF_CM_LOCK_UNLOCK;
+	SmartPtrCCmsMessage rc;
+	CCmsMessageCache::iterator cacheIter = _cmsMessageCache.find(cacheKey);
+	if ((cacheIter != _cmsMessageCache.end()) &&
+			cacheIter->second._cmsMessage->isCurrent()) {
+		rc = cacheIter->second._cmsMessage;
+		_cmsMessageUseList.splice(_cmsMessageUseList.begin(), _cmsMessageUseList,
+				cacheIter->second._useIter);
+	} else {
+		// Drop the entries of clients whose credentials changed or went away
+		for (CCmsMessageCache::iterator iter = _cmsMessageCache.begin();
+				iter != _cmsMessageCache.end();) {
+			if (iter->second._cmsMessage->isCurrent()) {
+				++iter;
+			} else {
+				_cmsMessageUseList.erase(iter->second._useIter);
+				_cmsMessageCache.erase(iter++);
+			}
+		}
+		if (_cmsMessageCache.size() >= MAX_CACHED_CMS_MESSAGES) {
+			_cmsMessageCache.erase(_cmsMessageUseList.back());
+			_cmsMessageUseList.pop_back();
+		}
+
+		rc.CreateInstance();
+		rc->initialize(appId, pmeId);
+
+		CCmsMessageCacheEntry entry;
+		entry._cmsMessage = rc;
+		entry._useIter = _cmsMessageUseList.insert(_cmsMessageUseList.begin(), cacheKey);
+		_cmsMessageCache[cacheKey] = entry;
+	}
+
+	return rc;
+}
+
 SmartPtrIIntMessage CCmsMessageTransformerInstance::createOutgoingPayload(
 		const IIntMessage::SmartPtrCHeaders& headers,
 		const SmartPtrCPayloadEnvelopeDoc& payloadEnvelope,
@@ -58,6 +58,21 @@ public: // ITransformer
 			const SmartPtrIIntMessage& message);
 
 private:
+	// Cache keys, most recently used first
+	typedef std::list<std::string> CCmsMessageUseList;
+
+	struct CCmsMessageCacheEntry {
+		SmartPtrCCmsMessage _cmsMessage;
+		CCmsMessageUseList::iterator _useIter;
+	};
+
+	typedef std::map<std::string, CCmsMessageCacheEntry> CCmsMessageCache;
+
+private:
+	SmartPtrCCmsMessage getCmsMessage(
+			const std::string& appId,
+			const std::string& pmeId);
+
 	SmartPtrIIntMessage createOutgoingPayload(
 			const IIntMessage::SmartPtrCHeaders& headers,
 			const SmartPtrCPayloadEnvelopeDoc& payloadEnvelope,
@@ -76,8 +91,12 @@ private:
 	bool _isSigningEnforced;
 	bool _isEncryptionEnforced;
 
+	CCmsMessageCache _cmsMessageCache;
+	CCmsMessageUseList _cmsMessageUseList;
+
 private:
 	CAF_CM_CREATE;
+	CAF_CM_CREATE_THREADSAFE;
 	CAF_CM_DECLARE_NOCOPY(CCmsMessageTransformerInstance);
 };
 
@@ -13,6 +13,9 @@
 
 using namespace Caf;
 
+// stdio buffer used for file BIOs so CMS streams files in large chunks
+static const size_t FILE_BIO_BUFFER_SIZE = 64 * 1024;
+
 BIO* CCmsMessageUtils::inputBufferToBio(
 		const SmartPtrCDynamicByteArray& inputBuffer) {
 	CAF_CM_STATIC_FUNC("CCmsMessageUtils", "inputBufferToBio");
@@ -53,6 +56,7 @@ BIO* CCmsMessageUtils::inputFileToBio(
 		CAF_CM_EXCEPTION_VA1(E_FAIL,
 				"BIO_new_file Failed - %s", inputFile.c_str());
 	}
+	setFileBioBuffer(rc);
 
 	return rc;
 }
@@ -85,6 +89,7 @@ BIO* CCmsMessageUtils::outputPathToBio(
 		CAF_CM_EXCEPTION_VA1(E_FAIL,
 				"BIO_new_file Failed - %s", outputPath.c_str());
 	}
+	setFileBioBuffer(rc);
 
 	return rc;
 }
@@ -189,6 +194,42 @@ EVP_PKEY* CCmsMessageUtils::bioToPrivateKey(
 	return rc;
 }
 
+X509* CCmsMessageUtils::fileToX509(
+		const std::string& inputFile) {
+	CAF_CM_STATIC_FUNC_VALIDATE("CCmsMessageUtils", "fileToX509");
+	CAF_CM_VALIDATE_STRING(inputFile);
+
+	BIO* bio = inputFileToBio(inputFile);
+	X509* rc = NULL;
+	try {
+		rc = bioToX509(bio);
+	} catch (...) {
+		free(bio);
+		throw;
+	}
+	free(bio);
+
+	return rc;
+}
+
+EVP_PKEY* CCmsMessageUtils::fileToPrivateKey(
+		const std::string& inputFile) {
+	CAF_CM_STATIC_FUNC_VALIDATE("CCmsMessageUtils", "fileToPrivateKey");
+	CAF_CM_VALIDATE_STRING(inputFile);
+
+	BIO* bio = inputFileToBio(inputFile);
+	EVP_PKEY* rc = NULL;
+	try {
+		rc = bioToPrivateKey(bio);
+	} catch (...) {
+		free(bio);
+		throw;
+	}
+	free(bio);
+
+	return rc;
+}
+
 const SSL_METHOD* CCmsMessageUtils::protocolToSslMethod(
 		const std::string& protocol) {
 	CAF_CM_STATIC_FUNC("CCmsMessageUtils", "protocolToSslMethod");
@@ -359,3 +400,14 @@ void CCmsMessageUtils::logCiphers(
 		cipher = SSL_get_cipher_list(ssl, index++);
 	}
 }
+
+void CCmsMessageUtils::setFileBioBuffer(
+		BIO* bio) {
+	CAF_CM_STATIC_FUNC_VALIDATE("CCmsMessageUtils", "setFileBioBuffer");
+	CAF_CM_VALIDATE_PTR(bio);
+
+	FILE* fp = NULL;
+	if ((BIO_get_fp(bio, &fp) > 0) && (fp != NULL)) {
+		::setvbuf(fp, NULL, _IOFBF, FILE_BIO_BUFFER_SIZE);
+	}
+}
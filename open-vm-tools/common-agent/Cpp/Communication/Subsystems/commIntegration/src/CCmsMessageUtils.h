@@ -65,6 +65,12 @@ public: // Convert
 	static EVP_PKEY* bioToPrivateKey(
 			BIO* bio);
 
+	static X509* fileToX509(
+			const std::string& inputFile);
+
+	static EVP_PKEY* fileToPrivateKey(
+			const std::string& inputFile);
+
 	static const SSL_METHOD* protocolToSslMethod(
 			const std::string& protocol);
 
@@ -111,6 +117,10 @@ public: // Log
 			const std::string& prefix,
 			const SSL* ssl);
 
+private:
+	static void setFileBioBuffer(
+			BIO* bio);
+
 private:
 	CAF_CM_DECLARE_NOCREATE(CCmsMessageUtils);
 };
@@ -24,7 +24,8 @@
 #include "Integration/Core/MessageHeaders.h"
 #include "Integration/Core/CMessageHeaderUtils.h"
 
-#include <fstream>
+#include <fcntl.h>
+#include <sys/resource.h>
 
 using namespace Caf;
 
@@ -181,6 +182,10 @@ SmartPtrIIntMessage COutgoingMessageHandler::rehydrateMultiPartMessage(
 		deliveryRecord->getCorrelationId(), deliveryRecord->getNumberOfParts());
 	payload->memAppend(partsHeader->getPtr(), partsHeader->getByteCount());
 
+	CFileDescriptors fileDescriptors;
+	uint64 bytesRead = 0;
+	const gint64 startTimeUs = g_get_monotonic_time();
+
 	uint32 partNumber = deliveryRecord->getStartingPartNumber();
 	if (CAF_CM_IS_LOG_DEBUG_ENABLED) {
 		CAF_CM_LOG_DEBUG_VA3("[# sourceRecords=%d][payloadSize=%d][startingPartNumber=%d]",
@@ -200,32 +205,51 @@ SmartPtrIIntMessage COutgoingMessageHandler::rehydrateMultiPartMessage(
 			sourceRecord->getFilePath().c_str(), sourceRecord->getDataLength(),
 			sourceRecord->getDataOffset());
 
-		std::ifstream file(sourceRecord->getFilePath().c_str(), std::ios::binary);
 		try {
-			if (!file.is_open()) {
-				CAF_CM_EXCEPTION_VA1(ERROR_FILE_NOT_FOUND,
-					"Could not open binary file - %s", sourceRecord->getFilePath().c_str());
-			}
-
-			file.seekg(sourceRecord->getDataOffset(), std::ios::beg);
-			file.read(reinterpret_cast<char*>(payload->getNonConstPtrAtCurrentPos()),
-				sourceRecord->getDataLength());
-			payload->verify();
-			if (! file) {
-				CAF_CM_EXCEPTION_VA3(ERROR_BUFFER_OVERFLOW,
-					"Did not read full contents - file: %s, requested: %d, read: %d",
-					sourceRecord->getFilePath().c_str(), sourceRecord->getDataLength(),
-					file.gcount());
+			// Parts of the same attachment share one descriptor
+			const std::string& filePath = sourceRecord->getFilePath();
+			CFileDescriptors::const_iterator fdIter = fileDescriptors.find(filePath);
+			int32 fd = -1;
+			if (fdIter == fileDescriptors.end()) {
+				fd = ::g_open(filePath.c_str(), O_RDONLY, 0);
+				if (fd < 0) {
+					CAF_CM_EXCEPTION_VA1(ERROR_FILE_NOT_FOUND,
+						"Could not open binary file - %s", filePath.c_str());
+				}
+				fileDescriptors.insert(std::make_pair(filePath, fd));
+#ifdef POSIX_FADV_SEQUENTIAL
+				::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+			} else {
+				fd = fdIter->second;
 			}
 
-			payload->incrementCurrentPos(sourceRecord->getDataLength());
+			readFileRange(fd, filePath, sourceRecord->getDataOffset(),
+				sourceRecord->getDataLength(), payload);
+			bytesRead += sourceRecord->getDataLength();
 		}
 		CAF_CM_CATCH_ALL;
-		file.close();
+		if (CAF_CM_ISEXCEPTION) {
+			closeFileDescriptors(fileDescriptors);
+		}
 		CAF_CM_LOG_CRIT_CAFEXCEPTION;
 		CAF_CM_THROWEXCEPTION;
 	}
 
+	closeFileDescriptors(fileDescriptors);
+
+	if (CAF_CM_IS_LOG_DEBUG_ENABLED) {
+		const gint64 elapsedUs = g_get_monotonic_time() - startTimeUs;
+		struct rusage usage;
+		const long maxRssKb = (::getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+		CAF_CM_LOG_DEBUG_VA4(
+			"Read attachment parts [bytes=%llu][elapsedUs=%lld][MB/s=%.1f][maxRssKb=%ld]",
+			static_cast<unsigned long long>(bytesRead),
+			static_cast<long long>(elapsedUs),
+			elapsedUs > 0 ? static_cast<double>(bytesRead) / elapsedUs : 0.0,
+			maxRssKb);
+	}
+
 	SmartPtrCIntMessage rc;
 	rc.CreateInstance();
 	rc->initialize(payload, deliveryRecord->getMessageHeaders(), addlHeaders);
@@ -258,3 +282,44 @@ SmartPtrIIntMessage COutgoingMessageHandler::augmentHeaders(
 
 	return messageImpl;
 }
+
+void COutgoingMessageHandler::readFileRange(
+	const int32 fd,
+	const std::string& filePath,
+	const uint32 dataOffset,
+	const uint32 dataLength,
+	SmartPtrCDynamicByteArray& payload) {
+	CAF_CM_STATIC_FUNC("COutgoingMessageHandler", "readFileRange");
+	CAF_CM_VALIDATE_SMARTPTR(payload);
+
+	// pread straight into the payload at its current position. It is sized up
+	// front in rehydrateMultiPartMessage, so there is no intermediate buffer and
+	// the same bytes are handed to the publish without another copy.
+	byte* dest = payload->getNonConstPtrAtCurrentPos();
+	uint32 totalRead = 0;
+	while (totalRead < dataLength) {
+		const ssize_t numRead = ::pread(fd, dest + totalRead,
+			dataLength - totalRead, static_cast<off_t>(dataOffset) + totalRead);
+		if (numRead < 0 && errno == EINTR) {
+			continue;
+		}
+		if (numRead <= 0) {
+			CAF_CM_EXCEPTION_VA3(ERROR_BUFFER_OVERFLOW,
+				"Did not read full contents - file: %s, requested: %d, read: %d",
+				filePath.c_str(), dataLength, totalRead);
+		}
+		totalRead += static_cast<uint32>(numRead);
+	}
+	payload->verify();
+
+	payload->incrementCurrentPos(dataLength);
+}
+
+void COutgoingMessageHandler::closeFileDescriptors(
+	CFileDescriptors& fileDescriptors) {
+	for (CFileDescriptors::const_iterator fdIter = fileDescriptors.begin();
+		fdIter != fileDescriptors.end(); fdIter++) {
+		::close(fdIter->second);
+	}
+	fileDescriptors.clear();
+}
@@ -43,6 +43,9 @@ public: // IMessageProcessor
 	SmartPtrIIntMessage processMessage(
 		const SmartPtrIIntMessage& message);
 
+private:
+	typedef std::map<std::string, int32> CFileDescriptors;
+
 private:
 	static SmartPtrIIntMessage rehydrateMultiPartMessage(
 		const SmartPtrCMessageDeliveryRecord& deliveryRecord,
@@ -52,6 +55,16 @@ private:
 		const bool isMultiPart,
 		const SmartPtrIIntMessage& message);
 
+	static void readFileRange(
+		const int32 fd,
+		const std::string& filePath,
+		const uint32 dataOffset,
+		const uint32 dataLength,
+		SmartPtrCDynamicByteArray& payload);
+
+	static void closeFileDescriptors(
+		CFileDescriptors& fileDescriptors);
+
 private:
 	bool _isInitialized;
 
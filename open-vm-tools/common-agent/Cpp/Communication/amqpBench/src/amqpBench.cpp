@@ -0,0 +1,281 @@
+/*
+ *  Copyright (C) 2018 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+/*
+ * Benchmarks message delivery through SimpleMessageListenerContainer, using
+ * a private queue on a broker.
+ *
+ * latency:    messages carrying their send time are published one at a time
+ *             and the listener reports how long each one took to arrive.
+ * throughput: for each message size a batch of messages is published back to
+ *             back and the time until the listener has seen all of them is
+ *             reported as messages/s and MB/s. Small messages exercise the
+ *             per frame overhead of the channel; large ones exercise body
+ *             assembly.
+ *
+ * Usage: CommAmqpBench latency|throughput [host [port [username [password [count]]]]]
+ */
+
+#include "stdafx.h"
+
+#include "Exception/CCafException.h"
+#include "Integration/Core/CIntMessage.h"
+#include "amqpCore/CachingConnectionFactory.h"
+#include "amqpCore/MessageListener.h"
+#include "amqpCore/QueueImpl.h"
+#include "amqpCore/RabbitAdmin.h"
+#include "amqpCore/RabbitTemplate.h"
+#include "amqpCore/SimpleMessageListenerContainer.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace Caf;
+using namespace Caf::AmqpIntegration;
+
+/**
+ * @brief Listener that hands a value per message to the main thread: the
+ * latency of the message in latency mode, its size in throughput mode
+ */
+class BenchListener : public MessageListener {
+	CAF_BEGIN_QI()
+		CAF_QI_ENTRY(MessageListener)
+	CAF_END_QI()
+
+public:
+	BenchListener() :
+		_isLatency(false),
+		_values(g_async_queue_new()) {
+	}
+
+	virtual ~BenchListener() {
+		g_async_queue_unref(_values);
+	}
+
+	void init(const bool isLatency) {
+		_isLatency = isLatency;
+	}
+
+	/**
+	 * @brief Waits for the value of the next message
+	 * @param timeoutMs how long to wait
+	 * @retval the latency in microseconds or the payload size in bytes,
+	 * -1 on timeout
+	 */
+	gint64 nextValue(const uint32 timeoutMs) {
+		gpointer data = g_async_queue_timeout_pop(
+				_values,
+				static_cast<guint64>(timeoutMs) * 1000);
+		return data ? static_cast<gint64>(GPOINTER_TO_SIZE(data)) - 1 : -1;
+	}
+
+public: // MessageListener
+	void onMessage(const SmartPtrIIntMessage& message) {
+		gsize value;
+		if (_isLatency) {
+			const gint64 now = g_get_monotonic_time();
+			const gint64 sent = g_ascii_strtoll(message->getPayloadStr().c_str(), NULL, 10);
+			value = static_cast<gsize>(std::max(now - sent, static_cast<gint64>(0)));
+		} else {
+			const SmartPtrCDynamicByteArray payload = message->getPayload();
+			value = payload.IsNull() ? 0 : payload->getByteCount();
+		}
+		g_async_queue_push(_values, GSIZE_TO_POINTER(value + 1));
+	}
+
+private:
+	bool _isLatency;
+	GAsyncQueue *_values;
+	CAF_CM_DECLARE_NOCOPY(BenchListener);
+};
+CAF_DECLARE_SMART_QI_POINTER(BenchListener);
+
+static void printLatencies(std::vector<gint64>& latencies) {
+	std::sort(latencies.begin(), latencies.end());
+	const size_t count = latencies.size();
+	gint64 total = 0;
+	for (size_t i = 0; i < count; ++i) {
+		total += latencies[i];
+	}
+	::printf("messages: %u\n", static_cast<uint32>(count));
+	::printf("min:      %8.3f ms\n", latencies[0] / 1000.0);
+	::printf("avg:      %8.3f ms\n", total / 1000.0 / count);
+	::printf("median:   %8.3f ms\n", latencies[count / 2] / 1000.0);
+	::printf("p99:      %8.3f ms\n", latencies[(count * 99) / 100] / 1000.0);
+	::printf("max:      %8.3f ms\n", latencies[count - 1] / 1000.0);
+}
+
+static void runLatency(
+		const SmartPtrRabbitTemplate& rabbitTemplate,
+		const std::string& queueName,
+		const SmartPtrBenchListener& listener,
+		const uint32 count,
+		const uint32 timeout) {
+	CAF_CM_STATIC_FUNC("CommAmqpBench", "runLatency");
+
+	std::vector<gint64> latencies;
+	latencies.reserve(count);
+	for (uint32 i = 0; i < count; ++i) {
+		SmartPtrCIntMessage message;
+		message.CreateInstance();
+		message->initializeStr(
+				CStringConv::toString<gint64>(g_get_monotonic_time()),
+				IIntMessage::SmartPtrCHeaders(),
+				IIntMessage::SmartPtrCHeaders());
+		rabbitTemplate->send(queueName, message);
+
+		const gint64 latency = listener->nextValue(timeout);
+		if (latency < 0) {
+			CAF_CM_EXCEPTION_VA1(E_FAIL, "Timed out waiting for message %u", i);
+		}
+		latencies.push_back(latency);
+	}
+
+	printLatencies(latencies);
+}
+
+static void runThroughput(
+		const SmartPtrRabbitTemplate& rabbitTemplate,
+		const std::string& queueName,
+		const SmartPtrBenchListener& listener,
+		const uint32 count,
+		const uint32 timeout) {
+	CAF_CM_STATIC_FUNC("CommAmqpBench", "runThroughput");
+
+	const uint32 sizes[] = { 64, 4 * 1024, 256 * 1024, 1024 * 1024 };
+	const uint64 maxBytesPerSize = 256 * 1024 * 1024;
+
+	::printf("%10s %10s %12s %10s\n", "size", "messages", "msgs/s", "MB/s");
+	for (size_t sizeIdx = 0; sizeIdx < sizeof(sizes) / sizeof(sizes[0]); ++sizeIdx) {
+		const uint32 size = sizes[sizeIdx];
+		const uint32 sizeCount = static_cast<uint32>(
+				std::min(static_cast<uint64>(count), maxBytesPerSize / size));
+
+		SmartPtrCDynamicByteArray payload;
+		payload.CreateInstance();
+		payload->allocateBytes(size);
+		::memset(payload->getNonConstPtr(), 'x', size);
+
+		SmartPtrCIntMessage message;
+		message.CreateInstance();
+		message->initialize(
+				payload,
+				IIntMessage::SmartPtrCHeaders(),
+				IIntMessage::SmartPtrCHeaders());
+
+		const gint64 start = g_get_monotonic_time();
+		for (uint32 i = 0; i < sizeCount; ++i) {
+			rabbitTemplate->send(queueName, message);
+		}
+		for (uint32 i = 0; i < sizeCount; ++i) {
+			const gint64 received = listener->nextValue(timeout);
+			if (received < 0) {
+				CAF_CM_EXCEPTION_VA2(E_FAIL,
+						"Timed out waiting for message %u of size %u", i, size);
+			}
+			if (received != size) {
+				CAF_CM_EXCEPTION_VA2(E_FAIL,
+						"Received %u bytes, expected %u",
+						static_cast<uint32>(received), size);
+			}
+		}
+		const double secs = (g_get_monotonic_time() - start) / 1000000.0;
+
+		::printf("%10u %10u %12.1f %10.1f\n",
+				size,
+				sizeCount,
+				secs > 0 ? sizeCount / secs : 0,
+				secs > 0 ? (static_cast<double>(size) * sizeCount) / secs / 1000000.0 : 0);
+	}
+}
+
+int32 main(int32 argc, char** argv) {
+	const std::string mode = argc > 1 ? argv[1] : "";
+	const bool isLatency = (mode == "latency");
+	if (! isLatency && (mode != "throughput")) {
+		::fprintf(stderr, "Usage: CommAmqpBench latency|throughput "
+				"[host [port [username [password [count]]]]]\n");
+		return 1;
+	}
+
+	HRESULT hr = CafInitialize::init();
+	if (hr != S_OK) {
+		::fprintf(stderr, "CommAmqpBench: CafInitialize::init() failed 0x%08X\n", hr);
+		return 1;
+	}
+
+	CAF_CM_STATIC_FUNC_LOG("CommAmqpBench", "main");
+
+	const std::string host = argc > 2 ? argv[2] : "localhost";
+	const uint32 port = argc > 3 ? static_cast<uint32>(::atoi(argv[3])) : 5672;
+	const std::string username = argc > 4 ? argv[4] : "guest";
+	const std::string password = argc > 5 ? argv[5] : "guest";
+	const uint32 count = argc > 6 ? static_cast<uint32>(::atoi(argv[6])) :
+			(isLatency ? 1000 : 10000);
+	const uint32 timeout = isLatency ? 10000 : 30000;
+
+	int32 iRc = 0;
+	try {
+		if (count == 0) {
+			CAF_CM_EXCEPTION_VA0(E_INVALIDARG, "count must be greater than zero");
+		}
+
+		SmartPtrCachingConnectionFactory factory;
+		factory.CreateInstance();
+		factory->init("amqp", host, port);
+		factory->setUsername(username);
+		factory->setPassword(password);
+
+		const std::string queueName = CStringUtils::createRandomUuid();
+		SmartPtrQueueImpl queue;
+		queue.CreateInstance();
+		queue->init(queueName, false, false, true);
+
+		SmartPtrRabbitAdmin admin;
+		admin.CreateInstance();
+		admin->init(factory);
+		admin->declareQueue(queue);
+
+		SmartPtrBenchListener listener;
+		listener.CreateInstance();
+		listener->init(isLatency);
+
+		SmartPtrSimpleMessageListenerContainer container;
+		container.CreateInstance();
+		container->setQueue(queueName);
+		container->setMessagerListener(listener);
+		container->init(factory);
+		container->start(timeout);
+
+		SmartPtrRabbitTemplate rabbitTemplate;
+		rabbitTemplate.CreateInstance();
+		rabbitTemplate->init(factory);
+
+		if (isLatency) {
+			runLatency(rabbitTemplate, queueName, listener, count, timeout);
+		} else {
+			runThroughput(rabbitTemplate, queueName, listener, count, timeout);
+		}
+
+		container->stop(timeout);
+		rabbitTemplate->term();
+		admin->deleteQueue(queueName);
+		admin->term();
+	}
+	CAF_CM_CATCH_CAF
+	CAF_CM_CATCH_DEFAULT
+	CAF_CM_LOG_CRIT_CAFEXCEPTION;
+
+	if (CAF_CM_ISEXCEPTION) {
+		::fprintf(
+				stderr,
+				"CommAmqpBench: %s\n",
+				CAF_CM_EXCEPTION_GET_FULLMSG.c_str());
+		iRc = 1;
+	}
+	CAF_CM_CLEAREXCEPTION;
+
+	CafInitialize::term();
+	return iRc;
+}
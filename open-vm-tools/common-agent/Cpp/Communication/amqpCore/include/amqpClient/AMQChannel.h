@@ -236,6 +236,8 @@ private:
 private:
 	static const uint8 DEBUGLOG_FLAG_ENTRYEXIT;
 	static const uint8 DEBUGLOG_FLAG_AMQP;
+	static const uint32 FRAME_BATCH_SIZE;
+	static const uint32 MAX_FRAMES_PER_TASK;
 
 	bool _isInitialized;
 	volatile bool _isOpen;
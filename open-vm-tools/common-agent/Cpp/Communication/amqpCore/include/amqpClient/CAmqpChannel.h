@@ -40,6 +40,11 @@ public:
 			SmartPtrCAmqpFrame& frame,
 			int32 timeout);
 
+	AMQPStatus receiveFrames(
+			CAmqpFrameBatch& frames,
+			const uint32 maxFrames,
+			int32 timeout);
+
 	AMQPStatus getId(
 			uint16 *id);
 
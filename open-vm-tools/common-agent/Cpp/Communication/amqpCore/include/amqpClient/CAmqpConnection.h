@@ -97,6 +97,12 @@ public:
 			SmartPtrCAmqpFrame& frame,
 			const int32 timeout);
 
+	AMQPStatus receiveFrames(
+			const amqp_channel_t& channel,
+			CAmqpFrameBatch& frames,
+			const uint32 maxFrames,
+			const int32 timeout);
+
 	AMQPStatus basicAck(
 			const amqp_channel_t& channel,
 			const uint64 deliveryTag,
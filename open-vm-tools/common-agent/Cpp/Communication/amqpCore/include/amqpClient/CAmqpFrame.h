@@ -62,6 +62,8 @@ private:
 };
 CAF_DECLARE_SMART_POINTER(CAmqpFrame);
 
+typedef std::vector<SmartPtrCAmqpFrame> CAmqpFrameBatch;
+
 }}
 
 #endif /* AMQPCLIENT_CAMQPFRAME_H_ */
@@ -75,8 +75,6 @@ private:
 		COMPLETE
 	} CAState;
 
-	typedef std::deque<SmartPtrCDynamicByteArray> CBodyCollection;
-
 private:
 	void consumeBodyFrame(const SmartPtrCAmqpFrame& frame);
 	void consumeHeaderFrame(const SmartPtrCAmqpFrame& frame);
@@ -91,8 +89,8 @@ private:
 	SmartPtrIMethod _method;
 	SmartPtrIContentHeader _contentHeader;
 	uint32 _remainingBodyBytes;
-	CBodyCollection _bodyCollection;
-	uint32 _bodyLength;
+	uint32 _bodySize;
+	SmartPtrCDynamicByteArray _body;
 
 	CAF_CM_CREATE;
 	CAF_CM_DECLARE_NOCOPY(CommandAssembler);
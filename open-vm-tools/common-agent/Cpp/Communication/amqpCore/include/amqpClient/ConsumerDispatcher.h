@@ -190,6 +190,10 @@ private:
 
 	ConsumerItem getConsumerItem(const std::string& consumerTag);
 
+	void dispatch(
+			const SmartPtrDispatcherTask& task,
+			const SmartPtrDispatcherWorkItem& workItem);
+
 private:
 	bool _isInitialized;
 	volatile bool _isShuttingDown;
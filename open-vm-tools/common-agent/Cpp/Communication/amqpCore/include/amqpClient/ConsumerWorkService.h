@@ -36,6 +36,12 @@ public:
 	 */
 	void addWork(const CManagedThreadPool::SmartPtrIThreadTask& task);
 
+	/**
+	 * @brief Tell the pool that a worker has new work to process
+	 * @param task the task previously passed to addWork()
+	 */
+	void notifyWork(const CManagedThreadPool::SmartPtrIThreadTask& task);
+
 	/**
 	 * @brief Respond to a connection-closed notification by terminating the thread pool
 	 */
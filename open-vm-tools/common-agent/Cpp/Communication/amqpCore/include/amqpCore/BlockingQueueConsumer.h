@@ -83,6 +83,14 @@ public:
 	 */
 	SmartPtrIIntMessage nextMessage(int32 timeout);
 
+	/**
+	 * @brief Releases a thread waiting in nextMessage()
+	 * <p>
+	 * The waiting call returns NULL.  If no thread is waiting, the next call
+	 * to nextMessage() returns NULL immediately.
+	 */
+	void wakeup();
+
 	/**
 	 * @brief Acknowledges unacknowledged messages
 	 * <p>
@@ -149,15 +157,20 @@ private:
 
 private:
 	struct Delivery : public ICafObject {
+		Delivery() : isWakeup(false) {}
+
 		AmqpClient::SmartPtrEnvelope envelope;
 		AmqpClient::AmqpContentHeaders::SmartPtrBasicProperties properties;
 		SmartPtrCDynamicByteArray body;
+		bool isWakeup;
 	};
 	CAF_DECLARE_SMART_POINTER(Delivery);
 
 private:
 	void checkShutdown();
 
+	SmartPtrIIntMessage handleQueueItem(gpointer data);
+
 	SmartPtrIIntMessage handle(SmartPtrDelivery delivery);
 
 	static void destroyQueueItem(gpointer data);
@@ -52,6 +52,8 @@ using namespace Caf::AmqpClient;
 
 const uint8 AMQChannel::DEBUGLOG_FLAG_ENTRYEXIT = 0x01;
 const uint8 AMQChannel::DEBUGLOG_FLAG_AMQP = 0x02;
+const uint32 AMQChannel::FRAME_BATCH_SIZE = 64;
+const uint32 AMQChannel::MAX_FRAMES_PER_TASK = 1000;
 
 #define AMQCHANNEL_ENTRY \
 	if (_debugLogFlags & DEBUGLOG_FLAG_ENTRYEXIT) { CAF_CM_LOG_DEBUG_VA0("entry"); }
@@ -760,14 +762,30 @@ bool AMQChannel::taskHandler() {
 	try {
 		uint32 frameCount = 0;
 		AMQPStatus status = AMQP_ERROR_OK;
-		SmartPtrCAmqpFrame frame;
-		while (_channelHandle && (frameCount < 1000)) {
+		CAmqpFrameBatch frames;
+		frames.reserve(FRAME_BATCH_SIZE);
+		while (_channelHandle && (frameCount < MAX_FRAMES_PER_TASK)) {
+			// Drain whatever is queued for this channel in one call so the
+			// channel and connection locks are taken once per batch rather
+			// than once per frame.
 			SmartPtrCAmqpChannel channelHandle = _channelHandle;
+			frames.clear();
 			{
 				CAF_CM_UNLOCK_LOCK;
-				status = AmqpChannel::AMQP_ChannelReceive(channelHandle, frame, 0);
+				status = AmqpChannel::AMQP_ChannelReceiveFrames(
+						channelHandle, frames, FRAME_BATCH_SIZE, 0);
 			}
-			if (frame) {
+			if (frames.empty()) {
+				if ((status == AMQP_ERROR_TIMEOUT) || (status == AMQP_ERROR_IO_INTERRUPTED)) {
+					break;
+				}
+				AMQUtil::checkAmqpStatus(status, "AmqpChannel::AMQP_ChannelReceiveFrames");
+				continue;
+			}
+
+			for (CAmqpFrameBatch::const_iterator frameIter = frames.begin();
+					(frameIter != frames.end()) && _channelHandle; frameIter++) {
+				const SmartPtrCAmqpFrame frame = *frameIter;
 				++frameCount;
 				try {
 					SmartPtrAMQCommand command = _command;
@@ -798,10 +816,6 @@ bool AMQChannel::taskHandler() {
 					}
 					CAF_CM_CLEAREXCEPTION;
 				}
-			} else if ((status == AMQP_ERROR_TIMEOUT) || (status == AMQP_ERROR_IO_INTERRUPTED)) {
-				break;
-			} else {
-				AMQUtil::checkAmqpStatus(status, "AmqpChannel::AMQP_ChannelReceive");
 			}
 		}
 	}
@@ -40,6 +40,17 @@ AMQPStatus AmqpChannel::AMQP_ChannelReceive(
 	return channel->receive(frame, timeout);
 }
 
+AMQPStatus AmqpChannel::AMQP_ChannelReceiveFrames(
+		const SmartPtrCAmqpChannel& channel,
+		CAmqpFrameBatch& frames,
+		const uint32 maxFrames,
+		const int32 timeout) {
+	CAF_CM_STATIC_FUNC_VALIDATE("AmqpChannel", "AMQP_ChannelReceiveFrames");
+	CAF_CM_VALIDATE_SMARTPTR(channel);
+
+	return channel->receiveFrames(frames, maxFrames, timeout);
+}
+
 AMQPStatus AmqpChannel::AMQP_ChannelGetId(
 		const SmartPtrCAmqpChannel& channel,
 		uint16 *id) {
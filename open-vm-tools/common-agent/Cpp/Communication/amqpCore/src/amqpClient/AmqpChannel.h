@@ -33,6 +33,12 @@ public:
 			SmartPtrCAmqpFrame& frame,
 			const int32 timeout);
 
+	static AMQPStatus AMQP_ChannelReceiveFrames(
+			const SmartPtrCAmqpChannel& chan,
+			CAmqpFrameBatch& frames,
+			const uint32 maxFrames,
+			const int32 timeout);
+
 	static AMQPStatus AMQP_ChannelGetId(
 			const SmartPtrCAmqpChannel& chan,
 			uint16 *id);
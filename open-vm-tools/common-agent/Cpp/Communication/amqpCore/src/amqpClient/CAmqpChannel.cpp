@@ -65,6 +65,16 @@ AMQPStatus CAmqpChannel::receive(
 	return _connection->receive(_channel, frame, timeout);
 }
 
+AMQPStatus CAmqpChannel::receiveFrames(
+		CAmqpFrameBatch& frames,
+		const uint32 maxFrames,
+		int32 timeout) {
+	CAF_CM_FUNCNAME_VALIDATE("receiveFrames");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	return _connection->receiveFrames(_channel, frames, maxFrames, timeout);
+}
+
 AMQPStatus CAmqpChannel::getId(
 		uint16 *id) {
 	CAF_CM_FUNCNAME_VALIDATE("getId");
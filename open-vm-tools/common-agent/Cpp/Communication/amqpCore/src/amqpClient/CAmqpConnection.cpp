@@ -229,9 +229,30 @@ AMQPStatus CAmqpConnection::receive(
 		const amqp_channel_t& channel,
 		SmartPtrCAmqpFrame& frame,
 		const int32 timeout) {
-	CAF_CM_FUNCNAME_VALIDATE("receive");
-
 	frame = SmartPtrCAmqpFrame();
+
+	CAmqpFrameBatch frames;
+	const AMQPStatus rc = receiveFrames(channel, frames, 1, timeout);
+	if (! frames.empty()) {
+		frame = frames.front();
+	}
+
+	return rc;
+}
+
+/*
+ * Moves up to maxFrames frames queued for the channel into frames, reading
+ * whatever is available on the socket first if nothing is queued. All of it
+ * happens under a single acquisition of the connection lock.
+ */
+AMQPStatus CAmqpConnection::receiveFrames(
+		const amqp_channel_t& channel,
+		CAmqpFrameBatch& frames,
+		const uint32 maxFrames,
+		const int32 timeout) {
+	CAF_CM_FUNCNAME_VALIDATE("receiveFrames");
+	CAF_CM_VALIDATE_NOTZERO(maxFrames);
+
 	AMQPStatus rc = AMQP_ERROR_OK;
 
 	CAF_CM_LOCK_UNLOCK;
@@ -244,7 +265,7 @@ AMQPStatus CAmqpConnection::receive(
 	int32 status = AMQP_STATUS_OK;
 	CChannelFrames::iterator iter = _channelFrames->find(channel);
 	if ((_channelFrames->end() == iter) || iter->second.empty()) {
-		CAmqpFrames frames;
+		CAmqpFrames socketFrames;
 		SmartPtrCAmqpFrame frame;
 		status = receiveFrame(_connectionState, frame);
 		if ((AMQP_STATUS_TIMEOUT == status) && (timeout > 0)) {
@@ -254,12 +275,12 @@ AMQPStatus CAmqpConnection::receive(
 
 		while (AMQP_STATUS_OK == status) {
 			CAF_CM_VALIDATE_SMARTPTR(frame);
-			frames.push_back(frame);
+			socketFrames.push_back(frame);
 			status = receiveFrame(_connectionState, frame);
 		}
 		_lastStatus = status;
 
-		addFrames(frames, _channelFrames);
+		addFrames(socketFrames, _channelFrames);
 	}
 
 	switch (status) {
@@ -269,8 +290,14 @@ AMQPStatus CAmqpConnection::receive(
 			if ((_channelFrames->end() == iter) || iter->second.empty()) {
 				rc = AMQP_ERROR_TIMEOUT;
 			} else {
-				frame = iter->second.front();
-				iter->second.pop_front();
+				for (uint32 frameCount = 0;
+						(frameCount < maxFrames) && ! iter->second.empty();
+						++frameCount) {
+					const SmartPtrCAmqpFrame queuedFrame = iter->second.front();
+					iter->second.pop_front();
+					queuedFrame->log("Returned");
+					frames.push_back(queuedFrame);
+				}
 			}
 		}
 		break;
@@ -304,10 +331,6 @@ AMQPStatus CAmqpConnection::receive(
 		break;
 	}
 
-	if (! frame.IsNull()) {
-		frame->log("Returned");
-	}
-
 	return rc;
 }
 
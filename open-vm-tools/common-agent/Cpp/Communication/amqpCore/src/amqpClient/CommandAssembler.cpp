@@ -15,11 +15,28 @@
 
 using namespace Caf::AmqpClient;
 
+// Default upper bound on the content body size a header may announce, used
+// unless communication_amqp/max_content_body_size is set. A larger (or
+// corrupt) size fails the command.
+static const uint32 DEFAULT_MAX_CONTENT_BODY_SIZE = 128 * 1024 * 1024;
+
+// Bodies up to this size are allocated up front from the size announced by
+// the header. Larger ones start at this size and grow as frames arrive, so
+// a header alone cannot make the client allocate the maximum.
+static const uint32 PREALLOC_CONTENT_BODY_SIZE = 1024 * 1024;
+
+static uint32 getMaxContentBodySize() {
+	static const uint32 maxContentBodySize = AppConfigUtils::getOptionalUint32(
+			"communication_amqp", "max_content_body_size");
+	return (maxContentBodySize > 0) ?
+			maxContentBodySize : DEFAULT_MAX_CONTENT_BODY_SIZE;
+}
+
 CommandAssembler::CommandAssembler() :
 	_isInitialized(false),
 	_state(EXPECTING_METHOD),
 	_remainingBodyBytes(0),
-	_bodyLength(0),
+	_bodySize(0),
 	CAF_CM_INIT("CommandAssembler") {
 }
 
@@ -90,6 +107,15 @@ void CommandAssembler::consumeBodyFrame(const SmartPtrCAmqpFrame& frame) {
 	CAF_CM_FUNCNAME("consumeBodyFrame");
 	if (frame->getFrameType() == AMQP_FRAME_BODY) {
 		const amqp_bytes_t * const fragment = frame->getBodyFragment();
+		if (fragment->len > _remainingBodyBytes) {
+			CAF_CM_EXCEPTIONEX_VA3(
+					AmqpExceptions::UnexpectedFrameException,
+					0,
+					"Body frame overruns the content size [channel=%d][len=%d][remaining=%d]",
+					frame->getChannel(),
+					static_cast<uint32>(fragment->len),
+					_remainingBodyBytes);
+		}
 		_remainingBodyBytes -= static_cast<uint32>(fragment->len);
 		updateContentBodyState();
 		appendBodyFragment(fragment);
@@ -106,7 +132,24 @@ void CommandAssembler::consumeHeaderFrame(const SmartPtrCAmqpFrame& frame) {
 	CAF_CM_FUNCNAME("consumeHeaderFrame");
 	if (frame->getFrameType() == AMQP_FRAME_HEADER) {
 		_contentHeader = AMQPImpl::headerFromFrame(frame);
-		_remainingBodyBytes = static_cast<uint32>(_contentHeader->getBodySize());
+		const uint64 bodySize = _contentHeader->getBodySize();
+		const uint32 maxBodySize = getMaxContentBodySize();
+		if (bodySize > maxBodySize) {
+			CAF_CM_EXCEPTIONEX_VA3(
+					AmqpExceptions::UnexpectedFrameException,
+					0,
+					"Content body too large [channel=%d][size=%llu][max=%u]",
+					frame->getChannel(),
+					static_cast<unsigned long long>(bodySize),
+					maxBodySize);
+		}
+		_bodySize = static_cast<uint32>(bodySize);
+		_remainingBodyBytes = _bodySize;
+		if (_remainingBodyBytes > 0) {
+			// Copy each fragment straight into one body buffer as it arrives
+			_body.CreateInstance();
+			_body->allocateBytes(std::min(_bodySize, PREALLOC_CONTENT_BODY_SIZE));
+		}
 		updateContentBodyState();
 	} else {
 		CAF_CM_EXCEPTIONEX_VA1(
@@ -137,32 +180,23 @@ void CommandAssembler::updateContentBodyState() {
 
 void CommandAssembler::appendBodyFragment(const amqp_bytes_t * const fragment) {
 	if (fragment && fragment->len) {
-		SmartPtrCDynamicByteArray fragmentData;
-		fragmentData.CreateInstance();
-		fragmentData->allocateBytes(fragment->len);
-		fragmentData->memCpy(fragment->bytes, fragment->len);
-		_bodyCollection.push_back(fragmentData);
-		_bodyLength += static_cast<uint32>(fragment->len);
+		const uint32 bodyBytes = _bodySize - _remainingBodyBytes;
+		if (bodyBytes > _body->getByteCount()) {
+			// Double the buffer, but never past the announced size, so the
+			// completed body is exactly _bodySize bytes
+			const uint32 capacity = _body->getByteCount();
+			_body->reallocateBytes((capacity > _bodySize - capacity) ?
+					_bodySize : std::max(2 * capacity, bodyBytes));
+		}
+		_body->memAppend(fragment->bytes, fragment->len);
 	}
 }
 
 SmartPtrCDynamicByteArray CommandAssembler::coalesceContentBody() {
-	SmartPtrCDynamicByteArray body;
-	body.CreateInstance();
-	if (_bodyLength) {
-		if (_bodyCollection.size() == 1) {
-			body = _bodyCollection.front();
-		} else {
-			body->allocateBytes(_bodyLength);
-			for (TSmartIterator<CBodyCollection> fragment(_bodyCollection);
-					fragment;
-					fragment++) {
-				body->memAppend(fragment->getPtr(), fragment->getByteCount());
-				*fragment = NULL;
-			}
-		}
-		_bodyCollection.clear();
-		_bodyCollection.push_back(body);
+	if (_body.IsNull()) {
+		SmartPtrCDynamicByteArray body;
+		body.CreateInstance();
+		return body;
 	}
-	return body;
+	return _body;
 }
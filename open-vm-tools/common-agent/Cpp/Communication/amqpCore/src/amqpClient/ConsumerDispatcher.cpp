@@ -85,6 +85,7 @@ void ConsumerDispatcher::removeConsumer(
 	ConsumerMap::iterator consumer = _consumers.find(consumerTag);
 	if (consumer != _consumers.end()) {
 		(consumer->second).second->term();
+		_workService->notifyWork((consumer->second).second);
 		_consumers.erase(consumer);
 	}
 }
@@ -112,6 +113,7 @@ void ConsumerDispatcher::handleShutdown(SmartPtrCCafException exception) {
 			consumerItem++) {
 		try {
 			consumerItem->second->term();
+			_workService->notifyWork(consumerItem->second);
 			consumerItem->first->handleShutdown(consumerItem.getKey(), exception);
 		}
 		CAF_CM_CATCH_ALL;
@@ -130,7 +132,7 @@ void ConsumerDispatcher::handleConsumeOk(const std::string& consumerTag) {
 			SmartPtrDispatcherWorkItem workItem;
 			workItem.CreateInstance();
 			workItem->init(DISPATCH_ITEM_METHOD_HANDLE_CONSUME_OK);
-			getConsumerItem(consumerTag).second->addWorkItem(workItem);
+			dispatch(getConsumerItem(consumerTag).second, workItem);
 		}
 	}
 	CAF_CM_CATCH_ALL;
@@ -147,7 +149,7 @@ void ConsumerDispatcher::handleCancelOk(const std::string& consumerTag) {
 			SmartPtrDispatcherWorkItem workItem;
 			workItem.CreateInstance();
 			workItem->init(DISPATCH_ITEM_METHOD_HANDLE_CANCEL_OK);
-			getConsumerItem(consumerTag).second->addWorkItem(workItem);
+			dispatch(getConsumerItem(consumerTag).second, workItem);
 		}
 	}
 	CAF_CM_CATCH_ALL;
@@ -168,7 +170,7 @@ void ConsumerDispatcher::handleRecoverOk() {
 					SmartPtrDispatcherWorkItem workItem;
 					workItem.CreateInstance();
 					workItem->init(DISPATCH_ITEM_METHOD_HANDLE_RECOVER_OK);
-					consumerItem->second->addWorkItem(workItem);
+					dispatch(consumerItem->second, workItem);
 				}
 			}
 		}
@@ -195,7 +197,7 @@ void ConsumerDispatcher::handleDelivery(
 					envelope,
 					properties,
 					body);
-			getConsumerItem(consumerTag).second->addWorkItem(workItem);
+			dispatch(getConsumerItem(consumerTag).second, workItem);
 		}
 	}
 	CAF_CM_CATCH_ALL;
@@ -216,6 +218,13 @@ ConsumerDispatcher::ConsumerItem ConsumerDispatcher::getConsumerItem(const std::
 	return consumerItem->second;
 }
 
+void ConsumerDispatcher::dispatch(
+		const SmartPtrDispatcherTask& task,
+		const SmartPtrDispatcherWorkItem& workItem) {
+	task->addWorkItem(workItem);
+	_workService->notifyWork(task);
+}
+
 #if (1) // DispatcherWorkItem
 ConsumerDispatcher::DispatcherWorkItem::DispatcherWorkItem() :
 	_method(DISPATCH_ITEM_METHOD_TERMINATE) {
@@ -41,6 +41,13 @@ void ConsumerWorkService::addWork(const CManagedThreadPool::SmartPtrIThreadTask&
 	_threadPool->enqueue(task);
 }
 
+void ConsumerWorkService::notifyWork(const CManagedThreadPool::SmartPtrIThreadTask& task) {
+	SmartPtrCManagedThreadPool threadPool = _threadPool;
+	if (!threadPool.IsNull()) {
+		threadPool->wakeup(task);
+	}
+}
+
 void ConsumerWorkService::notifyConnectionClosed() {
 	if (!_threadPool.IsNull()) {
 		_threadPool->term();
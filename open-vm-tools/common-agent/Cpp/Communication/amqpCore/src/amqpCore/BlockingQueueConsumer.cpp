@@ -82,22 +82,11 @@ SmartPtrIIntMessage BlockingQueueConsumer::nextMessage() {
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
 	CAF_CM_ASSERT(_isRunning);
 
-	// simulate a blocking pop from the queue
-	gpointer data = g_async_queue_try_pop(_deliveryQueue);
-	while (!data && !_isCanceled) {
-		CThreadUtils::sleep(100);
-		data = g_async_queue_try_pop(_deliveryQueue);
-	}
-
-	checkShutdown();
-	SmartPtrIIntMessage message;
-	if (data) {
-		Delivery *deliveryPtr = reinterpret_cast<Delivery*>(data);
-		SmartPtrDelivery delivery(deliveryPtr);
-		deliveryPtr->Release();
-		message = handle(delivery);
-	}
-	return message;
+	// stop(), wakeup() and handleShutdown() push a marker to release us
+	gpointer data = _isCanceled ?
+			g_async_queue_try_pop(_deliveryQueue) :
+			g_async_queue_pop(_deliveryQueue);
+	return handleQueueItem(data);
 }
 
 SmartPtrIIntMessage BlockingQueueConsumer::nextMessage(int32 timeout) {
@@ -107,16 +96,19 @@ SmartPtrIIntMessage BlockingQueueConsumer::nextMessage(int32 timeout) {
 
 	guint64 microTimeout = static_cast<guint64>(timeout) * 1000;
 	gpointer data = g_async_queue_timeout_pop(_deliveryQueue, microTimeout);
+	return handleQueueItem(data);
+}
 
-	checkShutdown();
-	SmartPtrIIntMessage message;
-	if (data) {
-		Delivery *deliveryPtr = reinterpret_cast<Delivery*>(data);
-		SmartPtrDelivery delivery(deliveryPtr);
-		deliveryPtr->Release();
-		message = handle(delivery);
-	}
-	return message;
+void BlockingQueueConsumer::wakeup() {
+	CAF_CM_FUNCNAME_VALIDATE("wakeup");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+
+	SmartPtrDelivery delivery;
+	delivery.CreateInstance();
+	delivery->isWakeup = true;
+	g_async_queue_push(
+			_deliveryQueue,
+			delivery.GetAddRefedInterface());
 }
 
 bool BlockingQueueConsumer::commitIfNecessary() {
@@ -281,14 +273,18 @@ void BlockingQueueConsumer::stop(const uint32 timeoutMs) {
 				// Wait for the cancelOk response
 				CAF_CM_LOG_DEBUG_VA0("Waiting for consumer handler to receive cancel.ok");
 				uint64 start = CDateTimeUtils::getTimeMs();
-				while (CDateTimeUtils::calcRemainingTime(start, timeoutMs)) {
-					gpointer data = g_async_queue_try_pop(_deliveryQueue);
+				uint64 remainingTime = 0;
+				while ((remainingTime = CDateTimeUtils::calcRemainingTime(start, timeoutMs)) > 0) {
+					gpointer data = g_async_queue_timeout_pop(
+							_deliveryQueue,
+							remainingTime * 1000);
 					if (data) {
 						Delivery *delivery = reinterpret_cast<Delivery*>(data);
-						if (!delivery->envelope) {
+						const bool isCancelOk = !delivery->envelope && !delivery->isWakeup;
+						delivery->Release();
+						if (isCancelOk) {
 							break;
 						}
-						delivery->Release();
 					}
 				}
 			}
@@ -303,6 +299,9 @@ void BlockingQueueConsumer::stop(const uint32 timeoutMs) {
 	}
 
 	try {
+		// Release a thread blocked in nextMessage()
+		wakeup();
+
 		if (_channel) {
 			_channel->close();
 			_channel = NULL;
@@ -340,6 +339,29 @@ bool BlockingQueueConsumer::isRunning() const {
 	return _isRunning;
 }
 
+SmartPtrIIntMessage BlockingQueueConsumer::handleQueueItem(gpointer data) {
+	SmartPtrDelivery delivery;
+	if (data) {
+		Delivery *deliveryPtr = reinterpret_cast<Delivery*>(data);
+		delivery = deliveryPtr;
+		deliveryPtr->Release();
+	}
+
+	checkShutdown();
+	SmartPtrIIntMessage message;
+	if (delivery && !delivery->isWakeup) {
+		if (delivery->envelope) {
+			message = handle(delivery);
+		} else if (_isCanceled) {
+			// The cancel.ok marker belongs to stop(); put it back
+			g_async_queue_push(
+					_deliveryQueue,
+					delivery.GetAddRefedInterface());
+		}
+	}
+	return message;
+}
+
 SmartPtrIIntMessage BlockingQueueConsumer::handle(SmartPtrDelivery delivery) {
 	CAF_CM_FUNCNAME_VALIDATE("handle");
 	CAF_CM_VALIDATE_INTERFACE(delivery);
@@ -446,6 +468,7 @@ void BlockingQueueConsumer::InternalConsumer::handleShutdown(
 	CAF_CM_LOCK_UNLOCK1(_parent->_parentLock);
 	_parent->_shutdownException = reason;
 	_parent->_deliveryTags.clear();
+	_parent->wakeup();
 	_parent = NULL;
 }
 
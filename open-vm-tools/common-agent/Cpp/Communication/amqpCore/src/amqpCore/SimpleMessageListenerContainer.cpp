@@ -398,6 +398,10 @@ void SimpleMessageListenerContainer::AsyncMessageProcessingConsumer::run() {
 
 void SimpleMessageListenerContainer::AsyncMessageProcessingConsumer::cancel() {
 	_isCanceled = true;
+	if (_consumer) {
+		// Don't leave the thread waiting out the receive timeout
+		_consumer->wakeup();
+	}
 }
 
 void SimpleMessageListenerContainer::AsyncMessageProcessingConsumer::handleError(
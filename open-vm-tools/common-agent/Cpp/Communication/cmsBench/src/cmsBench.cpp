@@ -0,0 +1,161 @@
+/*
+ *  Copyright (C) 2018 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+/*
+ * Measures CCmsMessage throughput on attachment files of various sizes. Each
+ * round runs the outgoing (encrypt then sign) and the incoming (verify then
+ * decrypt) file to file pipelines the way CCmsMessageAttachments does, plus a
+ * plain sign and verify, and reports messages/s and MB/s.
+ *
+ * The local directory must hold cert.pem and privateKey.pem. The remote one
+ * must hold cmsCert.pem, cmsCipherName.txt and a cmsCertCollection directory
+ * with the CA certificates, as under the persistence directory.
+ *
+ * Usage: CommCmsBench localDir remoteCertsDir [count]
+ */
+
+#include "stdafx.h"
+
+#include "Exception/CCafException.h"
+#include "CCmsMessage.h"
+
+#include <algorithm>
+
+using namespace Caf;
+
+typedef void (*FNBENCH)(
+		const SmartPtrCCmsMessage& cmsMessage,
+		const std::string& inputPath,
+		const std::string& workDir);
+
+static void signAndVerify(
+		const SmartPtrCCmsMessage& cmsMessage,
+		const std::string& inputPath,
+		const std::string& workDir) {
+	const std::string signedPath = FileSystemUtils::buildPath(workDir, "signed");
+	const std::string verifiedPath = FileSystemUtils::buildPath(workDir, "verified");
+
+	cmsMessage->signFileToFile(inputPath, signedPath);
+	cmsMessage->verifyFileToFile(signedPath, verifiedPath);
+}
+
+static void encryptSignVerifyDecrypt(
+		const SmartPtrCCmsMessage& cmsMessage,
+		const std::string& inputPath,
+		const std::string& workDir) {
+	const std::string encryptedPath = FileSystemUtils::buildPath(workDir, "encrypted");
+	const std::string signedPath = FileSystemUtils::buildPath(workDir, "signed");
+	const std::string verifiedPath = FileSystemUtils::buildPath(workDir, "verified");
+	const std::string decryptedPath = FileSystemUtils::buildPath(workDir, "decrypted");
+
+	cmsMessage->encryptFileToFile(inputPath, encryptedPath);
+	cmsMessage->signFileToFile(encryptedPath, signedPath);
+	cmsMessage->verifyFileToFile(signedPath, verifiedPath);
+	cmsMessage->decryptFileToFile(verifiedPath, decryptedPath);
+}
+
+static void runBench(
+		const char* name,
+		const FNBENCH fnBench,
+		const SmartPtrCCmsMessage& cmsMessage,
+		const std::string& inputPath,
+		const std::string& workDir,
+		const uint32 size,
+		const uint32 count) {
+	const gint64 start = g_get_monotonic_time();
+	for (uint32 i = 0; i < count; ++i) {
+		fnBench(cmsMessage, inputPath, workDir);
+	}
+	const double secs = (g_get_monotonic_time() - start) / 1e6;
+
+	::printf("%-24s %9u bytes %6u msgs: %10.1f msgs/s %8.1f MB/s\n",
+			name, size, count,
+			secs > 0 ? count / secs : 0.0,
+			secs > 0 ? static_cast<double>(size) * count / secs / 1e6 : 0.0);
+}
+
+int32 main(int32 argc, char** argv) {
+	HRESULT hr = CafInitialize::init();
+	if (hr != S_OK) {
+		::fprintf(stderr, "CommCmsBench: CafInitialize::init() failed 0x%08X\n", hr);
+		return 1;
+	}
+
+	CAF_CM_STATIC_FUNC_LOG("CommCmsBench", "main");
+
+	static const uint32 sizes[] = { 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+	static const uint64 maxBytesPerSize = 256 * 1024 * 1024;
+
+	int32 iRc = 0;
+	std::string workDir;
+	try {
+		if (argc < 3) {
+			CAF_CM_EXCEPTION_VA0(E_INVALIDARG,
+					"Usage: CommCmsBench localDir remoteCertsDir [count]");
+		}
+		const uint32 count = argc > 3 ? static_cast<uint32>(::atoi(argv[3])) : 100;
+		if (count == 0) {
+			CAF_CM_EXCEPTION_VA0(E_INVALIDARG, "count must be greater than zero");
+		}
+
+		SmartPtrCCmsMessage cmsMessage;
+		cmsMessage.CreateInstance();
+		cmsMessage->initializeFromDirs(argv[1], argv[2]);
+
+		workDir = FileSystemUtils::buildPath(FileSystemUtils::getTmpDir(),
+				"CommCmsBench-" + CStringUtils::createRandomUuid());
+		FileSystemUtils::createDirectory(workDir);
+
+		for (uint32 i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+			const uint32 size = sizes[i];
+
+			// Text content keeps the S/MIME output free of CRLF conversions
+			std::string contents;
+			contents.reserve(size);
+			while (contents.size() < size) {
+				contents += "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ\n";
+			}
+			contents.resize(size);
+
+			const std::string inputPath = FileSystemUtils::buildPath(workDir, "input");
+			FileSystemUtils::saveTextFile(inputPath, contents);
+
+			const uint32 sizeCount = static_cast<uint32>(std::max(static_cast<uint64>(1),
+					std::min(static_cast<uint64>(count), maxBytesPerSize / size)));
+
+			runBench("sign+verify", signAndVerify,
+					cmsMessage, inputPath, workDir, size, sizeCount);
+			runBench("encrypt+sign+verify+dec", encryptSignVerifyDecrypt,
+					cmsMessage, inputPath, workDir, size, sizeCount);
+
+			const std::string decryptedPath = FileSystemUtils::buildPath(workDir, "decrypted");
+			if (FileSystemUtils::getFileSize(decryptedPath) != static_cast<int64>(size)) {
+				CAF_CM_EXCEPTION_VA1(E_FAIL, "Round trip changed the content - size: %u", size);
+			}
+		}
+	}
+	CAF_CM_CATCH_CAF
+	CAF_CM_CATCH_DEFAULT
+	CAF_CM_LOG_CRIT_CAFEXCEPTION;
+
+	if (CAF_CM_ISEXCEPTION) {
+		::fprintf(
+				stderr,
+				"CommCmsBench: %s\n",
+				CAF_CM_EXCEPTION_GET_FULLMSG.c_str());
+		iRc = 1;
+	}
+	CAF_CM_CLEAREXCEPTION;
+
+	if (! workDir.empty()) {
+		try {
+			FileSystemUtils::recursiveRemoveDirectory(workDir);
+		} catch (...) {
+			::fprintf(stderr, "CommCmsBench: failed to remove %s\n", workDir.c_str());
+		}
+	}
+
+	CafInitialize::term();
+	return iRc;
+}
@@ -0,0 +1,11 @@
+/*
+ *  Copyright (C) 2018 VMware, Inc.  All rights reserved. -- VMware Confidential
+ */
+
+#ifndef stdafx_h
+#define stdafx_h
+
+#include <CommonDefines.h>
+#include <Integration.h>
+
+#endif /* stdafx_h */
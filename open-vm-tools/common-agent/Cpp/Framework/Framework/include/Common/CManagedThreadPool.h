@@ -17,6 +17,10 @@ namespace Caf {
  * @author mdonahue
  * @brief This class wraps a GThreadPool and makes it a bit more friendly to use. It
  * also allows tasks to partially complete and be requeued.
+ * <p>
+ * New and woken tasks are handed to the thread pool as soon as they are posted.
+ * A task that returns <code>false</code> from run() is run again after the task
+ * update interval or as soon as wakeup() is called for it, whichever comes first.
  * The shutdown behavior is to wait for all active tasks to finish. Inactive
  * (unscheduled) tasks will be aborted.
  */
@@ -44,7 +48,8 @@ public:
 	 * @brief initialize the thread pool
 	 * @param poolName a friendly name for the pool to aid in debugging
 	 * @param threadCount the number of task threads
-	 * @param taskUpdateInterval optional task queue refresh rate in milliseconds
+	 * @param taskUpdateInterval optional delay in milliseconds before an incomplete
+	 * task that has not been woken is run again
 	 */
 	void init(
 			const std::string& poolName,
@@ -69,6 +74,17 @@ public:
 	 */
 	void enqueue(const TaskDeque& tasks);
 
+	/**
+	 * @brief signal that a task has more work to do
+	 * <p>
+	 * An idle task is scheduled immediately. A task that is currently running
+	 * will be run again as soon as it returns.
+	 * @param task the task to wake
+	 * @retval true if the task is under management
+	 * @retval false if the task is unknown or has already completed
+	 */
+	bool wakeup(const SmartPtrIThreadTask& task);
+
 	/** @brief A simple structure to report some statistics
 	 *
 	 */
@@ -92,11 +108,49 @@ public:
 	/** @return the current statistics */
 	Stats getStats() const;
 
+	/** @brief Execution statistics of a single task
+	 *
+	 */
+	struct TaskStats {
+		/** The number of times the task has been run */
+		uint64 runCount;
+
+		/** The total time in microseconds the task waited to start once it was ready */
+		uint64 totalLatencyUs;
+
+		/** The longest time in microseconds the task waited to start once it was ready */
+		uint64 maxLatencyUs;
+
+		/** The total time in microseconds spent in the task's run() */
+		uint64 totalRunTimeUs;
+
+		/** The longest time in microseconds spent in a single call to run() */
+		uint64 maxRunTimeUs;
+	};
+
+	/**
+	 * @param task the task
+	 * @return the statistics of a task under management
+	 */
+	TaskStats getTaskStats(const SmartPtrIThreadTask& task) const;
+
+private:
+	class TaskWrapper;
+	CAF_DECLARE_SMART_POINTER(TaskWrapper);
+	typedef std::map<IThreadTask*, TaskWrapper*> TaskMap;
+	typedef std::set<std::pair<gint64, TaskWrapper*> > IdleTaskSet;
+
 private:
 	static gpointer poolWorkerFunc(gpointer context);
-	static void taskWorkerFunc(gpointer threadContext, gpointer NOT_USED);
+	static void taskWorkerFunc(gpointer threadContext, gpointer poolContext);
+	static void releaseTaskEvent(gpointer data);
 
 private:
+	void addTask(const SmartPtrIThreadTask& task);
+	void postTaskEvent(TaskWrapper* taskWrapper);
+	void handleTaskEvent(TaskWrapper* taskWrapper);
+	void scheduleTask(TaskWrapper* taskWrapper);
+	void addIdleTask(TaskWrapper* taskWrapper);
 	void runPool();
 
 private:
@@ -108,8 +162,9 @@ private:
 	volatile bool _isShuttingDown;
 	std::string _poolName;
 	GThreadPool *_threadPool;
-	typedef std::set<IThreadTask*> TaskSet;
-	TaskSet _tasks;
+	TaskMap _tasks;
+	IdleTaskSet _idleTasks;
+	GAsyncQueue *_taskEvents;
 	GThread* _workerThread;
 	uint32 _taskUpdateInterval;
 
@@ -11,7 +11,7 @@
 
 namespace Caf {
 
-class TaskWrapper : public CManagedThreadPool::IThreadTask {
+class CManagedThreadPool::TaskWrapper : public CManagedThreadPool::IThreadTask {
 public:
 	typedef enum {
 		StateInactive,
@@ -26,23 +26,60 @@ public:
 
 	void init(const CManagedThreadPool::SmartPtrIThreadTask& task);
 
+	CManagedThreadPool::IThreadTask* getTask() const;
+
 	void setState(EnumState state);
 
 	EnumState getState() const;
 
+	/*
+	 * Records that the task finished a run.  If it is incomplete and was
+	 * woken while running, it is ready to run again now.
+	 */
+	void setFinished(bool isComplete);
+
+	/*
+	 * Records the time from which the task's start latency is measured
+	 */
+	void setReadyTime(gint64 readyTime);
+
+	/*
+	 * Flags the task to be run again.
+	 * Returns 'false' if it was already flagged.
+	 */
+	bool requestWakeup();
+
+	/*
+	 * Returns and clears the wakeup flag
+	 */
+	bool takeWakeup();
+
+	/*
+	 * The time at which an idle task is run again; 0 if it isn't waiting
+	 * in the pool's idle task set.  Only used by the pool thread.
+	 */
+	void setIdleDeadline(gint64 idleDeadline);
+
+	gint64 getIdleDeadline() const;
+
+	CManagedThreadPool::TaskStats getTaskStats() const;
+
 public: // IThreadTask
 	bool run();
 
 private:
 	CManagedThreadPool::SmartPtrIThreadTask _task;
 	EnumState _state;
+	bool _isWakeupPending;
+	gint64 _readyTime;
+	gint64 _idleDeadline;
+	CManagedThreadPool::TaskStats _stats;
 
 private:
 	CAF_CM_CREATE_THREADSAFE;
 	CAF_CM_DECLARE_NOCOPY(TaskWrapper);
 
 };
-CAF_DECLARE_SMART_POINTER(TaskWrapper);
 
 }
 
@@ -54,6 +91,7 @@ CManagedThreadPool::CManagedThreadPool() :
 	_isInitialized(false),
 	_isShuttingDown(false),
 	_threadPool(NULL),
+	_taskEvents(NULL),
 	_workerThread(NULL),
 	_taskUpdateInterval(DEFAULT_TASK_UPDATE_INTERVAL),
 	CAF_CM_INIT_LOG("CManagedThreadPool") {
@@ -75,6 +113,9 @@ CManagedThreadPool::~CManagedThreadPool() {
 
 		if (_workerThread) {
 			CAF_CM_LOG_DEBUG_VA1("[poolName=%s] Waiting for worker thread to stop", poolName);
+			SmartPtrTaskWrapper shutdownMarker;
+			shutdownMarker.CreateInstance();
+			postTaskEvent(shutdownMarker.GetNonAddRefedInterface());
 			g_thread_join(_workerThread);
 		}
 
@@ -90,10 +131,14 @@ CManagedThreadPool::~CManagedThreadPool() {
 				"[poolName=%s] Pool has shut down.  Releasing %d tasks",
 				poolName,
 				_tasks.size());
-		for (TConstIterator<TaskSet> task(_tasks); task; task++) {
+		for (TConstMapIterator<TaskMap> task(_tasks); task; task++) {
 			(*task)->Release();
 		}
 	}
+
+	if (_taskEvents) {
+		g_async_queue_unref(_taskEvents);
+	}
 }
 
 void CManagedThreadPool::init(
@@ -112,10 +157,12 @@ void CManagedThreadPool::init(
 		_taskUpdateInterval = taskUpdateInterval;
 	}
 
+	_taskEvents = g_async_queue_new_full(releaseTaskEvent);
+
 	GError *error = NULL;
 	_threadPool = g_thread_pool_new(
 			taskWorkerFunc,
-			NULL,
+			this,
 			threadCount,
 			TRUE,
 			&error);
@@ -144,6 +191,9 @@ void CManagedThreadPool::term() {
 	GThread* workerThread = _workerThread;
 	{
 		CAF_CM_UNLOCK_LOCK;
+		SmartPtrTaskWrapper shutdownMarker;
+		shutdownMarker.CreateInstance();
+		postTaskEvent(shutdownMarker.GetNonAddRefedInterface());
 		g_thread_join(workerThread);
 	}
 	_workerThread = NULL;
@@ -163,57 +213,58 @@ void CManagedThreadPool::term() {
 			"[poolName=%s] Pool has shut down.  Releasing %d tasks",
 			_poolName.c_str(),
 			_tasks.size());
-	const TaskSet tasks = _tasks;
+	const TaskMap tasks = _tasks;
+	_tasks.clear();
+	_idleTasks.clear();
 	{
 		CAF_CM_UNLOCK_LOCK;
-		for (TConstIterator<TaskSet> task(tasks); task; task++) {
+		for (TConstMapIterator<TaskMap> task(tasks); task; task++) {
 			(*task)->Release();
 		}
+
+		// Drop the events posted by tasks that finished during shutdown
+		gpointer data = g_async_queue_try_pop(_taskEvents);
+		while (data) {
+			releaseTaskEvent(data);
+			data = g_async_queue_try_pop(_taskEvents);
+		}
 	}
-	_tasks.clear();
 }
 
 void CManagedThreadPool::enqueue(const SmartPtrIThreadTask& task) {
-	CAF_CM_FUNCNAME("enqueue");
+	CAF_CM_FUNCNAME_VALIDATE("enqueue");
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
 	CAF_CM_VALIDATE_INTERFACE(task);
 	CAF_CM_LOCK_UNLOCK;
-	SmartPtrTaskWrapper taskWrapper;
-	taskWrapper.CreateInstance();
-	taskWrapper->init(task);
-	if (!_tasks.insert(taskWrapper.GetAddRefedInterface()).second) {
-		// This should not be possible!
-		taskWrapper->Release();
-		CAF_CM_EXCEPTIONEX_VA1(
-				DuplicateElementException,
-				0,
-				"[poolName=%s] An attempt was made to add a task object with an "
-				"address equal to that of an existing object. "
-				"This should not be possible. Please report this bug.",
-				_poolName.c_str());
-	}
+	addTask(task);
 }
 
 void CManagedThreadPool::enqueue(const TaskDeque& tasks) {
-	CAF_CM_FUNCNAME("enqueue");
+	CAF_CM_FUNCNAME_VALIDATE("enqueue");
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
 	CAF_CM_LOCK_UNLOCK;
 	for (TSmartConstIterator<TaskDeque> task(tasks); task; task++) {
-		SmartPtrTaskWrapper taskWrapper;
-		taskWrapper.CreateInstance();
-		taskWrapper->init(*task);
-		if (!_tasks.insert(taskWrapper.GetAddRefedInterface()).second) {
-			// This should not be possible!
-			taskWrapper->Release();
-			CAF_CM_EXCEPTIONEX_VA1(
-					DuplicateElementException,
-					0,
-					"[poolName=%s] An attempt was made to add a task object with an "
-					"address equal to that of an existing object. "
-					"This should not be possible. Please report this bug.",
-					_poolName.c_str());
-		}
+		addTask(*task);
+	}
+}
+
+bool CManagedThreadPool::wakeup(const SmartPtrIThreadTask& task) {
+	CAF_CM_FUNCNAME_VALIDATE("wakeup");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+	CAF_CM_VALIDATE_INTERFACE(task);
+	CAF_CM_LOCK_UNLOCK;
+
+	TaskMap::const_iterator taskWrapper = _tasks.find(task.GetNonAddRefedInterface());
+	if (_isShuttingDown || (taskWrapper == _tasks.end())) {
+		return false;
+	}
+
+	// An already pending wakeup will be picked up by the event
+	// that is on its way to the pool thread.
+	if (taskWrapper->second->requestWakeup()) {
+		postTaskEvent(taskWrapper->second);
 	}
+	return true;
 }
 
 CManagedThreadPool::Stats CManagedThreadPool::getStats() const {
@@ -222,9 +273,8 @@ CManagedThreadPool::Stats CManagedThreadPool::getStats() const {
 	CAF_CM_LOCK_UNLOCK;
 	Stats stats = { 0, 0, 0, 0, 0 };
 	stats.taskCount = static_cast<uint32>(_tasks.size());
-	for (TConstIterator<TaskSet> task(_tasks); task; task++) {
-		TaskWrapper *taskWrapper = reinterpret_cast<TaskWrapper*>(*task);
-		switch (taskWrapper->getState()) {
+	for (TConstMapIterator<TaskMap> task(_tasks); task; task++) {
+		switch ((*task)->getState()) {
 		case TaskWrapper::StateActive:
 			++stats.activeTaskCount;
 			break;
@@ -245,6 +295,121 @@ CManagedThreadPool::Stats CManagedThreadPool::getStats() const {
 	return stats;
 }
 
+CManagedThreadPool::TaskStats CManagedThreadPool::getTaskStats(
+		const SmartPtrIThreadTask& task) const {
+	CAF_CM_FUNCNAME("getTaskStats");
+	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
+	CAF_CM_VALIDATE_INTERFACE(task);
+	CAF_CM_LOCK_UNLOCK;
+
+	TaskMap::const_iterator taskWrapper = _tasks.find(task.GetNonAddRefedInterface());
+	if (taskWrapper == _tasks.end()) {
+		CAF_CM_EXCEPTIONEX_VA1(
+				NoSuchElementException,
+				0,
+				"[poolName=%s] The task is not managed by this pool",
+				_poolName.c_str());
+	}
+	return taskWrapper->second->getTaskStats();
+}
+
+void CManagedThreadPool::addTask(const SmartPtrIThreadTask& task) {
+	CAF_CM_FUNCNAME("addTask");
+	CAF_CM_VALIDATE_INTERFACE(task);
+
+	SmartPtrTaskWrapper taskWrapper;
+	taskWrapper.CreateInstance();
+	taskWrapper->init(task);
+	if (!_tasks.insert(TaskMap::value_type(
+			task.GetNonAddRefedInterface(),
+			taskWrapper.GetNonAddRefedInterface())).second) {
+		CAF_CM_EXCEPTIONEX_VA1(
+				DuplicateElementException,
+				0,
+				"[poolName=%s] An attempt was made to add a task object "
+				"that is already managed by this pool.",
+				_poolName.c_str());
+	}
+
+	// _tasks holds a reference until the task completes
+	taskWrapper->AddRef();
+	taskWrapper->setReadyTime(g_get_monotonic_time());
+	postTaskEvent(taskWrapper.GetNonAddRefedInterface());
+}
+
+void CManagedThreadPool::postTaskEvent(TaskWrapper* taskWrapper) {
+	taskWrapper->AddRef();
+	g_async_queue_push(_taskEvents, taskWrapper);
+}
+
+void CManagedThreadPool::releaseTaskEvent(gpointer data) {
+	reinterpret_cast<TaskWrapper*>(data)->Release();
+}
+
+void CManagedThreadPool::handleTaskEvent(TaskWrapper* taskWrapper) {
+	switch (taskWrapper->getState()) {
+	case TaskWrapper::StateInactive:
+		// Newly added
+		scheduleTask(taskWrapper);
+		break;
+
+	case TaskWrapper::StateActive:
+		// Woken while running.  It will post again when it returns.
+		break;
+
+	case TaskWrapper::StateFinishedComplete: {
+			TaskMap::iterator task = _tasks.find(taskWrapper->getTask());
+			if ((task != _tasks.end()) && (task->second == taskWrapper)) {
+				_tasks.erase(task);
+				taskWrapper->Release();
+			}
+		}
+		break;
+
+	case TaskWrapper::StateFinishedIncomplete:
+		if (taskWrapper->takeWakeup()) {
+			_idleTasks.erase(std::make_pair(taskWrapper->getIdleDeadline(), taskWrapper));
+			scheduleTask(taskWrapper);
+		} else if (!taskWrapper->getIdleDeadline()) {
+			addIdleTask(taskWrapper);
+		}
+		break;
+	}
+}
+
+void CManagedThreadPool::addIdleTask(TaskWrapper* taskWrapper) {
+	const gint64 idleDeadline = g_get_monotonic_time() +
+			static_cast<gint64>(_taskUpdateInterval) * 1000;
+	taskWrapper->setIdleDeadline(idleDeadline);
+	_idleTasks.insert(std::make_pair(idleDeadline, taskWrapper));
+}
+
+void CManagedThreadPool::scheduleTask(TaskWrapper* taskWrapper) {
+	CAF_CM_FUNCNAME_VALIDATE("scheduleTask");
+
+	taskWrapper->setIdleDeadline(0);
+	taskWrapper->setState(TaskWrapper::StateActive);
+	GError *error = NULL;
+	g_thread_pool_push(
+			_threadPool,
+			taskWrapper,
+			&error);
+	if (error) {
+		CAF_CM_LOG_ERROR_VA3(
+				"[poolName=%s] Unable to add task to tread pool. "
+				"[%d][%s]",
+				_poolName.c_str(),
+				error->code,
+				error->message);
+		g_error_free(error);
+		error = NULL;
+
+		// Try again after the update interval
+		taskWrapper->setState(TaskWrapper::StateFinishedIncomplete);
+		addIdleTask(taskWrapper);
+	}
+}
+
 gpointer CManagedThreadPool::poolWorkerFunc(gpointer context) {
 	CAF_CM_STATIC_FUNC_LOG("CManagedThreadPool", "poolWorkerFunc");
 	try {
@@ -264,87 +429,65 @@ void CManagedThreadPool::runPool() {
 
 	CAF_CM_LOG_DEBUG_VA1("[poolName=%s] Starting runPool() thread", _poolName.c_str());
 	while (!_isShuttingDown) {
-		TaskSet tasksToRun;
-		TaskSet tasksRemoved;
-
 		try {
-			// Move inactive tasks to the thread pool
-			for (TConstIterator<TaskSet> task(_tasks);
-					!_isShuttingDown && task;
-					task++) {
-				TaskWrapper* taskWrapper = reinterpret_cast<TaskWrapper*>(*task);
-				if (TaskWrapper::StateInactive == taskWrapper->getState()) {
-					taskWrapper->setState(TaskWrapper::StateActive);
-					GError *error = NULL;
-					g_thread_pool_push(
-							_threadPool,
-							taskWrapper,
-							&error);
-					if (error) {
-						taskWrapper->setState(TaskWrapper::StateInactive);
-						CAF_CM_LOG_ERROR_VA3(
-								"[poolName=%s] Unable to add task to tread pool. "
-								"[%d][%s]",
-								_poolName.c_str(),
-								error->code,
-								error->message);
-						g_error_free(error);
-						error = NULL;
-					}
-				}
+			// Run the idle tasks whose update interval has expired
+			const gint64 now = g_get_monotonic_time();
+			while (!_isShuttingDown &&
+					!_idleTasks.empty() &&
+					(_idleTasks.begin()->first <= now)) {
+				TaskWrapper* taskWrapper = _idleTasks.begin()->second;
+				taskWrapper->setReadyTime(_idleTasks.begin()->first);
+				_idleTasks.erase(_idleTasks.begin());
+				scheduleTask(taskWrapper);
 			}
 		}
 		CAF_CM_CATCH_ALL;
 		CAF_CM_LOG_CRIT_CAFEXCEPTION;
 		CAF_CM_CLEAREXCEPTION;
 
-		try {
-			// Handle finished tasks.  The tasks may switch from Active to
-			// FinishedComplete or FinishedIncomplete while we are reading the
-			// state.  That's okay - we'll just catch it on the next go-round.
-			//
-			// The alternative is to protect the state variable in the task wrapper
-			// with a critical section.  Seems kind of expensive for something that
-			// isn't really a problem or time-critical.
-			//
-			// Also using naked iterators here since I'm updating the task set.
-			TaskSet::iterator task = _tasks.begin();
-			while (!_isShuttingDown && (task != _tasks.end())) {
-				TaskWrapper* taskWrapper = reinterpret_cast<TaskWrapper*>(*task);
-				if (TaskWrapper::StateFinishedComplete == taskWrapper->getState()) {
-					TaskSet::iterator toErase = task;
-					++task;
-					_tasks.erase(toErase);
-					taskWrapper->Release();
-				} else if (TaskWrapper::StateFinishedIncomplete == taskWrapper->getState()) {
-					taskWrapper->setState(TaskWrapper::StateInactive);
-					++task;
-				} else {
-					++task;
-				}
+		// Sleep until a task is added, finishes or is woken, or until the
+		// next idle task is due.
+		const gint64 idleDeadline = _idleTasks.empty() ? 0 : _idleTasks.begin()->first;
+		gpointer data = NULL;
+		{
+			CAF_CM_UNLOCK_LOCK;
+			if (idleDeadline) {
+				const gint64 timeout = idleDeadline - g_get_monotonic_time();
+				data = g_async_queue_timeout_pop(
+						_taskEvents,
+						timeout > 0 ? static_cast<guint64>(timeout) : 0);
+			} else {
+				data = g_async_queue_pop(_taskEvents);
 			}
 		}
-		CAF_CM_CATCH_ALL;
-		CAF_CM_LOG_CRIT_CAFEXCEPTION;
-		CAF_CM_CLEAREXCEPTION;
 
-		const uint32 taskUpdateInterval = _taskUpdateInterval;
-		{
-			CAF_CM_UNLOCK_LOCK;
-			CThreadUtils::sleep(taskUpdateInterval);
+		while (data) {
+			TaskWrapper* taskWrapper = reinterpret_cast<TaskWrapper*>(data);
+			if (!_isShuttingDown) {
+				try {
+					handleTaskEvent(taskWrapper);
+				}
+				CAF_CM_CATCH_ALL;
+				CAF_CM_LOG_CRIT_CAFEXCEPTION;
+				CAF_CM_CLEAREXCEPTION;
+			}
+			taskWrapper->Release();
+			data = _isShuttingDown ? NULL : g_async_queue_try_pop(_taskEvents);
 		}
 	}
 	CAF_CM_LOG_DEBUG_VA1("[poolName=%s] Leaving runPool() thread", _poolName.c_str());
 }
 
-void CManagedThreadPool::taskWorkerFunc(gpointer threadContext, gpointer) {
+void CManagedThreadPool::taskWorkerFunc(gpointer threadContext, gpointer poolContext) {
 	CAF_CM_STATIC_FUNC_LOG("TaskWorkerFunc", "taskWorkerFunc");
 	// Don't want to segfault so I'll test threadContext even though
 	// it *cannot* be NULL.  If it is we are in really bad shape!
 	try {
 		CAF_CM_VALIDATE_PTR(threadContext);
+		CAF_CM_VALIDATE_PTR(poolContext);
 
 		TaskWrapper *task = reinterpret_cast<TaskWrapper*>(threadContext);
+		CManagedThreadPool *pool = reinterpret_cast<CManagedThreadPool*>(poolContext);
 		bool complete = false;
 		try {
 			complete = task->run();
@@ -353,40 +496,108 @@ void CManagedThreadPool::taskWorkerFunc(gpointer threadContext, gpointer) {
 		if (CAF_CM_ISEXCEPTION) {
 			CAF_CM_LOG_CRIT_CAFEXCEPTION;
 			CAF_CM_CLEAREXCEPTION;
-			task->setState(TaskWrapper::StateFinishedComplete);
-		} else {
-			task->setState(complete ?
-					TaskWrapper::StateFinishedComplete :
-					TaskWrapper::StateFinishedIncomplete);
+			complete = true;
 		}
+		task->setFinished(complete);
+		pool->postTaskEvent(task);
 	}
 	CAF_CM_CATCH_ALL;
 	CAF_CM_LOG_CRIT_CAFEXCEPTION;
 	CAF_CM_CLEAREXCEPTION;
 }
 
-TaskWrapper::TaskWrapper() :
-	_state(StateInactive) {
+CManagedThreadPool::TaskWrapper::TaskWrapper() :
+	_state(StateInactive),
+	_isWakeupPending(false),
+	_readyTime(0),
+	_idleDeadline(0) {
 	CAF_CM_INIT_THREADSAFE;
+	const CManagedThreadPool::TaskStats stats = { 0, 0, 0, 0, 0 };
+	_stats = stats;
 }
 
-TaskWrapper::~TaskWrapper() {
+CManagedThreadPool::TaskWrapper::~TaskWrapper() {
 }
 
-void TaskWrapper::init(const CManagedThreadPool::SmartPtrIThreadTask& task) {
+void CManagedThreadPool::TaskWrapper::init(const CManagedThreadPool::SmartPtrIThreadTask& task) {
 	_task = task;
 }
 
-void TaskWrapper::setState(EnumState state) {
+CManagedThreadPool::IThreadTask* CManagedThreadPool::TaskWrapper::getTask() const {
+	return _task.GetNonAddRefedInterface();
+}
+
+void CManagedThreadPool::TaskWrapper::setState(EnumState state) {
 	CAF_CM_LOCK_UNLOCK;
 	_state = state;
 }
 
-TaskWrapper::EnumState TaskWrapper::getState() const {
+CManagedThreadPool::TaskWrapper::EnumState CManagedThreadPool::TaskWrapper::getState() const {
 	CAF_CM_LOCK_UNLOCK;
 	return _state;
 }
 
-bool TaskWrapper::run() {
-	return _task->run();
+void CManagedThreadPool::TaskWrapper::setFinished(bool isComplete) {
+	CAF_CM_LOCK_UNLOCK;
+	_state = isComplete ? StateFinishedComplete : StateFinishedIncomplete;
+	if (!isComplete && _isWakeupPending) {
+		_readyTime = g_get_monotonic_time();
+	}
+}
+
+void CManagedThreadPool::TaskWrapper::setReadyTime(gint64 readyTime) {
+	CAF_CM_LOCK_UNLOCK;
+	_readyTime = readyTime;
+}
+
+bool CManagedThreadPool::TaskWrapper::requestWakeup() {
+	CAF_CM_LOCK_UNLOCK;
+	if (_isWakeupPending) {
+		return false;
+	}
+	_isWakeupPending = true;
+	_readyTime = g_get_monotonic_time();
+	return true;
+}
+
+bool CManagedThreadPool::TaskWrapper::takeWakeup() {
+	CAF_CM_LOCK_UNLOCK;
+	const bool isWakeupPending = _isWakeupPending;
+	_isWakeupPending = false;
+	return isWakeupPending;
+}
+
+void CManagedThreadPool::TaskWrapper::setIdleDeadline(gint64 idleDeadline) {
+	_idleDeadline = idleDeadline;
+}
+
+gint64 CManagedThreadPool::TaskWrapper::getIdleDeadline() const {
+	return _idleDeadline;
+}
+
+CManagedThreadPool::TaskStats CManagedThreadPool::TaskWrapper::getTaskStats() const {
+	CAF_CM_LOCK_UNLOCK;
+	return _stats;
+}
+
+bool CManagedThreadPool::TaskWrapper::run() {
+	const gint64 startTime = g_get_monotonic_time();
+	{
+		CAF_CM_LOCK_UNLOCK;
+		const uint64 latency = (startTime > _readyTime) ?
+				static_cast<uint64>(startTime - _readyTime) : 0;
+		++_stats.runCount;
+		_stats.totalLatencyUs += latency;
+		_stats.maxLatencyUs = std::max(_stats.maxLatencyUs, latency);
+	}
+
+	const bool isComplete = _task->run();
+
+	const uint64 runTime = static_cast<uint64>(g_get_monotonic_time() - startTime);
+	{
+		CAF_CM_LOCK_UNLOCK;
+		_stats.totalRunTimeUs += runTime;
+		_stats.maxRunTimeUs = std::max(_stats.maxRunTimeUs, runTime);
+	}
+	return isComplete;
 }
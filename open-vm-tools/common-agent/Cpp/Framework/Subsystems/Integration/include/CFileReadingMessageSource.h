@@ -21,6 +21,8 @@ private:
 	typedef std::map<std::string, bool> CFileCollection;
 	CAF_DECLARE_SMART_POINTER(CFileCollection);
 
+	typedef std::deque<std::string> CPendingFiles;
+
 public:
 	CFileReadingMessageSource();
 	virtual ~CFileReadingMessageSource();
@@ -38,15 +40,28 @@ protected: // CAbstractPollableChannel
 
 private:
 	SmartPtrCFileCollection itemsInDirectory(
-		const std::string& directory,
-		const std::string& filenameRegex) const;
+		const std::string& directory) const;
 
 	SmartPtrCFileCollection merge(
 		const SmartPtrCFileCollection& newFileCollection,
 		const SmartPtrCFileCollection& existingFileCollection) const;
 
 	std::string calcNextFile(
-		SmartPtrCFileCollection& fileCollection) const;
+		SmartPtrCFileCollection& fileCollection);
+
+	void refreshPendingFiles();
+
+	bool readDirectoryEvents();
+
+	void addPendingFile(
+		const std::string& filename);
+
+	void removeFileEntry(
+		const std::string& filename);
+
+	void openDirectoryWatch();
+
+	void closeDirectoryWatch();
 
 	uint64 getTimeSec() const;
 
@@ -64,6 +79,9 @@ private:
 	uint64 _lastRefreshSec;
 
 	SmartPtrCFileCollection _fileCollection;
+	CPendingFiles _pendingFiles;
+	int32 _watchFd;
+	GRegex* _filenameGRegex;
 
 private:
 	CAF_CM_CREATE;
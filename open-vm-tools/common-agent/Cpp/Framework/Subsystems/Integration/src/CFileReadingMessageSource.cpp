@@ -13,22 +13,38 @@
 #include "CFileReadingMessageSource.h"
 #include "Exception/CCafException.h"
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <errno.h>
+#include <limits.h>
+#endif
+
 using namespace Caf;
 
+// With a directory watch in place the rescan only catches events that
+// were lost, so it can run infrequently
+static const uint32 WATCH_REFRESH_SEC = 60;
+
 CFileReadingMessageSource::CFileReadingMessageSource() :
 	_isInitialized(false),
 	_preventDuplicates(true),
 	_refreshSec(0),
 	_lastRefreshSec(0),
+	_watchFd(-1),
+	_filenameGRegex(NULL),
 	CAF_CM_INIT_LOG("CFileReadingMessageSource") {
 }
 
 CFileReadingMessageSource::~CFileReadingMessageSource() {
+	closeDirectoryWatch();
+	if (_filenameGRegex != NULL) {
+		g_regex_unref(_filenameGRegex);
+	}
 }
 
 void CFileReadingMessageSource::initialize(
 	const SmartPtrIDocument& configSection) {
-	CAF_CM_FUNCNAME_VALIDATE("initialize");
+	CAF_CM_FUNCNAME("initialize");
 	CAF_CM_PRECOND_ISNOTINITIALIZED(_isInitialized);
 	CAF_CM_VALIDATE_INTERFACE(configSection);
 
@@ -62,7 +78,26 @@ void CFileReadingMessageSource::initialize(
 			"Monitoring inbound directory - dir: %s, fileRegex: %s",
 			_directory.c_str(), _filenameRegex.c_str());
 
+	if (_filenameRegex.compare(FileSystemUtils::REGEX_MATCH_ALL) != 0) {
+		GError* gError = NULL;
+		_filenameGRegex = g_regex_new(_filenameRegex.c_str(),
+			(GRegexCompileFlags)(G_REGEX_OPTIMIZE | G_REGEX_RAW),
+			(GRegexMatchFlags)0,
+			&gError);
+		if (gError != NULL) {
+			const std::string errorMessage = gError->message;
+			const int32 errorCode = gError->code;
+			g_error_free(gError);
+
+			CAF_CM_EXCEPTIONEX_VA2(IOException, errorCode,
+				"g_regex_new Failed: %s regex: %s",
+				errorMessage.c_str(),
+				_filenameRegex.c_str());
+		}
+	}
+
 	_fileCollection.CreateInstance();
+	openDirectoryWatch();
 	_isInitialized = true;
 }
 
@@ -87,9 +122,10 @@ SmartPtrIIntMessage CFileReadingMessageSource::doReceive(const int32 timeout) {
 			"Timeout not currently supported: %s", _id.c_str());
 	}
 
-	if (isRefreshNecessary(_refreshSec, _lastRefreshSec)) {
+	const bool isRescanNecessary = readDirectoryEvents();
+	if (isRescanNecessary || isRefreshNecessary(_refreshSec, _lastRefreshSec)) {
 		const SmartPtrCFileCollection newFileCollection =
-			itemsInDirectory(_directory, _filenameRegex);
+			itemsInDirectory(_directory);
 
 		if (_preventDuplicates) {
 			_fileCollection = merge(newFileCollection, _fileCollection);
@@ -97,6 +133,7 @@ SmartPtrIIntMessage CFileReadingMessageSource::doReceive(const int32 timeout) {
 			_fileCollection = newFileCollection;
 		}
 
+		refreshPendingFiles();
 		_lastRefreshSec = getTimeSec();
 	}
 
@@ -116,21 +153,25 @@ SmartPtrIIntMessage CFileReadingMessageSource::doReceive(const int32 timeout) {
 
 CFileReadingMessageSource::SmartPtrCFileCollection
 CFileReadingMessageSource::itemsInDirectory(
-	const std::string& directory,
-	const std::string& filenameRegex) const {
+	const std::string& directory) const {
 	CAF_CM_FUNCNAME_VALIDATE("itemsInDirectory");
 	CAF_CM_PRECOND_ISINITIALIZED(_isInitialized);
 	CAF_CM_VALIDATE_STRING(directory);
-	// filenameRegex defaults to FileSystemUtils::REGEX_MATCH_ALL
 
 	SmartPtrCFileCollection rc;
 	rc.CreateInstance();
 
+	// Filter with the regex compiled in initialize() rather than having
+	// FileSystemUtils compile it again on every scan.
 	const FileSystemUtils::DirectoryItems directoryItems =
-		FileSystemUtils::itemsInDirectory(directory, filenameRegex);
+		FileSystemUtils::itemsInDirectory(directory, FileSystemUtils::REGEX_MATCH_ALL);
 	const FileSystemUtils::Files files = directoryItems.files;
 	for (TConstIterator<FileSystemUtils::Files> fileIter(files); fileIter; fileIter++) {
 		const std::string filename = *fileIter;
+		if ((_filenameGRegex != NULL)
+			&& ! g_regex_match(_filenameGRegex, filename.c_str(), (GRegexMatchFlags)0, NULL)) {
+			continue;
+		}
 		const std::string filePath = FileSystemUtils::buildPath(
 			directory, filename);
 
@@ -164,21 +205,141 @@ CFileReadingMessageSource::merge(
 }
 
 std::string CFileReadingMessageSource::calcNextFile(
-	SmartPtrCFileCollection& fileCollection) const {
+	SmartPtrCFileCollection& fileCollection) {
 	CAF_CM_FUNCNAME_VALIDATE("calcNextFile");
 	CAF_CM_VALIDATE_SMARTPTR(fileCollection);
 
+	// Entries for files that were removed or already received since they
+	// were queued are simply skipped
 	std::string filename;
-	for (TMapIterator<CFileCollection> fileIter(*fileCollection);
-		filename.empty() && fileIter; fileIter++) {
+	while (filename.empty() && ! _pendingFiles.empty()) {
+		CFileCollection::iterator fileIter =
+			fileCollection->find(_pendingFiles.front());
+		_pendingFiles.pop_front();
+
+		if ((fileIter != fileCollection->end()) && ! fileIter->second) {
+			filename = fileIter->first;
+			fileIter->second = true;
+		}
+	}
+
+	return filename;
+}
+
+void CFileReadingMessageSource::refreshPendingFiles() {
+	_pendingFiles.clear();
+	for (TConstMapIterator<CFileCollection> fileIter(*_fileCollection);
+		fileIter; fileIter++) {
 		const bool isFileReceived = *fileIter;
 		if (! isFileReceived) {
-			filename = fileIter.getKey();
-			*fileIter = true;
+			_pendingFiles.push_back(fileIter.getKey());
 		}
 	}
+}
 
-	return filename;
+void CFileReadingMessageSource::addPendingFile(
+	const std::string& filename) {
+	CFileCollection::iterator fileIter = _fileCollection->find(filename);
+	if (fileIter == _fileCollection->end()) {
+		_fileCollection->insert(std::make_pair(filename, false));
+		_pendingFiles.push_back(filename);
+	} else if (fileIter->second && ! _preventDuplicates) {
+		fileIter->second = false;
+		_pendingFiles.push_back(filename);
+	}
+}
+
+void CFileReadingMessageSource::removeFileEntry(
+	const std::string& filename) {
+	_fileCollection->erase(filename);
+}
+
+bool CFileReadingMessageSource::readDirectoryEvents() {
+	CAF_CM_FUNCNAME_VALIDATE("readDirectoryEvents");
+
+	bool rc = false;
+#ifdef __linux__
+	char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	while (_watchFd >= 0) {
+		const ssize_t bytesRead = ::read(_watchFd, buffer, sizeof(buffer));
+		if (bytesRead < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN) {
+				CAF_CM_LOG_WARN_VA2(
+						"Failed to read directory events, polling directory - dir: %s, errno: %d",
+						_directory.c_str(), errno);
+				closeDirectoryWatch();
+				rc = true;
+			}
+			break;
+		}
+
+		for (const char* eventPtr = buffer; eventPtr < buffer + bytesRead; ) {
+			const struct inotify_event* event =
+				reinterpret_cast<const struct inotify_event*>(eventPtr);
+			eventPtr += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				CAF_CM_LOG_DEBUG_VA1("Directory event queue overflowed - dir: %s",
+						_directory.c_str());
+				rc = true;
+			} else if (event->mask & IN_IGNORED) {
+				CAF_CM_LOG_WARN_VA1(
+						"Directory watch was removed, polling directory - dir: %s",
+						_directory.c_str());
+				closeDirectoryWatch();
+				rc = true;
+			} else if ((event->len > 0) && ! (event->mask & IN_ISDIR)
+				&& ((_filenameGRegex == NULL)
+					|| g_regex_match(_filenameGRegex, event->name, (GRegexMatchFlags)0, NULL))) {
+				const std::string filePath = FileSystemUtils::buildPath(
+					_directory, event->name);
+				if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+					addPendingFile(filePath);
+				} else {
+					removeFileEntry(filePath);
+				}
+			}
+		}
+	}
+#endif
+
+	return rc;
+}
+
+void CFileReadingMessageSource::openDirectoryWatch() {
+	CAF_CM_FUNCNAME_VALIDATE("openDirectoryWatch");
+
+#ifdef __linux__
+	_watchFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_watchFd < 0) {
+		CAF_CM_LOG_WARN_VA2(
+				"inotify_init1 failed, polling directory - dir: %s, errno: %d",
+				_directory.c_str(), errno);
+	} else if (::inotify_add_watch(_watchFd, _directory.c_str(),
+		IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0) {
+		CAF_CM_LOG_WARN_VA2(
+				"inotify_add_watch failed, polling directory - dir: %s, errno: %d",
+				_directory.c_str(), errno);
+		closeDirectoryWatch();
+	} else {
+		_refreshSec = WATCH_REFRESH_SEC;
+	}
+#endif
+}
+
+void CFileReadingMessageSource::closeDirectoryWatch() {
+#ifdef __linux__
+	if (_watchFd >= 0) {
+		::close(_watchFd);
+		_watchFd = -1;
+	}
+#endif
+	_refreshSec = 0;
 }
 
 bool CFileReadingMessageSource::isRefreshNecessary(
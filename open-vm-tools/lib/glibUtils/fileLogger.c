@@ -20,6 +20,20 @@
  * @file fileLogger.c
  *
  * Logger that uses file streams and provides optional log rotation.
+ *
+ * The asynchronous variant of the logger (POSIX only) does not write from the
+ * logging thread. Messages are copied to a bounded queue which does not use
+ * locks on the producer side, and a writer thread writes them to the file in
+ * batches with writev(), doing log rotation as needed. When the queue is full,
+ * messages of level "warning" and lower are dropped and counted; the writer
+ * notes how many were dropped in the log file once there is room again.
+ * Error and critical messages are never dropped: the logging thread writes
+ * the queued messages and its own message itself instead, unless writes are
+ * suspended.
+ *
+ * Writes can be suspended (e.g. while file systems are frozen): the queue is
+ * written out first, and the writer thread checks the "suspended" flag under
+ * the write lock before each batch, so no write starts until writes resume.
  */
 
 #include "glibUtils.h"
@@ -30,8 +44,29 @@
 #  include <process.h>
 #  include <windows.h>
 #else
+#  include <errno.h>
 #  include <fcntl.h>
 #  include <unistd.h>
+#  include <sys/uio.h>
+#endif
+
+#if !defined(_WIN32)
+/* Maximum number of messages written with a single writev() call. */
+#define FILELOGGER_BATCH_SIZE    64
+
+/* Bounds of the size of the message queue of the asynchronous logger. */
+#define FILELOGGER_QUEUE_MIN     16
+#define FILELOGGER_QUEUE_MAX     (64 * 1024)
+
+/*
+ * Slot of the message queue. The sequence number tells whether the slot is
+ * free for the producer of a given queue position, or holds a message for the
+ * consumer. See FileLoggerEnqueue().
+ */
+typedef struct FileLoggerRecord {
+   gint           seq;
+   gchar         *msg;
+} FileLoggerRecord;
 #endif
 
 
@@ -45,6 +80,20 @@ typedef struct FileLogger {
    gboolean       append;
    gboolean       error;
    GStaticMutex   lock;
+#if !defined(_WIN32)
+   /* Asynchronous logger only; the consumer side is protected by "lock". */
+   FileLoggerRecord *queue;
+   guint          queueMask;
+   gint           queueHead;
+   gint           queueTail;
+   gint           dropped;
+   gint           sleeping;
+   gint           suspended;
+   gboolean       stop;
+   GThread       *writer;
+   GMutex         wakeLock;
+   GCond          wake;
+#endif
 } FileLogger;
 
 
@@ -391,6 +440,405 @@ exit:
 }
 
 
+#if !defined(_WIN32)
+/*
+ *******************************************************************************
+ * FileLoggerEnqueue --                                                   */ /**
+ *
+ * Adds a copy of a message to the queue of an asynchronous logger. Safe to
+ * call from any number of threads at the same time.
+ *
+ * Each slot holds a sequence number. A slot is free for the producer that
+ * reserved queue position "pos" when its sequence number is "pos", and holds
+ * a message for the consumer when it is "pos + 1". Producers reserve a
+ * position by advancing the tail atomically, then fill the slot and publish
+ * it by updating its sequence number.
+ *
+ * @param[in] logger    File logger.
+ * @param[in] message   Message to queue.
+ *
+ * @return TRUE if the message was queued, FALSE if the queue is full.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+FileLoggerEnqueue(FileLogger *logger,
+                  const gchar *message)
+{
+   gchar *msg = g_strdup(message);
+   FileLoggerRecord *rec;
+   guint pos = (guint) g_atomic_int_get(&logger->queueTail);
+
+   for (;;) {
+      gint diff;
+
+      rec = &logger->queue[pos & logger->queueMask];
+      diff = (gint) ((guint) g_atomic_int_get(&rec->seq) - pos);
+      if (diff == 0) {
+         if (g_atomic_int_compare_and_exchange(&logger->queueTail, (gint) pos,
+                                               (gint) (pos + 1))) {
+            break;
+         }
+      } else if (diff < 0) {
+         /* The consumer hasn't freed the slot yet: the queue is full. */
+         g_free(msg);
+         return FALSE;
+      }
+      pos = (guint) g_atomic_int_get(&logger->queueTail);
+   }
+
+   rec->msg = msg;
+   g_atomic_int_set(&rec->seq, (gint) (pos + 1));
+   return TRUE;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerDequeue --                                                   */ /**
+ *
+ * Removes the oldest message from the queue of an asynchronous logger.
+ *
+ * @note Make sure this function is called with the write lock held.
+ *
+ * @param[in] logger    File logger.
+ *
+ * @return The message, NULL if the queue is empty. Should be g_free()'d.
+ *
+ *******************************************************************************
+ */
+
+static gchar *
+FileLoggerDequeue(FileLogger *logger)
+{
+   guint pos = (guint) g_atomic_int_get(&logger->queueHead);
+   FileLoggerRecord *rec = &logger->queue[pos & logger->queueMask];
+   gchar *msg;
+
+   if ((guint) g_atomic_int_get(&rec->seq) != pos + 1) {
+      return NULL;
+   }
+
+   msg = rec->msg;
+   rec->msg = NULL;
+   g_atomic_int_set(&rec->seq, (gint) (pos + logger->queueMask + 1));
+   g_atomic_int_set(&logger->queueHead, (gint) (pos + 1));
+   return msg;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerWriteBatch --                                                */ /**
+ *
+ * Writes messages to the log file with a single writev() call (more if the
+ * writes are short), and rotates the log file if it got too big. Frees the
+ * messages.
+ *
+ * @note Make sure this function is called with the write lock held.
+ *
+ * @param[in] logger    File logger.
+ * @param[in] msgs      Messages to write.
+ * @param[in] count     Number of messages, at most FILELOGGER_BATCH_SIZE.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerWriteBatch(FileLogger *logger,
+                     gchar **msgs,
+                     guint count)
+{
+   struct iovec iov[FILELOGGER_BATCH_SIZE + 1];
+   struct iovec *curr = iov;
+   gchar *note = NULL;
+   gint dropped;
+   guint n = 0;
+   guint i;
+
+   dropped = g_atomic_int_get(&logger->dropped);
+   if (dropped > 0) {
+      g_atomic_int_add(&logger->dropped, -dropped);
+      note = g_strdup_printf("[%d log messages were dropped, "
+                             "the log queue was full]\n", dropped);
+      iov[n].iov_base = note;
+      iov[n].iov_len = strlen(note);
+      n++;
+   }
+
+   for (i = 0; i < count; i++) {
+      iov[n].iov_base = msgs[i];
+      iov[n].iov_len = strlen(msgs[i]);
+      n++;
+   }
+
+   if (!logger->error && logger->file == NULL) {
+      logger->file = FileLoggerOpen(logger);
+      if (logger->file == NULL) {
+         logger->error = TRUE;
+      }
+   }
+
+   if (!logger->error && !FileLoggerIsValid(logger)) {
+      logger->error = TRUE;
+   }
+
+   if (!logger->error) {
+      int fd = g_io_channel_unix_get_fd(logger->file);
+
+      while (n > 0) {
+         ssize_t written = writev(fd, curr, n);
+
+         if (written < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            break;
+         }
+
+         /* Skip what has been written, in case of a short write. */
+         logger->logSize += (gint) written;
+         while (n > 0 && (size_t) written >= curr->iov_len) {
+            written -= curr->iov_len;
+            curr++;
+            n--;
+         }
+         if (n > 0) {
+            curr->iov_base = (char *) curr->iov_base + written;
+            curr->iov_len -= written;
+         }
+      }
+
+      if (logger->maxSize > 0 && logger->logSize >= logger->maxSize) {
+         g_io_channel_unref(logger->file);
+         logger->append = FALSE;
+         logger->file = FileLoggerOpen(logger);
+      }
+   }
+
+   for (i = 0; i < count; i++) {
+      g_free(msgs[i]);
+   }
+   g_free(note);
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerWriteQueued --                                               */ /**
+ *
+ * Writes all queued messages of an asynchronous logger to the log file.
+ *
+ * @note Make sure this function is called with the write lock held.
+ *
+ * @param[in] logger    File logger.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerWriteQueued(FileLogger *logger)
+{
+   gchar *msgs[FILELOGGER_BATCH_SIZE];
+   guint count;
+
+   do {
+      if (g_atomic_int_get(&logger->suspended)) {
+         return;
+      }
+      for (count = 0; count < FILELOGGER_BATCH_SIZE; count++) {
+         msgs[count] = FileLoggerDequeue(logger);
+         if (msgs[count] == NULL) {
+            break;
+         }
+      }
+      if (count > 0 || g_atomic_int_get(&logger->dropped) > 0) {
+         FileLoggerWriteBatch(logger, msgs, count);
+      }
+   } while (count == FILELOGGER_BATCH_SIZE);
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerIsQueueEmpty --                                              */ /**
+ *
+ * Checks whether the queue of an asynchronous logger has no message ready to
+ * be written.
+ *
+ * @param[in] logger    File logger.
+ *
+ * @return TRUE if the queue is empty.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+FileLoggerIsQueueEmpty(FileLogger *logger)
+{
+   guint pos = (guint) g_atomic_int_get(&logger->queueHead);
+   FileLoggerRecord *rec = &logger->queue[pos & logger->queueMask];
+
+   return (guint) g_atomic_int_get(&rec->seq) != pos + 1 &&
+          g_atomic_int_get(&logger->dropped) == 0;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerWriterThread --                                              */ /**
+ *
+ * Writer thread of an asynchronous logger. Sleeps until messages are queued,
+ * and writes them to the log file.
+ *
+ * @param[in] data      File logger.
+ *
+ * @return NULL.
+ *
+ *******************************************************************************
+ */
+
+static gpointer
+FileLoggerWriterThread(gpointer data)
+{
+   FileLogger *logger = data;
+
+   g_mutex_lock(&logger->wakeLock);
+   while (!logger->stop) {
+      /*
+       * Producers check "sleeping" after queuing a message, so either the
+       * message is seen here, or the producer wakes up the thread. Resuming
+       * writes always wakes up the thread.
+       */
+      g_atomic_int_set(&logger->sleeping, TRUE);
+      if (FileLoggerIsQueueEmpty(logger) ||
+          g_atomic_int_get(&logger->suspended)) {
+         g_cond_wait(&logger->wake, &logger->wakeLock);
+      }
+      g_atomic_int_set(&logger->sleeping, FALSE);
+      g_mutex_unlock(&logger->wakeLock);
+
+      g_static_mutex_lock(&logger->lock);
+      FileLoggerWriteQueued(logger);
+      g_static_mutex_unlock(&logger->lock);
+
+      g_mutex_lock(&logger->wakeLock);
+   }
+   g_mutex_unlock(&logger->wakeLock);
+
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerLogAsync --                                                  */ /**
+ *
+ * Queues a message to be written to the log file by the writer thread. See
+ * the file's description for what happens when the queue is full.
+ *
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] message   Message to log.
+ * @param[in] data      File logger.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerLogAsync(const gchar *domain,
+                   GLogLevelFlags level,
+                   const gchar *message,
+                   gpointer data)
+{
+   FileLogger *logger = data;
+
+   if (FileLoggerEnqueue(logger, message)) {
+      if (g_atomic_int_get(&logger->sleeping)) {
+         g_mutex_lock(&logger->wakeLock);
+         g_cond_signal(&logger->wake);
+         g_mutex_unlock(&logger->wakeLock);
+      }
+   } else if (level & (G_LOG_FLAG_FATAL |
+                       G_LOG_LEVEL_ERROR |
+                       G_LOG_LEVEL_CRITICAL)) {
+      g_static_mutex_lock(&logger->lock);
+      if (g_atomic_int_get(&logger->suspended)) {
+         g_atomic_int_inc(&logger->dropped);
+      } else {
+         gchar *msg = g_strdup(message);
+
+         FileLoggerWriteQueued(logger);
+         FileLoggerWriteBatch(logger, &msg, 1);
+      }
+      g_static_mutex_unlock(&logger->lock);
+   } else {
+      g_atomic_int_inc(&logger->dropped);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerFlush --                                                     */ /**
+ *
+ * Writes all queued messages of an asynchronous logger from the calling
+ * thread, waiting for the writer thread to finish any write in progress.
+ *
+ * @param[in] handler   File logger.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerFlush(GlibLogger *handler)
+{
+   FileLogger *logger = (FileLogger *) handler;
+
+   g_static_mutex_lock(&logger->lock);
+   FileLoggerWriteQueued(logger);
+   g_static_mutex_unlock(&logger->lock);
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerSuspend --                                                   */ /**
+ *
+ * Suspends or resumes writes of an asynchronous logger. Suspending writes out
+ * the queued messages, waiting for the writer thread to finish any write in
+ * progress; no write starts after this returns until writes are resumed.
+ * Messages logged in the meantime stay queued.
+ *
+ * @param[in] handler   File logger.
+ * @param[in] suspend   TRUE to suspend writes, FALSE to resume them.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerSuspend(GlibLogger *handler,
+                  gboolean suspend)
+{
+   FileLogger *logger = (FileLogger *) handler;
+
+   g_static_mutex_lock(&logger->lock);
+   if (suspend) {
+      FileLoggerWriteQueued(logger);
+   }
+   g_atomic_int_set(&logger->suspended, suspend);
+   g_static_mutex_unlock(&logger->lock);
+
+   if (!suspend) {
+      g_mutex_lock(&logger->wakeLock);
+      g_cond_signal(&logger->wake);
+      g_mutex_unlock(&logger->wakeLock);
+   }
+}
+#endif
+
+
 /*
  ******************************************************************************
  * FileLoggerDestroy --                                               */ /**
@@ -406,6 +854,23 @@ static void
 FileLoggerDestroy(gpointer data)
 {
    FileLogger *logger = data;
+
+#if !defined(_WIN32)
+   if (logger->writer != NULL) {
+      g_mutex_lock(&logger->wakeLock);
+      logger->stop = TRUE;
+      g_cond_signal(&logger->wake);
+      g_mutex_unlock(&logger->wakeLock);
+      g_thread_join(logger->writer);
+
+      g_atomic_int_set(&logger->suspended, FALSE);
+      FileLoggerFlush(&logger->handler);
+      g_cond_clear(&logger->wake);
+      g_mutex_clear(&logger->wakeLock);
+      g_free(logger->queue);
+   }
+#endif
+
    if (logger->file != NULL) {
       g_io_channel_unref(logger->file);
    }
@@ -461,3 +926,77 @@ GlibUtils_CreateFileLogger(const char *path,
    return &data->handler;
 }
 
+
+/*
+ *******************************************************************************
+ * GlibUtils_CreateAsyncFileLogger --                                     */ /**
+ *
+ * @brief Creates a new file logger that writes messages from a separate thread.
+ *
+ * Messages are queued by the logging threads and written in batches by a
+ * writer thread, which also rotates the log file. The queue is written out
+ * when the logger's flush function is called and when it is destroyed.
+ *
+ * On Windows, and if the writer thread cannot be started, this is the same
+ * as GlibUtils_CreateFileLogger().
+ *
+ * @param[in] path      Path to log file.
+ * @param[in] append    Whether to append to existing log file.
+ * @param[in] maxSize   Maximum log file size (in MB, 0 = no limit).
+ * @param[in] maxFiles  Maximum number of old files to be kept.
+ * @param[in] queueSize Number of messages that can be queued. Rounded up to
+ *                      a power of 2, between 16 and 65536.
+ *
+ * @return A new logger, or NULL on error.
+ *
+ *******************************************************************************
+ */
+
+GlibLogger *
+GlibUtils_CreateAsyncFileLogger(const char *path,
+                                gboolean append,
+                                guint maxSize,
+                                guint maxFiles,
+                                guint queueSize)
+{
+   GlibLogger *handler = GlibUtils_CreateFileLogger(path, append, maxSize,
+                                                    maxFiles);
+#if !defined(_WIN32)
+   FileLogger *data = (FileLogger *) handler;
+   guint size = FILELOGGER_QUEUE_MIN;
+   guint i;
+
+   if (handler == NULL) {
+      return NULL;
+   }
+
+   while (size < queueSize && size < FILELOGGER_QUEUE_MAX) {
+      size <<= 1;
+   }
+
+   data->queue = g_new0(FileLoggerRecord, size);
+   for (i = 0; i < size; i++) {
+      data->queue[i].seq = (gint) i;
+   }
+   data->queueMask = size - 1;
+   g_mutex_init(&data->wakeLock);
+   g_cond_init(&data->wake);
+
+   data->writer = g_thread_try_new("vmtools-log", FileLoggerWriterThread,
+                                   data, NULL);
+   if (data->writer == NULL) {
+      /* Fall back to synchronous writes. */
+      g_cond_clear(&data->wake);
+      g_mutex_clear(&data->wakeLock);
+      g_free(data->queue);
+      data->queue = NULL;
+      return handler;
+   }
+
+   handler->logfn = FileLoggerLogAsync;
+   handler->flush = FileLoggerFlush;
+   handler->suspend = FileLoggerSuspend;
+#endif
+
+   return handler;
+}
@@ -195,6 +195,28 @@
  */
 
 
+/*
+ ******************************************************************************
+ * BEGIN TimeSync goodies.
+ */
+
+/**
+ * Defines the string used for the TimeSync config file group.
+ */
+#define CONFGROUPNAME_TIMESYNC "timeSync"
+
+/**
+ * Path of a file where the recent time synchronization samples are saved,
+ * appending the new ones after each synchronization. Not written if unset.
+ */
+#define CONFNAME_TIMESYNC_SAMPLESFILE "samples-file"
+
+/*
+ * END TimeSync goodies.
+ ******************************************************************************
+ */
+
+
 /*
  ******************************************************************************
  * BEGIN Unity goodies.
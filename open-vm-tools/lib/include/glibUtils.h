@@ -48,12 +48,19 @@ extern "C" {
  * message. So if the @a addsTimestamp field is TRUE, the logging code can
  * choose to rely on that and not add a redundant timestamp field to the log
  * message.
+ *
+ * Loggers that queue messages and write them from another thread provide a
+ * @a flush function, which writes out all queued messages before returning,
+ * and a @a suspend function, which writes out all queued messages and then
+ * keeps the other thread from writing until it is called again to resume.
  */
 typedef struct GlibLogger {
    gboolean          shared;        /**< Output is shared with other processes. */
    gboolean          addsTimestamp; /**< Output adds timestamp automatically. */
    GLogFunc          logfn;         /**< The function that writes to the output. */
    GDestroyNotify    dtor;          /**< Destructor. */
+   void            (*flush)(struct GlibLogger *); /**< Flush, may be NULL. */
+   void            (*suspend)(struct GlibLogger *, gboolean); /**< Suspend/resume writes, may be NULL. */
 } GlibLogger;
 
 
@@ -63,6 +70,13 @@ GlibUtils_CreateFileLogger(const char *path,
                            guint maxSize,
                            guint maxFiles);
 
+GlibLogger *
+GlibUtils_CreateAsyncFileLogger(const char *path,
+                                gboolean append,
+                                guint maxSize,
+                                guint maxFiles,
+                                guint queueSize);
+
 GlibLogger *
 GlibUtils_CreateStdLogger(void);
 
@@ -47,6 +47,24 @@ extern "C" {
 #endif
 
 
+/*
+ * Per-channel transfer counters. Comparing the byte counts with the number
+ * of backdoor calls tells whether a channel ended up on the 4 bytes per call
+ * low-bandwidth path.
+ */
+typedef struct Message_Stats {
+   uint64 msgsSent;
+   uint64 msgsReceived;
+   uint64 bytesSent;
+   uint64 bytesReceived;
+   /* Every BDOOR_CMD_MESSAGE and BDOORHB_CMD_MESSAGE call */
+   uint64 backdoorCalls;
+   /* Payloads moved in a single high-bandwidth call */
+   uint64 hbTransfers;
+   /* Payloads moved 4 bytes at a time */
+   uint64 lbTransfers;
+} Message_Stats;
+
 /* The channel object */
 typedef struct Message_Channel {
    /* Identifier */
@@ -62,6 +80,8 @@ typedef struct Message_Channel {
    /* The cookie */
    uint32 cookieHigh;
    uint32 cookieLow;
+
+   Message_Stats stats;
 } Message_Channel;
 
 Bool Message_OpenAllocated(uint32 proto, Message_Channel *chan,
@@ -73,6 +93,7 @@ Bool Message_Receive(Message_Channel *chan, unsigned char **buf,
                      size_t *bufSize);
 Bool Message_CloseAllocated(Message_Channel *chan);
 Bool Message_Close(Message_Channel *chan);
+void Message_GetStats(const Message_Channel *chan, Message_Stats *stats);
 
 #ifdef __cplusplus
 }
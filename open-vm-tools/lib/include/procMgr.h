@@ -66,6 +66,17 @@ typedef struct ProcMgrProcInfo {
 
 DEFINE_DYNARRAY_TYPE(ProcMgrProcInfo);
 
+/*
+ * Optional filter for ProcMgr_ListProcessesEx(). A process is listed
+ * only if it matches every criterion that is set.
+ */
+
+typedef struct ProcMgrProcFilter {
+   size_t numPids;                // 0 matches any pid
+   const ProcMgr_Pid *pids;
+   const char *owner;             // UTF-8; NULL matches any owner
+} ProcMgrProcFilter;
+
 
 typedef struct ProcMgr_ProcArgs {
 #if defined(_WIN32)
@@ -134,6 +145,7 @@ typedef int Selectable;
 #endif
 
 ProcMgrProcInfoArray *ProcMgr_ListProcesses(void);
+ProcMgrProcInfoArray *ProcMgr_ListProcessesEx(const ProcMgrProcFilter *filter);
 void ProcMgr_FreeProcList(ProcMgrProcInfoArray *procList);
 Bool ProcMgr_KillByPid(ProcMgr_Pid procId);
 
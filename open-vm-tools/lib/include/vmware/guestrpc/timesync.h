@@ -43,6 +43,7 @@
    "time.synchronize.guest.resync.timeout"
 
 #define TIMESYNC_SYNCHRONIZE                    "Time_Synchronize"
+#define TIMESYNC_GET_SAMPLES                    "Time_Synchronize_Get_Samples"
 
 #endif /* _TIMESYNC_H_ */
 
@@ -56,6 +56,7 @@
 #define VMBACKUP_PROTOCOL_EVENT_SET       VMBACKUP_PROTOCOL_PREFIX"eventSet"
 #define VMBACKUP_PROTOCOL_SNAPSHOT_COMPLETED \
    VMBACKUP_PROTOCOL_PREFIX"snapshotCompleted"
+#define VMBACKUP_PROTOCOL_TIMELINE        VMBACKUP_PROTOCOL_PREFIX"timeline"
 
 /* These are responses to messages sent to the guest. */
 #define VMBACKUP_PROTOCOL_ERROR           "protocol.error"
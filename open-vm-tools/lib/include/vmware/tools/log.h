@@ -52,6 +52,28 @@
  *      default, at most 10 backed up log files will be kept. Value should be >= 1.
  *    - maxLogSize: maximum size of each log file, defaults to 10 (MB). A value of
  *      0 disables log rotation.
+ *    - async: whether to write the log file from a separate thread (POSIX
+ *      only). Messages are queued and written in batches, so logging threads
+ *      don't wait for the disk. When the queue is full, warnings and less
+ *      severe messages are dropped, and the number of dropped messages is
+ *      written to the log. Queued messages are written out before a panic.
+ *      Defaults to false.
+ *    - asyncQueueSize: maximum number of queued messages when "async" is
+ *      enabled, defaults to 4096.
+ *
+ * The rate of messages of any domain can be limited. Messages over the limit
+ * are dropped before being formatted, and the number of dropped messages is
+ * logged at most every "rateLimitSummaryInterval" seconds (a global option,
+ * 60 by default). Error and critical messages are never dropped.
+ *
+ *    - rateLimit: maximum average number of messages per second for the
+ *      domain. Default: 0 (no limit).
+ *    - rateLimitBurst: number of messages that can be logged at once above
+ *      the average rate. Defaults to 10 times "rateLimit".
+ *    - siteRateLimit, siteRateLimitBurst: same, applied separately to each
+ *      kind of message of the domain. Messages whose text differs only in
+ *      numbers are considered of the same kind, which approximates limiting
+ *      each place in the code that logs.
  *
  * When using syslog on Unix, the following options are available:
  *
@@ -120,6 +142,13 @@
  *
  * # Defines the "vmtoolsd" domain, and disable logging for it.
  * vmtoolsd.level = none
+ *
+ * # Limits the "guestinfo" domain to 5 messages per second, and each
+ * # kind of message to one per second once a burst of 3 is used.
+ * guestinfo.level = warning
+ * guestinfo.rateLimit = 5
+ * guestinfo.siteRateLimit = 1
+ * guestinfo.siteRateLimitBurst = 3
  * @endverbatim
  *
  * Log file names can contain references to pre-defined variables. The following
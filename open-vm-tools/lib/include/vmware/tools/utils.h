@@ -103,6 +103,18 @@
 #define VMTOOLS_WRAP_ARRAY(a) VMTools_WrapArray((a), sizeof *(a), G_N_ELEMENTS(a))
 
 
+/**
+ * Last known state of a config file, see VMTools_ReloadConfig(). Should be
+ * zeroed before the first load.
+ */
+typedef struct VMToolsConfigStamp {
+   gint64   mtime;      /**< Modification time, in ns. */
+   gint64   size;       /**< Size of the file. */
+   guint64  hash;       /**< Hash of the contents. */
+   gint64   checked;    /**< When the stamp was taken, in ns. */
+} VMToolsConfigStamp;
+
+
 G_BEGIN_DECLS
 
 void
@@ -114,6 +126,12 @@ VMTools_LoadConfig(const gchar *path,
                    GKeyFile **config,
                    time_t *mtime);
 
+gboolean
+VMTools_ReloadConfig(const gchar *path,
+                     GKeyFileFlags flags,
+                     GKeyFile **config,
+                     VMToolsConfigStamp *stamp);
+
 gboolean
 VMTools_WriteConfig(const gchar *path,
                     GKeyFile *config,
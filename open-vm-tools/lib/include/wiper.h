@@ -109,6 +109,24 @@ unsigned char *WiperSinglePartition_GetSpace(const WiperPartition *p,
                                              uint64 *free,
                                              uint64 *total);
 
+/* Ways of reclaiming the free space of a partition */
+typedef enum {
+   WIPER_METHOD_ZERO_FILL,    /* Fill the free space with zeroed files */
+   WIPER_METHOD_TRIM,         /* Discard the free space (FITRIM) */
+   WIPER_METHOD_MAX
+} WiperMethod;
+
+typedef struct WiperStats {
+   /* Method in use */
+   WiperMethod method;
+   /* Free space of the partition when the wipe started, in bytes */
+   uint64 startFree;
+   /* Bytes zeroed or discarded by each method */
+   uint64 bytes[WIPER_METHOD_MAX];
+   /* Time spent in each method, in microseconds */
+   uint64 usecs[WIPER_METHOD_MAX];
+} WiperStats;
+
 /* External definition of the wiper state */
 struct Wiper_State;
 typedef struct Wiper_State Wiper_State;
@@ -116,6 +134,10 @@ typedef struct Wiper_State Wiper_State;
 Wiper_State *Wiper_Start(const WiperPartition *p, unsigned int maxWiperFileSize);
 
 unsigned char *Wiper_Next(Wiper_State **s, unsigned int *progress);
+#if !defined(_WIN32)
+unsigned char *Wiper_NextWithStats(Wiper_State **s, unsigned int *progress,
+                                   WiperStats *stats);
+#endif
 unsigned char *Wiper_Cancel(Wiper_State **s);
 
 #if defined(__cplusplus)
@@ -75,6 +75,30 @@ extern "C" {
 #  define MESSAGE_LOG(...)
 #endif
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MessageBackdoor --
+ *
+ *    Issue a low-bandwidth backdoor call on behalf of a channel.
+ *
+ * Result:
+ *    None
+ *
+ * Side-effects:
+ *    Updates the channel's call counter.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE void
+MessageBackdoor(Message_Channel *chan, // IN/OUT
+                Backdoor_proto *bp)    // IN/OUT
+{
+   chan->stats.backdoorCalls++;
+   Backdoor(bp);
+}
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -104,6 +128,9 @@ Message_OpenAllocated(uint32 proto, Message_Channel *chan,
 {
    uint32 flags;
    Backdoor_proto bp;
+   Message_Stats noStats = { 0 };
+
+   chan->stats = noStats;
 
    flags = GUESTMSG_FLAG_COOKIE;
 retry:
@@ -113,7 +140,7 @@ retry:
    bp.in.size = proto | flags;
 
    bp.in.cx.halfs.low = BDOOR_CMD_MESSAGE;
-   Backdoor(&bp);
+   MessageBackdoor(chan, &bp);
 
    /* OUT: Status */
    if ((bp.in.cx.halfs.high & MESSAGE_STATUS_SUCCESS) == 0) {
@@ -217,7 +244,7 @@ retry:
    bp.in.size = myBufSize;
 
    bp.in.cx.halfs.low = BDOOR_CMD_MESSAGE;
-   Backdoor(&bp);
+   MessageBackdoor(chan, &bp);
 
    /* OUT: Status */
    if ((bp.in.cx.halfs.high & MESSAGE_STATUS_SUCCESS) == 0) {
@@ -242,6 +269,7 @@ retry:
          bphb.in.dstAddr = chan->cookieLow;
          bphb.in.size = myBufSize;
          bphb.in.srcAddr = (uintptr_t) myBuf;
+         chan->stats.backdoorCalls++;
          Backdoor_HbOut(&bphb);
          if ((bphb.in.bx.halfs.high & MESSAGE_STATUS_SUCCESS) == 0) {
             if ((bphb.in.bx.halfs.high & MESSAGE_STATUS_CPT) != 0) {
@@ -253,6 +281,7 @@ retry:
                         "communication channel %u\n", chan->id);
             return FALSE;
          }
+         chan->stats.hbTransfers++;
       }
    } else {
       /*
@@ -260,6 +289,10 @@ retry:
        * at a time. --hpreg
        */
 
+      if (myBufSize) {
+         chan->stats.lbTransfers++;
+      }
+
       for (;;) {
          if (myBufSize == 0) {
             /* We are done */
@@ -297,7 +330,7 @@ retry:
          }
 
          bp.in.cx.halfs.low = BDOOR_CMD_MESSAGE;
-         Backdoor(&bp);
+         MessageBackdoor(chan, &bp);
 
          /* OUT: Status */
          if ((bp.in.cx.halfs.high & MESSAGE_STATUS_SUCCESS) == 0) {
@@ -315,6 +348,9 @@ retry:
       }
    }
 
+   chan->stats.msgsSent++;
+   chan->stats.bytesSent += bufSize;
+
    return TRUE;
 }
 
@@ -358,7 +394,7 @@ retry:
    bp.in.di.word = chan->cookieLow;
 
    bp.in.cx.halfs.low = BDOOR_CMD_MESSAGE;
-   Backdoor(&bp);
+   MessageBackdoor(chan, &bp);
 
    /* OUT: Status */
    if ((bp.in.cx.halfs.high & MESSAGE_STATUS_SUCCESS) == 0) {
@@ -427,6 +463,7 @@ retry:
          bphb.in.bp.word = chan->cookieLow;
          bphb.in.size = myBufSize;
          bphb.in.dstAddr = (uintptr_t) myBuf;
+         chan->stats.backdoorCalls++;
          Backdoor_HbIn(&bphb);
          if ((bphb.in.bx.halfs.high & MESSAGE_STATUS_SUCCESS) == 0) {
             if ((bphb.in.bx.halfs.high & MESSAGE_STATUS_CPT) != 0) {
@@ -438,6 +475,7 @@ retry:
                         "communication channel %u\n", chan->id);
             goto error_quit;
          }
+         chan->stats.hbTransfers++;
       }
    } else {
       /*
@@ -445,6 +483,10 @@ retry:
        * bytes at a time. --hpreg
        */
 
+      if (myBufSize) {
+         chan->stats.lbTransfers++;
+      }
+
       for (;;) {
          if (myBufSize == 0) {
             /* We are done */
@@ -461,7 +503,7 @@ retry:
          bp.in.size = MESSAGE_STATUS_SUCCESS;
 
          bp.in.cx.halfs.low = BDOOR_CMD_MESSAGE;
-         Backdoor(&bp);
+         MessageBackdoor(chan, &bp);
 
          /* OUT: Status */
          if ((bp.in.cx.halfs.high & MESSAGE_STATUS_SUCCESS) == 0) {
@@ -526,7 +568,7 @@ retry:
    bp.in.size = MESSAGE_STATUS_SUCCESS;
 
    bp.in.cx.halfs.low = BDOOR_CMD_MESSAGE;
-   Backdoor(&bp);
+   MessageBackdoor(chan, &bp);
 
    /* OUT: Status */
    if ((bp.in.cx.halfs.high & MESSAGE_STATUS_SUCCESS) == 0) {
@@ -540,6 +582,9 @@ retry:
       goto error_quit;
    }
 
+   chan->stats.msgsReceived++;
+   chan->stats.bytesReceived += *bufSize;
+
    return TRUE;
 
 error_quit:
@@ -557,7 +602,7 @@ error_quit:
    bp.in.size = 0;
 
    bp.in.cx.halfs.low = BDOOR_CMD_MESSAGE;
-   Backdoor(&bp);
+   MessageBackdoor(chan, &bp);
 
    /* OUT: Status */
    if ((bp.in.cx.halfs.high & MESSAGE_STATUS_SUCCESS) == 0) {
@@ -602,7 +647,7 @@ Message_CloseAllocated(Message_Channel *chan) // IN/OUT
    bp.in.di.word = chan->cookieLow;
 
    bp.in.cx.halfs.low = BDOOR_CMD_MESSAGE;
-   Backdoor(&bp);
+   MessageBackdoor(chan, &bp);
 
    /* OUT: Status */
    if ((bp.in.cx.halfs.high & MESSAGE_STATUS_SUCCESS) == 0) {
@@ -646,6 +691,30 @@ Message_Close(Message_Channel *chan) // IN/OUT
    return ret;
 }
 
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Message_GetStats --
+ *
+ *    Retrieve the transfer counters of a communication channel.
+ *
+ * Result:
+ *    None
+ *
+ * Side-effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Message_GetStats(const Message_Channel *chan, // IN
+                 Message_Stats *stats)        // OUT
+{
+   *stats = chan->stats;
+}
+
 #ifdef __cplusplus
 }
 #endif
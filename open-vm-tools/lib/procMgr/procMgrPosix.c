@@ -80,6 +80,9 @@
 #include "strutil.h"
 #include "codeset.h"
 #include "unicode.h"
+#if defined(__linux__)
+#include "hashTable.h"
+#endif
 
 #ifdef USERWORLD
 #include <vm_basic_types.h>
@@ -140,6 +143,51 @@ Bool ProcMgr_PromoteEffectiveToReal(void);
 #endif
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrProcFilterMatches --
+ *
+ *      Check whether a process passes the (optional) filter.
+ *
+ * Results:
+ *      TRUE if the process should be listed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrProcFilterMatches(const ProcMgrProcFilter *filter,  // IN/OPT
+                         ProcMgr_Pid pid,                  // IN
+                         const char *owner)                // IN/OPT
+{
+   size_t i;
+
+   if (NULL == filter) {
+      return TRUE;
+   }
+
+   if (NULL != filter->owner &&
+       (NULL == owner || strcmp(filter->owner, owner) != 0)) {
+      return FALSE;
+   }
+
+   if (0 == filter->numPids) {
+      return TRUE;
+   }
+   for (i = 0; i < filter->numPids; i++) {
+      if (filter->pids[i] == pid) {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -223,6 +271,498 @@ done:
 }
 
 
+/*
+ * Cache of per-process information, so repeated listings only read
+ * /proc/<pid>/stat and /proc/<pid>/cmdline and stat(2) /proc/<pid> for
+ * processes that were already seen.
+ *
+ * An entry is keyed by pid and is only reused when both the start time
+ * and the command name reported in /proc/<pid>/stat are unchanged; this
+ * catches pid reuse as well as exec(2) in an existing process.  A process
+ * may also rewrite its arguments (setproctitle, as done by postgres, nginx
+ * or sshd), so the raw command line is re-read every time and the cached
+ * strings are only reused while it has not changed.
+ *
+ * Like the rest of the listing code, the caches are not thread-safe and
+ * callers must serialize calls to ProcMgr_ListProcesses[Ex].
+ */
+
+typedef struct ProcMgrCachedProc {
+   unsigned long long startTime;   // jiffies since boot
+   char *statName;                 // name field of /proc/<pid>/stat
+   char *cmdName;                  // UTF-8, may be NULL
+   char *cmdLine;                  // UTF-8
+   char *rawCmdLine;               // contents of /proc/<pid>/cmdline
+   int rawCmdLineLen;
+} ProcMgrCachedProc;
+
+#define PROCMGR_PROC_CACHE_MIN_SIZE  256
+
+/*
+ * Cached uid -> user name lookups. getpwuid(3) may go through NSS and is by
+ * far the most expensive part of listing a process, so the result is kept
+ * until /etc/passwd changes or PROCMGR_USER_CACHE_TTL seconds have passed
+ * (to pick up changes in remote name services).
+ */
+
+#define PROCMGR_USER_CACHE_SIZE  64
+#define PROCMGR_USER_CACHE_TTL   60
+
+static HashTable *procMgrProcCache = NULL;
+static HashTable *procMgrUserCache = NULL;
+static time_t procMgrUserCacheTime = 0;
+static time_t procMgrPasswdMTime = 0;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrFreeCachedProc --
+ *
+ *      Hash table free function for ProcMgrCachedProc entries.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees the entry.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcMgrFreeCachedProc(void *clientData)  // IN
+{
+   ProcMgrCachedProc *entry = clientData;
+
+   if (NULL != entry) {
+      free(entry->statName);
+      free(entry->cmdName);
+      free(entry->cmdLine);
+      free(entry->rawCmdLine);
+      free(entry);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrRefreshUserCache --
+ *
+ *      Drop the uid -> user name cache if it may be stale.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May free and reallocate procMgrUserCache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcMgrRefreshUserCache(void)
+{
+   struct stat passwdStat;
+   time_t now = time(NULL);
+   time_t passwdMTime = 0;
+
+   if (0 == stat("/etc/passwd", &passwdStat)) {
+      passwdMTime = passwdStat.st_mtime;
+   }
+
+   if (NULL != procMgrUserCache &&
+       passwdMTime == procMgrPasswdMTime &&
+       now >= procMgrUserCacheTime &&
+       now - procMgrUserCacheTime < PROCMGR_USER_CACHE_TTL) {
+      return;
+   }
+
+   if (NULL != procMgrUserCache) {
+      HashTable_Free(procMgrUserCache);
+   }
+   procMgrUserCache = HashTable_Alloc(PROCMGR_USER_CACHE_SIZE,
+                                      HASH_INT_KEY, free);
+   procMgrUserCacheTime = now;
+   procMgrPasswdMTime = passwdMTime;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrLookupUserName --
+ *
+ *      Map a uid to a user name, falling back to the numeric uid if the
+ *      user is unknown.
+ *
+ * Results:
+ *      The user name. Owned by the cache; must not be freed.
+ *
+ * Side effects:
+ *      May add an entry to procMgrUserCache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static const char *
+ProcMgrLookupUserName(uid_t uid)  // IN
+{
+   char *name;
+
+   if (!HashTable_Lookup(procMgrUserCache, (void *)(uintptr_t) uid,
+                         (void **) &name)) {
+      struct passwd *pwd = getpwuid(uid);
+
+      name = (NULL == pwd)
+             ? Str_SafeAsprintf(NULL, "%d", (int) uid)
+             : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
+      HashTable_Insert(procMgrUserCache, (void *)(uintptr_t) uid, name);
+   }
+
+   return name;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrReadCmdLine --
+ *
+ *      Read the command line and command name of a process, as reported
+ *      for the process listing.
+ *
+ * Results:
+ *      cached if the command line has not changed since it was read, a new
+ *      cache entry (without the /proc/<pid>/stat based fields filled in)
+ *      otherwise, or NULL if the process could not be examined.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ProcMgrCachedProc *
+ProcMgrReadCmdLine(const char *pidStr,           // IN
+                   ProcMgrCachedProc *cached)    // IN/OPT: previous entry
+{
+   ProcMgrCachedProc *entry;
+   char cmdFilePath[1024];
+   int numRead = 0;   /* number of bytes that read() actually read */
+   int cmdFd;
+   int replaceLoop;
+   char *cmdLineTemp = NULL;
+   char *cmdNameBegin;
+   Bool cmdNameLookup = TRUE;
+
+   if (snprintf(cmdFilePath,
+                sizeof cmdFilePath,
+                "/proc/%s/cmdline",
+                pidStr) == -1) {
+      Debug("Giant process id '%s'\n", pidStr);
+      return NULL;
+   }
+
+   cmdFd = open(cmdFilePath, O_RDONLY);
+   if (-1 == cmdFd) {
+      /*
+       * We may not be able to open the file due to the security reason.
+       * In that case, just ignore and continue.
+       */
+      return NULL;
+   }
+
+   /*
+    * Read in the command and its arguments.  Arguments are separated
+    * by \0, which we convert to ' '.  Then we add a NULL terminator
+    * at the end.  Example: "perl -cw try.pl" is read in as
+    * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
+    * It would have been nice to preserve the NUL character so it is easy
+    * to determine what the command line arguments are without
+    * using a quote and space parsing heuristic.  But we do this
+    * to have parity with how Windows reports the command line.
+    * In the future, we could keep the NUL version around and pass it
+    * back to the client for easier parsing when retrieving individual
+    * command line parameters is needed.
+    */
+   numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
+   close(cmdFd);
+
+   if (numRead < 0) {
+      return NULL;
+   }
+
+   if (NULL != cached && cached->rawCmdLineLen == numRead &&
+       (0 == numRead ||
+        0 == memcmp(cached->rawCmdLine, cmdLineTemp, numRead))) {
+      free(cmdLineTemp);
+      return cached;
+   }
+
+   entry = Util_SafeCalloc(1, sizeof *entry);
+   entry->rawCmdLineLen = numRead;
+   if (numRead > 0) {
+      entry->rawCmdLine = Util_SafeMalloc(numRead);
+      memcpy(entry->rawCmdLine, cmdLineTemp, numRead);
+   }
+
+   if (numRead > 0) {
+      /*
+       * Stop before we hit the final '\0'; want to leave it alone.
+       */
+      for (replaceLoop = 0 ; replaceLoop < (numRead - 1) ; replaceLoop++) {
+         if ('\0' == cmdLineTemp[replaceLoop]) {
+            if (cmdNameLookup) {
+               /*
+                * Store the command name.
+                * Find the last path separator, to get the cmd name.
+                * If no separator is found, then use the whole name.
+                */
+               cmdNameBegin = strrchr(cmdLineTemp, '/');
+               if (NULL == cmdNameBegin) {
+                  cmdNameBegin = cmdLineTemp;
+               } else {
+                  /*
+                   * Skip over the last separator.
+                   */
+                  cmdNameBegin++;
+               }
+               entry->cmdName = Unicode_Alloc(cmdNameBegin,
+                                              STRING_ENCODING_DEFAULT);
+               cmdNameLookup = FALSE;
+            }
+            cmdLineTemp[replaceLoop] = ' ';
+         }
+      }
+      entry->cmdLine = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+   } else {
+      /*
+       * Some procs don't have a command line text, so read a name from
+       * the 'status' file (should be the first line). If unable to get a name,
+       * the process is still real, so it should be included in the list, just
+       * without a name.
+       */
+      cmdFd = -1;
+      numRead = 0;
+
+      if (snprintf(cmdFilePath,
+                   sizeof cmdFilePath,
+                   "/proc/%s/status",
+                   pidStr) != -1) {
+         cmdFd = open(cmdFilePath, O_RDONLY);
+      }
+      if (cmdFd != -1) {
+         numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
+         close(cmdFd);
+      }
+      if (numRead > 0) {
+         /*
+          * Extract the part with just the name, by reading until the first
+          * space, then reading the next non-space word after that, and
+          * ignoring everything else. The format looks like this:
+          *     "^Name:[ \t]*(.*)$"
+          * for example:
+          *     "Name:    nfsd"
+          */
+         const char *nameStart;
+         char *copyItr;
+
+         /* Skip non-whitespace. */
+         for (nameStart = cmdLineTemp; *nameStart &&
+                                       *nameStart != ' ' &&
+                                       *nameStart != '\t' &&
+                                       *nameStart != '\n'; ++nameStart);
+         /* Skip whitespace. */
+         for (;*nameStart &&
+               (*nameStart == ' ' ||
+                *nameStart == '\t' ||
+                *nameStart == '\n'); ++nameStart);
+         /* Copy the name to the start of the string and null term it. */
+         for (copyItr = cmdLineTemp; *nameStart && *nameStart != '\n';) {
+            *(copyItr++) = *(nameStart++);
+         }
+         *copyItr = '\0';
+         /*
+          * Store the command name.
+          */
+         entry->cmdName = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+      }
+      entry->cmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
+   }
+
+   free(cmdLineTemp);
+
+   return entry;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrListProcess --
+ *
+ *      Examine /proc/<pid> and, if it passes the filter, add it to the
+ *      process list.  Process information is taken from oldCache if the
+ *      process has not changed since it was cached, and the (possibly
+ *      refreshed) entry is moved to newCache.
+ *
+ * Results:
+ *      FALSE if out of memory, TRUE otherwise (including when the process
+ *      is skipped).
+ *
+ * Side effects:
+ *      Updates the caches.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrListProcess(const char *pidStr,                // IN
+                   const ProcMgrProcFilter *filter,   // IN/OPT
+                   time_t hostStartTime,              // IN
+                   unsigned long long hertz,          // IN
+                   HashTable *oldCache,               // IN/OUT
+                   HashTable *newCache,               // IN/OUT
+                   ProcMgrProcInfoArray *procList)    // IN/OUT
+{
+   ProcMgrProcInfo procInfo;
+   ProcMgrCachedProc *entry = NULL;
+   ProcMgrCachedProc *newEntry;
+   struct stat fileStat;
+   char cmdFilePath[1024];
+   char *cmdStatTemp = NULL;
+   char *nameBegin;
+   char *nameEnd;
+   int cmdFd;
+   int numRead;
+   int numberFound;
+   unsigned long long relativeStartTime;
+   const char *owner;
+   pid_t pid = (pid_t) atoi(pidStr);
+   Bool ok = TRUE;
+
+   /*
+    * Get the inode information for this process.  This gives us
+    * the process owner.
+    */
+   if (snprintf(cmdFilePath,
+                sizeof cmdFilePath,
+                "/proc/%s",
+                pidStr) == -1) {
+      Debug("Giant process id '%s'\n", pidStr);
+      goto next_entry;
+   }
+
+   /*
+    * stat() /proc/<pid> to get the owner.  If we can't stat(), ignore and
+    * continue.  Maybe we don't have enough permission.
+    */
+   if (0 != stat(cmdFilePath, &fileStat)) {
+      goto next_entry;
+   }
+
+   owner = ProcMgrLookupUserName(fileStat.st_uid);
+   if (!ProcMgrProcFilterMatches(filter, pid, owner)) {
+      goto next_entry;
+   }
+
+   /*
+    * Figure out the process start time.  Open /proc/<pid>/stat
+    * and read the start time and compute it in absolute time.
+    */
+   if (snprintf(cmdFilePath,
+                sizeof cmdFilePath,
+                "/proc/%s/stat",
+                pidStr) == -1) {
+      Debug("Giant process id '%s'\n", pidStr);
+      goto next_entry;
+   }
+   cmdFd = open(cmdFilePath, O_RDONLY);
+   if (-1 == cmdFd) {
+      goto next_entry;
+   }
+   numRead = ProcMgr_ReadProcFile(cmdFd, &cmdStatTemp);
+   close(cmdFd);
+   if (0 >= numRead) {
+      goto next_entry;
+   }
+
+   /*
+    * The process name follows the pid in parentheses: "123 (bash) [...]".
+    * The name itself may contain parentheses, so look for the last one.
+    */
+   nameBegin = strchr(cmdStatTemp, '(');
+   nameEnd = strrchr(cmdStatTemp, ')');
+   if (NULL == nameBegin || NULL == nameEnd || nameEnd < nameBegin) {
+      goto next_entry;
+   }
+   *nameEnd = '\0';
+   nameBegin++;
+
+   /*
+    * Skip the state and the 18 fields that follow it, up to the start time.
+    */
+   numberFound = sscanf(nameEnd + 1, " %*c %*d %*d %*d %*d %*d "
+                        "%*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d "
+                        "%*d %*d %llu",
+                        &relativeStartTime);
+   if (1 != numberFound) {
+      goto next_entry;
+   }
+
+   if (HashTable_LookupAndDelete(oldCache, (void *)(uintptr_t) pid,
+                                 (void **) &entry) &&
+       (entry->startTime != relativeStartTime ||
+        strcmp(entry->statName, nameBegin) != 0)) {
+      /* The pid was reused, or the process exec'd something else. */
+      ProcMgrFreeCachedProc(entry);
+      entry = NULL;
+   }
+
+   newEntry = ProcMgrReadCmdLine(pidStr, entry);
+   if (newEntry != entry) {
+      ProcMgrFreeCachedProc(entry);
+      entry = newEntry;
+      if (NULL == entry) {
+         goto next_entry;
+      }
+      entry->startTime = relativeStartTime;
+      entry->statName = Util_SafeStrdup(nameBegin);
+   }
+   HashTable_Insert(newCache, (void *)(uintptr_t) pid, entry);
+
+   procInfo.procId = pid;
+   procInfo.procCmdName = (NULL == entry->cmdName) ?
+                          NULL : Util_SafeStrdup(entry->cmdName);
+   procInfo.procCmdLine = Util_SafeStrdup(entry->cmdLine);
+   procInfo.procOwner = Util_SafeStrdup(owner);
+
+   /*
+    * Store the time that the process started.
+    */
+   procInfo.procStartTime = hostStartTime + (relativeStartTime / hertz);
+
+   /*
+    * Store the process info into the list buffer.
+    */
+   if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
+      Warning("%s: failed to expand DynArray - out of memory\n",
+              __FUNCTION__);
+      free(procInfo.procCmdName);
+      free(procInfo.procCmdLine);
+      free(procInfo.procOwner);
+      ok = FALSE;
+   }
+
+next_entry:
+   free(cmdStatTemp);
+
+   return ok;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -243,21 +783,50 @@ done:
 
 ProcMgrProcInfoArray *
 ProcMgr_ListProcesses(void)
+{
+   return ProcMgr_ListProcessesEx(NULL);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcessesEx --
+ *
+ *      List the processes that the calling client has privilege to
+ *      enumerate and that match the given filter.
+ *
+ *      If the filter names specific pids only those /proc entries are
+ *      examined; otherwise all of /proc is scanned.  Only processes that
+ *      are new (or have exec'd or changed their arguments) since the
+ *      previous call have their command line converted again.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray, which is empty if a filter was given and
+ *      no process matched it.  NULL on failure.
+ *
+ * Side effects:
+ *
+ *      Updates the process and user name caches.
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesEx(const ProcMgrProcFilter *filter)  // IN/OPT
 {
    ProcMgrProcInfoArray *procList = NULL;
-   ProcMgrProcInfo procInfo;
    Bool failed = TRUE;
-   DIR *dir;
+   DIR *dir = NULL;
    struct dirent *ent;
+   HashTable *newCache;
    static time_t hostStartTime = 0;
    static unsigned long long hertz = 100;
    int numberFound;
 
    procList = Util_SafeCalloc(1, sizeof *procList);
    ProcMgrProcInfoArray_Init(procList, 0);
-   procInfo.procCmdName = NULL;
-   procInfo.procCmdLine = NULL;
-   procInfo.procOwner = NULL;
 
    /*
     * Figure out when the system started.  We need this number to
@@ -313,278 +882,83 @@ ProcMgr_ListProcesses(void)
 #endif
    } // if (0 == hostStartTime)
 
-   /*
-    * Scan /proc for any directory that is all numbers.
-    * That represents a process id.
-    */
-   dir = opendir("/proc");
-   if (NULL == dir) {
-      Warning("ProcMgr_ListProcesses unable to open /proc\n");
-      goto abort;
+   ProcMgrRefreshUserCache();
+   if (NULL == procMgrProcCache) {
+      procMgrProcCache = HashTable_Alloc(PROCMGR_PROC_CACHE_MIN_SIZE,
+                                         HASH_INT_KEY,
+                                         ProcMgrFreeCachedProc);
    }
 
-   while ((ent = readdir(dir))) {
-      struct stat fileStat;
-      char cmdFilePath[1024];
-      int statResult;
-      int numRead = 0;   /* number of bytes that read() actually read */
-      int cmdFd;
-      int replaceLoop;
-      struct passwd *pwd;
-      char *cmdLineTemp = NULL;
-      char *cmdStatTemp = NULL;
-      size_t strLen = 0;
-      unsigned long long dummy;
-      unsigned long long relativeStartTime;
-      char *stringBegin;
-      char *cmdNameBegin;
-      Bool cmdNameLookup = TRUE;
+   if (NULL != filter && filter->numPids > 0) {
+      size_t i;
 
       /*
-       * We only care about dirs that look like processes.
+       * Only look at the requested pids.  The cache is updated in place
+       * since the other entries were not revalidated.
        */
-      if (strspn(ent->d_name, "0123456789") != strlen(ent->d_name)) {
-         continue;
-      }
-
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/cmdline",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         continue;
-      }
-
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         /*
-          * We may not be able to open the file due to the security reason.
-          * In that case, just ignore and continue.
-          */
-         continue;
-      }
-
-      /*
-       * Read in the command and its arguments.  Arguments are separated
-       * by \0, which we convert to ' '.  Then we add a NULL terminator
-       * at the end.  Example: "perl -cw try.pl" is read in as
-       * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
-       * It would have been nice to preserve the NUL character so it is easy
-       * to determine what the command line arguments are without
-       * using a quote and space parsing heuristic.  But we do this
-       * to have parity with how Windows reports the command line.
-       * In the future, we could keep the NUL version around and pass it
-       * back to the client for easier parsing when retrieving individual
-       * command line parameters is needed.
-       */
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-      close(cmdFd);
-
-      if (numRead < 0) {
-         continue;
-      }
+      newCache = procMgrProcCache;
+      for (i = 0; i < filter->numPids; i++) {
+         char pidStr[32];
 
-      if (numRead > 0) {
-         /*
-          * Stop before we hit the final '\0'; want to leave it alone.
-          */
-         for (replaceLoop = 0 ; replaceLoop < (numRead - 1) ; replaceLoop++) {
-            if ('\0' == cmdLineTemp[replaceLoop]) {
-               if (cmdNameLookup) {
-                  /*
-                   * Store the command name.
-                   * Find the last path separator, to get the cmd name.
-                   * If no separator is found, then use the whole name.
-                   */
-                  cmdNameBegin = strrchr(cmdLineTemp, '/');
-                  if (NULL == cmdNameBegin) {
-                     cmdNameBegin = cmdLineTemp;
-                  } else {
-                     /*
-                      * Skip over the last separator.
-                      */
-                     cmdNameBegin++;
-                  }
-                  procInfo.procCmdName = Unicode_Alloc(cmdNameBegin, STRING_ENCODING_DEFAULT);
-                  cmdNameLookup = FALSE;
-               }
-               cmdLineTemp[replaceLoop] = ' ';
-            }
-         }
-      } else {
-         /*
-          * Some procs don't have a command line text, so read a name from
-          * the 'status' file (should be the first line). If unable to get a name,
-          * the process is still real, so it should be included in the list, just
-          * without a name.
-          */
-         cmdFd = -1;
-         numRead = 0;
-
-         if (snprintf(cmdFilePath,
-                      sizeof cmdFilePath,
-                      "/proc/%s/status",
-                      ent->d_name) != -1) {
-            cmdFd = open(cmdFilePath, O_RDONLY);
-         }
-         if (cmdFd != -1) {
-            numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-            close(cmdFd);
-         }
-         if (numRead > 0) {
-            /*
-             * Extract the part with just the name, by reading until the first
-             * space, then reading the next non-space word after that, and
-             * ignoring everything else. The format looks like this:
-             *     "^Name:[ \t]*(.*)$"
-             * for example:
-             *     "Name:    nfsd"
-             */
-            const char *nameStart;
-            char *copyItr;
-
-            /* Skip non-whitespace. */
-            for (nameStart = cmdLineTemp; *nameStart &&
-                                          *nameStart != ' ' &&
-                                          *nameStart != '\t' &&
-                                          *nameStart != '\n'; ++nameStart);
-            /* Skip whitespace. */
-            for (;*nameStart &&
-                  (*nameStart == ' ' ||
-                   *nameStart == '\t' ||
-                   *nameStart == '\n'); ++nameStart);
-            /* Copy the name to the start of the string and null term it. */
-            for (copyItr = cmdLineTemp; *nameStart && *nameStart != '\n';) {
-               *(copyItr++) = *(nameStart++);
-            }
-            *copyItr = '\0';
-            /*
-             * Store the command name.
-             */
-            procInfo.procCmdName = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
+         Str_Sprintf(pidStr, sizeof pidStr, "%d", (int) filter->pids[i]);
+         if (!ProcMgrListProcess(pidStr, filter, hostStartTime, hertz,
+                                 procMgrProcCache, newCache, procList)) {
+            goto abort;
          }
       }
+   } else {
+      uint32 cacheSize = PROCMGR_PROC_CACHE_MIN_SIZE;
 
       /*
-       * Get the inode information for this process.  This gives us
-       * the process owner.
+       * Scan /proc for any directory that is all numbers.
+       * That represents a process id.
        */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
+      dir = opendir("/proc");
+      if (NULL == dir) {
+         Warning("ProcMgr_ListProcesses unable to open /proc\n");
+         goto abort;
       }
 
       /*
-       * stat() /proc/<pid> to get the owner.  We use fileStat.st_uid
-       * later in this code.  If we can't stat(), ignore and continue.
-       * Maybe we don't have enough permission.
+       * Live processes are moved to a new cache, so whatever is left in
+       * the old one belongs to processes that have exited.
        */
-      statResult = stat(cmdFilePath, &fileStat);
-      if (0 != statResult) {
-         goto next_entry;
+      while (cacheSize < HashTable_GetNumElements(procMgrProcCache)) {
+         cacheSize <<= 1;
       }
+      newCache = HashTable_Alloc(cacheSize, HASH_INT_KEY,
+                                 ProcMgrFreeCachedProc);
 
-      /*
-       * Figure out the process start time.  Open /proc/<pid>/stat
-       * and read the start time and compute it in absolute time.
-       */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/stat",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         goto next_entry;
-      }
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdStatTemp);
-      close(cmdFd);
-      if (0 >= numRead) {
-         goto next_entry;
-      }
-      /*
-       * Skip over initial process id and process name.  "123 (bash) [...]".
-       */
-      stringBegin = strchr(cmdStatTemp, ')') + 2;
-
-      numberFound = sscanf(stringBegin, "%c %d %d %d %d %d "
-                           "%lu %lu %lu %lu %lu %Lu %Lu %Lu %Lu %ld %ld "
-                           "%d %ld %Lu",
-                           (char *) &dummy, (int *) &dummy, (int *) &dummy,
-                           (int *) &dummy, (int *) &dummy,  (int *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (long *) &dummy, (long *) &dummy,
-                           (int *) &dummy, (long *) &dummy,
-                           &relativeStartTime);
-      if (20 != numberFound) {
-         goto next_entry;
-      }
+      while ((ent = readdir(dir))) {
+         /*
+          * We only care about dirs that look like processes.
+          */
+         if (strspn(ent->d_name, "0123456789") != strlen(ent->d_name)) {
+            continue;
+         }
 
-      /*
-       * Store the command line string pointer in dynbuf.
-       */
-      if (cmdLineTemp) {
-         procInfo.procCmdLine = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-      } else {
-         procInfo.procCmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
+         if (!ProcMgrListProcess(ent->d_name, filter, hostStartTime, hertz,
+                                 procMgrProcCache, newCache, procList)) {
+            break;
+         }
       }
 
-      /*
-       * Store the pid in dynbuf.
-       */
-      procInfo.procId = (pid_t) atoi(ent->d_name);
-
-      /*
-       * Store the owner of the process.
-       */
-      pwd = getpwuid(fileStat.st_uid);
-      procInfo.procOwner = (NULL == pwd)
-                           ? Str_SafeAsprintf(&strLen, "%d", (int) fileStat.st_uid)
-                           : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
+      HashTable_Free(procMgrProcCache);
+      procMgrProcCache = newCache;
 
-      /*
-       * Store the time that the process started.
-       */
-      procInfo.procStartTime = hostStartTime + (relativeStartTime / hertz);
-
-      /*
-       * Store the process info pointer into a list buffer.
-       */
-      if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
-         Warning("%s: failed to expand DynArray - out of memory\n",
-                 __FUNCTION__);
+      if (NULL != ent) {
          goto abort;
       }
-      procInfo.procCmdName = NULL;
-      procInfo.procCmdLine = NULL;
-      procInfo.procOwner = NULL;
-
-next_entry:
-      free(cmdLineTemp);
-      free(cmdStatTemp);
-   } // while readdir
+   }
 
-   if (0 < ProcMgrProcInfoArray_Count(procList)) {
+   if (NULL != filter || 0 < ProcMgrProcInfoArray_Count(procList)) {
       failed = FALSE;
    }
 
 abort:
-   closedir(dir);
-
-   free(procInfo.procCmdName);
-   free(procInfo.procCmdLine);
-   free(procInfo.procOwner);
+   if (NULL != dir) {
+      closedir(dir);
+   }
 
    if (failed) {
       ProcMgr_FreeProcList(procList);
@@ -1157,6 +1531,57 @@ abort:
 }
 #endif // defined(__APPLE__)
 
+#if !defined(__linux__)
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcessesEx --
+ *
+ *      List the processes that the calling client has privilege to
+ *      enumerate and that match the given filter.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray, which is empty if a filter was given and
+ *      no process matched it.  NULL on failure.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesEx(const ProcMgrProcFilter *filter)  // IN/OPT
+{
+   ProcMgrProcInfoArray *procList = ProcMgr_ListProcesses();
+   size_t procCount;
+   size_t i;
+   size_t j;
+
+   if (NULL == procList || NULL == filter) {
+      return procList;
+   }
+
+   procCount = ProcMgrProcInfoArray_Count(procList);
+   for (i = 0, j = 0; i < procCount; i++) {
+      ProcMgrProcInfo *procInfo = ProcMgrProcInfoArray_AddressOf(procList, i);
+
+      if (ProcMgrProcFilterMatches(filter, procInfo->procId,
+                                   procInfo->procOwner)) {
+         *ProcMgrProcInfoArray_AddressOf(procList, j++) = *procInfo;
+      } else {
+         free(procInfo->procCmdName);
+         free(procInfo->procCmdLine);
+         free(procInfo->procOwner);
+      }
+   }
+   ProcMgrProcInfoArray_SetCount(procList, j);
+
+   return procList;
+}
+#endif // !defined(__linux__)
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -301,6 +301,15 @@ RpcOut_stop(RpcOut *out) // IN
    ASSERT(out != NULL);
 
    if (out->started) {
+      Message_Stats stats;
+
+      Message_GetStats(&out->channel, &stats);
+      if (stats.lbTransfers > 0) {
+         Debug("RpcOut: channel moved %"FMT64"u bytes in %"FMT64"u backdoor "
+               "calls without the high-bandwidth port\n",
+               stats.bytesSent + stats.bytesReceived, stats.backdoorCalls);
+      }
+
       /* Try to close the channel */
       if (Message_CloseAllocated(&out->channel) == FALSE) {
          Debug("RpcOut: couldn't close channel\n");
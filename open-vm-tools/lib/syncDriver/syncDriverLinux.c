@@ -21,19 +21,31 @@
  *
  * A sync driver backend that uses the Linux "FIFREEZE" and "FITHAW" ioctls
  * to freeze and thaw file systems.
+ *
+ * All the requested paths are opened concurrently before anything is frozen,
+ * so that a slow open() (e.g. on a stale mount) does not happen while other
+ * file systems are already frozen. The file systems are then frozen in
+ * "waves", keeping the order given by the caller. Consecutive file systems
+ * are put in the same wave, and frozen in parallel, only when sysfs shows
+ * that they share no underlying block device; all others are frozen one at
+ * a time. Thawing walks the waves in the opposite direction.
  */
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <linux/fs.h>
+#include <linux/major.h>
 #include <sys/ioctl.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include "vmware.h"
 #include "debug.h"
-#include "dynbuf.h"
+#include "log.h"
 #include "syncDriverInt.h"
 
 /* Out toolchain headers are somewhat outdated and don't define these. */
@@ -42,14 +54,325 @@
 #  define FITHAW          _IOWR('X', 120, int)    /* Thaw */
 #endif
 
+#if !defined(LOOP_MAJOR)
+#  define LOOP_MAJOR      7
+#endif
+
+/* Upper bound on the threads used to open, freeze and thaw concurrently. */
+#define LINUX_FI_MAX_THREADS     8
+
+/* Bound on the block device stacking followed by LinuxFiCollectDeps(). */
+#define LINUX_FI_MAX_DEP_DEPTH   16
+
+/*
+ * Time allowed for opening and freezing all the file systems. When it
+ * expires, whatever was frozen is thawed again and the freeze fails instead
+ * of leaving applications stunned for an unbounded amount of time.
+ */
+#define LINUX_FI_DEADLINE_MS     (30 * 1000)
+
+typedef enum {
+   LINUX_FI_OPEN,
+   LINUX_FI_FREEZE,
+   LINUX_FI_THAW,
+} LinuxFiOp;
+
+struct LinuxFiJob;
+
+typedef struct LinuxFiTarget {
+   struct LinuxFiJob *job;
+   char       *path;
+   int         fd;
+   dev_t       dev;
+   Bool        isDir;
+   Bool        frozen;
+   Bool        busy;        // Queued on, or running in, the thread pool.
+   LinuxFiOp   op;
+   guint       wave;
+   int         openErr;     // errno values, 0 on success.
+   int         statErr;
+   int         freezeErr;
+   int         thawErr;
+   gint64      openUs;      // Latencies, -1 if not attempted.
+   gint64      freezeUs;
+   gint64      thawUs;
+} LinuxFiTarget;
+
+/*
+ * State shared with the worker threads. It is reference counted because a
+ * worker stuck in open() or ioctl() may outlive the driver handle once the
+ * freeze deadline has expired.
+ */
+typedef struct LinuxFiJob {
+   gint            refCount;
+   GMutex          lock;
+   GCond           cond;
+   guint           pending;
+   Bool            abandoned;
+   size_t          count;
+   LinuxFiTarget  *targets;
+} LinuxFiJob;
+
+
 
 typedef struct LinuxDriver {
-   SyncHandle  driver;
-   size_t      fdCnt;
-   int        *fds;
+   SyncHandle     driver;
+   GThreadPool   *pool;
+   LinuxFiJob    *job;
+   guint          waveCnt;
 } LinuxDriver;
 
 
+/*
+ *******************************************************************************
+ * LinuxFiJobUnref --                                                     */ /**
+ *
+ * Drops a reference to the job, freeing it when the last one goes away. All
+ * file descriptors must have been closed by then.
+ *
+ * @param[in] job Job to release.
+ *
+ *******************************************************************************
+ */
+
+static void
+LinuxFiJobUnref(LinuxFiJob *job)
+{
+   if (g_atomic_int_dec_and_test(&job->refCount)) {
+      size_t i;
+
+      for (i = 0; i < job->count; i++) {
+         ASSERT(job->targets[i].fd == -1);
+         g_free(job->targets[i].path);
+      }
+      g_free(job->targets);
+      g_cond_clear(&job->cond);
+      g_mutex_clear(&job->lock);
+      g_free(job);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiWorker --                                                       */ /**
+ *
+ * Thread pool callback: performs the operation queued for a target and
+ * records its outcome and latency.
+ *
+ * If the caller stopped waiting for the job in the meantime (the freeze
+ * deadline expired), nobody else will look at the target any more. Opens and
+ * freezes that had not started yet are skipped, so no file system gets frozen
+ * after the caller reported failure, and the worker undoes whatever it did
+ * already: a file system it froze is thawed again and the file descriptor is
+ * closed.
+ *
+ * @param[in] data      The LinuxFiTarget.
+ * @param[in] userData  Unused.
+ *
+ *******************************************************************************
+ */
+
+static void
+LinuxFiWorker(gpointer data,
+              gpointer userData)
+{
+   LinuxFiTarget *target = data;
+   LinuxFiJob *job = target->job;
+   gint64 start = g_get_monotonic_time();
+   Bool abandoned;
+
+   g_mutex_lock(&job->lock);
+   abandoned = job->abandoned;
+   g_mutex_unlock(&job->lock);
+
+   if (abandoned && target->op != LINUX_FI_THAW) {
+      goto exit;
+   }
+
+   switch (target->op) {
+   case LINUX_FI_OPEN:
+      target->fd = open(target->path, O_RDONLY);
+      if (target->fd == -1) {
+         target->openErr = errno;
+      } else {
+         struct stat sbuf;
+
+         if (fstat(target->fd, &sbuf) == -1) {
+            target->statErr = errno;
+         } else {
+            target->dev = sbuf.st_dev;
+            target->isDir = S_ISDIR(sbuf.st_mode);
+         }
+      }
+      target->openUs = g_get_monotonic_time() - start;
+      break;
+
+   case LINUX_FI_FREEZE:
+      if (ioctl(target->fd, FIFREEZE) == -1) {
+         target->freezeErr = errno;
+      } else {
+         target->frozen = TRUE;
+      }
+      target->freezeUs = g_get_monotonic_time() - start;
+      break;
+
+   case LINUX_FI_THAW:
+      if (ioctl(target->fd, FITHAW) == -1) {
+         target->thawErr = errno;
+      }
+      target->frozen = FALSE;
+      target->thawUs = g_get_monotonic_time() - start;
+      break;
+   }
+
+exit:
+   g_mutex_lock(&job->lock);
+   target->busy = FALSE;
+   if (job->abandoned) {
+      if (target->frozen && ioctl(target->fd, FITHAW) == -1) {
+         Warning(LGPFX "failed to thaw '%s': %d (%s)\n",
+                 target->path, errno, strerror(errno));
+      }
+      target->frozen = FALSE;
+      if (target->fd != -1) {
+         close(target->fd);
+         target->fd = -1;
+      }
+   }
+   job->pending--;
+   g_cond_signal(&job->cond);
+   g_mutex_unlock(&job->lock);
+
+   LinuxFiJobUnref(job);
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiQueue --                                                        */ /**
+ *
+ * Queues an operation on a target to the driver's thread pool.
+ *
+ * @param[in] sync   The driver.
+ * @param[in] target Target to operate on.
+ * @param[in] op     Operation to perform.
+ *
+ *******************************************************************************
+ */
+
+static void
+LinuxFiQueue(LinuxDriver *sync,
+             LinuxFiTarget *target,
+             LinuxFiOp op)
+{
+   LinuxFiJob *job = sync->job;
+
+   target->op = op;
+   target->busy = TRUE;
+   g_atomic_int_inc(&job->refCount);
+
+   g_mutex_lock(&job->lock);
+   job->pending++;
+   g_mutex_unlock(&job->lock);
+
+   g_thread_pool_push(sync->pool, target, NULL);
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiWait --                                                         */ /**
+ *
+ * Waits for all the queued operations to complete.
+ *
+ * @param[in] job       The job.
+ * @param[in] deadline  Monotonic time after which to give up, 0 for none.
+ *
+ * @return TRUE if all operations completed, FALSE if the deadline expired.
+ *
+ *******************************************************************************
+ */
+
+static Bool
+LinuxFiWait(LinuxFiJob *job,
+            gint64 deadline)
+{
+   Bool done;
+
+   g_mutex_lock(&job->lock);
+   while (job->pending > 0) {
+      if (deadline == 0) {
+         g_cond_wait(&job->cond, &job->lock);
+      } else if (!g_cond_wait_until(&job->cond, &job->lock, deadline)) {
+         break;
+      }
+   }
+   done = job->pending == 0;
+   g_mutex_unlock(&job->lock);
+
+   return done;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiTrace --                                                        */ /**
+ *
+ * Logs one record per target for the given operation, with its latency and
+ * result, in a fixed "key=value" format so that freeze windows can be
+ * analyzed from the logs. Targets the operation was not attempted on, or
+ * that are still being worked on, are left out.
+ *
+ * @param[in] job The job.
+ * @param[in] op  Operation to report.
+ *
+ *******************************************************************************
+ */
+
+static void
+LinuxFiTrace(LinuxFiJob *job,
+             LinuxFiOp op)
+{
+   static const char *opNames[] = { "open", "freeze", "thaw" };
+   size_t i;
+
+   g_mutex_lock(&job->lock);
+   for (i = 0; i < job->count; i++) {
+      const LinuxFiTarget *target = &job->targets[i];
+      gint64 us;
+      int err;
+
+      if (target->busy) {
+         continue;
+      }
+
+      switch (op) {
+      case LINUX_FI_OPEN:
+         us = target->openUs;
+         err = target->openErr != 0 ? target->openErr : target->statErr;
+         break;
+
+      case LINUX_FI_FREEZE:
+         us = target->freezeUs;
+         err = target->freezeErr;
+         break;
+
+      default:
+         us = target->thawUs;
+         err = target->thawErr;
+         break;
+      }
+
+      if (us >= 0) {
+         Log(LGPFX "trace op=%s path=\"%s\" wave=%u us=%"FMT64"d err=%d\n",
+             opNames[op], target->path, target->wave, (int64) us, err);
+      }
+   }
+   g_mutex_unlock(&job->lock);
+}
+
+
 /*
  *******************************************************************************
  * LinuxFiThaw --                                                         */ /**
@@ -67,21 +390,41 @@ typedef struct LinuxDriver {
 static SyncDriverErr
 LinuxFiThaw(const SyncDriverHandle handle)
 {
-   size_t i;
    LinuxDriver *sync = (LinuxDriver *) handle;
+   LinuxFiJob *job = sync->job;
    SyncDriverErr err = SD_SUCCESS;
+   guint wave;
+   size_t i;
 
    /*
     * Thaw in the reverse order of freeze
     */
-   for (i = sync->fdCnt; i > 0; i--) {
-      Debug(LGPFX "Thawing fd=%d.\n", sync->fds[i-1]);
-      if (ioctl(sync->fds[i-1], FITHAW) == -1) {
-         Debug(LGPFX "Thaw failed for fd=%d.\n", sync->fds[i-1]);
-         err = SD_ERROR;
+   for (wave = sync->waveCnt; wave > 0; wave--) {
+      for (i = 0; i < job->count; i++) {
+         LinuxFiTarget *target = &job->targets[i];
+
+         if (target->frozen && target->wave == wave - 1) {
+            Debug(LGPFX "Thawing fd=%d.\n", target->fd);
+            target->thawErr = 0;
+            LinuxFiQueue(sync, target, LINUX_FI_THAW);
+         }
+      }
+
+      LinuxFiWait(job, 0);
+
+      for (i = 0; i < job->count; i++) {
+         LinuxFiTarget *target = &job->targets[i];
+
+         if (target->op == LINUX_FI_THAW && target->wave == wave - 1 &&
+             target->thawErr != 0) {
+            Debug(LGPFX "Thaw failed for fd=%d.\n", target->fd);
+            err = SD_ERROR;
+         }
       }
    }
 
+   LinuxFiTrace(job, LINUX_FI_THAW);
+
    return err;
 }
 
@@ -93,6 +436,10 @@ LinuxFiThaw(const SyncDriverHandle handle)
  * Closes the file descriptors used for freezing, and frees memory associated
  * with the handle.
  *
+ * File systems still frozen at this point are those of a freeze that ran
+ * past its deadline; they are thawed here. Targets a worker is still stuck
+ * on are left to that worker, see LinuxFiWorker().
+ *
  * @param[in] handle Handle to close.
  *
  *******************************************************************************
@@ -102,16 +449,46 @@ static void
 LinuxFiClose(SyncDriverHandle handle)
 {
    LinuxDriver *sync = (LinuxDriver *) handle;
+   LinuxFiJob *job = sync->job;
+   guint wave;
    size_t i;
 
+   g_mutex_lock(&job->lock);
+   job->abandoned = TRUE;
+
+   for (wave = sync->waveCnt; wave > 0; wave--) {
+      for (i = 0; i < job->count; i++) {
+         LinuxFiTarget *target = &job->targets[i];
+
+         if (!target->busy && target->frozen && target->wave == wave - 1) {
+            Debug(LGPFX "Thawing fd=%d.\n", target->fd);
+            if (ioctl(target->fd, FITHAW) == -1) {
+               Warning(LGPFX "failed to thaw '%s': %d (%s)\n",
+                       target->path, errno, strerror(errno));
+            }
+            target->frozen = FALSE;
+         }
+      }
+   }
+
    /*
     * Close in the reverse order of open
     */
-   for (i = sync->fdCnt; i > 0; i--) {
-      Debug(LGPFX "Closing fd=%d.\n", sync->fds[i-1]);
-      close(sync->fds[i-1]);
+   for (i = job->count; i > 0; i--) {
+      LinuxFiTarget *target = &job->targets[i - 1];
+
+      if (!target->busy && target->fd != -1) {
+         Debug(LGPFX "Closing fd=%d.\n", target->fd);
+         close(target->fd);
+         target->fd = -1;
+      }
    }
-   free(sync->fds);
+   g_mutex_unlock(&job->lock);
+
+   if (sync->pool != NULL) {
+      g_thread_pool_free(sync->pool, FALSE, FALSE);
+   }
+   LinuxFiJobUnref(job);
    free(sync);
 }
 
@@ -139,6 +516,250 @@ LinuxFiGetAttr(const SyncDriverHandle handle,   // IN (ignored)
 }
 
 
+/*
+ *******************************************************************************
+ * LinuxFiCollectDeps --                                                  */ /**
+ *
+ * Collects the block devices a file system depends on: its own device, the
+ * devices it is stacked on (/sys/dev/block/<dev>/slaves), and for loop
+ * devices the device holding the backing file, recursively.
+ *
+ * @param[in]  dev   Device to start from.
+ * @param[out] deps  Array of dev_t the devices are appended to.
+ * @param[in]  depth Current recursion depth.
+ *
+ * @return TRUE if the complete set of dependencies could be determined.
+ *
+ *******************************************************************************
+ */
+
+static Bool
+LinuxFiCollectDeps(dev_t dev,
+                   GArray *deps,
+                   guint depth)
+{
+   char *sysPath;
+   char *slavesPath;
+   GDir *dir;
+   Bool ok = TRUE;
+   guint i;
+
+   for (i = 0; i < deps->len; i++) {
+      if (g_array_index(deps, dev_t, i) == dev) {
+         return TRUE;
+      }
+   }
+   g_array_append_val(deps, dev);
+
+   /*
+    * Anonymous devices (major 0) are used by network and pseudo file
+    * systems, and by some multi-device ones such as btrfs; sysfs says
+    * nothing about what lies below them.
+    */
+   if (major(dev) == 0 || depth >= LINUX_FI_MAX_DEP_DEPTH) {
+      return FALSE;
+   }
+
+   sysPath = g_strdup_printf("/sys/dev/block/%u:%u", major(dev), minor(dev));
+   if (!g_file_test(sysPath, G_FILE_TEST_IS_DIR)) {
+      g_free(sysPath);
+      return FALSE;
+   }
+
+   if (major(dev) == LOOP_MAJOR) {
+      char *backingPath = g_build_filename(sysPath, "loop", "backing_file",
+                                           NULL);
+      char *backingFile = NULL;
+      struct stat st;
+
+      ok = g_file_get_contents(backingPath, &backingFile, NULL, NULL) &&
+           stat(g_strchomp(backingFile), &st) == 0 &&
+           LinuxFiCollectDeps(st.st_dev, deps, depth + 1);
+      g_free(backingFile);
+      g_free(backingPath);
+   }
+
+   /* Partitions and plain disks have no slaves directory. */
+   slavesPath = g_build_filename(sysPath, "slaves", NULL);
+   dir = ok ? g_dir_open(slavesPath, 0, NULL) : NULL;
+   if (dir != NULL) {
+      const char *name;
+
+      while (ok && (name = g_dir_read_name(dir)) != NULL) {
+         char *devPath = g_build_filename(slavesPath, name, "dev", NULL);
+         char *contents = NULL;
+         unsigned int devMajor;
+         unsigned int devMinor;
+
+         ok = g_file_get_contents(devPath, &contents, NULL, NULL) &&
+              sscanf(contents, "%u:%u", &devMajor, &devMinor) == 2 &&
+              LinuxFiCollectDeps(makedev(devMajor, devMinor), deps,
+                                 depth + 1);
+         g_free(contents);
+         g_free(devPath);
+      }
+      g_dir_close(dir);
+   }
+
+   g_free(slavesPath);
+   g_free(sysPath);
+   return ok;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiIndependent --                                                  */ /**
+ *
+ * Checks whether two sets of block devices, as returned by
+ * LinuxFiCollectDeps(), have no device in common.
+ *
+ * @param[in] a First set.
+ * @param[in] b Second set.
+ *
+ * @return TRUE if the sets are disjoint.
+ *
+ *******************************************************************************
+ */
+
+static Bool
+LinuxFiIndependent(const GArray *a,
+                   const GArray *b)
+{
+   guint i;
+   guint j;
+
+   for (i = 0; i < a->len; i++) {
+      for (j = 0; j < b->len; j++) {
+         if (g_array_index(a, dev_t, i) == g_array_index(b, dev_t, j)) {
+            return FALSE;
+         }
+      }
+   }
+   return TRUE;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiAssignWaves --                                                  */ /**
+ *
+ * Splits the open targets into waves that are frozen one after another.
+ *
+ * The caller's order is the dependency order (e.g. a loop-backed file system
+ * comes before the one holding its backing file), so waves never reorder
+ * targets. A target joins the wave of the targets just before it only when
+ * it is proven to share no block device with any of them, directly or
+ * through device stacking or loop backing files. Otherwise it starts a new
+ * wave, so anything that cannot be proven independent is frozen serially.
+ *
+ * @param[in] job The job.
+ *
+ * @return The number of waves.
+ *
+ *******************************************************************************
+ */
+
+static guint
+LinuxFiAssignWaves(LinuxFiJob *job)
+{
+   GArray **deps = g_new0(GArray *, job->count);
+   Bool *known = g_new0(Bool, job->count);
+   size_t waveStart = 0;
+   guint waveCnt = 0;
+   size_t i;
+   size_t j;
+
+   for (i = 0; i < job->count; i++) {
+      LinuxFiTarget *target = &job->targets[i];
+      Bool join;
+
+      if (target->fd == -1) {
+         continue;
+      }
+
+      deps[i] = g_array_new(FALSE, FALSE, sizeof (dev_t));
+      known[i] = LinuxFiCollectDeps(target->dev, deps[i], 0);
+
+      join = waveCnt > 0 && known[i];
+      for (j = waveStart; join && j < i; j++) {
+         if (job->targets[j].fd != -1 &&
+             (!known[j] || !LinuxFiIndependent(deps[j], deps[i]))) {
+            join = FALSE;
+         }
+      }
+
+      if (join) {
+         target->wave = waveCnt - 1;
+      } else {
+         target->wave = waveCnt++;
+         waveStart = i;
+      }
+   }
+
+   for (i = 0; i < job->count; i++) {
+      if (deps[i] != NULL) {
+         g_array_free(deps[i], TRUE);
+      }
+   }
+   g_free(deps);
+   g_free(known);
+
+   return waveCnt;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxFiCheckFreeze --                                                  */ /**
+ *
+ * Evaluates the outcome of freezing a target. Targets that could not be
+ * frozen for a benign reason are closed and skipped.
+ *
+ * @param[in] target Target that was frozen.
+ * @param[in] first  Whether this was the first freeze attempted.
+ *
+ * @return A SyncDriverErr.
+ *
+ *******************************************************************************
+ */
+
+static SyncDriverErr
+LinuxFiCheckFreeze(LinuxFiTarget *target,
+                   Bool first)
+{
+   int ioctlerr = target->freezeErr;
+
+   if (target->frozen) {
+      Debug(LGPFX "successfully froze '%s' (fd=%d).\n",
+            target->path, target->fd);
+      return SD_SUCCESS;
+   }
+
+   /*
+    * If the ioctl does not exist, Linux will return ENOTTY. If it's not
+    * supported on the device, we get EOPNOTSUPP. Ignore the latter,
+    * since freezing does not make sense for all fs types, and some
+    * Linux fs drivers may not have been hooked up in the running kernel.
+    *
+    * Also ignore EBUSY since we may try to freeze the same superblock
+    * more than once depending on the OS configuration (e.g., usage of
+    * bind mounts).
+    */
+   close(target->fd);
+   target->fd = -1;
+   Debug(LGPFX "freeze on '%s' returned: %d (%s)\n",
+         target->path, ioctlerr, strerror(ioctlerr));
+   if (ioctlerr != EBUSY && ioctlerr != EOPNOTSUPP) {
+      Debug(LGPFX "failed to freeze '%s': %d (%s)\n",
+            target->path, ioctlerr, strerror(ioctlerr));
+      return first && ioctlerr == ENOTTY ? SD_UNAVAILABLE : SD_ERROR;
+   }
+
+   return SD_SUCCESS;
+}
+
+
 /*
  *******************************************************************************
  * LinuxDriver_Freeze --                                                  */ /**
@@ -150,8 +771,9 @@ LinuxFiGetAttr(const SyncDriverHandle handle,   // IN (ignored)
  *
  * NOTE: This function performs two system calls open() and ioctl(). We have
  * seen open() being slow with NFS mount points at times and ioctl() being
- * slow when guest is performing significant IO. Therefore, caller should
- * consider running this function in a separate thread.
+ * slow when guest is performing significant IO. Both are issued from a thread
+ * pool and the whole operation is bounded by LINUX_FI_DEADLINE_MS, but the
+ * caller should still consider running this function in a separate thread.
  *
  * @param[in]  paths    List of paths to freeze.
  * @param[out] handle   Handle to use for thawing.
@@ -165,13 +787,17 @@ SyncDriverErr
 LinuxDriver_Freeze(const GSList *paths,
                    SyncDriverHandle *handle)
 {
-   ssize_t count = 0;
-   Bool first = TRUE;
-   DynBuf fds;
+   gint64 deadline = g_get_monotonic_time() +
+                     (gint64) LINUX_FI_DEADLINE_MS * 1000;
    LinuxDriver *sync = NULL;
+   LinuxFiJob *job;
+   LinuxFiTarget *probe = NULL;
    SyncDriverErr err = SD_SUCCESS;
-
-   DynBuf_Init(&fds);
+   Bool timedOut = FALSE;
+   guint frozenCnt = 0;
+   guint wave;
+   size_t i;
+   size_t j;
 
    Debug(LGPFX "Freezing using Linux ioctls...\n");
 
@@ -189,20 +815,53 @@ LinuxDriver_Freeze(const GSList *paths,
     */
    VERIFY(paths != NULL);
 
+   job = g_new0(LinuxFiJob, 1);
+   job->refCount = 1;
+   g_mutex_init(&job->lock);
+   g_cond_init(&job->cond);
+   job->count = g_slist_length((GSList *) paths);
+   job->targets = g_new0(LinuxFiTarget, job->count);
+   for (i = 0; paths != NULL; i++, paths = g_slist_next(paths)) {
+      LinuxFiTarget *target = &job->targets[i];
+
+      target->job = job;
+      target->path = g_strdup(paths->data);
+      target->fd = -1;
+      target->openUs = -1;
+      target->freezeUs = -1;
+      target->thawUs = -1;
+   }
+   sync->job = job;
+   sync->pool = g_thread_pool_new(LinuxFiWorker, NULL,
+                                  MIN(job->count, LINUX_FI_MAX_THREADS),
+                                  FALSE, NULL);
+   if (sync->pool == NULL) {
+      err = SD_ERROR;
+      goto exit;
+   }
+
    /*
-    * Iterate through the requested paths. If we get an error for the first
-    * path, and it's not EPERM, assume that the ioctls are not available in
-    * the current kernel.
+    * Open all the paths before freezing anything, so that a slow open()
+    * does not extend the time during which file systems are frozen.
     */
-   while (paths != NULL) {
-      int fd;
-      struct stat sbuf;
-      const char *path = paths->data;
-      Debug(LGPFX "opening path '%s'.\n", path);
-      paths = g_slist_next(paths);
-      fd = open(path, O_RDONLY);
-      if (fd == -1) {
-         switch (errno) {
+   for (i = 0; i < job->count; i++) {
+      Debug(LGPFX "opening path '%s'.\n", job->targets[i].path);
+      LinuxFiQueue(sync, &job->targets[i], LINUX_FI_OPEN);
+   }
+
+   if (!LinuxFiWait(job, deadline)) {
+      Warning(LGPFX "timed out opening the file systems to freeze.\n");
+      err = SD_ERROR;
+      timedOut = TRUE;
+      goto exit;
+   }
+
+   for (i = 0; i < job->count; i++) {
+      LinuxFiTarget *target = &job->targets[i];
+      const char *path = target->path;
+
+      if (target->fd == -1) {
+         switch (target->openErr) {
          case ENOENT:
             /*
              * We sometimes get stale mountpoints or special mountpoints
@@ -238,75 +897,122 @@ LinuxDriver_Freeze(const GSList *paths,
 
          default:
             Debug(LGPFX "failed to open '%s': %d (%s)\n",
-                  path, errno, strerror(errno));
+                  path, target->openErr, strerror(target->openErr));
             err = SD_ERROR;
             goto exit;
          }
       }
 
-      if (fstat(fd, &sbuf) == -1) {
-         close(fd);
+      if (target->statErr != 0) {
          Debug(LGPFX "failed to stat '%s': %d (%s)\n",
-               path, errno, strerror(errno));
+               path, target->statErr, strerror(target->statErr));
          err = SD_ERROR;
          goto exit;
       }
 
-      if (!S_ISDIR(sbuf.st_mode)) {
-         close(fd);
+      if (!target->isDir) {
+         close(target->fd);
+         target->fd = -1;
          Debug(LGPFX "Skipping a non-directory path '%s'.\n", path);
          continue;
       }
 
-      Debug(LGPFX "freezing path '%s' (fd=%d).\n", path, fd);
-      if (ioctl(fd, FIFREEZE) == -1) {
-         int ioctlerr = errno;
-         /*
-          * If the ioctl does not exist, Linux will return ENOTTY. If it's not
-          * supported on the device, we get EOPNOTSUPP. Ignore the latter,
-          * since freezing does not make sense for all fs types, and some
-          * Linux fs drivers may not have been hooked up in the running kernel.
-          *
-          * Also ignore EBUSY since we may try to freeze the same superblock
-          * more than once depending on the OS configuration (e.g., usage of
-          * bind mounts).
-          */
-         close(fd);
-         Debug(LGPFX "freeze on '%s' returned: %d (%s)\n",
-               path, ioctlerr, strerror(ioctlerr));
-         if (ioctlerr != EBUSY && ioctlerr != EOPNOTSUPP) {
-            Debug(LGPFX "failed to freeze '%s': %d (%s)\n",
-                  path, ioctlerr, strerror(ioctlerr));
-            err = first && ioctlerr == ENOTTY ? SD_UNAVAILABLE : SD_ERROR;
+      /*
+       * Freeze each file system only once, even if it is mounted at several
+       * places, rather than racing parallel freezes of the same superblock.
+       */
+      for (j = 0; j < i; j++) {
+         if (job->targets[j].fd != -1 &&
+             job->targets[j].dev == target->dev) {
             break;
          }
-      } else {
-         Debug(LGPFX "successfully froze '%s' (fd=%d).\n", path, fd);
-         if (!DynBuf_Append(&fds, &fd, sizeof fd)) {
-            if (ioctl(fd, FITHAW) == -1) {
-               Warning(LGPFX "failed to thaw '%s': %d (%s)\n",
-                       path, errno, strerror(errno));
-            }
-            close(fd);
-            err = SD_ERROR;
-            break;
+      }
+      if (j < i) {
+         close(target->fd);
+         target->fd = -1;
+         Debug(LGPFX "'%s' is on the same file system as '%s', skipping.\n",
+               path, job->targets[j].path);
+      }
+   }
+
+   sync->waveCnt = LinuxFiAssignWaves(job);
+
+   /*
+    * Freeze a single file system first: if that fails with ENOTTY, the ioctl
+    * is not available in the running kernel.
+    */
+   for (i = 0; i < job->count && probe == NULL; i++) {
+      if (job->targets[i].fd != -1 && job->targets[i].wave == 0) {
+         probe = &job->targets[i];
+      }
+   }
+
+   if (probe == NULL) {
+      goto exit;
+   }
+
+   Debug(LGPFX "freezing path '%s' (fd=%d).\n", probe->path, probe->fd);
+   LinuxFiQueue(sync, probe, LINUX_FI_FREEZE);
+   if (!LinuxFiWait(job, deadline)) {
+      Warning(LGPFX "timed out freezing the file systems.\n");
+      err = SD_ERROR;
+      timedOut = TRUE;
+      goto exit;
+   }
+   err = LinuxFiCheckFreeze(probe, TRUE);
+
+   for (wave = 0; wave < sync->waveCnt && err == SD_SUCCESS; wave++) {
+      for (i = 0; i < job->count; i++) {
+         LinuxFiTarget *target = &job->targets[i];
+
+         if (target != probe && target->fd != -1 && target->wave == wave) {
+            Debug(LGPFX "freezing path '%s' (fd=%d).\n",
+                  target->path, target->fd);
+            LinuxFiQueue(sync, target, LINUX_FI_FREEZE);
          }
-         count++;
       }
 
-      first = FALSE;
+      if (!LinuxFiWait(job, deadline)) {
+         Warning(LGPFX "timed out freezing the file systems.\n");
+         err = SD_ERROR;
+         timedOut = TRUE;
+         break;
+      }
+
+      for (i = 0; i < job->count; i++) {
+         LinuxFiTarget *target = &job->targets[i];
+
+         if (target != probe && target->op == LINUX_FI_FREEZE &&
+             target->wave == wave) {
+            SyncDriverErr targetErr = LinuxFiCheckFreeze(target, FALSE);
+
+            if (targetErr != SD_SUCCESS) {
+               err = targetErr;
+            }
+         }
+      }
    }
 
 exit:
-   sync->fds = DynBuf_Detach(&fds);
-   sync->fdCnt = count;
+   LinuxFiTrace(job, LINUX_FI_OPEN);
+   LinuxFiTrace(job, LINUX_FI_FREEZE);
 
    if (err != SD_SUCCESS) {
-      LinuxFiThaw(&sync->driver);
+      /*
+       * After a timeout some workers may still be stuck; LinuxFiClose()
+       * thaws what it safely can and leaves the rest to the workers.
+       */
+      if (!timedOut) {
+         LinuxFiThaw(&sync->driver);
+      }
       LinuxFiClose(&sync->driver);
    } else {
+      for (i = 0; i < job->count; i++) {
+         frozenCnt += job->targets[i].frozen ? 1 : 0;
+      }
+      Debug(LGPFX "froze %u file systems in %u waves.\n",
+            frozenCnt, sync->waveCnt);
       *handle = &sync->driver;
    }
    return err;
 }
-
@@ -27,6 +27,7 @@
 #error This file should not be compiled on this platform.
 #endif
 
+#include <errno.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #if defined(__linux__) || defined(sun)
@@ -44,6 +45,12 @@
 # endif /* __FreeBSD_version >= 500000 */
 #endif
 #include <unistd.h>
+#if defined(__linux__)
+# include <fcntl.h>
+# include <limits.h>
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
 
 #include "vmware.h"
 #include "wiper.h"
@@ -54,20 +61,39 @@
 #include "mntinfo.h"
 #include "posix.h"
 #include "util.h"
+#include "hostinfo.h"
 
 
-/* Number of bytes per disk sector */
-#define WIPER_SECTOR_SIZE 512
-
-/* Number of disk sectors to write per write system call.
+/*
+ * Wiper files are written with large aligned buffers, bypassing the page
+ * cache where the platform allows it, so that filling the disk does not
+ * evict the working set of the guest. Alignment covers 4 KB sector disks.
+ */
+#define WIPER_ALIGNMENT   4096
+#define WIPER_WRITE_MIN   (1 << 20)   /* 1 MB */
+#define WIPER_WRITE_MAX   (8 << 20)   /* 8 MB */
 
-   The bigger it is, the less calls we do and the faster we are.
+/*
+ * Amount of data written per call to Wiper_Next(). It is adapted after each
+ * call so that a call takes about WIPER_TARGET_US, which keeps cancellation
+ * responsive on slow disks while limiting the number of calls on fast ones.
+ */
+#define WIPER_QUANTUM_INIT   (2 << 20)     /* 2 MB */
+#define WIPER_QUANTUM_MAX    (256 << 20)   /* 256 MB */
+#define WIPER_TARGET_US      200000        /* 1/5 second */
 
-   This value has been empirically determined to give maximum performance.
+/*
+ * Disk space is an important system resource. Don't fill the partition
+ * completely.
+ */
+#define WIPER_MIN_FREE       (((uint64)5) << 20)   /* 5 MB */
 
---hpreg
-*/
-#define WIPER_SECTOR_STEP 128
+/*
+ * Number of bytes of the file system to discard per call to Wiper_Next().
+ * Discarding free space does not write any data, so this can be much larger
+ * than what is zeroed per call.
+ */
+#define WIPER_TRIM_STEP (((uint64)1) << 30) /* 1 GB */
 
 /* Number of device numbers to store for device-mapper */
 #define WIPER_MAX_DM_NUMBERS 8
@@ -81,6 +107,7 @@
 
 /* Types */
 typedef enum {
+   WIPER_PHASE_TRIM,
    WIPER_PHASE_CREATE,
    WIPER_PHASE_FILL,
 } WiperPhase;
@@ -102,10 +129,20 @@ typedef struct WiperState {
    File *f;
    /* Serial number of the next wiper file to create */
    unsigned int nr;
-   /*  Buffer to write in each sector of a wiper file */
-   unsigned char buf[WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE];
+   /* Zeroed buffer of WIPER_WRITE_MAX bytes, aligned for unbuffered IO */
+   unsigned char *buf;
+   /* Whether wiper files can be opened for unbuffered IO */
+   Bool unbuffered;
+   /* Bytes to write per call to Wiper_Next() */
+   uint64 quantum;
    /* Effective user id */
    uid_t euid;
+   /* Mount point opened to discard free space, -1 when not discarding */
+   int trimFd;
+   /* Offset in the file system of the next range to discard */
+   uint64 trimStart;
+   /* Per method statistics reported to the caller */
+   WiperStats stats;
 } WiperState;
 
 #ifdef sun
@@ -747,9 +784,16 @@ Wiper_Start(const WiperPartition *p,             // IN
             unsigned int maxWiperFileSize)       // IN : unused
 {
    WiperState *state;
+   uint64 total;
+   void *buf;
+
+   if (posix_memalign(&buf, WIPER_ALIGNMENT, WIPER_WRITE_MAX) != 0) {
+      return NULL;
+   }
 
    state = (WiperState *)malloc(sizeof *state);
    if (state == NULL) {
+      free(buf);
       return NULL;
    }
 
@@ -758,8 +802,33 @@ Wiper_Start(const WiperPartition *p,             // IN
    state->p = p;
    state->f = NULL;
    state->nr = 0;
-   memset(state->buf, 0, WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE);
+   state->buf = buf;
+   memset(state->buf, 0, WIPER_WRITE_MAX);
+   state->unbuffered = TRUE;
+   state->quantum = WIPER_QUANTUM_INIT;
    state->euid = geteuid();
+   state->trimFd = -1;
+   state->trimStart = 0;
+   memset(&state->stats, 0, sizeof state->stats);
+   state->stats.method = WIPER_METHOD_ZERO_FILL;
+   if (*WiperGetSpace(state, &state->stats.startFree, &total) != '\0') {
+      state->stats.startFree = 0;
+   }
+
+#if defined(__linux__) && defined(FITRIM)
+   /*
+    * Discarding the free space lets the virtual disk reclaim it without
+    * filling the partition. Fall back to zero-filling if the file system
+    * or the disk does not support it.
+    */
+   if (p->attemptUnmaps) {
+      state->trimFd = Posix_Open(p->mountPoint, O_RDONLY | O_DIRECTORY);
+      if (state->trimFd >= 0) {
+         state->phase = WIPER_PHASE_TRIM;
+         state->stats.method = WIPER_METHOD_TRIM;
+      }
+   }
+#endif
 
    return (void *)state;
 }
@@ -813,6 +882,10 @@ WiperClean(WiperState *state)      // IN/OUT
 {
    ASSERT(state);
 
+   if (state->trimFd >= 0) {
+      close(state->trimFd);
+   }
+
    while (state->f != NULL) {
       File *next;
 
@@ -822,25 +895,112 @@ WiperClean(WiperState *state)      // IN/OUT
       state->f = next;
    }
 
+   free(state->buf);
    free(state);
 }
 
 
+#if defined(__linux__) && defined(FITRIM)
 /*
  *-----------------------------------------------------------------------------
  *
- * Wiper_Next --
+ * WiperTrimNext --
  *
- *      Do the next piece of work to wipe
+ *      Discard the next range of the file system with FITRIM. The last range
+ *      extends to the end of the file system, since the size reported by
+ *      statfs() may not include its metadata.
  *
- * Note: Try to make sure that the execution of this function does not take
- *       more than 1/5 second, so that the user still has some feeling of
- *       interactivity
+ * Results:
+ *      TRUE on success, 'done' tells whether the whole file system has been
+ *      discarded.
+ *      FALSE if discarding is not supported, the discard phase is over and
+ *      the caller should fall back to zero-filling.
+ *
+ * Side Effects:
+ *      The wiper state is updated
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+WiperTrimNext(WiperState *state,   // IN/OUT
+              uint64 total,        // IN
+              Bool *done)          // OUT
+{
+   struct fstrim_range range;
+
+   range.start = state->trimStart;
+   range.minlen = 0;
+   *done = state->trimStart + WIPER_TRIM_STEP >= total;
+   range.len = *done ? ULLONG_MAX - state->trimStart : WIPER_TRIM_STEP;
+
+   if (ioctl(state->trimFd, FITRIM, &range) < 0) {
+      Log("Unable to discard free space of %s (%s), zero-filling instead.\n",
+          state->p->mountPoint, strerror(errno));
+      close(state->trimFd);
+      state->trimFd = -1;
+      state->phase = WIPER_PHASE_CREATE;
+      state->stats.method = WIPER_METHOD_ZERO_FILL;
+      *done = FALSE;
+      return FALSE;
+   }
+
+   /* On return, the length is the number of bytes actually discarded. */
+   state->stats.bytes[WIPER_METHOD_TRIM] += range.len;
+   state->trimStart += WIPER_TRIM_STEP;
+   return TRUE;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperAdaptQuantum --
+ *
+ *      Scale the amount of data written per call to Wiper_Next() so that a
+ *      call takes about WIPER_TARGET_US. The quantum at most doubles or
+ *      halves per call, so a single slow or fast write does not swing it.
  *
  * Results:
- *      "" on success. 'progress' is the updated progress indicator (between 0
- *                   and 100 included. 100 means that the job is done, the
- *                   wiper state is destroyed)
+ *      None
+ *
+ * Side Effects:
+ *      The wiper state is updated
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+WiperAdaptQuantum(WiperState *state,     // IN/OUT
+                  uint64 written,        // IN
+                  VmTimeType elapsed)    // IN: microseconds
+{
+   uint64 quantum;
+
+   if (written == 0) {
+      return;
+   }
+
+   quantum = elapsed > 0 ? written * WIPER_TARGET_US / elapsed
+                         : state->quantum * 2;
+   quantum = MAX(quantum, state->quantum / 2);
+   quantum = MIN(quantum, state->quantum * 2);
+   quantum = MIN(quantum, WIPER_QUANTUM_MAX);
+   quantum -= quantum % WIPER_WRITE_MIN;
+   state->quantum = MAX(quantum, WIPER_WRITE_MIN);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WiperNextStep --
+ *
+ *      Do the next piece of work to wipe. See Wiper_Next().
+ *
+ * Results:
+ *      "" on success. 'done' tells whether the job is done.
  *      The description of the error on failure
  *
  * Side Effects:
@@ -849,46 +1009,46 @@ WiperClean(WiperState *state)      // IN/OUT
  *-----------------------------------------------------------------------------
  */
 
-unsigned char *
-Wiper_Next(Wiper_State **s,         // IN/OUT
-           unsigned int *progress)  // OUT
+static unsigned char *
+WiperNextStep(WiperState *state,        // IN/OUT
+              unsigned int *progress,   // OUT
+              Bool *done)               // OUT
 {
-   WiperState **state;
    uint64 free;
    uint64 total;
    unsigned char *error;
 
-   ASSERT(s);
-   ASSERT(*s);
-   state = (WiperState **)s;
+   *done = FALSE;
 
-   error = WiperGetSpace(*state, &free, &total);
+   error = WiperGetSpace(state, &free, &total);
    if (*error != '\0') {
-      WiperClean(*state);
-      *state = NULL;
       return error;
    }
 
-   /* Disk space is an important system resource. Don't fill the partition
-      completely */
-   if (free <= (((uint64)5) << 20) /* 5 MB */) {
+   if (free <= WIPER_MIN_FREE) {
       /* We are done */
-      WiperClean(*state);
-      *state = NULL;
+      *done = TRUE;
       *progress = 100;
       return "";
    }
 
    /* We are not done */
-   switch ((*state)->phase) {
+   switch (state->phase) {
+#if defined(__linux__) && defined(FITRIM)
+   case WIPER_PHASE_TRIM:
+      if (WiperTrimNext(state, total, done)) {
+         *progress = *done ? 100 : 99 * state->trimStart / total;
+         return "";
+      }
+      break;
+#endif
+
    case WIPER_PHASE_CREATE:
       {
          File *new;
 
          new = (File *)malloc(sizeof *new);
          if (new == NULL) {
-            WiperClean(*state);
-            *state = NULL;
             return "Not enough memory";
          }
 
@@ -903,7 +1063,7 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
             FileIO_Invalidate(&new->fd);
 
             if (Str_Snprintf(new->name, NATIVE_MAX_PATH, "%s/wiper%d",
-                             (*state)->p->mountPoint, (*state)->nr++) == -1) {
+                             state->p->mountPoint, state->nr++) == -1) {
                Log("NATIVE_MAX_PATH is too small\n");
                ASSERT(0);
             }
@@ -911,53 +1071,83 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
             fret = FileIO_Open(&new->fd,
                                new->name,
                                FILEIO_OPEN_ACCESS_WRITE
-                               | FILEIO_OPEN_DELETE_ASAP,
+                               | FILEIO_OPEN_DELETE_ASAP
+                               | (state->unbuffered ?
+                                  FILEIO_OPEN_UNBUFFERED : 0),
                                FILEIO_OPEN_CREATE_SAFE);
             if (FileIO_IsSuccess(fret)) {
                break;
             }
 
             if (fret != FILEIO_OPEN_ERROR_EXIST) {
-               WiperClean(*state);
-               *state = NULL;
-               return "error.create";
+               if (!state->unbuffered) {
+                  return "error.create";
+               }
+               /* Not every file system supports O_DIRECT. */
+               Log("Unable to open %s for unbuffered IO, retrying buffered.\n",
+                   new->name);
+               state->unbuffered = FALSE;
             }
          }
          new->size = 0;
 
-         new->next = (*state)->f;
-         (*state)->f = new;
+         new->next = state->f;
+         state->f = new;
       }
-      (*state)->phase = WIPER_PHASE_FILL;
+      state->phase = WIPER_PHASE_FILL;
       break;
 
    case WIPER_PHASE_FILL:
       {
-         unsigned int i;
+         VmTimeType start = Hostinfo_SystemTimerUS();
+         uint64 quantum;
+         uint64 written = 0;
+         Bool full = FALSE;
+
+         /* Don't write past the free space we want to leave. */
+         quantum = MIN(state->quantum, free - WIPER_MIN_FREE);
+         quantum = MAX(quantum - quantum % WIPER_WRITE_MIN, WIPER_WRITE_MIN);
 
          /* Do several write system calls per call to Wiper_Next() */
-         for (i = 0; i < (2 << 20) /* 2 MB */
-                         / (WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE); i++) {
+         while (written < quantum) {
             FileIOResult fret;
+            size_t len = MIN(quantum - written, WIPER_WRITE_MAX);
+            size_t actual;
 
-            if ((*state)->f->size + WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE >=
-                (((uint64)2) << 30) /* 2 GB */) {
+            if (state->f->size + len >= (((uint64)2) << 30) /* 2 GB */) {
                /* The file is going to be larger than what most filesystems
                   can support. Create a new file */
-               (*state)->phase = WIPER_PHASE_CREATE;
+               state->phase = WIPER_PHASE_CREATE;
                break;
             }
 
-            fret = FileIO_Write(&(*state)->f->fd, (*state)->buf,
-                                WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE, NULL);
+            fret = FileIO_Write(&state->f->fd, state->buf, len, &actual);
+            state->f->size += actual;
+            written += actual;
 
             /*
              * We distiguish errors from FilieIO_Write.
              */
             if (!FileIO_IsSuccess(fret)) {
+               /*
+                * Some file systems accept O_DIRECT when opening but refuse
+                * the writes (e.g. ext4 with data=journal). Switch to
+                * buffered IO and write to a new file: this one has no name
+                * any more, so it cannot be reopened. It is closed with the
+                * others when the wiper is done.
+                */
+               if (fret == FILEIO_ERROR && errno == EINVAL &&
+                   state->unbuffered) {
+                  Log("Unable to write to %s with unbuffered IO, "
+                      "retrying buffered.\n", state->f->name);
+                  state->unbuffered = FALSE;
+                  state->phase = WIPER_PHASE_CREATE;
+                  break;
+               }
+
                /* The file is too big even though its size is less than 2GB */
                if (fret == FILEIO_WRITE_ERROR_FBIG) {
-                  (*state)->phase = WIPER_PHASE_CREATE;
+                  state->phase = WIPER_PHASE_CREATE;
 
                   break;
                }
@@ -967,26 +1157,37 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
                 * or the user runs out of his disk quota.
                 */
                if (fret == FILEIO_WRITE_ERROR_NOSPC) {
-                  WiperClean(*state);
-                  *state = NULL;
-                  *progress = 100;
-                  return "";
+                  full = TRUE;
+                  break;
                }
 
                /* Otherwise, it is a real error */
-               WiperClean(*state);
-               *state = NULL;
+               state->stats.bytes[WIPER_METHOD_ZERO_FILL] += written;
                return fret==FILEIO_WRITE_ERROR_DQUOT ? "User's disk quota exceeded" :
                                                        "Unable to write to a wiper file";
             }
+         }
+
+#if defined(__linux__)
+         if (!state->unbuffered) {
+            /* Start writeback and drop what has been written from the cache. */
+            (void) posix_fadvise(state->f->fd.posix, 0, 0,
+                                 POSIX_FADV_DONTNEED);
+         }
+#endif
 
-            (*state)->f->size += WIPER_SECTOR_STEP * WIPER_SECTOR_SIZE;
+         state->stats.bytes[WIPER_METHOD_ZERO_FILL] += written;
+         if (full) {
+            *done = TRUE;
+            *progress = 100;
+            return "";
          }
+         WiperAdaptQuantum(state, written, Hostinfo_SystemTimerUS() - start);
       }
       break;
 
    default:
-      Log("state is %u\n", (*state)->phase);
+      Log("state is %u\n", state->phase);
       ASSERT(0);
       break;
    }
@@ -996,6 +1197,87 @@ Wiper_Next(Wiper_State **s,         // IN/OUT
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Wiper_NextWithStats --
+ *
+ *      Do the next piece of work to wipe, and report how much space has
+ *      been reclaimed so far with each method and how long it took.
+ *
+ * Note: Try to make sure that the execution of this function does not take
+ *       more than 1/5 second, so that the user still has some feeling of
+ *       interactivity
+ *
+ * Results:
+ *      "" on success. 'progress' is the updated progress indicator (between 0
+ *                   and 100 included. 100 means that the job is done, the
+ *                   wiper state is destroyed)
+ *      The description of the error on failure
+ *      'stats' is updated in both cases, if not NULL.
+ *
+ * Side Effects:
+ *      The wiper state is updated
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+unsigned char *
+Wiper_NextWithStats(Wiper_State **s,         // IN/OUT
+                    unsigned int *progress,  // OUT
+                    WiperStats *stats)       // OUT/OPT
+{
+   WiperState *state;
+   WiperMethod method;
+   VmTimeType start;
+   unsigned char *error;
+   Bool done;
+
+   ASSERT(s);
+   ASSERT(*s);
+   state = (WiperState *)*s;
+
+   method = state->stats.method;
+   start = Hostinfo_SystemTimerUS();
+   error = WiperNextStep(state, progress, &done);
+   state->stats.usecs[method] += Hostinfo_SystemTimerUS() - start;
+
+   if (stats != NULL) {
+      *stats = state->stats;
+   }
+
+   if (*error != '\0' || done) {
+      WiperClean(state);
+      *s = NULL;
+   }
+   return error;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Wiper_Next --
+ *
+ *      Do the next piece of work to wipe
+ *
+ * Results:
+ *      See Wiper_NextWithStats().
+ *
+ * Side Effects:
+ *      The wiper state is updated
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+unsigned char *
+Wiper_Next(Wiper_State **s,         // IN/OUT
+           unsigned int *progress)  // OUT
+{
+   return Wiper_NextWithStats(s, progress, NULL);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -39,6 +39,13 @@
 #include "strutil.h"
 #include "util.h"
 
+#define NSEC_PER_SEC G_GINT64_CONSTANT(1000000000)
+
+/* GStatBuf was added in 2.26. */
+#if !GLIB_CHECK_VERSION(2, 26, 0)
+typedef struct stat GStatBuf;
+#endif
+
 /** Data types supported for translation. */
 typedef enum {
    CFG_BOOLEAN,
@@ -300,35 +307,132 @@ VMToolsGetToolsConfFile(void)
 
 
 /**
- * Loads the configuration file at the given path.
+ * Returns the modification time of a file, in nanoseconds when the platform
+ * provides it.
  *
- * If an old configuration file is detected and the current process has write
- * permission to the file, the configuration data will automatically upgraded to
- * the new configuration format (the old configuration file is saved with a
- * ".old" extension).
+ * @param[in]  st    Result of g_stat() on the file.
+ *
+ * @return The modification time in nanoseconds since the epoch.
+ */
+
+static gint64
+VMToolsConfigMtime(const GStatBuf *st)
+{
+#if defined(__linux__)
+   return (gint64) st->st_mtim.tv_sec * NSEC_PER_SEC + st->st_mtim.tv_nsec;
+#else
+   return (gint64) st->st_mtime * NSEC_PER_SEC;
+#endif
+}
+
+
+/**
+ * Computes the 64-bit FNV-1a hash of the contents of a config file.
+ *
+ * @param[in]  data  File contents.
+ * @param[in]  len   Length of the contents.
+ *
+ * @return The hash.
+ */
+
+static guint64
+VMToolsConfigHash(const gchar *data,
+                  gsize len)
+{
+   guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+   gsize i;
+
+   for (i = 0; i < len; i++) {
+      hash ^= (guchar) data[i];
+      hash *= G_GUINT64_CONSTANT(1099511628211);
+   }
+   return hash;
+}
+
+
+/**
+ * Checks whether a config file may have changed since a stamp was taken. The
+ * modification time and size are compared first; the contents are hashed if
+ * they differ, or if the file was modified less than a second before the
+ * stamp was taken, since a later write in the same timestamp tick would not
+ * change the modification time on file systems with coarse timestamps.
+ *
+ * @param[in]  path     Path of the file, in the local encoding.
+ * @param[in]  st       Result of g_stat() on the file.
+ * @param[in]  stamp    Last known state of the file.
+ * @param[out] newStamp Current state of the file.
+ * @param[out] contents Contents of the file if they were read, NULL
+ *                      otherwise. Should be freed with g_free().
+ * @param[out] len      Length of the contents.
+ *
+ * @return Whether the contents changed, or could not be read.
+ */
+
+static gboolean
+VMToolsConfigChanged(const gchar *path,
+                     const GStatBuf *st,
+                     const VMToolsConfigStamp *stamp,
+                     VMToolsConfigStamp *newStamp,
+                     gchar **contents,
+                     gsize *len)
+{
+   GError *err = NULL;
+
+   *contents = NULL;
+   *len = 0;
+   *newStamp = *stamp;
+   newStamp->mtime = VMToolsConfigMtime(st);
+   newStamp->size = st->st_size;
+   newStamp->checked = g_get_real_time() * 1000;
+
+   if (stamp->checked != 0 &&
+       newStamp->mtime == stamp->mtime &&
+       newStamp->size == stamp->size &&
+       stamp->mtime < stamp->checked - NSEC_PER_SEC) {
+      return FALSE;
+   }
+
+   if (!g_file_get_contents(path, contents, len, &err)) {
+      g_warning("Cannot read config file: %s\n", err->message);
+      g_clear_error(&err);
+      return TRUE;
+   }
+
+   newStamp->size = *len;
+   newStamp->hash = VMToolsConfigHash(*contents, *len);
+   return stamp->checked == 0 ||
+          newStamp->size != stamp->size ||
+          newStamp->hash != stamp->hash;
+}
+
+
+/**
+ * Loads the configuration file at the given path. See VMTools_LoadConfig()
+ * and VMTools_ReloadConfig().
  *
  * @param[in]     path     Path to the configuration file, or NULL for default
  *                         Tools config file.
  * @param[in]     flags    Flags for opening the file.
- * @param[in,out] config   Where to store the config dictionary; when reloading
- *                         the file, the old config object will be destroyed.
- * @param[in,out] mtime    Last known modification time of the config file.
- *                         When the function succeeds, will contain the new
- *                         modification time read from the file. If NULL (or 0),
- *                         the config dictionary is always loaded.
+ * @param[in,out] config   Where to store the config dictionary.
+ * @param[in,out] mtime    Last known modification time, may be NULL.
+ * @param[in,out] stamp    Last known state of the file, may be NULL.
  *
  * @return Whether a new config dictionary was loaded.
  */
 
-gboolean
-VMTools_LoadConfig(const gchar *path,
-                   GKeyFileFlags flags,
-                   GKeyFile **config,
-                   time_t *mtime)
+static gboolean
+VMToolsConfigLoad(const gchar *path,
+                  GKeyFileFlags flags,
+                  GKeyFile **config,
+                  time_t *mtime,
+                  VMToolsConfigStamp *stamp)
 {
    gchar *backup = NULL;
    gchar *defaultPath = NULL;
    gchar *localPath = NULL;
+   gchar *contents = NULL;
+   gsize contentsLen = 0;
+   VMToolsConfigStamp newStamp = { 0, };
    /* GStatBuf was added in 2.26. */
 #if GLIB_CHECK_VERSION(2, 26, 0)
    GStatBuf confStat;
@@ -378,7 +482,14 @@ VMTools_LoadConfig(const gchar *path,
    hadConfFile = TRUE;
 
    /* Check if we really need to load the data. */
-   if (mtime != NULL && confStat.st_mtime <= *mtime) {
+   if (stamp != NULL) {
+      if (!VMToolsConfigChanged(localPath, &confStat, stamp, &newStamp,
+                                &contents, &contentsLen)) {
+         /* Same contents: only remember the new modification time. */
+         *stamp = newStamp;
+         goto exit;
+      }
+   } else if (mtime != NULL && confStat.st_mtime <= *mtime) {
       goto exit;
    }
 
@@ -387,11 +498,15 @@ VMTools_LoadConfig(const gchar *path,
    cfg = g_key_file_new();
 
    /* Empty file: just return an empty dictionary. */
-   if (confStat.st_size == 0) {
+   if (contents != NULL ? contentsLen == 0 : confStat.st_size == 0) {
       goto exit;
    }
 
-   g_key_file_load_from_file(cfg, localPath, flags, &err);
+   if (contents != NULL) {
+      g_key_file_load_from_data(cfg, contents, contentsLen, flags, &err);
+   } else {
+      g_key_file_load_from_file(cfg, localPath, flags, &err);
+   }
    if (err == NULL) {
       goto exit;
    }
@@ -451,7 +566,11 @@ exit:
       if (mtime != NULL) {
          *mtime = confStat.st_mtime;
       }
+      if (stamp != NULL) {
+         *stamp = newStamp;
+      }
    }
+   g_free(contents);
    g_free(backup);
    g_free(defaultPath);
    VMTOOLS_RELEASE_FILENAME_LOCAL(localPath);
@@ -459,6 +578,67 @@ exit:
 }
 
 
+/**
+ * Loads the configuration file at the given path.
+ *
+ * If an old configuration file is detected and the current process has write
+ * permission to the file, the configuration data will automatically upgraded to
+ * the new configuration format (the old configuration file is saved with a
+ * ".old" extension).
+ *
+ * @param[in]     path     Path to the configuration file, or NULL for default
+ *                         Tools config file.
+ * @param[in]     flags    Flags for opening the file.
+ * @param[in,out] config   Where to store the config dictionary; when reloading
+ *                         the file, the old config object will be destroyed.
+ * @param[in,out] mtime    Last known modification time of the config file.
+ *                         When the function succeeds, will contain the new
+ *                         modification time read from the file. If NULL (or 0),
+ *                         the config dictionary is always loaded.
+ *
+ * @return Whether a new config dictionary was loaded.
+ */
+
+gboolean
+VMTools_LoadConfig(const gchar *path,
+                   GKeyFileFlags flags,
+                   GKeyFile **config,
+                   time_t *mtime)
+{
+   return VMToolsConfigLoad(path, flags, config, mtime, NULL);
+}
+
+
+/**
+ * Reloads the configuration file at the given path if its contents changed.
+ * Like VMTools_LoadConfig(), but the file is parsed again only if its
+ * contents are different from the ones recorded in the stamp, so rewriting
+ * or touching the file without changing it does not cause a reload, and
+ * changes made within the same second are not missed.
+ *
+ * @param[in]     path     Path to the configuration file, or NULL for default
+ *                         Tools config file.
+ * @param[in]     flags    Flags for opening the file.
+ * @param[in,out] config   Where to store the config dictionary; when reloading
+ *                         the file, the old config object will be destroyed.
+ * @param[in,out] stamp    Last known state of the config file, updated when
+ *                         the function succeeds. If zeroed, the config
+ *                         dictionary is always loaded.
+ *
+ * @return Whether a new config dictionary was loaded.
+ */
+
+gboolean
+VMTools_ReloadConfig(const gchar *path,
+                     GKeyFileFlags flags,
+                     GKeyFile **config,
+                     VMToolsConfigStamp *stamp)
+{
+   g_return_val_if_fail(stamp != NULL, FALSE);
+   return VMToolsConfigLoad(path, flags, config, NULL, stamp);
+}
+
+
 /**
  * Saves the given config data to the given path.
  *
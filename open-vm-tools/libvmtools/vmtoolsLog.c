@@ -67,6 +67,20 @@
  */
 #define DEFAULT_MAX_CACHE_ENTRIES      (4*1024)
 
+/*
+ * Default number of messages that can be queued by a file handler
+ * configured to write asynchronously.
+ */
+#define DEFAULT_ASYNC_QUEUE_SIZE       (4*1024)
+
+/*
+ * Rate limiting of log messages: maximum number of distinct message keys
+ * tracked per domain, and default interval between two reports of the
+ * number of suppressed messages of a domain.
+ */
+#define MAX_RATE_LIMIT_SITES           (256)
+#define DEFAULT_RATE_SUMMARY_INTERVAL  (60)
+
 /** The default handler to use if none is specified by the config data. */
 #define DEFAULT_HANDLER "file+"
 
@@ -109,11 +123,42 @@
       g_free((handler)->domain);                   \
       g_free((handler)->type);                     \
       g_free((handler)->confData);                 \
+      if ((handler)->rateLimit.sites != NULL) {    \
+         g_hash_table_destroy((handler)->rateLimit.sites); \
+      }                                            \
       g_free(handler);                             \
    }                                               \
 } while (0)
 
 
+/**
+ * Token bucket: holds up to "burst" tokens, refilled at "rate" tokens per
+ * second. Each logged message takes a token.
+ */
+typedef struct LogBucket {
+   gdouble        tokens;
+   gint64         lastRefill;
+} LogBucket;
+
+
+/**
+ * Rate limiting state of a log domain. Messages are limited for the domain
+ * as a whole and for each call site, the latter being approximated by the
+ * text of the message with digits ignored, so that messages from the same
+ * call site that only differ in numbers share a bucket.
+ */
+typedef struct LogRateLimit {
+   guint          rate;          /**< Messages per second, 0 = no limit. */
+   guint          burst;
+   guint          siteRate;      /**< Per call site, 0 = no limit. */
+   guint          siteBurst;
+   LogBucket      bucket;
+   GHashTable    *sites;         /**< Message key -> LogBucket. */
+   guint          suppressed;    /**< Since the last summary. */
+   gint64         lastSummary;
+} LogRateLimit;
+
+
 typedef struct LogHandler {
    GlibLogger    *logger;
    gchar         *domain;
@@ -128,6 +173,7 @@ typedef struct LogHandler {
    gboolean       needsFileIO;
    gboolean       isSysLog;
    gchar         *confData;
+   LogRateLimit   rateLimit;
 } LogHandler;
 
 
@@ -158,10 +204,84 @@ static gboolean gLogInitialized = FALSE;
 static GStaticRecMutex gLogStateMutex = G_STATIC_REC_MUTEX_INIT;
 static gboolean gLoggingStopped = FALSE;
 static gboolean gLogIOSuspended = FALSE;
+static guint gRateSummaryInterval = DEFAULT_RATE_SUMMARY_INTERVAL;
+G_LOCK_DEFINE_STATIC(gRateLimitLock);
 
 /* Internal functions. */
 
 
+/**
+ * Writes out the messages queued by a log handler, if it writes
+ * asynchronously.
+ *
+ * @param[in] data      Log handler, may be NULL.
+ */
+
+static void
+VMToolsFlushLogHandler(LogHandler *data)
+{
+   if (data != NULL && data->logger != NULL && data->logger->flush != NULL) {
+      data->logger->flush(data->logger);
+   }
+}
+
+
+/**
+ * Writes out the messages queued by all asynchronous log handlers.
+ */
+
+static void
+VMToolsFlushLogs(void)
+{
+   VMToolsFlushLogHandler(gDefaultData);
+
+   if (gDomains != NULL) {
+      guint i;
+      for (i = 0; i < gDomains->len; i++) {
+         VMToolsFlushLogHandler(g_ptr_array_index(gDomains, i));
+      }
+   }
+}
+
+
+/**
+ * Suspends or resumes the writes of a log handler, if it writes
+ * asynchronously.
+ *
+ * @param[in] data      Log handler, may be NULL.
+ * @param[in] suspend   TRUE to suspend writes, FALSE to resume them.
+ */
+
+static void
+VMToolsSuspendLogHandler(LogHandler *data,
+                         gboolean suspend)
+{
+   if (data != NULL && data->logger != NULL && data->logger->suspend != NULL) {
+      data->logger->suspend(data->logger, suspend);
+   }
+}
+
+
+/**
+ * Suspends or resumes the writes of all asynchronous log handlers.
+ *
+ * @param[in] suspend   TRUE to suspend writes, FALSE to resume them.
+ */
+
+static void
+VMToolsSuspendLogs(gboolean suspend)
+{
+   VMToolsSuspendLogHandler(gDefaultData, suspend);
+
+   if (gDomains != NULL) {
+      guint i;
+      for (i = 0; i < gDomains->len; i++) {
+         VMToolsSuspendLogHandler(g_ptr_array_index(gDomains, i), suspend);
+      }
+   }
+}
+
+
 /**
  * Aborts the program, optionally creating a core dump.
  */
@@ -171,6 +291,12 @@ VMToolsLogPanic(void)
 {
    gPanicCount++;
 
+   /*
+    * Make sure the messages leading to the panic, queued by asynchronous
+    * handlers, make it to the log files before aborting.
+    */
+   VMToolsFlushLogs();
+
    /*
     * Probably, flush the cached logs here. It is not
     * critial though because we will have the cached
@@ -455,94 +581,268 @@ VMToolsLogMsg(gpointer _data, gpointer userData)
 
 
 /**
- * Log handler function that does the common processing of log messages,
- * and delegates the actual printing of the message to the given handler.
+ * Formats a message and passes it to the given handler, or caches it if log
+ * IO is suspended and the handler needs file IO.
  *
  * @param[in] domain    Log domain.
  * @param[in] level     Log level.
  * @param[in] message   Message to log.
- * @param[in] _data     LogHandler pointer.
+ * @param[in] data      LogHandler pointer.
  */
 
 static void
-VMToolsLog(const gchar *domain,
-           GLogLevelFlags level,
-           const gchar *message,
-           gpointer _data)
+VMToolsLogDispatch(const gchar *domain,
+                   GLogLevelFlags level,
+                   const gchar *message,
+                   LogHandler *data)
 {
-   LogHandler *data = _data;
-
-   if (SHOULD_LOG(level, data)) {
-      LogEntry *entry;
+   LogEntry *entry;
 
-      data = data->inherited ? gDefaultData : data;
+   entry = g_malloc0(sizeof(LogEntry));
+   if (entry) {
+      entry->domain = domain ? g_strdup(domain) : NULL;
+      if (domain && !entry->domain) {
+         VMToolsLogPanic();
+      }
+      entry->handler = data;
+      entry->level = level;
+   }
 
-      entry = g_malloc0(sizeof(LogEntry));
-      if (entry) {
-         entry->domain = domain ? g_strdup(domain) : NULL;
-         if (domain && !entry->domain) {
-            VMToolsLogPanic();
-         }
-         entry->handler = data;
-         entry->level = level;
+   if (gLogIOSuspended && data->needsFileIO) {
+      if (gMaxCacheEntries == 0) {
+         /* No way to log at this point, drop it */
+         VMToolsFreeLogEntry(entry);
+         gDroppedLogCount++;
+         return;
       }
 
-      if (gLogIOSuspended && data->needsFileIO) {
-         if (gMaxCacheEntries == 0) {
-            /* No way to log at this point, drop it */
-            VMToolsFreeLogEntry(entry);
-            gDroppedLogCount++;
-            goto exit;
-         }
+      entry->msg = VMToolsLogFormat(message, domain, level, data, TRUE);
 
-         entry->msg = VMToolsLogFormat(message, domain, level, data, TRUE);
+      /*
+       * Cache the log message
+       */
+      if (!gCachedLogs) {
 
          /*
-          * Cache the log message
+          * If gMaxCacheEntries > 1K, start with 1/4th size
+          * to avoid frequent allocations
           */
+         gCachedLogs = g_ptr_array_sized_new(gMaxCacheEntries < 1024 ?
+                                             gMaxCacheEntries :
+                                             gMaxCacheEntries/4);
          if (!gCachedLogs) {
-
-            /*
-             * If gMaxCacheEntries > 1K, start with 1/4th size
-             * to avoid frequent allocations
-             */
-            gCachedLogs = g_ptr_array_sized_new(gMaxCacheEntries < 1024 ?
-                                                gMaxCacheEntries :
-                                                gMaxCacheEntries/4);
-            if (!gCachedLogs) {
-               VMToolsLogPanic();
-            }
-
-            /*
-             * Some builds use glib version 2.16.4 which does not
-             * support g_ptr_array_set_free_func function
-             */
+            VMToolsLogPanic();
          }
 
          /*
-          * We don't expect logging to be suspended for a long time,
-          * so we can avoid putting a cap on cache size. However, we
-          * still have a default cap of 4K messages, just to be safe.
+          * Some builds use glib version 2.16.4 which does not
+          * support g_ptr_array_set_free_func function
           */
-         if (gCachedLogs->len < gMaxCacheEntries) {
-            g_ptr_array_add(gCachedLogs, entry);
-         } else {
-            /*
-             * Cache is full, drop the oldest log message. This is not
-             * very efficient but we don't expect this to be a common
-             * case anyway.
-             */
-            LogEntry *oldest = g_ptr_array_remove_index(gCachedLogs, 0);
-            VMToolsFreeLogEntry(oldest);
-            gDroppedLogCount++;
+      }
+
+      /*
+       * We don't expect logging to be suspended for a long time,
+       * so we can avoid putting a cap on cache size. However, we
+       * still have a default cap of 4K messages, just to be safe.
+       */
+      if (gCachedLogs->len < gMaxCacheEntries) {
+         g_ptr_array_add(gCachedLogs, entry);
+      } else {
+         /*
+          * Cache is full, drop the oldest log message. This is not
+          * very efficient but we don't expect this to be a common
+          * case anyway.
+          */
+         LogEntry *oldest = g_ptr_array_remove_index(gCachedLogs, 0);
+         VMToolsFreeLogEntry(oldest);
+         gDroppedLogCount++;
+
+         g_ptr_array_add(gCachedLogs, entry);
+      }
+
+   } else {
+      entry->msg = VMToolsLogFormat(message, domain, level, data, FALSE);
+      VMToolsLogMsg(entry, NULL);
+   }
+}
+
+
+/**
+ * Computes the key identifying the call site of a message: a hash of the
+ * message ignoring digits, so that counters, addresses and error codes don't
+ * make messages from the same call site look different.
+ *
+ * @param[in] message   Message to log.
+ *
+ * @return The message key.
+ */
+
+static guint
+VMToolsLogSiteKey(const gchar *message)
+{
+   guint hash = 5381;
+   guint i;
+
+   for (i = 0; message[i] != '\0' && i < 256; i++) {
+      if (!g_ascii_isdigit(message[i])) {
+         hash = hash * 33 + (guchar) message[i];
+      }
+   }
+
+   return hash;
+}
+
+
+/**
+ * Adds the tokens earned since the last refill to a bucket.
+ *
+ * @param[in] bucket    Token bucket.
+ * @param[in] rate      Tokens per second.
+ * @param[in] burst     Maximum number of tokens.
+ * @param[in] now       Current monotonic time.
+ */
+
+static void
+VMToolsLogRefill(LogBucket *bucket,
+                 guint rate,
+                 guint burst,
+                 gint64 now)
+{
+   bucket->tokens += (now - bucket->lastRefill) * (gdouble) rate / G_USEC_PER_SEC;
+   bucket->tokens = MIN(bucket->tokens, burst);
+   bucket->lastRefill = now;
+}
+
+
+/**
+ * Checks whether a message is within the rate limits of its log domain.
+ * Error and critical messages are never suppressed.
+ *
+ * @param[in]  data        LogHandler of the message's domain.
+ * @param[in]  level       Log level.
+ * @param[in]  message     Message to log.
+ * @param[out] suppressed  Number of messages suppressed since the last
+ *                         summary, when it is time to log one; 0 otherwise.
+ * @param[out] elapsed     Seconds since the last summary.
+ *
+ * @return TRUE if the message should be logged.
+ */
+
+static gboolean
+VMToolsLogRateCheck(LogHandler *data,
+                    GLogLevelFlags level,
+                    const gchar *message,
+                    guint *suppressed,
+                    gint64 *elapsed)
+{
+   LogRateLimit *limit = &data->rateLimit;
+   LogBucket *site = NULL;
+   gboolean allowed = TRUE;
+   gint64 now;
+
+   *suppressed = 0;
+   if ((limit->rate == 0 && limit->siteRate == 0) ||
+       (level & (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL))) {
+      return TRUE;
+   }
+
+   now = g_get_monotonic_time();
+
+   G_LOCK(gRateLimitLock);
+
+   if (limit->rate > 0) {
+      VMToolsLogRefill(&limit->bucket, limit->rate, limit->burst, now);
+      allowed = limit->bucket.tokens >= 1;
+   }
+
+   if (allowed && limit->sites != NULL) {
+      gpointer key = GUINT_TO_POINTER(VMToolsLogSiteKey(message));
 
-            g_ptr_array_add(gCachedLogs, entry);
+      site = g_hash_table_lookup(limit->sites, key);
+      if (site == NULL) {
+         if (g_hash_table_size(limit->sites) >= MAX_RATE_LIMIT_SITES) {
+            g_hash_table_remove_all(limit->sites);
          }
+         site = g_new(LogBucket, 1);
+         site->tokens = limit->siteBurst;
+         site->lastRefill = now;
+         g_hash_table_insert(limit->sites, key, site);
+      }
+      VMToolsLogRefill(site, limit->siteRate, limit->siteBurst, now);
+      allowed = site->tokens >= 1;
+   }
 
-      } else {
-         entry->msg = VMToolsLogFormat(message, domain, level, data, FALSE);
-         VMToolsLogMsg(entry, NULL);
+   if (allowed) {
+      if (limit->rate > 0) {
+         limit->bucket.tokens -= 1;
+      }
+      if (site != NULL) {
+         site->tokens -= 1;
+      }
+      if (limit->suppressed > 0 &&
+          now - limit->lastSummary >= gRateSummaryInterval * G_USEC_PER_SEC) {
+         *suppressed = limit->suppressed;
+         *elapsed = (now - limit->lastSummary) / G_USEC_PER_SEC;
+         limit->suppressed = 0;
+         limit->lastSummary = now;
+      }
+   } else {
+      if (limit->suppressed == 0 &&
+          now - limit->lastSummary >= gRateSummaryInterval * G_USEC_PER_SEC) {
+         /* Start of a new period of suppression. */
+         limit->lastSummary = now;
+      }
+      limit->suppressed++;
+   }
+
+   G_UNLOCK(gRateLimitLock);
+
+   return allowed;
+}
+
+
+/**
+ * Log handler function that does the common processing of log messages,
+ * and delegates the actual printing of the message to the given handler.
+ *
+ * Messages over the rate limits of their domain are dropped before being
+ * formatted; the number of dropped messages is logged periodically.
+ *
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] message   Message to log.
+ * @param[in] _data     LogHandler pointer.
+ */
+
+static void
+VMToolsLog(const gchar *domain,
+           GLogLevelFlags level,
+           const gchar *message,
+           gpointer _data)
+{
+   LogHandler *data = _data;
+
+   if (SHOULD_LOG(level, data)) {
+      guint suppressed;
+      gint64 elapsed;
+
+      if (!VMToolsLogRateCheck(data, level, message, &suppressed, &elapsed)) {
+         goto exit;
       }
+
+      data = data->inherited ? gDefaultData : data;
+
+      if (suppressed > 0) {
+         gchar *summary;
+
+         summary = g_strdup_printf("Suppressed %u log messages in the last "
+                                   "%"G_GINT64_FORMAT" seconds: rate limit "
+                                   "exceeded.", suppressed, elapsed);
+         VMToolsLogDispatch(domain, level, summary, data);
+         g_free(summary);
+      }
+
+      VMToolsLogDispatch(domain, level, message, data);
    }
 
 exit:
@@ -689,6 +989,7 @@ VMToolsGetLogHandler(const gchar *handler,
       gboolean append = strcmp(handler, "file+") == 0;
       guint maxSize;
       guint maxFiles;
+      gint queueSize;
       GError *err = NULL;
 
       /* Use the same type name for both. */
@@ -711,7 +1012,20 @@ VMToolsGetLogHandler(const gchar *handler,
             maxFiles = 10;
          }
 
-         glogger = GlibUtils_CreateFileLogger(path, append, maxSize, maxFiles);
+         g_snprintf(key, sizeof key, "%s.async", domain);
+         if (g_key_file_get_boolean(cfg, LOGGING_GROUP, key, NULL)) {
+            g_snprintf(key, sizeof key, "%s.asyncQueueSize", domain);
+            queueSize = g_key_file_get_integer(cfg, LOGGING_GROUP, key, &err);
+            if (err != NULL || queueSize <= 0) {
+               g_clear_error(&err);
+               queueSize = DEFAULT_ASYNC_QUEUE_SIZE;
+            }
+            glogger = GlibUtils_CreateAsyncFileLogger(path, append, maxSize,
+                                                      maxFiles, queueSize);
+         } else {
+            glogger = GlibUtils_CreateFileLogger(path, append, maxSize,
+                                                 maxFiles);
+         }
          needsFileIO = TRUE;
       } else {
          g_warning("Missing path for domain '%s'.", domain);
@@ -767,6 +1081,90 @@ VMToolsGetLogHandler(const gchar *handler,
 }
 
 
+/**
+ * Reads an unsigned integer from the logging configuration.
+ *
+ * @param[in] cfg       Config dictionary.
+ * @param[in] key       Key to read.
+ * @param[in] defValue  Value to use if the key is missing or invalid.
+ *
+ * @return The configured value.
+ */
+
+static guint
+VMToolsGetLogConfigUInt(GKeyFile *cfg,
+                        const gchar *key,
+                        guint defValue)
+{
+   GError *err = NULL;
+   gint value = g_key_file_get_integer(cfg, LOGGING_GROUP, key, &err);
+
+   if (err != NULL) {
+      if (err->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND &&
+          err->code != G_KEY_FILE_ERROR_GROUP_NOT_FOUND) {
+         g_warning("Invalid value for %s key: Error %d.", key, err->code);
+      }
+      g_clear_error(&err);
+      return defValue;
+   }
+
+   return value < 0 ? defValue : (guint) value;
+}
+
+
+/**
+ * Configures the rate limits of a log domain. The limits are given in
+ * messages per second; bursts default to ten seconds worth of messages.
+ *
+ * @param[in] data      LogHandler of the domain.
+ * @param[in] domain    Name of the domain.
+ * @param[in] cfg       Config dictionary.
+ */
+
+static void
+VMToolsConfigRateLimit(LogHandler *data,
+                       const gchar *domain,
+                       GKeyFile *cfg)
+{
+   LogRateLimit *limit = &data->rateLimit;
+   gchar key[MAX_DOMAIN_LEN + 64];
+   guint rate;
+   guint burst;
+   guint siteRate;
+   guint siteBurst;
+
+   g_snprintf(key, sizeof key, "%s.rateLimit", domain);
+   rate = VMToolsGetLogConfigUInt(cfg, key, 0);
+   g_snprintf(key, sizeof key, "%s.rateLimitBurst", domain);
+   burst = MAX(VMToolsGetLogConfigUInt(cfg, key, rate * 10), 1);
+   g_snprintf(key, sizeof key, "%s.siteRateLimit", domain);
+   siteRate = VMToolsGetLogConfigUInt(cfg, key, 0);
+   g_snprintf(key, sizeof key, "%s.siteRateLimitBurst", domain);
+   siteBurst = MAX(VMToolsGetLogConfigUInt(cfg, key, siteRate * 10), 1);
+
+   G_LOCK(gRateLimitLock);
+   if (limit->rate != rate || limit->burst != burst) {
+      limit->bucket.tokens = burst;
+      limit->bucket.lastRefill = g_get_monotonic_time();
+   }
+   limit->rate = rate;
+   limit->burst = burst;
+   limit->siteRate = siteRate;
+   limit->siteBurst = siteBurst;
+
+   if (siteRate > 0 && limit->sites == NULL) {
+      limit->sites = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                           NULL, g_free);
+   } else if (siteRate == 0 && limit->sites != NULL) {
+      g_hash_table_destroy(limit->sites);
+      limit->sites = NULL;
+   } else if (limit->sites != NULL) {
+      g_hash_table_remove_all(limit->sites);
+   }
+   G_UNLOCK(gRateLimitLock);
+}
+
+
 /**
  * Configures the given log domain based on the data provided in the given
  * dictionary. If the log domain being configured doesn't match the default, and
@@ -915,6 +1313,8 @@ VMToolsConfigLogDomain(const gchar *domain,
       data->confData = g_strdup(confData);
    }
 
+   VMToolsConfigRateLimit(data, domain, cfg);
+
    if (isDefault) {
       gDefaultData = data;
       g_log_set_default_handler(VMToolsLog, gDefaultData);
@@ -1185,6 +1585,10 @@ VMTools_ConfigLogging(const gchar *defaultDomain,
       g_message("Log caching is disabled.");
    }
 
+   gRateSummaryInterval = VMToolsGetLogConfigUInt(cfg,
+                                                  "rateLimitSummaryInterval",
+                                                  DEFAULT_RATE_SUMMARY_INTERVAL);
+
    if (g_key_file_has_key(cfg, LOGGING_GROUP, "enableCoreDump", NULL)) {
       gEnableCoreDump = g_key_file_get_boolean(cfg, LOGGING_GROUP,
                                                "enableCoreDump", NULL);
@@ -1370,6 +1774,14 @@ void
 VMTools_SuspendLogIO()
 {
    gLogIOSuspended = TRUE;
+
+   /*
+    * Messages logged from now on are cached. Write out what asynchronous
+    * handlers have queued so far and stop their writer threads, so that
+    * they don't touch the file systems while IO is suspended, even for
+    * messages that were being queued while the flag above was set.
+    */
+   VMToolsSuspendLogs(TRUE);
 }
 
 
@@ -1387,6 +1799,7 @@ VMTools_ResumeLogIO()
     * from within this function itself!
     */
    gLogIOSuspended = FALSE;
+   VMToolsSuspendLogs(FALSE);
 
    /*
     * Flush the cached log messages, if any
@@ -85,12 +85,56 @@ typedef struct BlockInfo {
 } BlockInfo;
 
 
-/* XXX: Is it worth turning this into a hash table? */
-static DblLnkLst_Links blockedFiles;
+/*
+ * Blocked files are kept in a hash table keyed by filename so that lookups,
+ * which happen on every access through the vmblock file system, don't have
+ * to scan every block when a large DnD operation has many files blocked.
+ * Lookups take blockedFilesLock for reading and therefore only contend with
+ * adding and removing blocks, not with each other.
+ */
+#define BLOCK_HASH_BITS    10
+#define BLOCK_HASH_SIZE    (1 << BLOCK_HASH_BITS)
+#define BLOCK_HASH_MASK    (BLOCK_HASH_SIZE - 1)
+
+static DblLnkLst_Links blockedFiles[BLOCK_HASH_SIZE];
 static os_rwlock_t blockedFilesLock;
 static os_kmem_cache_t *blockInfoCache;
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockHashBucket --
+ *
+ *    Returns the hash table bucket for the provided filename (FNV-1a).
+ *
+ * Results:
+ *    Pointer to the head of the bucket's list.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static DblLnkLst_Links *
+BlockHashBucket(const char *filename)  // IN: file to hash
+{
+   unsigned int hash = 2166136261U;
+   const unsigned char *p;
+
+   for (p = (const unsigned char *)filename; *p != '\0'; p++) {
+      hash ^= *p;
+      hash *= 16777619U;
+   }
+
+   /* Fold the upper bits in, the low ones alone don't mix well. */
+   hash ^= hash >> BLOCK_HASH_BITS;
+
+   return &blockedFiles[hash & BLOCK_HASH_MASK];
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -110,6 +154,8 @@ static os_kmem_cache_t *blockInfoCache;
 int
 BlockInit(void)
 {
+   unsigned int i;
+
    ASSERT(!blockInfoCache);
 
    blockInfoCache = os_kmem_cache_create("blockInfoCache",
@@ -120,7 +166,9 @@ BlockInit(void)
       return OS_ENOMEM;
    }
 
-   DblLnkLst_Init(&blockedFiles);
+   for (i = 0; i < BLOCK_HASH_SIZE; i++) {
+      DblLnkLst_Init(&blockedFiles[i]);
+   }
    os_rwlock_init(&blockedFilesLock);
 
    return 0;
@@ -146,8 +194,15 @@ BlockInit(void)
 void
 BlockCleanup(void)
 {
+#ifdef VMX86_DEBUG
+   unsigned int i;
+
+   for (i = 0; i < BLOCK_HASH_SIZE; i++) {
+      ASSERT(!DblLnkLst_IsLinked(&blockedFiles[i]));
+   }
+#endif
+
    ASSERT(blockInfoCache);
-   ASSERT(!DblLnkLst_IsLinked(&blockedFiles));
 
    os_rwlock_destroy(&blockedFilesLock);
    os_kmem_cache_destroy(blockInfoCache);
@@ -315,6 +370,7 @@ GetBlock(const char *filename,          // IN: file to find block for
          const os_blocker_id_t blocker) // IN: blocker associated with this block
 {
    struct DblLnkLst_Links *curr;
+   struct DblLnkLst_Links *bucket;
 
    /*
     * On FreeBSD we have a mechanism to assert (but not simply check)
@@ -328,7 +384,8 @@ GetBlock(const char *filename,          // IN: file to find block for
    ASSERT(os_rwlock_held(&blockedFilesLock));
 #endif
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
+   bucket = BlockHashBucket(filename);
+   DblLnkLst_ForEach(curr, bucket) {
       BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
       if ((blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
           strcmp(currBlock->filename, filename) == 0) {
@@ -422,7 +479,7 @@ BlockAddFileBlock(const char *filename,           // IN: name of file to block
       goto out;
    }
 
-   DblLnkLst_LinkLast(&blockedFiles, &block->links);
+   DblLnkLst_LinkLast(BlockHashBucket(block->filename), &block->links);
    LOG(4, "added block for [%s]\n", filename);
    retval = 0;
 
@@ -498,20 +555,23 @@ BlockRemoveAllBlocks(const os_blocker_id_t blocker)  // IN: blocker to remove bl
    struct DblLnkLst_Links *curr;
    struct DblLnkLst_Links *tmp;
    unsigned int removed = 0;
+   unsigned int i;
 
    os_write_lock(&blockedFilesLock);
 
-   DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
+   for (i = 0; i < BLOCK_HASH_SIZE; i++) {
+      DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles[i]) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
 
-         BlockDoRemoveBlock(currBlock);
+            BlockDoRemoveBlock(currBlock);
 
-         /*
-          * We count only entries removed from the -list-, regardless of whether
-          * or not other waiters exist.
-          */
-         ++removed;
+            /*
+             * We count only entries removed from the -list-, regardless of
+             * whether or not other waiters exist.
+             */
+            ++removed;
+         }
       }
    }
 
@@ -689,13 +749,16 @@ BlockListFileBlocks(void)
 {
    DblLnkLst_Links *curr;
    int count = 0;
+   unsigned int i;
 
    os_read_lock(&blockedFilesLock);
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
-          count++, currBlock->filename, currBlock->blocker);
+   for (i = 0; i < BLOCK_HASH_SIZE; i++) {
+      DblLnkLst_ForEach(curr, &blockedFiles[i]) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
+             count++, currBlock->filename, currBlock->blocker);
+      }
    }
 
    os_read_unlock(&blockedFilesLock);
@@ -704,5 +767,43 @@ BlockListFileBlocks(void)
       LOG(1, "BlockListFileBlocks: No blocks currently exist.\n");
    }
 }
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockWaiterCount --
+ *
+ *    Counts the threads that hold a reference on the block on the provided
+ *    filename, i.e. that are waiting in BlockWaitOnFile() or hold a handle
+ *    from BlockLookup().
+ *
+ * Results:
+ *    Number of references besides the block list's own, -1 if the file is
+ *    not blocked.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+BlockWaiterCount(const char *filename)  // IN: blocked file
+{
+   BlockInfo *block;
+   int count = -1;
+
+   os_read_lock(&blockedFilesLock);
+
+   block = GetBlock(filename, OS_UNKNOWN_BLOCKER);
+   if (block) {
+      count = os_atomic_read(&block->refcount) - 1;
+   }
+
+   os_read_unlock(&blockedFilesLock);
+
+   return count;
+}
 #endif
 
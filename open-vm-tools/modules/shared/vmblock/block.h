@@ -82,6 +82,7 @@ int BlockWaitOnFile(const char *filename, BlockHandle cookie);
 BlockHandle BlockLookup(const char *filename, const os_blocker_id_t blocker);
 #ifdef VMX86_DEVEL
 void BlockListFileBlocks(void);
+int BlockWaiterCount(const char *filename);
 #endif
 
 #endif /* __BLOCK_H__ */
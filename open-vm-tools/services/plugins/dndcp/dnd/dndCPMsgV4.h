@@ -173,6 +173,7 @@ typedef enum DnDCPMsgPacketType {
 #define DND_CP_CAP_ACTIVE_CP        (1 << 13)
 #define DND_CP_CAP_GUEST_PROGRESS   (1 << 14)
 #define DND_CP_CAP_BIG_BUFFER       (1 << 15)
+#define DND_CP_CAP_BIG_BUFFER_WINDOW (1 << 16)
 
 #define DND_CP_CAP_FORMATS_CP       (DND_CP_CAP_PLAIN_TEXT_CP   | \
                                      DND_CP_CAP_RTF_CP          | \
@@ -220,6 +221,22 @@ DnDCPMsgHdrV4;
                                            DND_CP_MSG_HEADERSIZE_V4)
 #define DND_CP_MSG_MAX_BINARY_SIZE_V4 (1 << 22)
 
+/*
+ * With DND_CP_CAP_BIG_BUFFER_WINDOW on both sides, the sender of a big
+ * message may have this many packets outstanding, and the receiver
+ * acknowledges with a cumulative DNDCP_CMD_REQUEST_NEXT once half of them
+ * have arrived, instead of after every packet.
+ *
+ * Windowed mode only takes effect with a host that implements it and sets
+ * the bit in its own PING/PING_REPLY capabilities. Hosts that do not know
+ * the bit never set it, so the guest keeps the one packet per
+ * DNDCP_CMD_REQUEST_NEXT protocol with them.
+ */
+#define DND_CP_BIG_BUFFER_WINDOW_PACKETS 4
+#define DND_CP_BIG_BUFFER_WINDOW_SIZE (DND_CP_BIG_BUFFER_WINDOW_PACKETS * \
+                                       DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4)
+#define DND_CP_BIG_BUFFER_ACK_SIZE (DND_CP_BIG_BUFFER_WINDOW_SIZE / 2)
+
 /* DnD version 4 message. */
 typedef struct DnDCPMsgV4 {
    DnDCPMsgHdrV4 hdr;
@@ -278,7 +278,8 @@ GuestCopyPasteMgr::VmxCopyPasteVersionChanged(uint32 version)
          sigc::mem_fun(this, &GuestCopyPasteMgr::OnRpcDestRequestClip));
       mRpc->Init();
       mRpc->SendPing(GuestDnDCPMgr::GetInstance()->GetCaps() &
-                     (DND_CP_CAP_CP | DND_CP_CAP_FORMATS_CP | DND_CP_CAP_VALID));
+                     (DND_CP_CAP_CP | DND_CP_CAP_FORMATS_CP | DND_CP_CAP_VALID |
+                      DND_CP_CAP_BIG_BUFFER_WINDOW));
    }
 
    ResetCopyPaste();
@@ -667,7 +667,7 @@ GuestDnDMgr::VmxDnDVersionChanged(uint32 version)
       mRpc->Init();
       mRpc->SendPing(GuestDnDCPMgr::GetInstance()->GetCaps() &
                      (DND_CP_CAP_DND | DND_CP_CAP_FORMATS_DND |
-                      DND_CP_CAP_VALID));
+                      DND_CP_CAP_VALID | DND_CP_CAP_BIG_BUFFER_WINDOW));
    }
 
    ResetDnD();
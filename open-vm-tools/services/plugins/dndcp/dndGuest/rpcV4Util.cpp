@@ -53,7 +53,13 @@ extern "C" {
 
 RpcV4Util::RpcV4Util(void)
    : mVersionMajor(4),
-     mVersionMinor(0)
+     mVersionMinor(0),
+     mBigMsgInAcked(0),
+     mBigMsgOutAcked(0),
+     mBigMsgInWindowed(false),
+     mBigMsgOutWindowed(false),
+     mLocalCaps(0),
+     mPeerCaps(0)
 {
    DnDCPMsgV4_Init(&mBigMsgIn);
    DnDCPMsgV4_Init(&mBigMsgOut);
@@ -210,9 +216,19 @@ RpcV4Util::SendMsg(RpcParams *params,
       memcpy(msgOut->binary, binary,binarySize);
    }
 
-   ret = SendMsg(msgOut);
-   /* The mBigMsgOut is destroyed when the message sending was failed. */
-   if (!ret && msgOut == &mBigMsgOut) {
+   if (msgOut == &mBigMsgOut) {
+      mBigMsgOutAcked = 0;
+      mBigMsgOutWindowed = IsWindowed();
+      ret = SendBigMsgWindow();
+   } else {
+      ret = SendMsg(msgOut);
+   }
+   /*
+    * The mBigMsgOut is destroyed when the message sending was failed, or
+    * when the whole message already fit in the first window.
+    */
+   if (msgOut == &mBigMsgOut &&
+       (!ret || mBigMsgOut.hdr.payloadOffset == mBigMsgOut.hdr.binarySize)) {
       DnDCPMsgV4_Destroy(&mBigMsgOut);
    }
    DnDCPMsgV4_Destroy(&shortMsg);
@@ -237,6 +253,7 @@ RpcV4Util::SendPingMsg(uint32 destId,
    memset(&params, 0, sizeof params);
    params.addrId = destId;
    params.cmd = DNDCP_CMD_PING;
+   mLocalCaps = capability;
    params.optional.version.major = mVersionMajor;
    params.optional.version.minor = mVersionMinor;
    params.optional.version.capability = capability;
@@ -262,6 +279,7 @@ RpcV4Util::SendPingReplyMsg(uint32 destId,
    memset(&params, 0, sizeof params);
    params.addrId = destId;
    params.cmd = DNDCP_CMD_PING_REPLY;
+   mLocalCaps = capability;
    params.optional.version.major = mVersionMajor;
    params.optional.version.minor = mVersionMinor;
    params.optional.version.capability = capability;
@@ -299,7 +317,8 @@ RpcV4Util::SendCmdReplyMsg(uint32 destId,
 /**
  * Construct a DNDCP_CMD_REQUEST_NEXT message and send it to mBigMsgIn.addrId.
  * This is used for big message receiving. After received a packet, receiver
- * side should send this message to ask for next piece of binary.
+ * side should send this message to ask for next piece of binary. In windowed
+ * mode the payloadOffset acknowledges all binary received so far.
  *
  * @return true on success, false otherwise.
  */
@@ -316,7 +335,34 @@ RpcV4Util::RequestNextPacket(void)
    params.optional.requestNextCmd.binarySize = mBigMsgIn.hdr.binarySize;
    params.optional.requestNextCmd.payloadOffset = mBigMsgIn.hdr.payloadOffset;
 
-   return SendMsg(&params);
+   if (!SendMsg(&params)) {
+      return false;
+   }
+   mBigMsgInAcked = mBigMsgIn.hdr.payloadOffset;
+   return true;
+}
+
+
+/**
+ * Send the next packet(s) of mBigMsgOut. Without windowed mode this is
+ * exactly one packet. With it, packets are sent until the unacknowledged
+ * binary reaches DND_CP_BIG_BUFFER_WINDOW_SIZE or the message is done.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendBigMsgWindow(void)
+{
+   do {
+      if (!SendMsg(&mBigMsgOut)) {
+         return false;
+      }
+   } while (mBigMsgOutWindowed &&
+            mBigMsgOut.hdr.payloadOffset < mBigMsgOut.hdr.binarySize &&
+            mBigMsgOut.hdr.payloadOffset - mBigMsgOutAcked <
+               DND_CP_BIG_BUFFER_WINDOW_SIZE);
+   return true;
 }
 
 
@@ -434,12 +480,23 @@ RpcV4Util::HandlePacket(uint32 srcId,
    }
 
    mBigMsgIn.addrId = srcId;
+   if (DND_CP_MSG_PACKET_TYPE_MULTIPLE_NEW == packetType) {
+      mBigMsgInAcked = 0;
+      mBigMsgInWindowed = IsWindowed();
+   }
 
    /*
     * If there are multiple packets for the message, sends DNDCP_REQUEST_NEXT
-    * back to sender to ask for next packet.
+    * back to sender to ask for next packet. In windowed mode the sender keeps
+    * several packets in flight, so only acknowledge every
+    * DND_CP_BIG_BUFFER_ACK_SIZE bytes.
     */
    if (DND_CP_MSG_PACKET_TYPE_MULTIPLE_END != packetType) {
+      if (mBigMsgInWindowed &&
+          mBigMsgIn.hdr.payloadOffset - mBigMsgInAcked <
+             DND_CP_BIG_BUFFER_ACK_SIZE) {
+         return;
+      }
       if (!RequestNextPacket()) {
          LOG(1, ("%s: RequestNextPacket failed.\n", __FUNCTION__));
          goto cleanup;
@@ -477,7 +534,34 @@ RpcV4Util::HandleMsg(DnDCPMsgV4 *msgIn)
        * of data. For details about big buffer support, please refer to
        * https://wiki.eng.vmware.com/DnDVersion4Message#Binary_Buffer
        */
-      bool ret = SendMsg(&mBigMsgOut);
+      bool ret;
+
+      if (NULL == mBigMsgOut.binary) {
+         LOG(1, ("%s: no big message pending, ignoring request.\n",
+                 __FUNCTION__));
+         return;
+      }
+
+      if (mBigMsgOutWindowed) {
+         /*
+          * param3 is requestNextCmd.payloadOffset, the cumulative ack. A
+          * duplicate ack does not open the window, so sending on it would
+          * go past the window.
+          */
+         uint32 acked = msgIn->hdr.param3;
+
+         if (msgIn->hdr.sessionId != mBigMsgOut.hdr.sessionId ||
+             msgIn->hdr.param1 != mBigMsgOut.hdr.cmd ||
+             acked <= mBigMsgOutAcked ||
+             acked > mBigMsgOut.hdr.payloadOffset) {
+            LOG(1, ("%s: stale request for offset %u, ignoring.\n",
+                    __FUNCTION__, acked));
+            return;
+         }
+         mBigMsgOutAcked = acked;
+      }
+
+      ret = SendBigMsgWindow();
 
       if (!ret) {
          LOG(1, ("%s: SendMsg failed. \n", __FUNCTION__));
@@ -504,6 +588,10 @@ RpcV4Util::HandleMsg(DnDCPMsgV4 *msgIn)
    params.optional.genericParams.param5 = msgIn->hdr.param5;
    params.optional.genericParams.param6 = msgIn->hdr.param6;
 
+   if (DNDCP_CMD_PING == params.cmd || DNDCP_CMD_PING_REPLY == params.cmd) {
+      mPeerCaps = params.optional.version.capability;
+   }
+
    mRpc->HandleMsg(&params, msgIn->binary, msgIn->hdr.binarySize);
    FireRpcReceivedCallbacks(msgIn->hdr.cmd, msgIn->addrId, msgIn->hdr.sessionId);
 }
@@ -88,7 +88,10 @@ private:
    void FireRpcReceivedCallbacks(uint32 cmd, uint32 src, uint32 session);
    void FireRpcSentCallbacks(uint32 cmd, uint32 dest, uint32 session);
    bool SendMsg(DnDCPMsgV4 *msg);
+   bool SendBigMsgWindow(void);
    bool RequestNextPacket(void);
+   bool IsWindowed(void) const
+      { return (mLocalCaps & mPeerCaps & DND_CP_CAP_BIG_BUFFER_WINDOW) != 0; }
    void HandlePacket(uint32 srcId,
                      const uint8 *packet,
                      size_t packetSize);
@@ -103,6 +106,16 @@ private:
    uint32 mVersionMinor;
    DnDCPMsgV4 mBigMsgIn;
    DnDCPMsgV4 mBigMsgOut;
+   uint32 mBigMsgInAcked;
+   uint32 mBigMsgOutAcked;
+   /*
+    * Whether each big message uses windowed mode, decided when it starts so
+    * that a ping changing the capabilities cannot switch protocols midway.
+    */
+   bool mBigMsgInWindowed;
+   bool mBigMsgOutWindowed;
+   uint32 mLocalCaps;
+   uint32 mPeerCaps;
    uint32 mMsgType;
    uint32 mMsgSrc;
    DblLnkLst_Links mRpcSentListeners;
@@ -46,7 +46,7 @@
 #include "embed_version.h"
 #include "vmtoolsd_version.h"
 #include "rpcout.h"
-#include "rabbitmqProxyConst.h"
+#include "rabbitmqProxyRelay.h"
 #include "vm_basic_types.h"
 #include "poll.h"
 #ifdef OPEN_VM_TOOLS
@@ -73,14 +73,10 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 #define sockerr()           errno
 #endif
 
-#define GUEST_RABBITMQ_PROXY_VERSION             "1.0"
 #define CONFGROUP_GRABBITMQ_PROXY                "grabbitmqproxy"
 
 #define DEFAULT_MAX_SEND_QUEUE_LEN               (256 * 1024)
 
-/*user level recv buffer */
-#define RMQ_CLIENT_CONN_RECV_BUFF_SIZE           (64 * 1024)
-
 /* these are socket level send/recv buffers */
 #define DEFAULT_RMQCLIENT_CONN_RECV_BUFF_SIZE    (64 * 1024)
 #define DEFAULT_RMQCLIENT_CONN_SEND_BUFF_SIZE    (64 * 1024)
@@ -100,10 +96,12 @@ typedef struct _ConnInfo {
    gboolean shutDown;
 
    int32 packetLen;
-   char *recvBuf;
-   int recvBufLen;
+   char *recvBuf;             /* where data is being received, in the send
+                                 ring of toConn */
 
    int sendQueueLen;
+   RmqRelayRing sendRing;     /* buffers queued for send, filled by toConn */
+   RmqRelayStats stats;
 
    gboolean recvStopped;
 
@@ -289,6 +287,8 @@ ShutDownConn(ConnInfo *conn)            // IN
 static void
 CloseConn(ConnInfo *conn)   // IN
 {
+   char stats[256];
+
    g_debug("Entering %s\n", __FUNCTION__);
 
    ASSERT(conn->asock != NULL);
@@ -297,12 +297,14 @@ CloseConn(ConnInfo *conn)   // IN
       ShutDownConn(conn->toConn);
       conn->toConn = NULL;
    }
-   g_info("Closing %s connection %d\n", GetConnName(conn),
-          AsyncSocket_GetFd(conn->asock));
+   RmqRelayStats_Format(&conn->stats, stats, sizeof stats);
+   g_info("Closing %s connection %d, %s\n", GetConnName(conn),
+          AsyncSocket_GetFd(conn->asock), stats);
 
+   /* flushes the pending sends, the ring can be freed afterwards */
    AsyncSocket_Close(conn->asock);
    conn->asock = NULL;
-   free(conn->recvBuf);
+   RmqRelayRing_Destroy(&conn->sendRing);
    conn->recvBuf = NULL;
 
    /* remove the connection from corresponding conn list */
@@ -366,23 +368,29 @@ static gboolean
 StartRecvFromRmqClient(ConnInfo *conn)   // IN
 {
    int res;
+   char *buf;
 
    ASSERT(AsyncSocket_GetState(conn->asock) == AsyncSocketConnected);
+   ASSERT(conn->toConn != NULL);
 
-   if (conn->recvBuf == NULL) {
-      conn->recvBufLen = RMQ_CLIENT_CONN_RECV_BUFF_SIZE;
-      conn->recvBuf = malloc(conn->recvBufLen);
-      if (conn->recvBuf == NULL) {
-         g_info("Error in allocating recv buffer for socket %d, "
-                "closing connection.\n",
-                AsyncSocket_GetFd(conn->asock));
-         CloseConn(conn);
-         return FALSE;
-      }
+   /*
+    * Receive right into the send ring of the vmx connection, leaving room
+    * for the dataMap framing so the packet can be sent without a copy.
+    */
+   buf = RmqRelayRing_Reserve(&conn->toConn->sendRing,
+                              RMQ_RELAY_HEADER_LEN +
+                              RMQ_CLIENT_CONN_RECV_BUFF_SIZE);
+   if (buf == NULL) {
+      g_info("Error in allocating recv buffer for socket %d, "
+             "closing connection.\n",
+             AsyncSocket_GetFd(conn->asock));
+      CloseConn(conn);
+      return FALSE;
    }
+   conn->recvBuf = buf + RMQ_RELAY_HEADER_LEN;
 
    res = AsyncSocket_RecvPartial(conn->asock, conn->recvBuf,
-                                 conn->recvBufLen,
+                                 RMQ_CLIENT_CONN_RECV_BUFF_SIZE,
                                  conn->recvCb, conn);
    if (res != ASOCKERR_SUCCESS) {
       g_info("Error in AsyncSocket_RecvPartial for socket %d: %s\n",
@@ -448,8 +456,7 @@ RecvPacketFromVmxConn(ConnInfo *conn, int len)
 {
    int res;
 
-   res = AsyncSocket_Recv(conn->asock, conn->recvBuf + sizeof conn->packetLen,
-         len, conn->recvCb, conn);
+   res = AsyncSocket_Recv(conn->asock, conn->recvBuf, len, conn->recvCb, conn);
    if (res != ASOCKERR_SUCCESS) {
       g_info("Error in AsyncSocket_Recv for socket %d: %s\n",
              AsyncSocket_GetFd(conn->asock), AsyncSocket_Err2String(res));
@@ -487,14 +494,14 @@ ConnSendDoneCb(void *buf,            // IN
 
    g_debug("Entering %s\n", __FUNCTION__);
 
-   free(buf);
-
    if (AsyncSocket_GetState(asock) != AsyncSocketConnected) {
       /* this callback may be called after the connection is closed to
-       * empty the send buffer */
+       * empty the send buffer, the ring is freed by CloseConn() */
       return;
    }
 
+   RmqRelayRing_Release(&dst->sendRing, buf, &dst->stats,
+                        g_get_monotonic_time());
    dst->sendQueueLen -= len;
    ASSERT(dst->sendQueueLen >= 0);
 
@@ -510,7 +517,8 @@ ConnSendDoneCb(void *buf,            // IN
            dst->sendQueueLen);
 
    if ((!(dst->shutDown)) && src->recvStopped &&
-       (dst->sendQueueLen < proxyData.maxSendQueueLen)) {
+       (dst->sendQueueLen < proxyData.maxSendQueueLen) &&
+       !RmqRelayRing_IsFull(&dst->sendRing)) {
       g_debug("Restart reading from connection %d.\n",
               AsyncSocket_GetFd(src->asock));
 
@@ -557,9 +565,10 @@ StopRecvFromConn(ConnInfo *conn)   // IN
  *
  * SendToConn --
  *
- *      Call AsyncSocket_Send to queue the buffer for send.
- *      - If there is too much data queued, then recv from
- *        source connection is temporarily stopped.
+ *      Call AsyncSocket_Send to queue the buffer for send. The buffer must
+ *      be in the reserved buffer of the send ring of the connection.
+ *      - If there is too much data queued, or no more buffer in the send
+ *        ring, then recv from source connection is temporarily stopped.
  *
  * Result:
  *      TRUE on success, FALSE otherwise.
@@ -580,13 +589,13 @@ SendToConn(ConnInfo *dst,          // IN/OUT
 
    g_debug("Entering %s\n", __FUNCTION__);
 
+   RmqRelayRing_Commit(&dst->sendRing, len, g_get_monotonic_time());
    res = AsyncSocket_Send(dst->asock, buf, len, dst->sendCb, dst);
 
    if (res != ASOCKERR_SUCCESS) {
       g_info("Error in AsyncSocket_Send for socket %d, "
              "closing connection: %s\n",
              AsyncSocket_GetFd(dst->asock), AsyncSocket_Err2String(res));
-      free(buf);     /* need to free here */
       CloseConn(dst);
       return FALSE;
    }
@@ -598,7 +607,9 @@ SendToConn(ConnInfo *dst,          // IN/OUT
    g_debug("Socket %d sendQueueLen = %d\n",
            AsyncSocket_GetFd(dst->asock), dst->sendQueueLen);
 
-   if ((!src->recvStopped) && (dst->sendQueueLen > proxyData.maxSendQueueLen)) {
+   if ((!src->recvStopped) &&
+       (dst->sendQueueLen > proxyData.maxSendQueueLen ||
+        RmqRelayRing_IsFull(&dst->sendRing))) {
       StopRecvFromConn(src);
       return FALSE;
    }
@@ -668,6 +679,8 @@ SendVmxConnectRequest(void)
  * SendToVmxRmqProxy --
  *
  *      Package RabbitMQ Client data and send it to VMX RabbitMQ Proxy.
+ *      The data was received behind room reserved for the dataMap framing,
+ *      which is written in place so the packet is sent without a copy.
  *
  * Result:
  *      TRUE on sucess, FALSE on error
@@ -683,68 +696,12 @@ SendToVmxRmqProxy(ConnInfo *cli,     // IN
                   char *buf,         // IN
                   int len)           // IN
 {
-   DataMap map;
-   ErrorCode res;
-   char *newBuf;
-   char *serBuf;
-   int bufLen;
-   gboolean mapCreated = FALSE;
-   char *ver;
+   char *packet = buf - RMQ_RELAY_HEADER_LEN;
 
    g_debug("Entering %s\n", __FUNCTION__);
 
-   res = DataMap_Create(&map);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   mapCreated = TRUE;
-
-   res = DataMap_SetInt64(&map, RMQPROXYDM_FLD_COMMAND,
-                          COMMAND_DATA, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   ver = strdup(GUEST_RABBITMQ_PROXY_VERSION);
-   if (ver == NULL) {
-      res = DMERR_INSUFFICIENT_MEM;
-      goto quit;
-   }
-   res = DataMap_SetString(&map, RMQPROXYDM_FLD_GUEST_VER_ID, ver, -1, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   newBuf = malloc(len);
-   if (newBuf == NULL) {
-      g_warning("Error in allocating memory.\n");
-      goto quit;
-   }
-   memcpy(newBuf, buf, len);
-   res = DataMap_SetString(&map, RMQPROXYDM_FLD_PAYLOAD, newBuf,
-                           len, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   res = DataMap_Serialize(&map, &serBuf, &bufLen);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   DataMap_Destroy(&map);
-   return SendToConn(cli->toConn, serBuf, bufLen);
-
-quit:
-   if (mapCreated) {
-      DataMap_Destroy(&map);
-   }
-   g_info("Error in dataMap encoding for socket %d, error=%d, "
-          "closing connection.\n",
-          AsyncSocket_GetFd(cli->asock), res);
-   CloseConn(cli);
-   return FALSE;
+   RmqRelay_EncodeDataHeader(packet, len);
+   return SendToConn(cli->toConn, packet, RMQ_RELAY_HEADER_LEN + len);
 }
 
 
@@ -788,7 +745,8 @@ RmqClientConnRecvedCb(void *buf,            // IN
  *
  * ProcessVmxDataPacket --
  *
- *      Process the dataMap packet received from VMX.
+ *      Process the dataMap packet received from VMX. The packet was
+ *      received into the send ring of the client connection.
  *
  * Result:
  *      TRUE on success, FALSE on error.
@@ -800,40 +758,26 @@ RmqClientConnRecvedCb(void *buf,            // IN
  */
 
 static gboolean
-ProcessVmxDataPacket(ConnInfo *cli,     // IN
-                     DataMap *map)      // IN
+ProcessVmxDataPacket(ConnInfo *cli,          // IN
+                     int64 cmdType,          // IN
+                     const char *payload,    // IN
+                     int payloadLen)         // IN
 {
-   ErrorCode res;
-   int64 cmdType;
-
    g_debug("Entering %s\n", __FUNCTION__);
 
-   res = DataMap_GetInt64(map, RMQPROXYDM_FLD_COMMAND, &cmdType);
-   ASSERT(res == DMERR_SUCCESS);
-
    switch (cmdType) {
       case COMMAND_DATA:
          {
-            char *buf;
-            int payloadLen;
-            char *payload;
-
-            res = DataMap_GetString(map, RMQPROXYDM_FLD_PAYLOAD,
-                                    &payload, &payloadLen);
-            ASSERT(res == DMERR_SUCCESS && payloadLen > 0);
-            buf = malloc(payloadLen); /* get rid of this ? */
-
-            if (buf) {
-               memcpy(buf, payload, payloadLen);
-               return SendToConn(cli, buf, payloadLen);
-            } else {
-               g_warning("Could not allocate buffer for socket %d, "
-                         "closing connection.\n",
-                         AsyncSocket_GetFd(cli->asock));
+            if (payload == NULL) {
+               g_info("No payload in data packet for connection %d, "
+                      "closing connection.\n",
+                      AsyncSocket_GetFd(cli->asock));
                CloseConn(cli);
                return FALSE;
             }
-            break;
+
+            /* the payload is sent from the recv buffer */
+            return SendToConn(cli, (char *)payload, payloadLen);
          }
       case COMMAND_CLOSE:
          {
@@ -879,19 +823,26 @@ ProcessPacketHeaderLen(ConnInfo *conn,   // IN
 
    g_debug("Entering %s\n", __FUNCTION__);
 
-   if (conn->recvBuf == NULL || conn->recvBufLen < pktLen + len) {
-      conn->recvBufLen = pktLen + len;
-      free(conn->recvBuf);
-      conn->recvBuf = malloc(pktLen + len);
-      if (conn->recvBuf == NULL) {
-         g_info("Could not allocate recv buffer for socket %d, "
-                "closing connection.\n", AsyncSocket_GetFd(conn->asock));
-         CloseConn(conn);
-         return;
-      }
+   if (pktLen <= 0) {
+      g_info("Invalid packet length %d from socket %d, "
+             "closing connection.\n", pktLen, AsyncSocket_GetFd(conn->asock));
+      CloseConn(conn);
+      return;
+   }
+
+   /*
+    * Receive the packet right into the send ring of the client connection
+    * so its payload can be sent from there.
+    */
+   ASSERT(conn->toConn != NULL);
+   conn->recvBuf = RmqRelayRing_Reserve(&conn->toConn->sendRing, pktLen);
+   if (conn->recvBuf == NULL) {
+      g_info("Could not allocate recv buffer for socket %d, "
+             "closing connection.\n", AsyncSocket_GetFd(conn->asock));
+      CloseConn(conn);
+      return;
    }
 
-   *((int32 *)(conn->recvBuf)) = conn->packetLen;
    RecvPacketFromVmxConn(conn, pktLen);
 }
 
@@ -926,19 +877,25 @@ VmxConnRecvedCb(void *buf,            // IN
       ASSERT(len == sizeof conn->packetLen);
       ProcessPacketHeaderLen(conn, len);
    } else {
-      DataMap map;
       ErrorCode res;
-      int packetLen = len + sizeof conn->packetLen;
-
-      /* decoding the packet */
-      res = DataMap_Deserialize(conn->recvBuf, packetLen, &map);
-      ASSERT(res == DMERR_SUCCESS);
+      int64 cmdType;
+      const char *payload;
+      int payloadLen;
+
+      /* decoding the packet in place */
+      ASSERT(buf == conn->recvBuf);
+      res = RmqRelay_ParsePacket(conn->recvBuf, len, &cmdType,
+                                 &payload, &payloadLen);
+      if (res != DMERR_SUCCESS) {
+         g_info("Error in dataMap decoding for socket %d, error=%d, "
+                "closing connection.\n", AsyncSocket_GetFd(conn->asock), res);
+         CloseConn(conn);
+         return;
+      }
 
-      if (ProcessVmxDataPacket(conn->toConn, &map)) {
+      if (ProcessVmxDataPacket(conn->toConn, cmdType, payload, payloadLen)) {
          StartRecvFromVmx(conn); /* continue to recv next packet */
       }
-
-      DataMap_Destroy(&map);
    }
 
 }
@@ -1838,6 +1795,58 @@ GRabbitmqProxyShutdown(gpointer src,                 // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * GRabbitmqProxyDumpState --
+ *
+ *      Log the traffic relayed on each client connection and its vmx
+ *      connection.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+GRabbitmqProxyDumpState(gpointer src,                 // IN
+                        ToolsAppCtx *ctx,             // IN
+                        ToolsPluginData *plugin)      // IN
+{
+   GList *lp;
+   char stats[256];
+
+   ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                      "Message bus tunnelling %s, %u client connections.\n",
+                      proxyData.messageTunnellingEnabled ? "enabled" :
+                                                           "disabled",
+                      g_list_length(proxyData.rmqConnList));
+
+   for (lp = proxyData.rmqConnList; lp; lp = g_list_next(lp)) {
+      ConnInfo *cli = (ConnInfo *)(lp->data);
+
+      RmqRelayStats_Format(&cli->stats, stats, sizeof stats);
+      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                         "Client connection %d: sendQueueLen %d, %s\n",
+                         AsyncSocket_GetFd(cli->asock), cli->sendQueueLen,
+                         stats);
+      if (cli->toConn != NULL) {
+         ConnInfo *vmx = cli->toConn;
+
+         RmqRelayStats_Format(&vmx->stats, stats, sizeof stats);
+         ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                            "   vmx connection %d: sendQueueLen %d, %s\n",
+                            AsyncSocket_GetFd(vmx->asock), vmx->sendQueueLen,
+                            stats);
+      }
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -1943,7 +1952,8 @@ ToolsOnLoad(ToolsAppCtx *ctx)           // IN
 
    ToolsPluginSignalCb sigs[] = {
       { TOOLS_CORE_SIG_SHUTDOWN, GRabbitmqProxyShutdown, &regData },
-      { TOOLS_CORE_SIG_SET_OPTION, GRabbitmqProxySetOption, &regData }
+      { TOOLS_CORE_SIG_SET_OPTION, GRabbitmqProxySetOption, &regData },
+      { TOOLS_CORE_SIG_DUMP_STATE, GRabbitmqProxyDumpState, &regData }
    };
    ToolsAppReg regs[] = {
       { TOOLS_APP_SIGNALS,
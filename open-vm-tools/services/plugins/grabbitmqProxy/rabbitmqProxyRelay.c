@@ -0,0 +1,541 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rabbitmqProxyRelay.c --
+ *
+ *    Relay buffers and dataMap framing for the guest RabbitMQ proxy.
+ *
+ *    Data from a RabbitMQ client is received right behind room reserved for
+ *    the dataMap framing, which is then written in place so the packet can be
+ *    sent to VMX as is. The framing is the one DataMap_Serialize() produces
+ *    for a map holding the command, the guest proxy version and the payload,
+ *    with the payload last. Packets from VMX are parsed in place and their
+ *    payload is sent to the client from the receive buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#else
+#include <winsock2.h>
+#endif
+
+#include "vm_assert.h"
+#include "rabbitmqProxyRelay.h"
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PutInt32 --
+ *
+ *      Encode an int32 in network byte order and advance the buffer.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PutInt32(char **buf,     // IN/OUT
+         int32 num)      // IN
+{
+   uint32 netVal = htonl((uint32)num);
+
+   memcpy(*buf, &netVal, sizeof netVal);
+   *buf += sizeof netVal;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * GetInt32 --
+ *
+ *      Decode an int32 in network byte order and advance the buffer.
+ *
+ * Results:
+ *      DMERR_SUCCESS, or DMERR_TRUNCATED_DATA if the buffer is too short.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+GetInt32(const char **buf,   // IN/OUT
+         int *left,          // IN/OUT
+         int32 *num)         // OUT
+{
+   uint32 netVal;
+
+   if (*left < (int)sizeof netVal) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
+   memcpy(&netVal, *buf, sizeof netVal);
+   *num = (int32)ntohl(netVal);
+   *buf += sizeof netVal;
+   *left -= sizeof netVal;
+
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SkipString --
+ *
+ *      Skip a counted string in a dataMap buffer.
+ *
+ * Results:
+ *      DMERR_SUCCESS on success, an error code if the string is malformed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+SkipString(const char **buf,      // IN/OUT
+           int *left,             // IN/OUT
+           const char **str,      // OUT/OPT
+           int *strLen)           // OUT/OPT
+{
+   ErrorCode res;
+   int32 len;
+
+   res = GetInt32(buf, left, &len);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   if (len <= 0) {
+      return DMERR_BAD_DATA;
+   }
+
+   if (*left < len) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
+   if (str != NULL) {
+      *str = *buf;
+      *strLen = len;
+   }
+   *buf += len;
+   *left -= len;
+
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqRelayRing_Reserve --
+ *
+ *      Get the buffer the next data for this connection should be received
+ *      into. The buffer stays reserved until it is committed, so calling
+ *      this again returns the same buffer. Buffers are allocated on first
+ *      use and only grown for packets larger than RMQ_RELAY_BUF_SIZE.
+ *
+ * Results:
+ *      The buffer, or NULL if out of memory.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+char *
+RmqRelayRing_Reserve(RmqRelayRing *ring,     // IN/OUT
+                     int size)               // IN
+{
+   RmqRelayBuf *rb = &ring->bufs[ring->head];
+
+   ASSERT(!RmqRelayRing_IsFull(ring));
+   ASSERT(size > 0);
+
+   if (rb->size < size) {
+      int newSize = MAX(size, RMQ_RELAY_BUF_SIZE);
+
+      /* the contents need not be kept, avoid the copy of realloc() */
+      free(rb->data);
+      rb->data = malloc(newSize);
+      rb->size = rb->data != NULL ? newSize : 0;
+   }
+
+   return rb->data;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqRelayRing_Commit --
+ *
+ *      Mark the reserved buffer as queued for send.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RmqRelayRing_Commit(RmqRelayRing *ring,      // IN/OUT
+                    int len,                 // IN
+                    int64 now)               // IN
+{
+   RmqRelayBuf *rb = &ring->bufs[ring->head];
+
+   ASSERT(!RmqRelayRing_IsFull(ring));
+   ASSERT(rb->data != NULL && len <= rb->size);
+
+   rb->len = len;
+   rb->queuedTime = now;
+   ring->head = (ring->head + 1) % RMQ_RELAY_RING_SIZE;
+   ring->used++;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqRelayRing_Release --
+ *
+ *      Release the oldest queued buffer once it has been sent and account
+ *      for it. Buffers larger than the default size are freed so a single
+ *      large packet does not pin memory.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RmqRelayRing_Release(RmqRelayRing *ring,     // IN/OUT
+                     const void *buf,        // IN
+                     RmqRelayStats *stats,   // IN/OUT
+                     int64 now)              // IN
+{
+   RmqRelayBuf *rb = &ring->bufs[ring->tail];
+   int64 latency = now - rb->queuedTime;
+
+   ASSERT(ring->used > 0);
+   /* sends complete in the order they were queued */
+   ASSERT((const char *)buf >= rb->data &&
+          (const char *)buf < rb->data + rb->size);
+
+   if (stats->packets == 0) {
+      stats->firstTime = rb->queuedTime;
+   }
+   stats->bytes += rb->len;
+   stats->packets++;
+   stats->lastTime = now;
+   stats->latencySum += latency;
+   stats->latencyMax = MAX(stats->latencyMax, latency);
+
+   if (rb->size > RMQ_RELAY_BUF_SIZE) {
+      free(rb->data);
+      rb->data = NULL;
+      rb->size = 0;
+   }
+   rb->len = 0;
+   ring->tail = (ring->tail + 1) % RMQ_RELAY_RING_SIZE;
+   ring->used--;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqRelayRing_IsFull --
+ *
+ *      Check whether all buffers are queued for send.
+ *
+ * Results:
+ *      TRUE if no buffer can be reserved.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+RmqRelayRing_IsFull(const RmqRelayRing *ring)   // IN
+{
+   return ring->used == RMQ_RELAY_RING_SIZE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqRelayRing_Destroy --
+ *
+ *      Free all the buffers. Nothing may be pending on them.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RmqRelayRing_Destroy(RmqRelayRing *ring)     // IN/OUT
+{
+   int i;
+
+   for (i = 0; i < RMQ_RELAY_RING_SIZE; i++) {
+      free(ring->bufs[i].data);
+   }
+   memset(ring, 0, sizeof *ring);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqRelay_EncodeDataHeader --
+ *
+ *      Write the dataMap framing of a COMMAND_DATA packet in the
+ *      RMQ_RELAY_HEADER_LEN bytes in front of the payload. The result is
+ *      what DataMap_Serialize() produces for the same map, with the fields
+ *      ordered so that the payload comes last.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RmqRelay_EncodeDataHeader(char *buf,         // OUT
+                          int payloadLen)    // IN
+{
+   char *p = buf;
+   int verLen = sizeof GUEST_RABBITMQ_PROXY_VERSION - 1;
+
+   ASSERT(payloadLen > 0);
+
+   PutInt32(&p, RMQ_RELAY_HEADER_LEN - sizeof(int32) + payloadLen);
+
+   PutInt32(&p, DMFIELDTYPE_INT64);
+   PutInt32(&p, RMQPROXYDM_FLD_COMMAND);
+   PutInt32(&p, COMMAND_DATA);           /* low 32 bits */
+   PutInt32(&p, 0);                      /* high 32 bits */
+
+   PutInt32(&p, DMFIELDTYPE_STRING);
+   PutInt32(&p, RMQPROXYDM_FLD_GUEST_VER_ID);
+   PutInt32(&p, verLen);
+   memcpy(p, GUEST_RABBITMQ_PROXY_VERSION, verLen);
+   p += verLen;
+
+   PutInt32(&p, DMFIELDTYPE_STRING);
+   PutInt32(&p, RMQPROXYDM_FLD_PAYLOAD);
+   PutInt32(&p, payloadLen);
+
+   ASSERT(p == buf + RMQ_RELAY_HEADER_LEN);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqRelay_ParsePacket --
+ *
+ *      Find the command and the payload of a dataMap packet without
+ *      decoding it into a map. 'content' is the packet without its length.
+ *      The packet is checked the way DataMap_DeserializeContent() does,
+ *      other fields are skipped.
+ *
+ * Results:
+ *      DMERR_SUCCESS on success, and the payload points into 'content', or is
+ *      NULL if the packet has none. An error code if the packet is malformed
+ *      or has no command.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+RmqRelay_ParsePacket(const char *content,    // IN
+                     int contentLen,         // IN
+                     int64 *command,         // OUT
+                     const char **payload,   // OUT
+                     int *payloadLen)        // OUT
+{
+   const char *buf = content;
+   int left = contentLen;
+   Bool haveCommand = FALSE;
+   ErrorCode res = DMERR_SUCCESS;
+
+   *payload = NULL;
+   *payloadLen = 0;
+
+   while (left > 0 && res == DMERR_SUCCESS) {
+      int32 type;
+      int32 fieldId;
+      int32 count;
+      int32 i;
+
+      if ((res = GetInt32(&buf, &left, &type)) != DMERR_SUCCESS ||
+          (res = GetInt32(&buf, &left, &fieldId)) != DMERR_SUCCESS) {
+         break;
+      }
+
+      switch (type) {
+      case DMFIELDTYPE_INT64:
+         {
+            int32 low;
+            int32 high;
+
+            if ((res = GetInt32(&buf, &left, &low)) != DMERR_SUCCESS ||
+                (res = GetInt32(&buf, &left, &high)) != DMERR_SUCCESS) {
+               break;
+            }
+            if (fieldId == RMQPROXYDM_FLD_COMMAND) {
+               if (haveCommand) {
+                  res = DMERR_DUPLICATED_FIELD_IDS;
+                  break;
+               }
+               *command = (int64)(((uint64)(uint32)high << 32) | (uint32)low);
+               haveCommand = TRUE;
+            }
+            break;
+         }
+      case DMFIELDTYPE_STRING:
+         if (fieldId == RMQPROXYDM_FLD_PAYLOAD) {
+            if (*payload != NULL) {
+               res = DMERR_DUPLICATED_FIELD_IDS;
+               break;
+            }
+            res = SkipString(&buf, &left, payload, payloadLen);
+         } else {
+            res = SkipString(&buf, &left, NULL, NULL);
+         }
+         break;
+      case DMFIELDTYPE_INT64LIST:
+         res = GetInt32(&buf, &left, &count);
+         if (res == DMERR_SUCCESS) {
+            if (count < 0 || count > left / (int)sizeof(int64)) {
+               res = DMERR_BAD_DATA;
+               break;
+            }
+            buf += count * sizeof(int64);
+            left -= count * sizeof(int64);
+         }
+         break;
+      case DMFIELDTYPE_STRINGLIST:
+         res = GetInt32(&buf, &left, &count);
+         if (res == DMERR_SUCCESS) {
+            if (count < 0 || count > left / (int)sizeof(int32)) {
+               res = DMERR_BAD_DATA;
+               break;
+            }
+            for (i = 0; i < count && res == DMERR_SUCCESS; i++) {
+               res = SkipString(&buf, &left, NULL, NULL);
+            }
+         }
+         break;
+      default:
+         res = DMERR_UNKNOWN_TYPE;
+         break;
+      }
+   }
+
+   if (res == DMERR_SUCCESS && !haveCommand) {
+      res = DMERR_NOT_FOUND;
+   }
+   if (res != DMERR_SUCCESS) {
+      *payload = NULL;
+      *payloadLen = 0;
+   }
+
+   return res;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqRelayStats_Format --
+ *
+ *      Describe the traffic sent on a connection.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RmqRelayStats_Format(const RmqRelayStats *stats,   // IN
+                     char *buf,                    // OUT
+                     size_t bufSize)               // IN
+{
+   int64 elapsed = stats->lastTime - stats->firstTime;
+   double rate = 0;
+
+   if (stats->packets == 0) {
+      snprintf(buf, bufSize, "no data sent");
+      return;
+   }
+
+   if (elapsed > 0) {
+      rate = (double)stats->bytes / elapsed;   /* bytes per us == MB/s */
+   }
+
+   snprintf(buf, bufSize,
+            "%"FMT64"u bytes in %"FMT64"u sends, %.2f MB/s, "
+            "latency avg %"FMT64"u us max %"FMT64"d us",
+            stats->bytes, stats->packets, rate,
+            stats->latencySum / stats->packets, stats->latencyMax);
+}
@@ -0,0 +1,129 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rabbitmqProxyRelay.h --
+ *
+ *    Buffers and dataMap framing used to relay data between RabbitMQ
+ *    clients and the VMX RabbitMQ proxy without copying it.
+ */
+
+#ifndef _RABBITMQ_PROXY_RELAY_H_
+#define _RABBITMQ_PROXY_RELAY_H_
+
+#include "vm_basic_types.h"
+#include "rabbitmqProxyConst.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define GUEST_RABBITMQ_PROXY_VERSION             "1.0"
+
+/* user level recv buffer */
+#define RMQ_CLIENT_CONN_RECV_BUFF_SIZE           (64 * 1024)
+
+/*
+ * Size of the dataMap framing put in front of a client payload: the packet
+ * length, the command, the guest proxy version and the payload field header.
+ */
+#define RMQ_RELAY_HEADER_LEN                                    \
+   (sizeof(int32) +                                             \
+    2 * sizeof(int32) + sizeof(int64) +                         \
+    3 * sizeof(int32) + sizeof GUEST_RABBITMQ_PROXY_VERSION - 1 + \
+    3 * sizeof(int32))
+
+/* default size of a relay buffer, enough for a full client recv */
+#define RMQ_RELAY_BUF_SIZE \
+   (RMQ_RELAY_HEADER_LEN + RMQ_CLIENT_CONN_RECV_BUFF_SIZE)
+
+/* number of buffers that can be queued for send on a connection */
+#define RMQ_RELAY_RING_SIZE                      8
+
+typedef struct RmqRelayBuf {
+   char *data;
+   int size;                  /* allocated size of data */
+   int len;                   /* number of bytes sent from the buffer */
+   int64 queuedTime;          /* when the buffer was queued, in us */
+} RmqRelayBuf;
+
+/*
+ * FIFO of buffers queued for send on a connection. The peer connection
+ * receives into the head buffer, which is committed once the data is queued
+ * for send, and buffers are released in order as sends complete. Buffers are
+ * kept for reuse, so the relay does not allocate memory once the ring is
+ * warm.
+ */
+typedef struct RmqRelayRing {
+   RmqRelayBuf bufs[RMQ_RELAY_RING_SIZE];
+   int head;                  /* next buffer to receive into */
+   int tail;                  /* oldest buffer being sent */
+   int used;                  /* number of buffers being sent */
+} RmqRelayRing;
+
+typedef struct RmqRelayStats {
+   uint64 bytes;              /* bytes sent */
+   uint64 packets;            /* buffers sent */
+   int64 firstTime;           /* when the first buffer was queued, in us */
+   int64 lastTime;            /* when the last send completed, in us */
+   uint64 latencySum;         /* total time from queued to sent, in us */
+   int64 latencyMax;          /* longest time from queued to sent, in us */
+} RmqRelayStats;
+
+char *
+RmqRelayRing_Reserve(RmqRelayRing *ring,
+                     int size);
+
+void
+RmqRelayRing_Commit(RmqRelayRing *ring,
+                    int len,
+                    int64 now);
+
+void
+RmqRelayRing_Release(RmqRelayRing *ring,
+                     const void *buf,
+                     RmqRelayStats *stats,
+                     int64 now);
+
+Bool
+RmqRelayRing_IsFull(const RmqRelayRing *ring);
+
+void
+RmqRelayRing_Destroy(RmqRelayRing *ring);
+
+void
+RmqRelay_EncodeDataHeader(char *buf,
+                          int payloadLen);
+
+ErrorCode
+RmqRelay_ParsePacket(const char *content,
+                     int contentLen,
+                     int64 *command,
+                     const char **payload,
+                     int *payloadLen);
+
+void
+RmqRelayStats_Format(const RmqRelayStats *stats,
+                     char *buf,
+                     size_t bufSize);
+
+#if defined(__cplusplus)
+}  // extern "C"
+#endif
+
+#endif  /* _RABBITMQ_PROXY_RELAY_H_ */
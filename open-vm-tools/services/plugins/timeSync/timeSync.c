@@ -108,6 +108,10 @@
  *    of seconds. This additional correction mitigates potential failures
  *    in guest time sync agent.
  *
+ * Each synchronization is recorded in a sample log (see timeSyncSamples.c)
+ * so that the behavior of the corrections can be studied offline, for
+ * example with the simulator in tests/testTimeSync.
+ *
  */
 
 #include "timeSync.h"
@@ -180,6 +184,8 @@ typedef struct TimeSyncData {
    uint32             guestResyncTimeout;
    GSource           *guestResyncTimer;
    ToolsAppCtx       *ctx;
+   gboolean           ioFrozen;
+   gboolean           samplesPending;
 } TimeSyncData;
 
 /*
@@ -449,10 +455,11 @@ TimeSyncStepTime(TimeSyncData *data, int64 adjustment)
  *
  * @param[in]  data              Structure tracking time sync state.
  * @param[in]  adjustment        Amount to correct the guest time.
+ * @param[out] sample            Sample to record the correction in.
  */
 
 static gboolean
-TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
+TimeSyncSlewTime(TimeSyncData *data, int64 adjustment, TimeSyncSample *sample)
 {
    static int64 calibrationStart;
    static int64 calibrationAdjustment;
@@ -475,6 +482,8 @@ TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
 
    if (data->slewState == TimeSyncUncalibrated) {
       g_debug("Slewing time: adjustment %"FMT64"d\n", adjustment);
+      sample->action = TIMESYNC_ACTION_SLEW;
+      sample->correction = slewDiff;
       if (!TimeSync_Slew(slewDiff, timeSyncPeriodUS, &remaining)) {
          data->slewState = TimeSyncUncalibrated;
          return FALSE;
@@ -492,6 +501,7 @@ TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
          int64 ppmErr;
          /* Reset slewing to nominal and find out remaining slew. */
          TimeSync_Slew(0, timeSyncPeriodUS, &remaining);
+         sample->action = TIMESYNC_ACTION_CALIBRATE;
          calibrationAdjustment += adjustment;
          calibrationAdjustment -= remaining;
          ppmErr = ((1000000 * calibrationAdjustment) << 16) / 
@@ -502,6 +512,8 @@ TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
             TimeSync_PLLUpdate(adjustment);
             TimeSync_PLLSetFrequency(ppmErr);
             data->slewState = TimeSyncPLL;
+            sample->action = TIMESYNC_ACTION_PLL;
+            sample->correction = adjustment;
          } else {
             /* PPM error is too large to try the PLL. */
             g_debug("PPM error too large: %"FMT64"d (%"FMT64"d) "
@@ -510,6 +522,8 @@ TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
          }
       } else {
          g_debug("Calibrating error: adjustment %"FMT64"d\n", adjustment);
+         sample->action = TIMESYNC_ACTION_CALIBRATE;
+         sample->correction = slewDiff;
          if (!TimeSync_Slew(slewDiff, timeSyncPeriodUS, &remaining)) {
             return FALSE;
          }
@@ -519,10 +533,13 @@ TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
    } else {
       ASSERT(data->slewState == TimeSyncPLL);
       g_debug("Updating PLL: adjustment %"FMT64"d\n", adjustment);
+      sample->action = TIMESYNC_ACTION_PLL;
+      sample->correction = adjustment;
       if (!TimeSync_PLLUpdate(adjustment)) {
          TimeSyncResetSlew(data);
       }
    }
+   sample->remaining = remaining;
    return TRUE;
 }
 
@@ -594,6 +611,55 @@ TimeSyncGuestResyncTimeoutHandler(gpointer _data)
 }
 
 
+/**
+ * Append the new samples of the sample log to the file configured in
+ * tools.conf, if any.
+ *
+ * @param[in]  data     Time sync data.
+ */
+
+static void
+TimeSyncWriteSamples(TimeSyncData *data)
+{
+   if (data->ctx != NULL && data->ctx->config != NULL) {
+      gchar *path = g_key_file_get_string(data->ctx->config,
+                                          CONFGROUPNAME_TIMESYNC,
+                                          CONFNAME_TIMESYNC_SAMPLESFILE,
+                                          NULL);
+      if (path != NULL && *path != '\0') {
+         TimeSync_AppendSamples(path);
+      }
+      g_free(path);
+   }
+}
+
+
+/**
+ * Add a sample to the sample log, and append it to the file configured in
+ * tools.conf, if any.
+ *
+ * While I/O is frozen the file is left alone, since writing to a frozen file
+ * system would block the main loop that has to process the thaw; the samples
+ * recorded in the meantime are appended once I/O is thawed.
+ *
+ * @param[in]  data     Time sync data.
+ * @param[in]  sample   The sample.
+ */
+
+static void
+TimeSyncRecordSample(TimeSyncData *data,
+                     const TimeSyncSample *sample)
+{
+   TimeSync_RecordSample(sample);
+
+   if (data->ioFrozen) {
+      data->samplesPending = TRUE;
+   } else {
+      TimeSyncWriteSamples(data);
+   }
+}
+
+
 /**
  * Set the guest OS time to the host OS time.
  *
@@ -616,6 +682,8 @@ TimeSyncDoSync(Bool slewCorrection,
    int64 gosError, apparentError, maxTimeError;
    Bool apparentErrorValid;
    TimeSyncData *data = _data;
+   TimeSyncSample sample = { 0 };
+   gboolean ret = TRUE;
 
    g_debug("Synchronizing time: "
            "syncType %d, slewCorrection %d, allowBackwardSync %d "
@@ -630,6 +698,13 @@ TimeSyncDoSync(Bool slewCorrection,
 
    gosError = guest - host - apparentError;
 
+   sample.host = host;
+   sample.guest = guest;
+   sample.apparentError = apparentError;
+   sample.maxTimeError = maxTimeError;
+   sample.periodic = syncType == TIMESYNC_PERIODIC;
+   sample.action = TIMESYNC_ACTION_NONE;
+
    if (syncType == TIMESYNC_STEP || syncType == TIMESYNC_STEP_NORESYNC) {
       /*
        * Non-loop behavior:
@@ -653,8 +728,11 @@ TimeSyncDoSync(Bool slewCorrection,
             if (data->guestResyncTimer == NULL) {
                g_debug("Guest resync: stepping time.\n");
                ASSERT(data->ctx != NULL);
+               sample.action = TIMESYNC_ACTION_RESYNC;
                if (!TimeSync_DoGuestResync(data->ctx)) {
                   g_warning("Guest resync operation failed.\n");
+                  sample.failed = TRUE;
+                  TimeSyncRecordSample(data, &sample);
                   return TimeSyncDoSync(data->slewCorrection,
                                         TIMESYNC_STEP_NORESYNC,
                                         allowBackwardSync, data);
@@ -669,13 +747,13 @@ TimeSyncDoSync(Bool slewCorrection,
             } else {
                g_warning("Guest resync is in progress, ignoring one-time "
                          "synchronization event.\n");
-               return FALSE;
+               ret = FALSE;
             }
          } else {
             g_debug("One time synchronization: stepping time.\n");
-            if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
-               return FALSE;
-            }
+            sample.action = TIMESYNC_ACTION_STEP;
+            sample.correction = -gosError + -apparentError;
+            ret = TimeSyncStepTime(data, sample.correction);
          }
       } else {
          g_debug("One time synchronization: correction not needed.\n");
@@ -695,18 +773,18 @@ TimeSyncDoSync(Bool slewCorrection,
 
       if (gosError < -maxTimeError) {
          g_debug("Periodic synchronization: stepping time.\n");
-         if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
-            return FALSE;
-         }
+         sample.action = TIMESYNC_ACTION_STEP;
+         sample.correction = -gosError + -apparentError;
+         ret = TimeSyncStepTime(data, sample.correction);
       } else if (slewCorrection && apparentErrorValid) {
          g_debug("Periodic synchronization: slewing time.\n");
-         if (!TimeSyncSlewTime(data, -gosError)) {
-            return FALSE;
-         }
+         ret = TimeSyncSlewTime(data, -gosError, &sample);
       }
    }
 
-   return TRUE;
+   sample.failed = !ret;
+   TimeSyncRecordSample(data, &sample);
+   return ret;
 }
 
 
@@ -830,6 +908,21 @@ TimeSyncTcloHandler(RpcInData *data)
 }
 
 
+/**
+ * Returns the recent time synchronization samples.
+ *
+ * @param[in]  data     RPC request data.
+ *
+ * @return TRUE
+ */
+
+static gboolean
+TimeSyncSamplesHandler(RpcInData *data)
+{
+   return RPCIN_SETRETVALSF(data, TimeSync_GetSamples(), TRUE);
+}
+
+
 /**
  * Parses boolean option string.
  *
@@ -998,6 +1091,32 @@ TimeSyncSetOption(gpointer src,
 }
 
 
+/**
+ * IO freeze signal handler. Holds back writes to the sample file while I/O
+ * is frozen, and writes out the samples recorded in the meantime on thaw.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      The app context.
+ * @param[in]  freeze   Whether I/O is being frozen.
+ * @param[in]  plugin   Plugin registration data.
+ */
+
+static void
+TimeSyncIOFreeze(gpointer src,
+                 ToolsAppCtx *ctx,
+                 gboolean freeze,
+                 ToolsPluginData *plugin)
+{
+   TimeSyncData *data = plugin->_private;
+
+   data->ioFrozen = freeze;
+   if (!freeze && data->samplesPending) {
+      data->samplesPending = FALSE;
+      TimeSyncWriteSamples(data);
+   }
+}
+
+
 /**
  * Handles a shutdown callback; cleans up internal plugin state.
  *
@@ -1041,9 +1160,11 @@ ToolsOnLoad(ToolsAppCtx *ctx)
 
    TimeSyncData *data = g_malloc(sizeof (TimeSyncData));
    RpcChannelCallback rpcs[] = {
-      { TIMESYNC_SYNCHRONIZE, TimeSyncTcloHandler, data, NULL, NULL, 0 }
+      { TIMESYNC_SYNCHRONIZE, TimeSyncTcloHandler, data, NULL, NULL, 0 },
+      { TIMESYNC_GET_SAMPLES, TimeSyncSamplesHandler, NULL, NULL, NULL, 0 }
    };
    ToolsPluginSignalCb sigs[] = {
+      { TOOLS_CORE_SIG_IO_FREEZE, TimeSyncIOFreeze, &regData },
       { TOOLS_CORE_SIG_SET_OPTION, TimeSyncSetOption, &regData },
       { TOOLS_CORE_SIG_SHUTDOWN, TimeSyncShutdown, &regData }
    };
@@ -1063,6 +1184,8 @@ ToolsOnLoad(ToolsAppCtx *ctx)
    data->guestResyncTimeout = 0;
    data->guestResyncTimer = NULL;
    data->ctx = ctx;
+   data->ioFrozen = FALSE;
+   data->samplesPending = FALSE;
    regData.regs = VMTools_WrapArray(regs, sizeof *regs, ARRAYSIZE(regs));
    regData._private = data;
 
@@ -26,10 +26,46 @@
  */
 
 #define G_LOG_DOMAIN "timeSync"
+#include <glib.h>
 #include "vm_basic_types.h"
 
 #define US_PER_SEC 1000000
 
+/** Correction chosen by a synchronization. */
+typedef enum TimeSyncAction {
+   TIMESYNC_ACTION_NONE,
+   TIMESYNC_ACTION_STEP,
+   TIMESYNC_ACTION_RESYNC,
+   TIMESYNC_ACTION_SLEW,
+   TIMESYNC_ACTION_CALIBRATE,
+   TIMESYNC_ACTION_PLL,
+} TimeSyncAction;
+
+/** One synchronization, as recorded in the sample log. All times in us. */
+typedef struct TimeSyncSample {
+   int64           host;           /* Host time. */
+   int64           guest;          /* Guest time. */
+   int64           apparentError;  /* Apparent time - host time. */
+   int64           maxTimeError;   /* Error allowed before stepping. */
+   Bool            periodic;       /* Periodic or one time sync. */
+   TimeSyncAction  action;
+   int64           correction;     /* Change requested from the clock. */
+   int64           remaining;      /* Part of the previous slew not done. */
+   Bool            failed;
+} TimeSyncSample;
+
+void
+TimeSync_RecordSample(const TimeSyncSample *sample);
+
+gchar *
+TimeSync_GetSamples(void);
+
+void
+TimeSync_WriteSamples(const char *path);
+
+void
+TimeSync_AppendSamples(const char *path);
+
 Bool
 TimeSync_GetCurrentTime(int64 *now);
 
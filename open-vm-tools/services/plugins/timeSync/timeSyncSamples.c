@@ -0,0 +1,226 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file timeSyncSamples.c
+ *
+ * Keeps a log of the most recent time synchronizations: the host and guest
+ * times that were read, the apparent error reported by the host and the
+ * correction that was decided. Samples live in a fixed size ring buffer
+ * that holds a day worth of periodic synchronizations at the default
+ * period, so the oldest samples are dropped first.
+ *
+ * The log is returned by the "Time_Synchronize_Get_Samples" RPC and, if
+ * timeSync.samples-file is set in tools.conf, saved to that file: the file is
+ * rewritten with the whole log the first time, then the new samples are
+ * appended after each synchronization. Once the file holds
+ * TIMESYNC_SAMPLES_FILE_MAX samples it is compacted, i.e. rewritten with the
+ * whole log again. Each line holds, in microseconds, the host time,
+ * the guest time, the guest OS error (guest - host - apparent error), the
+ * apparent error and the maximum error allowed before stepping, followed by
+ * the type of synchronization, the action taken, the correction requested
+ * from the clock, the part of the previous slew that was not done and
+ * whether the correction succeeded.
+ *
+ * Only the main loop synchronizes time, so the ring is not locked.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "timeSync.h"
+#include "vm_assert.h"
+#include "vm_basic_defs.h"
+
+#define TIMESYNC_SAMPLES_SIZE 1440
+#define TIMESYNC_SAMPLES_FILE_MAX (2 * TIMESYNC_SAMPLES_SIZE)
+
+#define TIMESYNC_SAMPLES_HEADER "# host_us guest_us gos_error_us " \
+                                "apparent_error_us max_error_us type action " \
+                                "correction_us remaining_us status\n"
+
+static TimeSyncSample gSamples[TIMESYNC_SAMPLES_SIZE];
+static guint gSamplesNext;
+static guint gSamplesCount;
+
+/* Newest samples not saved to the sample file yet. */
+static guint gSamplesUnsaved;
+/* Sample file the log was last saved to, NULL if it must be rewritten. */
+static gchar *gSamplesPath;
+/* Number of samples in that file. */
+static guint gSamplesInFile;
+
+static const char *gActionNames[] = {
+   "none",
+   "step",
+   "resync",
+   "slew",
+   "calibrate",
+   "pll",
+};
+
+
+/**
+ * Adds a sample to the log, replacing the oldest one if the log is full.
+ *
+ * @param[in]  sample   The sample.
+ */
+
+void
+TimeSync_RecordSample(const TimeSyncSample *sample)
+{
+   gSamples[gSamplesNext] = *sample;
+   gSamplesNext = (gSamplesNext + 1) % TIMESYNC_SAMPLES_SIZE;
+   if (gSamplesCount < TIMESYNC_SAMPLES_SIZE) {
+      gSamplesCount++;
+   }
+   if (gSamplesUnsaved < TIMESYNC_SAMPLES_SIZE) {
+      gSamplesUnsaved++;
+   }
+}
+
+
+/**
+ * Formats a sample of the log as a line of text.
+ *
+ * @param[in]  str      String the line is appended to.
+ * @param[in]  i        Index of the sample, 0 being the oldest.
+ */
+
+static void
+TimeSyncFormatSample(GString *str,
+                     guint i)
+{
+   TimeSyncSample *s = &gSamples[(gSamplesNext + TIMESYNC_SAMPLES_SIZE -
+                                  gSamplesCount + i) %
+                                 TIMESYNC_SAMPLES_SIZE];
+
+   ASSERT(i < gSamplesCount);
+   ASSERT(s->action < ARRAYSIZE(gActionNames));
+   g_string_append_printf(str, "%"FMT64"d %"FMT64"d %"FMT64"d %"FMT64"d "
+                          "%"FMT64"d %s %s %"FMT64"d %"FMT64"d %s\n",
+                          s->host, s->guest,
+                          s->guest - s->host - s->apparentError,
+                          s->apparentError, s->maxTimeError,
+                          s->periodic ? "periodic" : "onetime",
+                          gActionNames[s->action], s->correction,
+                          s->remaining, s->failed ? "failed" : "ok");
+}
+
+
+/**
+ * Formats the contents of the log, oldest sample first.
+ *
+ * @return The samples as text. Should be freed with g_free().
+ */
+
+gchar *
+TimeSync_GetSamples(void)
+{
+   GString *str = g_string_new(TIMESYNC_SAMPLES_HEADER);
+   guint i;
+
+   for (i = 0; i < gSamplesCount; i++) {
+      TimeSyncFormatSample(str, i);
+   }
+
+   return g_string_free(str, FALSE);
+}
+
+
+/**
+ * Writes the log to the given file.
+ *
+ * @param[in]  path     Path of the file.
+ */
+
+void
+TimeSync_WriteSamples(const char *path)
+{
+   gchar *contents = TimeSync_GetSamples();
+   GError *err = NULL;
+
+   g_free(gSamplesPath);
+   gSamplesPath = NULL;
+
+   if (g_file_set_contents(path, contents, -1, &err)) {
+      gSamplesPath = g_strdup(path);
+      gSamplesInFile = gSamplesCount;
+      gSamplesUnsaved = 0;
+   } else {
+      g_warning("Error writing time sync samples %s: %s\n", path,
+                err->message);
+      g_clear_error(&err);
+   }
+   g_free(contents);
+}
+
+
+/**
+ * Appends the samples recorded since the last call to the given file.
+ * Rewrites the file instead if it was not written by this process yet, if
+ * the last write failed, or if it would grow beyond TIMESYNC_SAMPLES_FILE_MAX
+ * samples.
+ *
+ * @param[in]  path     Path of the file.
+ */
+
+void
+TimeSync_AppendSamples(const char *path)
+{
+   GString *str;
+   FILE *file;
+   gboolean ok;
+   guint i;
+
+   if (gSamplesPath == NULL || strcmp(gSamplesPath, path) != 0 ||
+       gSamplesInFile + gSamplesUnsaved > TIMESYNC_SAMPLES_FILE_MAX) {
+      TimeSync_WriteSamples(path);
+      return;
+   }
+
+   if (gSamplesUnsaved == 0) {
+      return;
+   }
+
+   str = g_string_new(NULL);
+   for (i = gSamplesCount - gSamplesUnsaved; i < gSamplesCount; i++) {
+      TimeSyncFormatSample(str, i);
+   }
+
+   file = g_fopen(path, "a");
+   if (file == NULL) {
+      ok = FALSE;
+   } else {
+      ok = fwrite(str->str, 1, str->len, file) == str->len;
+      ok = fclose(file) == 0 && ok;
+   }
+
+   if (ok) {
+      gSamplesInFile += gSamplesUnsaved;
+      gSamplesUnsaved = 0;
+   } else {
+      /* The file may end with a partial line: rewrite it next time. */
+      g_warning("Error appending time sync samples to %s: %s\n", path,
+                strerror(errno));
+      g_free(gSamplesPath);
+      gSamplesPath = NULL;
+   }
+   g_string_free(str, TRUE);
+}
@@ -5246,6 +5246,34 @@ VixToolsListProcCacheCleanup(void *clientData) // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsComparePids --
+ *
+ *    qsort() comparison function for ProcMgr_Pid values.
+ *
+ * Return value:
+ *    Negative, zero or positive as *a is less than, equal to or greater
+ *    than *b.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+VixToolsComparePids(const void *a,  // IN
+                    const void *b)  // IN
+{
+   ProcMgr_Pid pidA = *(const ProcMgr_Pid *)a;
+   ProcMgr_Pid pidB = *(const ProcMgr_Pid *)b;
+
+   return (pidA > pidB) - (pidA < pidB);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -5273,6 +5301,8 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
    ProcMgrProcInfo *procInfo;
    DynBuf dynBuffer;
    VixToolsStartedProgramState *spList;
+   ProcMgr_Pid *pidFilter = NULL;
+   size_t numFiltered = 0;
    int numReported = 0;
    int i;
    int j;
@@ -5338,14 +5368,50 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
 
    /*
     * The startedProcess list didn't give everything we need, so
-    * ask the OS.
+    * ask the OS.  If specific pids were requested, only have those
+    * looked up; requested processes that do not exist (any more) are
+    * left out of the results.
     *
-    * XXX Need a smarter version of ProcMgr_ListProcesses().
-    * It should allow a list of pids for optimization, and
-    * return an error code so there's no risk of errno/LastError
-    * being clobbered.
+    * XXX ProcMgr_ListProcessesEx() should return an error code so
+    * there's no risk of errno/LastError being clobbered.
     */
-   procList = ProcMgr_ListProcesses();
+   if (numPids > 0) {
+      ProcMgrProcFilter filter;
+
+      pidFilter = Util_SafeCalloc(numPids, sizeof *pidFilter);
+      for (i = 0; i < numPids; i++) {
+         if (!VixToolsFindStartedProgramState(pids[i])) {
+            pidFilter[numFiltered++] = (ProcMgr_Pid) pids[i];
+         }
+      }
+      if (0 == numFiltered) {
+         goto done;
+      }
+
+      /*
+       * The caller may name the same pid more than once; only ask the OS
+       * about each one once.
+       */
+      if (numFiltered > 1) {
+         size_t numUnique = 1;
+         size_t k;
+
+         qsort(pidFilter, numFiltered, sizeof *pidFilter, VixToolsComparePids);
+         for (k = 1; k < numFiltered; k++) {
+            if (pidFilter[k] != pidFilter[numUnique - 1]) {
+               pidFilter[numUnique++] = pidFilter[k];
+            }
+         }
+         numFiltered = numUnique;
+      }
+
+      memset(&filter, 0, sizeof filter);
+      filter.numPids = numFiltered;
+      filter.pids = pidFilter;
+      procList = ProcMgr_ListProcessesEx(&filter);
+   } else {
+      procList = ProcMgr_ListProcesses();
+   }
    if (NULL == procList) {
       err = FoundryToolsDaemon_TranslateSystemErr();
       goto abort;
@@ -5419,6 +5485,7 @@ done:
 abort:
    DynBuf_Destroy(&dynBuffer);
    ProcMgr_FreeProcList(procList);
+   free(pidFilter);
    return err;
 }
 
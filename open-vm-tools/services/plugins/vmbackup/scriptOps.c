@@ -1,5 +1,5 @@
 /*********************************************************
- * Copyright (C) 2007-2016 VMware, Inc. All rights reserved.
+ * Copyright (C) 2007-2018 VMware, Inc. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -56,18 +56,31 @@
 typedef struct VmBackupScript {
    char *path;
    ProcMgr_AsyncProc *proc;
+   GSource *watch;
+   struct VmBackupScriptOp *op;
+   guint stage;
+   Bool failed;            // The freeze script failed to start or to run.
+   gint64 startTime;
+   gint64 freezeMs;        // Run time of the freeze script, -1 if not run.
 } VmBackupScript;
 
 
 typedef struct VmBackupScriptOp {
    VmBackupOp callbacks;
    Bool canceled;
+   Bool freezeFailed;
    Bool thawFailed;
+   guint running;
+   VmBackupOpStatus status;
    VmBackupScriptType type;
    VmBackupState *state;
 } VmBackupScriptOp;
 
 
+static void
+VmBackupScriptOpUpdate(VmBackupScriptOp *op);
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -104,111 +117,345 @@ VmBackupGetScriptPath(void)
 /*
  *-----------------------------------------------------------------------------
  *
- * VmBackupRunNextScript --
+ *  VmBackupScriptOpName --
  *
- *    Runs the next script for the given operation. If thawing (or running
- *    scripts after a failure), this function will try as much as possible
- *    to start a script, meaning that if it fails to start a script it will
- *    try to start the preceding one until one script is run, or it runs out
- *    of scripts to try.
+ *    Returns the argument passed to scripts for the given operation.
  *
- * Results:
- *    -1: an error occurred.
- *    0: no more scripts to run.
- *    1: script was started.
+ * Result
+ *    The operation name.
  *
  * Side effects:
- *    Increments (or decrements) the "current script" index in the backup state.
+ *    None.
  *
  *-----------------------------------------------------------------------------
  */
 
-static int
-VmBackupRunNextScript(VmBackupScriptOp *op)  // IN/OUT
+static const char *
+VmBackupScriptOpName(VmBackupScriptType type)  // IN
 {
-   const char *scriptOp;
-   int ret = 0;
-   ssize_t index;
-   VmBackupScript *scripts = op->state->scripts;
-
-   switch (op->type) {
+   switch (type) {
    case VMBACKUP_SCRIPT_FREEZE:
-      index = ++op->state->currentScript;
-      scriptOp = "freeze";
-      break;
+      return "freeze";
 
    case VMBACKUP_SCRIPT_FREEZE_FAIL:
-      index = --op->state->currentScript;
-      scriptOp = "freezeFail";
-      break;
+      return "freezeFail";
 
    case VMBACKUP_SCRIPT_THAW:
-      index = --op->state->currentScript;
-      scriptOp = "thaw";
-      break;
+      return "thaw";
 
    default:
       NOT_REACHED();
    }
+}
 
-   while (index >= 0 && scripts[index].path != NULL) {
-      char *cmd;
 
-      if (File_IsFile(scripts[index].path)) {
-         if (op->state->scriptArg != NULL) {
-            cmd = Str_Asprintf(NULL, "\"%s\" %s \"%s\"", scripts[index].path,
-                               scriptOp, op->state->scriptArg);
-         } else {
-            cmd = Str_Asprintf(NULL, "\"%s\" %s", scripts[index].path,
-                               scriptOp);
-         }
-         if (cmd != NULL) {
-            g_debug("Running script: %s\n", cmd);
-            scripts[index].proc = ProcMgr_ExecAsync(cmd, NULL);
-         } else {
-            g_debug("Failed to allocate memory to run script: %s\n",
-                    scripts[index].path);
-            scripts[index].proc = NULL;
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupScriptExited --
+ *
+ *    Handles the exit of a script: records its result and run time, and,
+ *    once all the scripts of the current stage are done, starts the next
+ *    stage. The state machine is woken up when the operation completes so
+ *    it doesn't have to wait for its next poll.
+ *
+ * Result
+ *    None.
+ *
+ * Side effects:
+ *    Might start new processes.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VmBackupScriptExited(VmBackupScript *script)  // IN/OUT
+{
+   VmBackupScriptOp *op = script->op;
+   gint64 durationMs = (g_get_monotonic_time() - script->startTime) / 1000;
+   int exitCode = -1;
+   Bool succeeded;
+   gchar *name;
+   gchar *spanName;
+
+   succeeded = (ProcMgr_GetExitCode(script->proc, &exitCode) == 0 &&
+                exitCode == 0);
+   ProcMgr_Free(script->proc);
+   script->proc = NULL;
+   g_source_unref(script->watch);
+   script->watch = NULL;
+
+   g_message("Script %s (%s, stage %u) finished in %"G_GINT64_FORMAT" ms, "
+             "exit code %d.\n", script->path, VmBackupScriptOpName(op->type),
+             script->stage, durationMs, exitCode);
+
+   name = g_path_get_basename(script->path);
+   spanName = g_strdup_printf("script.%s:%s", VmBackupScriptOpName(op->type),
+                              name);
+   VmBackup_TimelineAdd(spanName, script->startTime);
+   g_free(spanName);
+   g_free(name);
+
+   /*
+    * If thaw scripts fail, keep running and only notify the failure after
+    * all others have run.
+    */
+   if (op->type == VMBACKUP_SCRIPT_FREEZE) {
+      script->freezeMs = durationMs;
+      if (!succeeded) {
+         script->failed = TRUE;
+         op->freezeFailed = TRUE;
+      }
+   } else if (!succeeded && op->type == VMBACKUP_SCRIPT_THAW) {
+      op->thawFailed = TRUE;
+   }
+
+   ASSERT(op->running > 0);
+   if (--op->running == 0) {
+      VmBackupScriptOpUpdate(op);
+      if (op->status != VMBACKUP_STATUS_PENDING) {
+         VmBackup_WakeUp();
+      }
+   }
+}
+
+
+#if defined(_WIN32)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupScriptWatchCb --
+ *
+ *    Called when the process handle of a script is signaled.
+ *
+ * Result
+ *    FALSE.
+ *
+ * Side effects:
+ *    See VmBackupScriptExited.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VmBackupScriptWatchCb(gpointer data)   // IN
+{
+   VmBackupScriptExited(data);
+   return FALSE;
+}
+
+#else
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupScriptWatchCb --
+ *
+ *    Called when the ProcMgr waiter of a script reports the script's exit
+ *    status on its pipe.
+ *
+ * Result
+ *    FALSE.
+ *
+ * Side effects:
+ *    See VmBackupScriptExited.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VmBackupScriptWatchCb(GIOChannel *chan,     // IN
+                      GIOCondition cond,    // IN
+                      gpointer data)        // IN
+{
+   VmBackupScriptExited(data);
+   return FALSE;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupStartScript --
+ *
+ *    Starts a script and sets up an event source that fires when it exits.
+ *
+ * Result
+ *    Whether the script was started.
+ *
+ * Side effects:
+ *    Starts a new process.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VmBackupStartScript(VmBackupScriptOp *op,       // IN
+                    VmBackupScript *script)     // IN/OUT
+{
+   const char *scriptOp = VmBackupScriptOpName(op->type);
+   char *cmd;
+
+   if (op->state->scriptArg != NULL) {
+      cmd = Str_Asprintf(NULL, "\"%s\" %s \"%s\"", script->path,
+                         scriptOp, op->state->scriptArg);
+   } else {
+      cmd = Str_Asprintf(NULL, "\"%s\" %s", script->path, scriptOp);
+   }
+   if (cmd != NULL) {
+      g_debug("Running script: %s\n", cmd);
+      script->proc = ProcMgr_ExecAsync(cmd, NULL);
+   } else {
+      g_debug("Failed to allocate memory to run script: %s\n",
+              script->path);
+      script->proc = NULL;
+   }
+   vm_free(cmd);
+
+   if (script->proc == NULL) {
+      return FALSE;
+   }
+
+   script->op = op;
+   script->startTime = g_get_monotonic_time();
+#if defined(_WIN32)
+   script->watch =
+      VMTools_NewHandleSource(ProcMgr_GetAsyncProcSelectable(script->proc));
+#else
+   {
+      GIOChannel *chan =
+         g_io_channel_unix_new(ProcMgr_GetAsyncProcSelectable(script->proc));
+
+      script->watch = g_io_create_watch(chan, G_IO_IN | G_IO_HUP | G_IO_ERR);
+      g_io_channel_unref(chan);
+   }
+#endif
+   VMTOOLSAPP_ATTACH_SOURCE(op->state->ctx, script->watch,
+                            VmBackupScriptWatchCb, script, NULL);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VmBackupRunNextStage --
+ *
+ *    Starts all the scripts of the next stage for the given operation. Freeze
+ *    scripts run stages in ascending order; thaw and fail scripts run them in
+ *    descending order, and only for scripts whose freeze did not fail. Stages
+ *    where no script could be started are skipped.
+ *
+ *    If a freeze script fails to start, the remaining scripts of the stage
+ *    are not started, but the ones already running are waited for.
+ *
+ * Results:
+ *    -1: an error occurred.
+ *    0: no more scripts to run.
+ *    1: scripts were started.
+ *
+ * Side effects:
+ *    Increments (or decrements) the "current stage" index in the backup state.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+VmBackupRunNextStage(VmBackupScriptOp *op)  // IN/OUT
+{
+   VmBackupScript *scripts = op->state->scripts;
+
+   ASSERT(op->running == 0);
+
+   for (;;) {
+      Bool found = FALSE;
+      ssize_t stage;
+      size_t i;
+
+      if (op->type == VMBACKUP_SCRIPT_FREEZE) {
+         stage = ++op->state->currentStage;
+      } else {
+         stage = --op->state->currentStage;
+      }
+
+      for (i = 0; scripts[i].path != NULL; i++) {
+         VmBackupScript *script = &scripts[i];
+
+         if ((ssize_t) script->stage != stage) {
+            continue;
          }
-         vm_free(cmd);
 
-         if (scripts[index].proc == NULL) {
-            if (op->type == VMBACKUP_SCRIPT_FREEZE) {
-               ret = -1;
-               break;
+         found = TRUE;
+         if (op->freezeFailed) {
+            script->failed = TRUE;
+         } else if ((op->type == VMBACKUP_SCRIPT_FREEZE || !script->failed) &&
+                    File_IsFile(script->path)) {
+            if (VmBackupStartScript(op, script)) {
+               op->running++;
+            } else if (op->type == VMBACKUP_SCRIPT_FREEZE) {
+               script->failed = TRUE;
+               op->freezeFailed = TRUE;
             } else {
                op->thawFailed = TRUE;
             }
-         } else {
-            ret = 1;
-            break;
          }
       }
 
-      if (op->type == VMBACKUP_SCRIPT_FREEZE) {
-         index = ++op->state->currentScript;
-      } else {
-         index = --op->state->currentScript;
+      if (op->running > 0) {
+         return 1;
+      } else if (op->freezeFailed) {
+         return -1;
+      } else if (!found) {
+         return 0;
       }
+   }
+}
+
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupScriptOpUpdate --
+ *
+ *    Called when no script of the operation is running: moves on to the next
+ *    stage, or computes the final status of the operation.
+ *
+ * Result
+ *    None.
+ *
+ * Side effects:
+ *    Might start new processes.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VmBackupScriptOpUpdate(VmBackupScriptOp *op)  // IN/OUT
+{
+   int ret = op->freezeFailed ? -1 : VmBackupRunNextStage(op);
+
+   switch (ret) {
+   case -1:
       /*
-       * This happens if all thaw/fail scripts failed to start. Since the first
-       * entry may be a legacy script (which may not exist), need to check
-       * whether the interesting failure is the first or the second entry in
-       * the script list.
+       * Scripts of the failed stage that did succeed still need to see the
+       * "freezeFail" call, so make that stage the first one to be undone.
        */
-      if (index == -1) {
-         size_t failIdx = 0;
-         if (!File_IsFile(scripts[0].path)) {
-            failIdx = 1;
-         }
-         if (scripts[failIdx].proc == NULL && scripts[failIdx].path != NULL) {
-            ret = -1;
-         }
+      if (op->type == VMBACKUP_SCRIPT_FREEZE) {
+         op->state->currentStage++;
       }
-   }
+      op->status = VMBACKUP_STATUS_ERROR;
+      break;
 
-   return ret;
+   case 0:
+      op->status = op->thawFailed ? VMBACKUP_STATUS_ERROR :
+                                    VMBACKUP_STATUS_FINISHED;
+      break;
+
+   default:
+      op->status = VMBACKUP_STATUS_PENDING;
+      break;
+   }
 }
 
 
@@ -239,78 +486,107 @@ VmBackupStringCompare(const void *str1,   // IN
 /*
  *-----------------------------------------------------------------------------
  *
- *  VmBackupScriptOpQuery --
+ *  VmBackupScriptPrefixLen --
  *
- *    Checks the status of the current running script. If the script is
- *    finished, run the next script in the queue or, if no scripts are left,
- *    return a "finished" status.
+ *    Returns the length of the numeric prefix of a script's file name.
  *
  * Result
- *    The status of the operation.
+ *    Number of leading digits in the file name.
  *
  * Side effects:
- *    Might start a new process.
+ *    None.
  *
  *-----------------------------------------------------------------------------
  */
 
-static VmBackupOpStatus
-VmBackupScriptOpQuery(VmBackupOp *_op) // IN
+static size_t
+VmBackupScriptPrefixLen(const char *name)   // IN
 {
-   VmBackupOpStatus ret = VMBACKUP_STATUS_PENDING;
-   VmBackupScriptOp *op = (VmBackupScriptOp *) _op;
-   VmBackupScript *scripts = op->state->scripts;
-   VmBackupScript *currScript = NULL;
+   size_t len = 0;
 
-   if (scripts != NULL && op->state->currentScript >= 0) {
-      currScript = &scripts[op->state->currentScript];
-   }
-
-   if (op->canceled) {
-      ret = VMBACKUP_STATUS_CANCELED;
-      goto exit;
-   } else if (scripts == NULL || currScript == NULL || currScript->proc == NULL) {
-      ret = VMBACKUP_STATUS_FINISHED;
-      goto exit;
+   while (name[len] >= '0' && name[len] <= '9') {
+      len++;
    }
+   return len;
+}
 
-   if (!ProcMgr_IsAsyncProcRunning(currScript->proc)) {
-      int exitCode;
-      Bool succeeded;
 
-      succeeded = (ProcMgr_GetExitCode(currScript->proc, &exitCode) == 0 &&
-                   exitCode == 0);
-      ProcMgr_Free(currScript->proc);
-      currScript->proc = NULL;
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupAssignStages --
+ *
+ *    Splits the sorted script list into stages. Each stage is run to
+ *    completion before the next one is started.
+ *
+ *    By default every script is a stage of its own, which keeps the scripts
+ *    running one at a time. When parallel execution is enabled, adjacent
+ *    scripts whose file names start with the same number (e.g. "20-db" and
+ *    "20-web") share a stage and run concurrently. Scripts without such a
+ *    prefix always run on their own.
+ *
+ * Result
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-      /*
-       * If thaw scripts fail, keep running and only notify the failure after
-       * all others have run.
-       */
-      if (!succeeded) {
-          if (op->type == VMBACKUP_SCRIPT_FREEZE) {
-             ret = VMBACKUP_STATUS_ERROR;
-             goto exit;
-          } else if (op->type == VMBACKUP_SCRIPT_THAW) {
-             op->thawFailed = TRUE;
-          }
-      }
+static void
+VmBackupAssignStages(VmBackupScript *scripts,   // IN/OUT
+                     Bool parallel)             // IN
+{
+   const char *prevName = NULL;
+   size_t prevLen = 0;
+   guint stage = 0;
+   size_t i;
 
-      switch (VmBackupRunNextScript(op)) {
-      case -1:
-         ret = VMBACKUP_STATUS_ERROR;
-         break;
+   for (i = 0; scripts[i].path != NULL; i++) {
+      const char *name = strrchr(scripts[i].path, DIRSEPC);
+      size_t len;
 
-      case 0:
-         ret = op->thawFailed ? VMBACKUP_STATUS_ERROR : VMBACKUP_STATUS_FINISHED;
-         break;
+      name = (name != NULL) ? name + 1 : scripts[i].path;
+      len = VmBackupScriptPrefixLen(name);
 
-      default:
-         break;
+      if (i > 0 &&
+          !(parallel && len > 0 && len == prevLen &&
+            strncmp(name, prevName, len) == 0)) {
+         stage++;
       }
+      scripts[i].stage = stage;
+
+      prevName = name;
+      prevLen = len;
    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupScriptOpQuery --
+ *
+ *    Returns the status of the script operation. Scripts are started and
+ *    their completion is handled by event sources, so this only reports the
+ *    current state.
+ *
+ * Result
+ *    The status of the operation.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VmBackupOpStatus
+VmBackupScriptOpQuery(VmBackupOp *_op) // IN
+{
+   VmBackupScriptOp *op = (VmBackupScriptOp *) _op;
+   VmBackupOpStatus ret = op->canceled ? VMBACKUP_STATUS_CANCELED : op->status;
 
-exit:
    if (ret == VMBACKUP_STATUS_ERROR) {
       /* Report the script error to the host */
       VmBackup_SendEvent(VMBACKUP_EVENT_REQUESTOR_ERROR,
@@ -321,6 +597,38 @@ exit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupScriptStopWatches --
+ *
+ *    Removes the exit event sources of the scripts of the given operation.
+ *
+ * Result
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VmBackupScriptStopWatches(VmBackupScriptOp *op)   // IN
+{
+   VmBackupScript *scripts = op->state->scripts;
+   size_t i;
+
+   for (i = 0; scripts != NULL && scripts[i].path != NULL; i++) {
+      if (scripts[i].watch != NULL && scripts[i].op == op) {
+         g_source_destroy(scripts[i].watch);
+         g_source_unref(scripts[i].watch);
+         scripts[i].watch = NULL;
+      }
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -345,6 +653,8 @@ VmBackupScriptOpRelease(VmBackupOp *_op)  // IN
    size_t i;
    VmBackupScriptOp *op = (VmBackupScriptOp *) _op;
 
+   VmBackupScriptStopWatches(op);
+
    if (op->type != VMBACKUP_SCRIPT_FREEZE && op->state->scripts != NULL) {
       VmBackupScript *scripts = op->state->scripts;
       for (i = 0; scripts[i].path != NULL; i++) {
@@ -355,7 +665,7 @@ VmBackupScriptOpRelease(VmBackupOp *_op)  // IN
       }
       free(op->state->scripts);
       op->state->scripts = NULL;
-      op->state->currentScript = 0;
+      op->state->currentStage = 0;
    }
 
    free(op);
@@ -384,26 +694,79 @@ VmBackupScriptOpCancel(VmBackupOp *_op)   // IN
 {
    VmBackupScriptOp *op = (VmBackupScriptOp *) _op;
    VmBackupScript *scripts = op->state->scripts;
-   VmBackupScript *currScript = NULL;
-   ProcMgr_Pid pid;
+   size_t i;
 
-   if (scripts != NULL) {
-      currScript = &scripts[op->state->currentScript];
-      ASSERT(currScript->proc != NULL);
+   VmBackupScriptStopWatches(op);
 
-      pid = ProcMgr_GetPid(currScript->proc);
-      if (!ProcMgr_KillByPid(pid)) {
-         // XXX: what to do in this situation? other than log and cry?
-      } else {
-         int exitCode;
-         ProcMgr_GetExitCode(currScript->proc, &exitCode);
+   for (i = 0; scripts != NULL && scripts[i].path != NULL; i++) {
+      VmBackupScript *script = &scripts[i];
+
+      if (script->proc != NULL && script->op == op) {
+         ProcMgr_Pid pid = ProcMgr_GetPid(script->proc);
+
+         if (!ProcMgr_KillByPid(pid)) {
+            // XXX: what to do in this situation? other than log and cry?
+         } else {
+            int exitCode;
+            ProcMgr_GetExitCode(script->proc, &exitCode);
+         }
       }
    }
 
+   op->running = 0;
    op->canceled = TRUE;
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackup_GetScriptManifest --
+ *
+ *    Returns an XML fragment listing the freeze scripts that were run, with
+ *    their stage and run time, for inclusion in the backup manifest.
+ *
+ * Result
+ *    The XML fragment, or NULL if no script was run. Free with g_free().
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+gchar *
+VmBackup_GetScriptManifest(VmBackupState *state)   // IN
+{
+   VmBackupScript *scripts = state->scripts;
+   GString *xml = NULL;
+   size_t i;
+
+   for (i = 0; scripts != NULL && scripts[i].path != NULL; i++) {
+      gchar *path;
+
+      if (scripts[i].freezeMs < 0) {
+         continue;
+      }
+
+      if (xml == NULL) {
+         xml = g_string_new("   <scripts>\n");
+      }
+      path = g_markup_escape_text(scripts[i].path, -1);
+      g_string_append_printf(xml, "      <script stage=\"%u\" "
+                             "durationMs=\"%"G_GINT64_FORMAT"\">%s</script>\n",
+                             scripts[i].stage, scripts[i].freezeMs, path);
+      g_free(path);
+   }
+
+   if (xml == NULL) {
+      return NULL;
+   }
+   g_string_append(xml, "   </scripts>\n");
+   return g_string_free(xml, FALSE);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -411,7 +774,8 @@ VmBackupScriptOpCancel(VmBackupOp *_op)   // IN
  *
  *    Creates a new state object to monitor the execution of OnFreeze or
  *    OnThaw scripts. This will identify all the scripts in the backup scripts
- *    directory and add them to an execution queue.
+ *    directory and add them to an execution queue, grouped in stages (see
+ *    VmBackupAssignStages).
  *
  *    Note: there is some state created when instantianting the "OnFreeze"
  *    scripts which is only released after the "OnThaw" scripts are run. So
@@ -422,7 +786,7 @@ VmBackupScriptOpCancel(VmBackupOp *_op)   // IN
  *    A pointer to the operation state, or NULL on failure.
  *
  * Side effects:
- *    If there are scripts to be executed, the first one is started.
+ *    If there are scripts to be executed, the first stage is started.
  *
  *-----------------------------------------------------------------------------
  */
@@ -475,7 +839,7 @@ VmBackup_NewScriptOp(VmBackupScriptType type, // IN
       size_t idx = 0;
 
       state->scripts = NULL;
-      state->currentScript = 0;
+      state->currentStage = 0;
 
       if (File_IsFile(LEGACY_FREEZE_SCRIPT) ||
           File_IsFile(LEGACY_THAW_SCRIPT)) {
@@ -494,10 +858,10 @@ VmBackup_NewScriptOp(VmBackupScriptType type, // IN
          }
 
          /*
-          * VmBackupRunNextScript increments the index, so need to make it point
-          * to "before the first script".
+          * VmBackupRunNextStage increments the index, so need to make it point
+          * to "before the first stage".
           */
-         state->currentScript = -1;
+         state->currentStage = -1;
          state->scripts = scripts;
       }
 
@@ -526,6 +890,13 @@ VmBackup_NewScriptOp(VmBackupScriptType type, // IN
             }
          }
       }
+
+      if (scripts != NULL) {
+         for (i = 0; scripts[i].path != NULL; i++) {
+            scripts[i].freezeMs = -1;
+         }
+         VmBackupAssignStages(scripts, state->parallelScripts);
+      }
    } else if (state->scripts != NULL) {
       VmBackupScript *scripts = state->scripts;
       if (strcmp(scripts[0].path, LEGACY_FREEZE_SCRIPT) == 0) {
@@ -535,12 +906,17 @@ VmBackup_NewScriptOp(VmBackupScriptType type, // IN
    }
 
    /*
-    * If there are any scripts to be executed, start the first one. If we get to
-    * this point, we won't free the scripts array until VmBackupScriptOpRelease
-    * is called after thawing (or after the sync provider failed and the "fail"
-    * scripts are run).
+    * If there are any scripts to be executed, start the first stage. If we get
+    * to this point, we won't free the scripts array until
+    * VmBackupScriptOpRelease is called after thawing (or after the sync
+    * provider failed and the "fail" scripts are run).
     */
-   fail = (state->scripts != NULL && VmBackupRunNextScript(op) == -1);
+   if (state->scripts != NULL) {
+      VmBackupScriptOpUpdate(op);
+      fail = (op->freezeFailed && op->status == VMBACKUP_STATUS_ERROR);
+   } else {
+      op->status = VMBACKUP_STATUS_FINISHED;
+   }
 
 exit:
    /* Free the file list. */
@@ -144,6 +144,27 @@ VmBackupGetStateName(VmBackupMState state)
 }
 
 
+/**
+ * Moves the state machine to the given state, recording the time spent in
+ * the current state in the timeline.
+ *
+ * @param[in]  state    The new state.
+ */
+
+static void
+VmBackupSetState(VmBackupMState state)
+{
+   if (state != gBackupState->machineState) {
+      if (gBackupState->machineState != VMBACKUP_MSTATE_IDLE) {
+         VmBackup_TimelineAdd(VmBackupGetStateName(gBackupState->machineState),
+                              gBackupState->stateStart);
+      }
+      gBackupState->machineState = state;
+      gBackupState->stateStart = g_get_monotonic_time();
+   }
+}
+
+
 /**
  * Sends a keep alive backup event to the VMX.
  *
@@ -306,6 +327,10 @@ VmBackupFinalize(void)
    }
    g_static_mutex_unlock(&gBackupState->opLock);
 
+   VmBackupSetState(VMBACKUP_MSTATE_IDLE);
+   VmBackup_TimelineAdd("total", gBackupState->runStart);
+   VmBackup_TimelineWrite(gBackupState->configDir);
+
    VmBackup_SendEvent(VMBACKUP_EVENT_REQUESTOR_DONE, VMBACKUP_SUCCESS, "");
 
    if (gBackupState->timerEvent != NULL) {
@@ -379,7 +404,7 @@ VmBackupStartScripts(VmBackupScriptType type)
       return FALSE;
    }
 
-   gBackupState->machineState = nextState;
+   VmBackupSetState(nextState);
    return TRUE;
 }
 
@@ -400,7 +425,7 @@ VmBackupOnError(void)
    case VMBACKUP_MSTATE_SYNC_ERROR:
       /* Next state is "script error". */
       if (!VmBackupStartScripts(VMBACKUP_SCRIPT_FREEZE_FAIL)) {
-         gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+         VmBackupSetState(VMBACKUP_MSTATE_IDLE);
       }
       break;
 
@@ -409,7 +434,7 @@ VmBackupOnError(void)
    case VMBACKUP_MSTATE_SYNC_THAW:
       /* Next state is "sync error". */
       gBackupState->pollPeriod = 1000;
-      gBackupState->machineState = VMBACKUP_MSTATE_SYNC_ERROR;
+      VmBackupSetState(VMBACKUP_MSTATE_SYNC_ERROR);
       g_signal_emit_by_name(gBackupState->ctx->serviceObj,
                             TOOLS_CORE_SIG_IO_FREEZE,
                             gBackupState->ctx,
@@ -419,7 +444,7 @@ VmBackupOnError(void)
    case VMBACKUP_MSTATE_SCRIPT_THAW:
    case VMBACKUP_MSTATE_COMPLETE_WAIT:
       /* Next state is "idle". */
-      gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+      VmBackupSetState(VMBACKUP_MSTATE_IDLE);
       break;
 
    default:
@@ -667,7 +692,7 @@ VmBackupAsyncCallback(void *clientData)
    case VMBACKUP_MSTATE_SCRIPT_ERROR:
    case VMBACKUP_MSTATE_COMPLETE_WAIT:
       /* Next state is "idle". */
-      gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+      VmBackupSetState(VMBACKUP_MSTATE_IDLE);
       break;
 
    case VMBACKUP_MSTATE_SYNC_ERROR:
@@ -694,6 +719,27 @@ exit:
 }
 
 
+/**
+ * Runs the state machine right away instead of at the next poll. Used by
+ * asynchronous operations that are notified of their own completion.
+ */
+
+void
+VmBackup_WakeUp(void)
+{
+   if (gBackupState != NULL && gBackupState->timerEvent != NULL) {
+      g_source_destroy(gBackupState->timerEvent);
+      g_source_unref(gBackupState->timerEvent);
+      gBackupState->timerEvent = g_timeout_source_new(0);
+      VMTOOLSAPP_ATTACH_SOURCE(gBackupState->ctx,
+                               gBackupState->timerEvent,
+                               VmBackupAsyncCallback,
+                               NULL,
+                               NULL);
+   }
+}
+
+
 /**
  * Calls the sync provider's start function and moves the state
  * machine to next state.
@@ -745,11 +791,11 @@ VmBackupEnableSyncWait(void)
 
 #if defined(_WIN32)
    /* Move to next state */
-   gBackupState->machineState = VMBACKUP_MSTATE_SYNC_FREEZE;
+   VmBackupSetState(VMBACKUP_MSTATE_SYNC_FREEZE);
 #else
    g_debug("Submitted backup start task.");
    /* Move to next state */
-   gBackupState->machineState = VMBACKUP_MSTATE_SYNC_FREEZE_WAIT;
+   VmBackupSetState(VMBACKUP_MSTATE_SYNC_FREEZE_WAIT);
 #endif
 
    return TRUE;
@@ -771,7 +817,7 @@ VmBackupEnableCompleteWait(void)
    g_debug("*** %s\n", __FUNCTION__);
 
    if (gBackupState->completer == NULL) {
-      gBackupState->machineState = VMBACKUP_MSTATE_IDLE;
+      VmBackupSetState(VMBACKUP_MSTATE_IDLE);
       goto exit;
    }
 
@@ -799,7 +845,7 @@ VmBackupEnableCompleteWait(void)
    if (gBackupState->completer->start(gBackupState,
                                       gBackupState->completer->clientData)) {
       /* Move to next state */
-      gBackupState->machineState = VMBACKUP_MSTATE_COMPLETE_WAIT;
+      VmBackupSetState(VMBACKUP_MSTATE_COMPLETE_WAIT);
    } else {
       VmBackup_SendEvent(VMBACKUP_EVENT_REQUESTOR_ERROR,
                          VMBACKUP_SYNC_ERROR,
@@ -836,7 +882,7 @@ VmBackupEnableSync(void)
    } else if (gBackupState->freezeStatus == VMBACKUP_FREEZE_CANCELED ||
               gBackupState->freezeStatus == VMBACKUP_FREEZE_FINISHED) {
       /* Move to next state */
-      gBackupState->machineState = VMBACKUP_MSTATE_SYNC_FREEZE;
+      VmBackupSetState(VMBACKUP_MSTATE_SYNC_FREEZE);
    } else {
       ASSERT(gBackupState->freezeStatus == VMBACKUP_FREEZE_PENDING);
    }
@@ -957,14 +1003,19 @@ VmBackupStartCommon(RpcInData *data,
    gBackupState->enableNullDriver = VMBACKUP_CONFIG_GET_BOOL(ctx->config,
                                                              "enableNullDriver",
                                                              TRUE);
+   gBackupState->parallelScripts = VMBACKUP_CONFIG_GET_BOOL(ctx->config,
+                                                            "enableParallelScripts",
+                                                            FALSE);
 
    g_debug("Using quiesceApps = %d, quiesceFS = %d, allowHWProvider = %d,"
            " execScripts = %d, scriptArg = %s, timeout = %u,"
-           " enableNullDriver = %d, forceQuiesce = %d\n",
+           " enableNullDriver = %d, parallelScripts = %d,"
+           " forceQuiesce = %d\n",
            gBackupState->quiesceApps, gBackupState->quiesceFS,
            gBackupState->allowHWProvider, gBackupState->execScripts,
            (gBackupState->scriptArg != NULL) ? gBackupState->scriptArg : "",
-           gBackupState->timeout, gBackupState->enableNullDriver, forceQuiesce);
+           gBackupState->timeout, gBackupState->enableNullDriver,
+           gBackupState->parallelScripts, forceQuiesce);
 #if defined(__linux__)
    gBackupState->excludedFileSystems =
          VMBACKUP_CONFIG_GET_STR(ctx->config, "excludedFileSystems", NULL);
@@ -981,6 +1032,8 @@ VmBackupStartCommon(RpcInData *data,
       goto error;
    }
 
+   gBackupState->runStart = VmBackup_TimelineStart();
+
    VmBackup_SendEvent(VMBACKUP_EVENT_RESET, VMBACKUP_SUCCESS, "");
 
    if (!VmBackupStartScripts(VMBACKUP_SCRIPT_FREEZE)) {
@@ -1251,11 +1304,16 @@ VmBackupSnapshotDone(RpcInData *data)
                               "Error: unexpected state for quiesce done message.",
                               FALSE);
    } else {
+      gint64 start = g_get_monotonic_time();
+      Bool success;
+
       if (data->argsSize > 1) {
          gBackupState->snapshots = g_strndup(data->args + 1, data->argsSize - 1);
       }
-      if (!gBackupState->provider->snapshotDone(gBackupState,
-                                                gBackupState->provider->clientData)) {
+      success = gBackupState->provider->snapshotDone(gBackupState,
+                                         gBackupState->provider->clientData);
+      VmBackup_TimelineAdd("snapshotDone", start);
+      if (!success) {
          VmBackup_SendEvent(VMBACKUP_EVENT_REQUESTOR_ERROR,
                             VMBACKUP_SYNC_ERROR,
                             "Error when notifying the sync provider.");
@@ -1263,7 +1321,7 @@ VmBackupSnapshotDone(RpcInData *data)
             VmBackupFinalize();
          }
       } else {
-         gBackupState->machineState = VMBACKUP_MSTATE_SYNC_THAW;
+         VmBackupSetState(VMBACKUP_MSTATE_SYNC_THAW);
       }
       return RPCIN_SETRETVALS(data, "", TRUE);
    }
@@ -1309,6 +1367,23 @@ VmBackupSnapshotCompleted(RpcInData *data)
 }
 
 
+/**
+ * Handler for the "vmbackup.timeline" message. Returns the timeline of the
+ * most recent quiesce operations.
+ *
+ * @param[in]  data     RPC data.
+ *
+ * @return TRUE
+ */
+
+static gboolean
+VmBackupTimeline(RpcInData *data)
+{
+   g_debug("*** %s\n", __FUNCTION__);
+   return RPCIN_SETRETVALSF(data, VmBackup_TimelineGet(), TRUE);
+}
+
+
 /**
  * Prints some information about the plugin's state to the log.
  *
@@ -1395,7 +1470,8 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       { VMBACKUP_PROTOCOL_ABORT, VmBackupAbort, NULL, NULL, NULL, 0 },
       { VMBACKUP_PROTOCOL_SNAPSHOT_COMPLETED, VmBackupSnapshotCompleted, NULL,
                     NULL, NULL, 0 },
-      { VMBACKUP_PROTOCOL_SNAPSHOT_DONE, VmBackupSnapshotDone, NULL, NULL, NULL, 0 }
+      { VMBACKUP_PROTOCOL_SNAPSHOT_DONE, VmBackupSnapshotDone, NULL, NULL, NULL, 0 },
+      { VMBACKUP_PROTOCOL_TIMELINE, VmBackupTimeline, NULL, NULL, NULL, 0 }
    };
    ToolsPluginSignalCb sigs[] = {
       { TOOLS_CORE_SIG_DUMP_STATE, VmBackupDumpState, NULL },
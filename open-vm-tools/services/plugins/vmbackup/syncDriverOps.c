@@ -125,7 +125,9 @@ VmBackupDriverOpQuery(VmBackupOp *_op) // IN
       }
    } else {
       if (op->manifest != NULL) {
+         gint64 start = g_get_monotonic_time();
          SyncManifestSend(op->manifest);
+         VmBackup_TimelineAdd("manifest.send", start);
       }
       ret = VMBACKUP_STATUS_FINISHED;
    }
@@ -215,6 +217,7 @@ VmBackupNewDriverOp(VmBackupState *state,       // IN
 {
    Bool success;
    VmBackupDriverOp *op = NULL;
+   gint64 start = g_get_monotonic_time();
 
    g_return_val_if_fail((handle == NULL || *handle == SYNCDRIVER_INVALID_HANDLE) ||
                         !freeze,
@@ -238,9 +241,11 @@ VmBackupNewDriverOp(VmBackupState *state,       // IN
                                   state->enableNullDriver : FALSE,
                                   op->syncHandle,
                                   state->excludedFileSystems);
+      VmBackup_TimelineAdd("sync.freeze", start);
    } else {
       op->manifest = SyncNewManifest(state, *op->syncHandle);
       success = VmBackupDriverThaw(op->syncHandle);
+      VmBackup_TimelineAdd("sync.thaw", start);
    }
    if (!success) {
       g_warning("Error %s filesystems.", freeze ? "freezing" : "thawing");
@@ -278,8 +283,10 @@ VmBackupSyncDriverReadyForSnapshot(VmBackupState *state)
 
    g_debug("*** %s\n", __FUNCTION__);
    if (handle != NULL && *handle != SYNCDRIVER_INVALID_HANDLE) {
+      gint64 start = g_get_monotonic_time();
       Bool success;
       success = VmBackup_SendEvent(VMBACKUP_EVENT_SNAPSHOT_COMMIT, 0, "");
+      VmBackup_TimelineAdd("event.snapshotCommit", start);
       if (success) {
          state->freezeStatus = VMBACKUP_FREEZE_FINISHED;
       } else {
@@ -41,6 +41,7 @@ static const char syncManifestFmt[] = {
    "<quiesceManifest>\n"
    "   <productVersion>%d</productVersion>\n"  /* version of tools */
    "   <providerName>%s</providerName>\n"      /* name of backend provider */
+   "%s"                                       /* freeze scripts, if any */
    "</quiesceManifest>\n"
 };
 
@@ -105,6 +106,7 @@ SyncNewManifest(VmBackupState *state,          // IN
    manifest->path = g_strdup_printf("%s/%s", state->configDir,
                                     syncManifestName);
    manifest->providerName = g_strdup(providerName);
+   manifest->scripts = VmBackup_GetScriptManifest(state);
    return manifest;
 }
 
@@ -128,6 +130,7 @@ SyncManifestRelease(SyncManifest *manifest)    // IN
    if (manifest != NULL) {
       g_free(manifest->path);
       g_free(manifest->providerName);
+      g_free(manifest->scripts);
       g_free(manifest);
    }
 }
@@ -165,7 +168,8 @@ SyncManifestSend(SyncManifest *manifest)       // IN
    }
 
    ret = fprintf(f, syncManifestFmt, TOOLS_VERSION_CURRENT,
-                 manifest->providerName);
+                 manifest->providerName,
+                 manifest->scripts != NULL ? manifest->scripts : "");
    fclose(f);
    if (ret < 0) {
       g_warning("Error writing backup manifest file %s: %d %s\n",
@@ -34,6 +34,7 @@
 typedef struct {
    char *path;
    char *providerName;
+   char *scripts;
 } SyncManifest;
 
 SyncManifest *
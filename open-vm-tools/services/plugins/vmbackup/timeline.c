@@ -0,0 +1,177 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file timeline.c
+ *
+ * Keeps a timeline of the most recent quiesce operations. Each entry is a
+ * span measured with the monotonic clock: the time spent in a state of the
+ * state machine, or the time taken by a sub-operation such as a script or
+ * the sync driver freeze. Entries live in a fixed size ring buffer shared
+ * by all runs, so the oldest runs are dropped first.
+ *
+ * The whole timeline is returned by the "vmbackup.timeline" RPC. After each
+ * run, the spans of that run alone are written to quiesce_timeline.txt in
+ * the configuration directory, next to the backup manifest, so that copies
+ * of the file collected after different runs never repeat a run. Each line
+ * holds the run number, the start of
+ * the span relative to the start of the run and its duration, both in
+ * microseconds, followed by the span's name.
+ */
+
+#include "vmBackupInt.h"
+
+#define VMBACKUP_TIMELINE_SIZE   256
+#define VMBACKUP_TIMELINE_FILE   "quiesce_timeline.txt"
+
+typedef struct VmBackupSpan {
+   guint    run;
+   gint64   start;
+   gint64   duration;
+   char     name[48];
+} VmBackupSpan;
+
+/*
+ * Sub-operations like the sync driver freeze run in the tools thread pool,
+ * so the ring is protected by a lock.
+ */
+G_LOCK_DEFINE_STATIC(gTimelineLock);
+static VmBackupSpan gTimeline[VMBACKUP_TIMELINE_SIZE];
+static guint gTimelineNext;
+static guint gTimelineCount;
+static guint gTimelineRun;
+static gint64 gTimelineRunStart;
+
+
+/**
+ * Starts the timeline of a new quiesce operation.
+ *
+ * @return The start time of the run.
+ */
+
+gint64
+VmBackup_TimelineStart(void)
+{
+   G_LOCK(gTimelineLock);
+   gTimelineRun++;
+   gTimelineRunStart = g_get_monotonic_time();
+   G_UNLOCK(gTimelineLock);
+   return gTimelineRunStart;
+}
+
+
+/**
+ * Records a span that started at the given time and ends now.
+ *
+ * @param[in]  name     Name of the span. Truncated if too long.
+ * @param[in]  start    Start time of the span, from g_get_monotonic_time().
+ */
+
+void
+VmBackup_TimelineAdd(const char *name,
+                     gint64 start)
+{
+   gint64 now = g_get_monotonic_time();
+   VmBackupSpan *span;
+
+   G_LOCK(gTimelineLock);
+   span = &gTimeline[gTimelineNext];
+   span->run = gTimelineRun;
+   span->start = start - gTimelineRunStart;
+   span->duration = now - start;
+   g_strlcpy(span->name, name, sizeof span->name);
+   gTimelineNext = (gTimelineNext + 1) % VMBACKUP_TIMELINE_SIZE;
+   if (gTimelineCount < VMBACKUP_TIMELINE_SIZE) {
+      gTimelineCount++;
+   }
+   G_UNLOCK(gTimelineLock);
+}
+
+
+/**
+ * Formats the spans of the timeline, oldest span first.
+ *
+ * @param[in]  run      Run to format, 0 for all the runs in the ring.
+ *
+ * @return The spans as text. Should be freed with g_free().
+ */
+
+static gchar *
+VmBackupTimelineFormat(guint run)
+{
+   GString *str = g_string_new("# run start_us duration_us name\n");
+   guint i;
+
+   G_LOCK(gTimelineLock);
+   for (i = 0; i < gTimelineCount; i++) {
+      VmBackupSpan *span = &gTimeline[(gTimelineNext + VMBACKUP_TIMELINE_SIZE -
+                                       gTimelineCount + i) %
+                                      VMBACKUP_TIMELINE_SIZE];
+      if (run != 0 && span->run != run) {
+         continue;
+      }
+      g_string_append_printf(str, "%u %"G_GINT64_FORMAT" %"G_GINT64_FORMAT
+                             " %s\n", span->run, span->start, span->duration,
+                             span->name);
+   }
+   G_UNLOCK(gTimelineLock);
+
+   return g_string_free(str, FALSE);
+}
+
+
+/**
+ * Formats the contents of the timeline, oldest span first.
+ *
+ * @return The timeline as text. Should be freed with g_free().
+ */
+
+gchar *
+VmBackup_TimelineGet(void)
+{
+   return VmBackupTimelineFormat(0);
+}
+
+
+/**
+ * Writes the spans of the current run to the given directory.
+ *
+ * @param[in]  dir      Directory where to write the file.
+ */
+
+void
+VmBackup_TimelineWrite(const char *dir)
+{
+   gchar *path = g_build_filename(dir, VMBACKUP_TIMELINE_FILE, NULL);
+   gchar *contents;
+   GError *err = NULL;
+   guint run;
+
+   G_LOCK(gTimelineLock);
+   run = gTimelineRun;
+   G_UNLOCK(gTimelineLock);
+
+   contents = VmBackupTimelineFormat(run);
+
+   if (!g_file_set_contents(path, contents, -1, &err)) {
+      g_warning("Error writing quiesce timeline %s: %s\n", path, err->message);
+      g_clear_error(&err);
+   }
+   g_free(contents);
+   g_free(path);
+}
@@ -121,15 +121,18 @@ typedef struct VmBackupState {
    Bool           allowHWProvider;
    Bool           execScripts;
    Bool           enableNullDriver;
+   Bool           parallelScripts;
    Bool           needsPriv;
    gchar         *scriptArg;
    guint          timeout;
    gpointer       clientData;
    void          *scripts;
    const char    *configDir;
-   ssize_t        currentScript;
+   ssize_t        currentStage;
    gchar         *errorMsg;
    VmBackupMState machineState;
+   gint64         runStart;
+   gint64         stateStart;
    VmBackupFreezeStatus freezeStatus;
    struct VmBackupSyncProvider *provider;
    struct VmBackupSyncCompleter *completer;
@@ -290,11 +293,30 @@ VmBackupOp *
 VmBackup_NewScriptOp(VmBackupScriptType freeze,
                      VmBackupState *state);
 
+gchar *
+VmBackup_GetScriptManifest(VmBackupState *state);
+
 Bool
 VmBackup_SendEvent(const char *event,
                    const uint32 code,
                    const char *desc);
 
+void
+VmBackup_WakeUp(void);
+
+gint64
+VmBackup_TimelineStart(void);
+
+void
+VmBackup_TimelineAdd(const char *name,
+                     gint64 start);
+
+gchar *
+VmBackup_TimelineGet(void);
+
+void
+VmBackup_TimelineWrite(const char *dir);
+
 void
 VmBackup_SyncDriverReset(void);
 
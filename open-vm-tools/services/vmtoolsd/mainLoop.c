@@ -29,6 +29,11 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#  include <errno.h>
+#  include <sys/inotify.h>
+#endif
 #include "toolsCoreInt.h"
 #include "conf.h"
 #include "guestApp.h"
@@ -71,6 +76,19 @@
 
 #define CONFNAME_MAX_CHANNEL_ATTEMPTS "maxChannelAttempts"
 
+/*
+ * Time to wait for writes to the config file to settle before reloading it,
+ * in milliseconds. Editors and tools often write a file in several steps.
+ */
+#define CONF_RELOAD_DELAY 250
+
+
+static void
+ToolsCoreStopConfCheck(ToolsServiceState *state);
+
+static void
+ToolsCoreStartConfCheck(ToolsServiceState *state);
+
 
 /*
  ******************************************************************************
@@ -87,6 +105,7 @@
 static void
 ToolsCoreCleanup(ToolsServiceState *state)
 {
+   ToolsCoreStopConfCheck(state);
    ToolsCorePool_Shutdown(&state->ctx);
    ToolsCore_UnloadPlugins(state);
 #if defined(__linux__)
@@ -175,6 +194,243 @@ ToolsCoreConfFileCb(gpointer clientData)
 }
 
 
+#if defined(__linux__)
+
+/**
+ * Timer callback for a delayed reload of the config file.
+ *
+ * @param[in]  clientData  Service state.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+ToolsCoreConfReloadCb(gpointer clientData)
+{
+   ToolsServiceState *state = clientData;
+
+   state->configReloadTask = 0;
+   ToolsCore_ReloadConfig(state, FALSE);
+   return FALSE;
+}
+
+
+/**
+ * Schedules a reload of the config file. Events that arrive before the
+ * reload happens push it back, so a burst of writes causes a single reload.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreScheduleConfReload(ToolsServiceState *state)
+{
+   if (state->configReloadTask != 0) {
+      g_source_remove(state->configReloadTask);
+   }
+   state->configReloadTask = g_timeout_add(CONF_RELOAD_DELAY,
+                                           ToolsCoreConfReloadCb,
+                                           state);
+}
+
+
+/**
+ * Handles inotify events on the config directory. Changes to the config
+ * file, whether written in place or renamed over, schedule a reload. If the
+ * directory itself goes away, the check is restarted, which falls back to
+ * polling if the directory cannot be watched anymore.
+ *
+ * @param[in]  source      inotify channel.
+ * @param[in]  cond        Unused.
+ * @param[in]  clientData  Service state.
+ *
+ * @return TRUE to keep watching.
+ */
+
+static gboolean
+ToolsCoreConfWatchCb(GIOChannel *source,
+                     GIOCondition cond,
+                     gpointer clientData)
+{
+   ToolsServiceState *state = clientData;
+   gchar buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+   gboolean reload = FALSE;
+   gboolean lost = FALSE;
+   ssize_t len;
+
+   while ((len = read(g_io_channel_unix_get_fd(source), buf, sizeof buf)) > 0) {
+      gchar *p;
+
+      for (p = buf; p < buf + len; ) {
+         const struct inotify_event *ev = (const struct inotify_event *) p;
+
+         if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+            lost = TRUE;
+         } else if (ev->mask & IN_Q_OVERFLOW) {
+            reload = TRUE;
+         } else if (ev->len > 0 &&
+                    strcmp(ev->name, state->configWatchName) == 0) {
+            reload = TRUE;
+         }
+         p += sizeof *ev + ev->len;
+      }
+   }
+
+   if (len < 0 && errno != EAGAIN && errno != EINTR) {
+      g_warning("Error reading config file events: %s\n", strerror(errno));
+      lost = TRUE;
+   }
+
+   if (lost) {
+      g_info("Config directory is no longer watched.\n");
+      ToolsCoreStopConfCheck(state);
+      ToolsCoreStartConfCheck(state);
+      reload = TRUE;
+   }
+   if (reload) {
+      ToolsCoreScheduleConfReload(state);
+   }
+
+   /* On loss, the source was already removed by ToolsCoreStopConfCheck(). */
+   return !lost;
+}
+
+
+/**
+ * Starts watching the directory of the config file with inotify.
+ *
+ * @param[in]  state    Service state.
+ *
+ * @return Whether the directory is being watched.
+ */
+
+static gboolean
+ToolsCoreWatchConf(ToolsServiceState *state)
+{
+   gchar *path;
+   gchar *dir;
+   GError *err = NULL;
+   int fd;
+   int wd;
+
+   if (state->configFile != NULL) {
+      path = VMTOOLS_GET_FILENAME_LOCAL(state->configFile, &err);
+      if (path == NULL) {
+         g_clear_error(&err);
+         return FALSE;
+      }
+      dir = g_path_get_dirname(path);
+      state->configWatchName = g_path_get_basename(path);
+   } else {
+      char *confPath = GuestApp_GetConfPath();
+
+      if (confPath == NULL) {
+         return FALSE;
+      }
+      dir = g_strdup(confPath);
+      free(confPath);
+      path = g_build_filename(dir, CONF_FILE, NULL);
+      state->configWatchName = g_strdup(CONF_FILE);
+   }
+
+   /* Writes to the target of a symlink are not seen in this directory. */
+   if (g_file_test(path, G_FILE_TEST_IS_SYMLINK)) {
+      g_debug("Config file %s is a symlink, polling it.\n", path);
+      goto error;
+   }
+
+   fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fd < 0) {
+      g_info("Cannot watch the config file: %s\n", strerror(errno));
+      goto error;
+   }
+
+   wd = inotify_add_watch(fd, dir,
+                          IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE |
+                          IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                          IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+   if (wd < 0) {
+      g_info("Cannot watch the config directory %s: %s\n", dir,
+             strerror(errno));
+      close(fd);
+      goto error;
+   }
+
+   state->configWatch = g_io_channel_unix_new(fd);
+   g_io_channel_set_close_on_unref(state->configWatch, TRUE);
+   state->configCheckTask = g_io_add_watch(state->configWatch, G_IO_IN,
+                                           ToolsCoreConfWatchCb, state);
+   g_debug("Watching config directory %s.\n", dir);
+
+   g_free(dir);
+   VMTOOLS_RELEASE_FILENAME_LOCAL(path);
+   return TRUE;
+
+error:
+   g_free(state->configWatchName);
+   state->configWatchName = NULL;
+   g_free(dir);
+   VMTOOLS_RELEASE_FILENAME_LOCAL(path);
+   return FALSE;
+}
+
+#endif
+
+
+/**
+ * Starts checking the config file for changes: on Linux, by watching its
+ * directory with inotify, otherwise (or if that fails) by polling it every
+ * CONF_POLL_TIME seconds.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreStartConfCheck(ToolsServiceState *state)
+{
+   ASSERT(state->configCheckTask == 0);
+
+#if defined(__linux__)
+   if (ToolsCoreWatchConf(state)) {
+      return;
+   }
+#endif
+
+   state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
+                                          ToolsCoreConfFileCb,
+                                          state);
+}
+
+
+/**
+ * Stops checking the config file for changes.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreStopConfCheck(ToolsServiceState *state)
+{
+   if (state->configCheckTask > 0) {
+      g_source_remove(state->configCheckTask);
+      state->configCheckTask = 0;
+   }
+
+#if defined(__linux__)
+   if (state->configReloadTask > 0) {
+      g_source_remove(state->configReloadTask);
+      state->configReloadTask = 0;
+   }
+   if (state->configWatch != NULL) {
+      g_io_channel_unref(state->configWatch);
+      state->configWatch = NULL;
+   }
+   g_free(state->configWatchName);
+   state->configWatchName = NULL;
+#endif
+}
+
+
 /**
  * IO freeze signal handler. Disables the conf file check task if I/O is
  * frozen, re-enable it otherwise. See bug 529653.
@@ -192,14 +448,17 @@ ToolsCoreIOFreezeCb(gpointer src,
                     ToolsServiceState *state)
 {
    if (state->configCheckTask > 0 && freeze) {
-      g_source_remove(state->configCheckTask);
-      state->configCheckTask = 0;
+      ToolsCoreStopConfCheck(state);
       VMTools_SuspendLogIO();
    } else if (state->configCheckTask == 0 && !freeze) {
       VMTools_ResumeLogIO();
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      ToolsCoreStartConfCheck(state);
+#if defined(__linux__)
+      /* Changes made while frozen were not seen. */
+      if (state->configWatch != NULL) {
+         ToolsCoreScheduleConfReload(state);
+      }
+#endif
    }
 }
 
@@ -359,9 +618,7 @@ ToolsCoreRunLoop(ToolsServiceState *state)
                           state);
       }
 
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      ToolsCoreStartConfCheck(state);
 
 #if defined(__APPLE__)
       ToolsCore_CFRunLoop(state);
@@ -507,10 +764,10 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
    gboolean first = state->ctx.config == NULL;
    gboolean loaded;
 
-   loaded = VMTools_LoadConfig(state->configFile,
-                               G_KEY_FILE_NONE,
-                               &state->ctx.config,
-                               &state->configMtime);
+   loaded = VMTools_ReloadConfig(state->configFile,
+                                 G_KEY_FILE_NONE,
+                                 &state->ctx.config,
+                                 &state->configStamp);
 
    if (!first && loaded) {
       g_debug("Config file reloaded.\n");
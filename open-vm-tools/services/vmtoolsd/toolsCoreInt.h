@@ -69,8 +69,13 @@ typedef struct ToolsAppProviderReg {
 typedef struct ToolsServiceState {
    gchar         *name;
    gchar         *configFile;
-   time_t         configMtime;
+   VMToolsConfigStamp configStamp;
    guint          configCheckTask;
+#if defined(__linux__)
+   GIOChannel    *configWatch;
+   gchar         *configWatchName;
+   guint          configReloadTask;
+#endif
    gboolean       mainService;
    gboolean       capsRegistered;
    gchar         *commonPath;
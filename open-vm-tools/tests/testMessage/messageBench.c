@@ -0,0 +1,327 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * messageBench.c --
+ *
+ *   Benchmark for lib/message. The backdoor is replaced by a local mock
+ *   that implements the guest side of the message protocol and echoes every
+ *   message back, so the high-bandwidth and the 4 bytes per call transports
+ *   can be compared outside of a virtual machine. An optional busy loop per
+ *   backdoor call approximates the cost of a VM exit.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "backdoor.h"
+#include "backdoor_def.h"
+#include "guest_msg_def.h"
+#include "message.h"
+
+#define MOCK_CHANNEL_ID    1
+#define MOCK_COOKIE_HIGH   0x12345678
+#define MOCK_COOKIE_LOW    0x9abcdef0
+
+typedef struct MockHost {
+   Bool hb;               // Offer the high-bandwidth port
+   unsigned int exitCost; // Busy loop iterations per backdoor call
+   unsigned char *buf;    // Message being transferred
+   size_t size;           // Its size
+   size_t pos;            // Bytes transferred so far
+   Bool pending;          // A reply is waiting for the guest
+} MockHost;
+
+static MockHost host;
+static volatile unsigned int exitSink;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MockExit --
+ *
+ *    Burn some cycles to stand in for a VM exit.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+MockExit(void)
+{
+   unsigned int i;
+
+   for (i = 0; i < host.exitCost; i++) {
+      exitSink++;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MockStatus --
+ *
+ *    Status bits the mock host returns for a successful request.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint16
+MockStatus(void)
+{
+   return MESSAGE_STATUS_SUCCESS | (host.hb ? MESSAGE_STATUS_HB : 0);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Backdoor --
+ *
+ *    Mock of the low-bandwidth backdoor call, restricted to
+ *    BDOOR_CMD_MESSAGE.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Backdoor(Backdoor_proto *bp) // IN/OUT
+{
+   uint16 type = bp->in.cx.halfs.high;
+   uint32 piece;
+   size_t len;
+
+   MockExit();
+
+   if (bp->in.cx.halfs.low != BDOOR_CMD_MESSAGE) {
+      bp->in.cx.halfs.high = 0;
+      return;
+   }
+
+   switch (type) {
+   case MESSAGE_TYPE_OPEN:
+      bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+      bp->in.dx.halfs.high = MOCK_CHANNEL_ID;
+      bp->out.si.word = MOCK_COOKIE_HIGH;
+      bp->out.di.word = MOCK_COOKIE_LOW;
+      break;
+
+   case MESSAGE_TYPE_SENDSIZE:
+      host.size = bp->in.size;
+      host.pos = 0;
+      host.pending = host.size == 0;
+      bp->in.cx.halfs.high = MockStatus();
+      break;
+
+   case MESSAGE_TYPE_SENDPAYLOAD:
+      piece = (uint32)bp->in.size;
+      len = MIN(host.size - host.pos, sizeof piece);
+      memcpy(host.buf + host.pos, &piece, len);
+      host.pos += len;
+      host.pending = host.pos == host.size;
+      bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+      break;
+
+   case MESSAGE_TYPE_RECVSIZE:
+      bp->in.cx.halfs.high = MockStatus();
+      if (host.pending) {
+         bp->in.cx.halfs.high |= MESSAGE_STATUS_DORECV;
+         bp->in.dx.halfs.high = MESSAGE_TYPE_SENDSIZE;
+         bp->out.bx.word = host.size;
+         host.pos = 0;
+      }
+      break;
+
+   case MESSAGE_TYPE_RECVPAYLOAD:
+      piece = 0;
+      len = MIN(host.size - host.pos, sizeof piece);
+      memcpy(&piece, host.buf + host.pos, len);
+      host.pos += len;
+      bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+      bp->in.dx.halfs.high = MESSAGE_TYPE_SENDPAYLOAD;
+      bp->out.bx.word = piece;
+      break;
+
+   case MESSAGE_TYPE_RECVSTATUS:
+      host.pending = FALSE;
+      bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+      break;
+
+   case MESSAGE_TYPE_CLOSE:
+      bp->in.cx.halfs.high = MESSAGE_STATUS_SUCCESS;
+      break;
+
+   default:
+      bp->in.cx.halfs.high = 0;
+      break;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Backdoor_HbOut --
+ *
+ *    Mock of the high-bandwidth guest to host transfer.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Backdoor_HbOut(Backdoor_proto_hb *bp) // IN/OUT
+{
+   MockExit();
+   memcpy(host.buf, (const void *)bp->in.srcAddr, bp->in.size);
+   host.pos = host.size;
+   host.pending = TRUE;
+   bp->in.bx.halfs.high = MESSAGE_STATUS_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Backdoor_HbIn --
+ *
+ *    Mock of the high-bandwidth host to guest transfer.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Backdoor_HbIn(Backdoor_proto_hb *bp) // IN/OUT
+{
+   MockExit();
+   memcpy((void *)bp->in.dstAddr, host.buf, bp->in.size);
+   host.pos = host.size;
+   bp->in.bx.halfs.high = MESSAGE_STATUS_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunBench --
+ *
+ *    Echo messages of the given size over a fresh channel and print the
+ *    resulting throughput and call counts.
+ *
+ * Results:
+ *    TRUE if every message came back intact.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+RunBench(Bool hb,          // IN
+         size_t msgSize,   // IN
+         unsigned int iter) // IN
+{
+   Message_Channel *chan;
+   Message_Stats stats;
+   unsigned char *msg;
+   unsigned char *reply;
+   size_t replySize;
+   struct timeval start;
+   struct timeval end;
+   double secs;
+   unsigned int i;
+   Bool ok = TRUE;
+
+   host.hb = hb;
+   host.buf = malloc(msgSize);
+   msg = malloc(msgSize);
+   if (host.buf == NULL || msg == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+   }
+   for (i = 0; i < msgSize; i++) {
+      msg[i] = (unsigned char)(i * 31 + 7);
+   }
+
+   chan = Message_Open(0x4f4c4354);
+   if (chan == NULL) {
+      fprintf(stderr, "Message_Open failed\n");
+      exit(1);
+   }
+
+   gettimeofday(&start, NULL);
+   for (i = 0; i < iter && ok; i++) {
+      ok = Message_Send(chan, msg, msgSize) &&
+           Message_Receive(chan, &reply, &replySize) &&
+           replySize == msgSize &&
+           memcmp(reply, msg, msgSize) == 0;
+   }
+   gettimeofday(&end, NULL);
+
+   Message_GetStats(chan, &stats);
+   Message_Close(chan);
+
+   secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+   printf("%-4s %8"FMTSZ"u bytes: %10.1f MB/s %10.1f calls/msg "
+          "%8.1f bytes/call%s\n",
+          hb ? "hb" : "lb", msgSize,
+          secs > 0 ? (stats.bytesSent + stats.bytesReceived) / secs / 1e6 : 0,
+          (double)stats.backdoorCalls / (stats.msgsSent + stats.msgsReceived),
+          (double)(stats.bytesSent + stats.bytesReceived) / stats.backdoorCalls,
+          ok ? "" : "  MISMATCH");
+
+   free(msg);
+   free(host.buf);
+   return ok;
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   static const size_t sizes[] = { 64, 4096, 65536, 1024 * 1024 };
+   unsigned int iter = 100;
+   unsigned int i;
+   int opt;
+   Bool ok = TRUE;
+
+   while ((opt = getopt(argc, argv, "c:n:")) != -1) {
+      switch (opt) {
+      case 'c':
+         host.exitCost = atoi(optarg);
+         break;
+      case 'n':
+         iter = atoi(optarg);
+         break;
+      default:
+         fprintf(stderr, "Usage: %s [-c exit cost] [-n iterations]\n",
+                 argv[0]);
+         return 1;
+      }
+   }
+
+   for (i = 0; i < ARRAYSIZE(sizes); i++) {
+      ok = RunBench(TRUE, sizes[i], iter) && ok;
+      ok = RunBench(FALSE, sizes[i], iter) && ok;
+   }
+
+   return ok ? 0 : 1;
+}
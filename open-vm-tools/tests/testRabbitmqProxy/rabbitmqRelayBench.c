@@ -0,0 +1,675 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rabbitmqRelayBench.c --
+ *
+ *   Loopback benchmark for the relay path of the guest RabbitMQ proxy. A
+ *   producer thread writes traffic into a socketpair, the main thread relays
+ *   it to a second socketpair the way the proxy does, and a consumer thread
+ *   reads and checks it. Both directions are measured:
+ *
+ *   - client->vmx: raw client data is wrapped into dataMap packets;
+ *   - vmx->client: dataMap packets are unwrapped into their payload;
+ *
+ *   once with the previous path of the proxy (DataMap encoding or decoding
+ *   and a malloc'ed copy per packet) and once with the relay ring of
+ *   services/plugins/grabbitmqProxy/rabbitmqProxyRelay.c (data framed and
+ *   parsed in place in reused buffers). For each run the throughput and
+ *   the average and longest time from the end of a recv to the end of the
+ *   matching send are printed.
+ *
+ *   Usage: vmware-rabbitmq-relay-bench [--size BYTES] [--count N] [--verify]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "vmware.h"
+#include "rabbitmqProxyRelay.h"
+
+#define BENCH_PATTERN(i)   ((char)((i) % 251))
+
+typedef enum {
+   BENCH_TO_VMX,
+   BENCH_TO_CLIENT,
+} BenchDirection;
+
+typedef struct BenchRun {
+   BenchDirection dir;
+   int in[2];                 /* producer -> relay */
+   int out[2];                /* relay -> consumer */
+   uint64 consumed;           /* payload bytes seen by the consumer */
+   gboolean ok;
+} BenchRun;
+
+static gint gSize = 16 * 1024;
+static gint gCount = 100000;
+static gboolean gVerify = FALSE;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ReadFull --
+ *
+ *      Read exactly len bytes.
+ *
+ * Results:
+ *      TRUE on success, FALSE on error or end of file.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+ReadFull(int fd,          // IN
+         void *buf,       // OUT
+         size_t len)      // IN
+{
+   char *p = buf;
+
+   while (len > 0) {
+      ssize_t n = read(fd, p, len);
+
+      if (n < 0 && errno == EINTR) {
+         continue;
+      }
+      if (n <= 0) {
+         return FALSE;
+      }
+      p += n;
+      len -= n;
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WriteFull --
+ *
+ *      Write exactly len bytes.
+ *
+ * Results:
+ *      TRUE on success, FALSE on error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+WriteFull(int fd,            // IN
+          const void *buf,   // IN
+          size_t len)        // IN
+{
+   const char *p = buf;
+
+   while (len > 0) {
+      ssize_t n = write(fd, p, len);
+
+      if (n < 0 && errno == EINTR) {
+         continue;
+      }
+      if (n < 0) {
+         return FALSE;
+      }
+      p += n;
+      len -= n;
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BuildVmxPacket --
+ *
+ *      Serialize a COMMAND_DATA packet the way the VMX proxy sends them.
+ *
+ * Results:
+ *      The packet, to be freed with free(), or NULL on error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+BuildVmxPacket(const char *payload,    // IN
+               int payloadLen,         // IN
+               uint32 *packetLen)      // OUT
+{
+   DataMap map;
+   char *copy = malloc(payloadLen);
+   char *packet = NULL;
+
+   if (copy == NULL || DataMap_Create(&map) != DMERR_SUCCESS) {
+      free(copy);
+      return NULL;
+   }
+   memcpy(copy, payload, payloadLen);
+   if (DataMap_SetInt64(&map, RMQPROXYDM_FLD_COMMAND, COMMAND_DATA,
+                        TRUE) != DMERR_SUCCESS ||
+       DataMap_SetString(&map, RMQPROXYDM_FLD_PAYLOAD, copy, payloadLen,
+                         TRUE) != DMERR_SUCCESS ||
+       DataMap_Serialize(&map, &packet, packetLen) != DMERR_SUCCESS) {
+      packet = NULL;
+   }
+   DataMap_Destroy(&map);
+   return packet;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Producer --
+ *
+ *      Thread writing gCount client writes or VMX packets of gSize bytes of
+ *      payload.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      Closes the write end of the input socketpair.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+Producer(gpointer data)    // IN
+{
+   BenchRun *run = data;
+   char *payload = malloc(gSize);
+   char *packet = NULL;
+   uint32 packetLen = gSize;
+   int i;
+
+   for (i = 0; i < gSize; i++) {
+      payload[i] = BENCH_PATTERN(i);
+   }
+
+   if (run->dir == BENCH_TO_CLIENT) {
+      packet = BuildVmxPacket(payload, gSize, &packetLen);
+   } else {
+      packet = payload;
+      payload = NULL;
+   }
+
+   for (i = 0; packet != NULL && i < gCount; i++) {
+      if (!WriteFull(run->in[0], packet, packetLen)) {
+         break;
+      }
+   }
+
+   free(packet);
+   free(payload);
+   close(run->in[0]);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CheckPayload --
+ *
+ *      Check a payload against the producer's pattern. 'offset' is the
+ *      position of the payload in the producer's write.
+ *
+ * Results:
+ *      TRUE if the payload matches.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+CheckPayload(const char *payload,     // IN
+             int len,                 // IN
+             uint64 offset)           // IN
+{
+   int i;
+
+   for (i = 0; i < len; i++) {
+      if (payload[i] != BENCH_PATTERN((offset + i) % gSize)) {
+         return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Consumer --
+ *
+ *      Thread reading the relayed traffic. Packets sent to VMX are decoded
+ *      with DataMap_Deserialize(), the first one always and all of them
+ *      with --verify, which also checks every payload byte.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gpointer
+Consumer(gpointer data)    // IN
+{
+   BenchRun *run = data;
+   uint64 expected = (uint64)gSize * gCount;
+   int bufSize = MAX(gSize, RMQ_RELAY_BUF_SIZE);
+   char *buf = malloc(bufSize + sizeof(int32));
+
+   run->ok = TRUE;
+   while (run->consumed < expected) {
+      if (run->dir == BENCH_TO_VMX) {
+         int32 len;
+         DataMap map;
+         char *payload;
+         int32 payloadLen;
+         int64 cmd;
+
+         if (!ReadFull(run->out[1], buf, sizeof len)) {
+            break;
+         }
+         len = ntohl(*(int32 *)buf);
+         if (len <= 0 || len > bufSize ||
+             !ReadFull(run->out[1], buf + sizeof len, len)) {
+            break;
+         }
+         if (run->consumed == 0 || gVerify) {
+            if (DataMap_Deserialize(buf, len + sizeof len, &map) !=
+                DMERR_SUCCESS) {
+               break;
+            }
+            if (DataMap_GetInt64(&map, RMQPROXYDM_FLD_COMMAND, &cmd) !=
+                   DMERR_SUCCESS || cmd != COMMAND_DATA ||
+                DataMap_GetString(&map, RMQPROXYDM_FLD_PAYLOAD, &payload,
+                                  &payloadLen) != DMERR_SUCCESS ||
+                !CheckPayload(payload, payloadLen, run->consumed)) {
+               DataMap_Destroy(&map);
+               break;
+            }
+            DataMap_Destroy(&map);
+         } else {
+            /* both paths send the same fields, only the payload varies */
+            payloadLen = len - (RMQ_RELAY_HEADER_LEN - sizeof len);
+         }
+         run->consumed += payloadLen;
+      } else {
+         ssize_t n = read(run->out[1], buf, bufSize);
+
+         if (n < 0 && errno == EINTR) {
+            continue;
+         }
+         if (n <= 0) {
+            break;
+         }
+         if (gVerify && !CheckPayload(buf, n, run->consumed)) {
+            break;
+         }
+         run->consumed += n;
+      }
+   }
+
+   run->ok = run->consumed == expected;
+   free(buf);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Account --
+ *
+ *      Account for a send of the legacy path, the way RmqRelayRing_Release()
+ *      does for the relay ring.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Account(RmqRelayStats *stats,   // IN/OUT
+        int len,                // IN
+        int64 queued)           // IN
+{
+   int64 now = g_get_monotonic_time();
+
+   if (stats->packets == 0) {
+      stats->firstTime = queued;
+   }
+   stats->bytes += len;
+   stats->packets++;
+   stats->lastTime = now;
+   stats->latencySum += now - queued;
+   stats->latencyMax = MAX(stats->latencyMax, now - queued);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RelayLegacy --
+ *
+ *      Relay with the previous path of the proxy: a DataMap and malloc'ed
+ *      copies for every packet.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+RelayLegacy(BenchRun *run,            // IN
+            RmqRelayStats *stats)     // OUT
+{
+   char *recvBuf = NULL;
+   int recvBufLen = 0;
+
+   for (;;) {
+      DataMap map;
+      char *sendBuf;
+      uint32 sendLen;
+      int64 queued;
+
+      if (run->dir == BENCH_TO_VMX) {
+         char *payload;
+         ssize_t n;
+
+         if (recvBuf == NULL) {
+            recvBufLen = RMQ_CLIENT_CONN_RECV_BUFF_SIZE;
+            recvBuf = malloc(recvBufLen);
+         }
+         n = read(run->in[1], recvBuf, recvBufLen);
+         if (n <= 0) {
+            break;
+         }
+         queued = g_get_monotonic_time();
+
+         payload = malloc(n);
+         memcpy(payload, recvBuf, n);
+         if (DataMap_Create(&map) != DMERR_SUCCESS ||
+             DataMap_SetInt64(&map, RMQPROXYDM_FLD_COMMAND, COMMAND_DATA,
+                              TRUE) != DMERR_SUCCESS ||
+             DataMap_SetString(&map, RMQPROXYDM_FLD_GUEST_VER_ID,
+                               strdup(GUEST_RABBITMQ_PROXY_VERSION), -1,
+                               TRUE) != DMERR_SUCCESS ||
+             DataMap_SetString(&map, RMQPROXYDM_FLD_PAYLOAD, payload, n,
+                               TRUE) != DMERR_SUCCESS ||
+             DataMap_Serialize(&map, &sendBuf, &sendLen) != DMERR_SUCCESS) {
+            return FALSE;
+         }
+         DataMap_Destroy(&map);
+      } else {
+         int32 pktLen;
+         char *payload;
+         int32 payloadLen;
+
+         if (!ReadFull(run->in[1], &pktLen, sizeof pktLen)) {
+            break;
+         }
+         if (recvBuf == NULL ||
+             recvBufLen < (int)(ntohl(pktLen) + sizeof pktLen)) {
+            recvBufLen = ntohl(pktLen) + sizeof pktLen;
+            free(recvBuf);
+            recvBuf = malloc(recvBufLen);
+         }
+         *(int32 *)recvBuf = pktLen;
+         if (!ReadFull(run->in[1], recvBuf + sizeof pktLen, ntohl(pktLen))) {
+            return FALSE;
+         }
+         queued = g_get_monotonic_time();
+
+         if (DataMap_Deserialize(recvBuf, ntohl(pktLen) + sizeof pktLen,
+                                 &map) != DMERR_SUCCESS ||
+             DataMap_GetString(&map, RMQPROXYDM_FLD_PAYLOAD, &payload,
+                               &payloadLen) != DMERR_SUCCESS) {
+            return FALSE;
+         }
+         sendBuf = malloc(payloadLen);
+         memcpy(sendBuf, payload, payloadLen);
+         sendLen = payloadLen;
+         DataMap_Destroy(&map);
+      }
+
+      if (!WriteFull(run->out[0], sendBuf, sendLen)) {
+         return FALSE;
+      }
+      free(sendBuf);
+      Account(stats, sendLen, queued);
+   }
+
+   free(recvBuf);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RelayRing --
+ *
+ *      Relay with the relay ring: data is framed or parsed in place and sent
+ *      from reused buffers.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+RelayRing(BenchRun *run,            // IN
+          RmqRelayStats *stats)     // OUT
+{
+   RmqRelayRing ring;
+   gboolean ok = TRUE;
+
+   memset(&ring, 0, sizeof ring);
+
+   for (;;) {
+      char *buf;
+      char *sendBuf;
+      int sendLen;
+
+      if (run->dir == BENCH_TO_VMX) {
+         ssize_t n;
+
+         buf = RmqRelayRing_Reserve(&ring, RMQ_RELAY_HEADER_LEN +
+                                           RMQ_CLIENT_CONN_RECV_BUFF_SIZE);
+         n = read(run->in[1], buf + RMQ_RELAY_HEADER_LEN,
+                  RMQ_CLIENT_CONN_RECV_BUFF_SIZE);
+         if (n <= 0) {
+            break;
+         }
+         RmqRelay_EncodeDataHeader(buf, n);
+         sendBuf = buf;
+         sendLen = RMQ_RELAY_HEADER_LEN + n;
+      } else {
+         int32 pktLen;
+         int64 cmd;
+         const char *payload;
+
+         if (!ReadFull(run->in[1], &pktLen, sizeof pktLen)) {
+            break;
+         }
+         pktLen = ntohl(pktLen);
+         buf = RmqRelayRing_Reserve(&ring, pktLen);
+         if (!ReadFull(run->in[1], buf, pktLen) ||
+             RmqRelay_ParsePacket(buf, pktLen, &cmd, &payload,
+                                  &sendLen) != DMERR_SUCCESS ||
+             payload == NULL) {
+            ok = FALSE;
+            break;
+         }
+         sendBuf = (char *)payload;
+      }
+
+      RmqRelayRing_Commit(&ring, sendLen, g_get_monotonic_time());
+      if (!WriteFull(run->out[0], sendBuf, sendLen)) {
+         ok = FALSE;
+         break;
+      }
+      RmqRelayRing_Release(&ring, sendBuf, stats, g_get_monotonic_time());
+   }
+
+   RmqRelayRing_Destroy(&ring);
+   return ok;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunBench --
+ *
+ *      Relay gCount writes in one direction with one of the paths and print
+ *      the results.
+ *
+ * Results:
+ *      TRUE on success.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+RunBench(const char *name,       // IN
+         BenchDirection dir,     // IN
+         gboolean ring)          // IN
+{
+   BenchRun run;
+   RmqRelayStats stats;
+   GThread *producer;
+   GThread *consumer;
+   int64 start;
+   double secs;
+   gboolean ok;
+
+   memset(&run, 0, sizeof run);
+   memset(&stats, 0, sizeof stats);
+   run.dir = dir;
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, run.in) != 0 ||
+       socketpair(AF_UNIX, SOCK_STREAM, 0, run.out) != 0) {
+      fprintf(stderr, "socketpair: %s\n", strerror(errno));
+      return FALSE;
+   }
+
+   start = g_get_monotonic_time();
+   producer = g_thread_new("producer", Producer, &run);
+   consumer = g_thread_new("consumer", Consumer, &run);
+
+   ok = ring ? RelayRing(&run, &stats) : RelayLegacy(&run, &stats);
+   close(run.out[0]);
+
+   g_thread_join(producer);
+   g_thread_join(consumer);
+   secs = (g_get_monotonic_time() - start) / 1e6;
+   close(run.in[1]);
+   close(run.out[1]);
+
+   ok = ok && run.ok;
+   printf("%-12s %-8s %10.1f %10.1f %10"FMT64"u %10"FMT64"d %s\n",
+          dir == BENCH_TO_VMX ? "client->vmx" : "vmx->client", name,
+          run.consumed / 1048576.0 / secs,
+          (double)stats.packets / secs,
+          stats.packets ? stats.latencySum / stats.packets : 0,
+          stats.latencyMax, ok ? "ok" : "FAILED");
+   return ok;
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   GOptionEntry entries[] = {
+      { "size", 0, 0, G_OPTION_ARG_INT, &gSize,
+        "Payload bytes per client write or VMX packet", "BYTES" },
+      { "count", 0, 0, G_OPTION_ARG_INT, &gCount,
+        "Number of writes or packets per run", "N" },
+      { "verify", 0, 0, G_OPTION_ARG_NONE, &gVerify,
+        "Decode and check every relayed byte", NULL },
+      { NULL }
+   };
+   GOptionContext *optCtx;
+   GError *err = NULL;
+   gboolean ok = TRUE;
+
+   optCtx = g_option_context_new("- benchmark the RabbitMQ proxy relay");
+   g_option_context_add_main_entries(optCtx, entries, NULL);
+   if (!g_option_context_parse(optCtx, &argc, &argv, &err)) {
+      fprintf(stderr, "%s\n", err->message);
+      return 1;
+   }
+   g_option_context_free(optCtx);
+
+   if (gSize <= 0 || gCount <= 0) {
+      fprintf(stderr, "Size and count must be positive\n");
+      return 1;
+   }
+
+   printf("%-12s %-8s %10s %10s %10s %10s\n", "direction", "path", "MB/s",
+          "sends/s", "avg us", "max us");
+   ok = RunBench("legacy", BENCH_TO_VMX, FALSE) && ok;
+   ok = RunBench("ring", BENCH_TO_VMX, TRUE) && ok;
+   ok = RunBench("legacy", BENCH_TO_CLIENT, FALSE) && ok;
+   ok = RunBench("ring", BENCH_TO_CLIENT, TRUE) && ok;
+
+   return ok ? 0 : 1;
+}
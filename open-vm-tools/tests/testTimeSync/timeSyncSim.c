@@ -0,0 +1,780 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * timeSyncSim.c --
+ *
+ *   Offline simulator for the time sync plugin. The plugin's own decision
+ *   logic (services/plugins/timeSync/timeSync.c) is built into this program
+ *   and driven through its Set_Option and shutdown callbacks, while the
+ *   platform clock calls of timeSync.h, the backdoor and the periodic timer
+ *   are replaced with a simulated host and guest clock:
+ *
+ *   - the guest clock drifts by a given number of ppm and starts at a given
+ *     offset from the host clock;
+ *   - host reads have gaussian noise and report a fixed interrupt lag;
+ *   - slewing changes the tick length like slewLinux.c does;
+ *   - the PLL is a model of the Linux kernel discipline with the time
+ *     constant pllLinux.c asks for.
+ *
+ *   The simulated guest error (guest - host - apparent error) is measured
+ *   every second, and the time it takes to stay within a threshold, the
+ *   overshoot (largest error of the opposite sign of the initial error),
+ *   the maximum error, the RMS error over the last quarter of the run and
+ *   the number of steps are printed.
+ *
+ *   With --replay, the drift is instead estimated from a sample log written
+ *   by the plugin (timeSync.samples-file in tools.conf, or the reply to the
+ *   "Time_Synchronize_Get_Samples" RPC) and the same metrics are printed
+ *   for the recorded trace and for its simulation with the given options,
+ *   e.g. to try another --percent on a recorded workload. The drift over
+ *   intervals where the PLL was active can't be estimated from the log and
+ *   is carried over from the previous interval.
+ *
+ *   Usage: vmware-timesync-sim [options]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "timeSync.h"
+#include "backdoor.h"
+#include "backdoor_def.h"
+#include "vmware/guestrpc/timesync.h"
+#include "vmware/tools/plugin.h"
+
+#define SIM_HOST_START     (G_GINT64_CONSTANT(1500000000) * US_PER_SEC)
+
+/* Tick lengths of slewLinux.c, in us, with USER_HZ 100. */
+#define SIM_TICK_NOMINAL   10000
+#define SIM_TICK_MAX       11000
+#define SIM_TICK_MIN       9000
+#define SIM_USER_HZ        100
+
+/*
+ * Kernel PLL: 1/64 of the remaining offset is applied every second
+ * (SHIFT_PLL + time constant 4) and the frequency moves by offset * dt / 2^16.
+ */
+#define SIM_PLL_PHASE_DIV  64.0
+#define SIM_PLL_FREQ_DIV   65536.0
+#define SIM_PLL_MAX_FREQ   500.0
+#define SIM_PLL_MAX_OFFSET 500000
+
+typedef struct SimTimer {
+   GSource source;
+   gint64 readyTime;
+   gint64 interval;
+} SimTimer;
+
+typedef struct SimDrift {
+   gint64 until;       // Simulated time up to which the drift applies, in us
+   double ppm;
+} SimDrift;
+
+typedef struct SimPoint {
+   gint64 t;
+   double err;
+} SimPoint;
+
+typedef struct SimMetrics {
+   double initial;
+   gint64 convergedAt; // -1 if the error is above the threshold at the end
+   double overshoot;
+   double maxError;
+   double sumSq;
+   guint tailCount;
+   guint steps;
+   gboolean started;
+} SimMetrics;
+
+/* Options. */
+static gint gDuration = 24 * 60 * 60;
+static gint gPeriod = 60;
+static gint gPercent = 50;
+static gdouble gOffsetOpt = 50000;
+static gdouble gDriftOpt = 20;
+static gdouble gNoise = 0;
+static gint gLag = 0;
+static gint gMaxLag = 1000000;
+static gint gThreshold = 1000;
+static gint gSeed = 1;
+static gboolean gNoSlew = FALSE;
+static gboolean gNoPll = FALSE;
+static gchar *gReplay = NULL;
+static gchar *gOutput = NULL;
+
+/* Simulated world. */
+static gint64 gNow;             // Time since the start of the run, in us
+static double gOffset;          // Guest time - host time, in us
+static gint64 gTick = SIM_TICK_NOMINAL;
+static double gPllOffset;
+static double gPllFreq;         // In ppm
+static gint64 gPllLastUpdate = -1;
+static GArray *gDrift;
+static GRand *gRand;
+static guint gSteps;
+
+/* Entry point of the plugin, in timeSync.c. */
+ToolsPluginData *ToolsOnLoad(ToolsAppCtx *ctx);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SimDriftAt --
+ *
+ *    Drift of the guest clock at the given time, in ppm.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+SimDriftAt(gint64 t)   // IN
+{
+   guint i;
+
+   for (i = 0; i < gDrift->len; i++) {
+      SimDrift *d = &g_array_index(gDrift, SimDrift, i);
+
+      if (t < d->until || i == gDrift->len - 1) {
+         return d->ppm;
+      }
+   }
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SimAdvance --
+ *
+ *    Advances the simulated clocks by one second.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+SimAdvance(void)
+{
+   double chunk = gPllOffset / SIM_PLL_PHASE_DIV;
+
+   gPllOffset -= chunk;
+   gOffset += SimDriftAt(gNow) + gPllFreq + chunk +
+              (gTick - SIM_TICK_NOMINAL) * SIM_USER_HZ;
+   gNow += US_PER_SEC;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SimNoise --
+ *
+ *    Gaussian noise with the configured standard deviation, in us.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+SimNoise(void)
+{
+   double u1;
+   double u2;
+
+   if (gNoise <= 0) {
+      return 0;
+   }
+   u1 = g_rand_double(gRand);
+   u2 = g_rand_double(gRand);
+   if (u1 <= 0) {
+      u1 = 1e-12;
+   }
+   return gNoise * sqrt(-2 * log(u1)) * cos(2 * G_PI * u2);
+}
+
+
+/*
+ * Replacements for the platform clock calls of timeSync.h.
+ */
+
+Bool
+TimeSync_GetCurrentTime(int64 *now)   // OUT
+{
+   *now = SIM_HOST_START + gNow + (int64)floor(gOffset);
+   return TRUE;
+}
+
+
+Bool
+TimeSync_AddToCurrentTime(int64 delta)   // IN
+{
+   gOffset += delta;
+   gSteps++;
+   return TRUE;
+}
+
+
+Bool
+TimeSync_Slew(int64 delta,            // IN
+              int64 timeSyncPeriod,   // IN
+              int64 *remaining)       // OUT
+{
+   static int64 startTime = 0;
+   static int64 tickLength;
+   static int64 deltaRequested;
+   int64 now;
+
+   TimeSync_GetCurrentTime(&now);
+   if (startTime != 0) {
+      int64 ticksElapsed = (now - startTime) / tickLength;
+      int64 deltaApplied = ticksElapsed * (tickLength - SIM_TICK_NOMINAL);
+      *remaining = deltaRequested - deltaApplied;
+   }
+
+   tickLength =
+      (timeSyncPeriod + delta) / ((timeSyncPeriod / US_PER_SEC) * SIM_USER_HZ);
+   tickLength = MIN(MAX(tickLength, SIM_TICK_MIN), SIM_TICK_MAX);
+   startTime = now;
+   deltaRequested = delta;
+   gTick = tickLength;
+   return TRUE;
+}
+
+
+Bool
+TimeSync_DisableTimeSlew(void)
+{
+   gTick = SIM_TICK_NOMINAL;
+   return TRUE;
+}
+
+
+Bool
+TimeSync_PLLUpdate(int64 offset)   // IN
+{
+   offset = MIN(MAX(offset, -SIM_PLL_MAX_OFFSET), SIM_PLL_MAX_OFFSET);
+   if (gPllLastUpdate >= 0) {
+      gPllFreq += offset * ((gNow - gPllLastUpdate) / (double)US_PER_SEC) /
+                  SIM_PLL_FREQ_DIV;
+      gPllFreq = MIN(MAX(gPllFreq, -SIM_PLL_MAX_FREQ), SIM_PLL_MAX_FREQ);
+   }
+   gPllLastUpdate = gNow;
+   gPllOffset = offset;
+   return TRUE;
+}
+
+
+Bool
+TimeSync_PLLSetFrequency(int64 ppmCorrection)   // IN
+{
+   gPllFreq = ppmCorrection / 65536.0;
+   return TRUE;
+}
+
+
+Bool
+TimeSync_PLLSupported(void)
+{
+   return !gNoPll;
+}
+
+
+Bool
+TimeSync_IsGuestSyncServiceRunning(void)
+{
+   return FALSE;
+}
+
+
+Bool
+TimeSync_DoGuestResync(void *_ctx)   // IN
+{
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Backdoor --
+ *
+ *    Answers the host time queries of the plugin with the simulated host
+ *    clock.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Backdoor(Backdoor_proto *bp)   // IN/OUT
+{
+   uint16 cmd = bp->in.cx.halfs.low;
+   int64 host;
+   int64 secs;
+
+   memset(bp, 0, sizeof *bp);
+   if (cmd != BDOOR_CMD_GETTIMEFULL_WITH_LAG) {
+      return;
+   }
+
+   host = SIM_HOST_START + gNow + (int64)SimNoise();
+   secs = host / US_PER_SEC;
+   bp->out.ax.word = BDOOR_MAGIC;
+   bp->out.si.word = (uint32)(secs >> 32);
+   bp->out.dx.word = (uint32)secs;
+   bp->out.bx.word = host % US_PER_SEC;
+   bp->out.cx.word = gMaxLag;
+   bp->out.di.word = gLag;
+}
+
+
+/*
+ * The plugin's timers are built with SimTimeoutSourceNew() instead of
+ * g_timeout_source_new() (see Makefile.am) so they follow the simulated
+ * clock.
+ */
+
+static gboolean
+SimTimerPrepare(GSource *src,   // IN
+                gint *timeout)  // OUT
+{
+   *timeout = -1;
+   return gNow >= ((SimTimer *)src)->readyTime;
+}
+
+
+static gboolean
+SimTimerCheck(GSource *src)   // IN
+{
+   return gNow >= ((SimTimer *)src)->readyTime;
+}
+
+
+static gboolean
+SimTimerDispatch(GSource *src,          // IN
+                 GSourceFunc callback,  // IN
+                 gpointer data)         // IN
+{
+   SimTimer *timer = (SimTimer *)src;
+
+   timer->readyTime = gNow + timer->interval;
+   return callback(data);
+}
+
+
+static GSourceFuncs gSimTimerFuncs = {
+   SimTimerPrepare,
+   SimTimerCheck,
+   SimTimerDispatch,
+   NULL
+};
+
+
+GSource *
+SimTimeoutSourceNew(guint interval)   // IN: milliseconds
+{
+   GSource *src = g_source_new(&gSimTimerFuncs, sizeof (SimTimer));
+   SimTimer *timer = (SimTimer *)src;
+
+   timer->interval = (gint64)interval * 1000;
+   timer->readyTime = gNow + timer->interval;
+   return src;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MetricsAdd --
+ *
+ *    Accounts for the guest error at the given time.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+MetricsAdd(SimMetrics *m,     // IN/OUT
+           gint64 t,          // IN
+           gint64 tailStart,  // IN
+           double err)        // IN
+{
+   if (!m->started) {
+      memset(m, 0, sizeof *m);
+      m->started = TRUE;
+      m->initial = err;
+      m->convergedAt = -1;
+   }
+
+   if (fabs(err) >= gThreshold) {
+      m->convergedAt = -1;
+   } else if (m->convergedAt < 0) {
+      m->convergedAt = t;
+   }
+   if (err * m->initial < 0 && fabs(err) > m->overshoot) {
+      m->overshoot = fabs(err);
+   }
+   if (fabs(err) > m->maxError) {
+      m->maxError = fabs(err);
+   }
+   if (t >= tailStart) {
+      m->sumSq += err * err;
+      m->tailCount++;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MetricsPrint --
+ *
+ *    Prints one line of results.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+MetricsPrint(const char *name,        // IN
+             const SimMetrics *m)     // IN
+{
+   char converged[32];
+
+   if (m->convergedAt >= 0) {
+      g_snprintf(converged, sizeof converged, "%.0f",
+                 m->convergedAt / (double)US_PER_SEC);
+   } else {
+      g_strlcpy(converged, "never", sizeof converged);
+   }
+   printf("%-10s %12s %14.0f %14.0f %12.1f %6u\n", name, converged,
+          m->overshoot, m->maxError,
+          m->tailCount > 0 ? sqrt(m->sumSq / m->tailCount) : 0.0, m->steps);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LoadReplay --
+ *
+ *    Reads a sample log, fills in the drift schedule and the initial state
+ *    of the simulation, and computes the metrics of the recorded trace.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+LoadReplay(const char *path,       // IN
+           SimMetrics *recorded)   // OUT
+{
+   FILE *f = fopen(path, "r");
+   char line[512];
+   gboolean first = TRUE;
+   gint64 start = 0;
+   gint64 lastHost = 0;
+   gint64 lastGos = 0;
+   gint64 lastApplied = 0;
+   gboolean lastKnown = FALSE;
+   gboolean lastSlew = FALSE;
+   double ppm = 0;
+   guint steps = 0;
+   GArray *samples = g_array_new(FALSE, FALSE, sizeof (SimPoint));
+   guint i;
+
+   if (f == NULL) {
+      perror(path);
+      return FALSE;
+   }
+
+   memset(recorded, 0, sizeof *recorded);
+   while (fgets(line, sizeof line, f) != NULL) {
+      long long host, guest, gos, apparent, maxError, correction, remaining;
+      char type[16], action[16], status[16];
+      gboolean slew;
+      SimPoint point;
+
+      if (line[0] == '#' ||
+          sscanf(line, "%lld %lld %lld %lld %lld %15s %15s %lld %lld %15s",
+                 &host, &guest, &gos, &apparent, &maxError, type, action,
+                 &correction, &remaining, status) != 10) {
+         continue;
+      }
+
+      slew = strcmp(action, "slew") == 0 || strcmp(action, "calibrate") == 0;
+      if (first) {
+         first = FALSE;
+         start = host;
+         gOffset = guest - host;
+         gLag = -apparent;
+         gMaxLag = maxError;
+      } else if (host > lastHost) {
+         /*
+          * The error moved by the drift plus what was applied of the last
+          * correction. A slew that was cut short reports what it didn't
+          * apply at the next slew.
+          */
+         gint64 applied = lastApplied - (lastSlew && slew ? remaining : 0);
+
+         if (lastKnown) {
+            SimDrift d;
+
+            ppm = (gos - lastGos - applied) * (double)US_PER_SEC /
+                  (host - lastHost);
+            d.until = host - start;
+            d.ppm = ppm;
+            g_array_append_val(gDrift, d);
+         } else {
+            SimDrift d = { host - start, ppm };
+            g_array_append_val(gDrift, d);
+         }
+      }
+
+      lastHost = host;
+      lastGos = gos;
+      lastSlew = slew && strcmp(status, "ok") == 0;
+      lastKnown = strcmp(action, "pll") != 0 && strcmp(action, "resync") != 0;
+      lastApplied = 0;
+      if (strcmp(status, "ok") == 0 && (strcmp(action, "step") == 0 || slew)) {
+         lastApplied = correction;
+      }
+      if (strcmp(action, "step") == 0 && strcmp(status, "ok") == 0) {
+         steps++;
+      }
+
+      point.t = host - start;
+      point.err = gos;
+      g_array_append_val(samples, point);
+   }
+   fclose(f);
+
+   if (samples->len < 2) {
+      fprintf(stderr, "%s: not enough samples\n", path);
+      g_array_free(samples, TRUE);
+      return FALSE;
+   }
+
+   gDuration = (lastHost - start) / US_PER_SEC;
+   for (i = 0; i < samples->len; i++) {
+      SimPoint *point = &g_array_index(samples, SimPoint, i);
+
+      MetricsAdd(recorded, point->t, (gint64)gDuration * US_PER_SEC * 3 / 4,
+                 point->err);
+   }
+   recorded->steps = steps;
+   g_array_free(samples, TRUE);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SetOption --
+ *
+ *    Sends an option to the plugin, like the VMX would.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+SetOption(ToolsAppCtx *ctx,          // IN
+          ToolsPluginData *plugin,   // IN
+          const char *option,        // IN
+          const char *value)         // IN
+{
+   guint i;
+
+   for (i = 0; i < plugin->regs->len; i++) {
+      ToolsAppReg *reg = &g_array_index(plugin->regs, ToolsAppReg, i);
+      guint j;
+
+      if (reg->type != TOOLS_APP_SIGNALS) {
+         continue;
+      }
+      for (j = 0; j < reg->data->len; j++) {
+         ToolsPluginSignalCb *sig = &g_array_index(reg->data,
+                                                   ToolsPluginSignalCb, j);
+         gboolean (*cb)(gpointer, ToolsAppCtx *, const gchar *,
+                        const gchar *, ToolsPluginData *) = sig->callback;
+
+         if (strcmp(sig->signame, TOOLS_CORE_SIG_SET_OPTION) == 0 &&
+             !cb(NULL, ctx, option, value, sig->clientData)) {
+            fprintf(stderr, "Option %s=%s rejected\n", option, value);
+         }
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Shutdown --
+ *
+ *    Sends the shutdown signal to the plugin.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Shutdown(ToolsAppCtx *ctx,          // IN
+         ToolsPluginData *plugin)   // IN
+{
+   guint i;
+
+   for (i = 0; i < plugin->regs->len; i++) {
+      ToolsAppReg *reg = &g_array_index(plugin->regs, ToolsAppReg, i);
+      guint j;
+
+      if (reg->type != TOOLS_APP_SIGNALS) {
+         continue;
+      }
+      for (j = 0; j < reg->data->len; j++) {
+         ToolsPluginSignalCb *sig = &g_array_index(reg->data,
+                                                   ToolsPluginSignalCb, j);
+         void (*cb)(gpointer, ToolsAppCtx *, ToolsPluginData *) =
+            sig->callback;
+
+         if (strcmp(sig->signame, TOOLS_CORE_SIG_SHUTDOWN) == 0) {
+            cb(NULL, ctx, sig->clientData);
+         }
+      }
+   }
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   GOptionEntry entries[] = {
+      { "duration", 0, 0, G_OPTION_ARG_INT, &gDuration,
+        "Simulated time in seconds", "SECS" },
+      { "period", 0, 0, G_OPTION_ARG_INT, &gPeriod,
+        "Time sync period in seconds", "SECS" },
+      { "percent", 0, 0, G_OPTION_ARG_INT, &gPercent,
+        "Percent of the error corrected by each slew", "PCT" },
+      { "offset", 0, 0, G_OPTION_ARG_DOUBLE, &gOffsetOpt,
+        "Initial guest - host time in us", "US" },
+      { "drift", 0, 0, G_OPTION_ARG_DOUBLE, &gDriftOpt,
+        "Guest clock drift in ppm", "PPM" },
+      { "noise", 0, 0, G_OPTION_ARG_DOUBLE, &gNoise,
+        "Standard deviation of host time reads in us", "US" },
+      { "lag", 0, 0, G_OPTION_ARG_INT, &gLag,
+        "Interrupt lag reported by the host in us", "US" },
+      { "max-lag", 0, 0, G_OPTION_ARG_INT, &gMaxLag,
+        "Error allowed before stepping in us", "US" },
+      { "threshold", 0, 0, G_OPTION_ARG_INT, &gThreshold,
+        "Error considered converged in us", "US" },
+      { "seed", 0, 0, G_OPTION_ARG_INT, &gSeed,
+        "Seed of the noise", "N" },
+      { "no-slew", 0, 0, G_OPTION_ARG_NONE, &gNoSlew,
+        "Disable slew correction", NULL },
+      { "no-pll", 0, 0, G_OPTION_ARG_NONE, &gNoPll,
+        "Act as if the platform had no PLL", NULL },
+      { "replay", 0, 0, G_OPTION_ARG_FILENAME, &gReplay,
+        "Estimate the drift from a sample log", "FILE" },
+      { "output", 0, 0, G_OPTION_ARG_FILENAME, &gOutput,
+        "Write the plugin's samples to a file", "FILE" },
+      { NULL }
+   };
+   GOptionContext *optCtx;
+   GError *err = NULL;
+   GMainContext *mainCtx;
+   ToolsAppCtx ctx;
+   ToolsPluginData *plugin;
+   SimMetrics recorded;
+   SimMetrics simulated;
+   gint64 tailStart;
+   gchar *value;
+
+   optCtx = g_option_context_new("- simulate the time sync plugin");
+   g_option_context_add_main_entries(optCtx, entries, NULL);
+   if (!g_option_context_parse(optCtx, &argc, &argv, &err)) {
+      fprintf(stderr, "%s\n", err->message);
+      return 1;
+   }
+   g_option_context_free(optCtx);
+
+   if (gPeriod <= 0 || gDuration <= 0) {
+      fprintf(stderr, "Period and duration must be positive\n");
+      return 1;
+   }
+
+   gRand = g_rand_new_with_seed(gSeed);
+   gDrift = g_array_new(FALSE, FALSE, sizeof (SimDrift));
+   if (gReplay != NULL) {
+      if (!LoadReplay(gReplay, &recorded)) {
+         return 1;
+      }
+   } else {
+      SimDrift d = { 0, gDriftOpt };
+
+      g_array_append_val(gDrift, d);
+      gOffset = gOffsetOpt;
+   }
+
+   memset(&ctx, 0, sizeof ctx);
+   ctx.name = "vmsvc";
+   mainCtx = g_main_context_new();
+   ctx.mainLoop = g_main_loop_new(mainCtx, FALSE);
+   plugin = ToolsOnLoad(&ctx);
+
+   SetOption(&ctx, plugin, TOOLSOPTION_SYNCTIME_SLEWCORRECTION,
+             gNoSlew ? "0" : "1");
+   value = g_strdup_printf("%d", gPercent);
+   SetOption(&ctx, plugin, TOOLSOPTION_SYNCTIME_PERCENTCORRECTION, value);
+   g_free(value);
+   value = g_strdup_printf("%d", gPeriod);
+   SetOption(&ctx, plugin, TOOLSOPTION_SYNCTIME_PERIOD, value);
+   g_free(value);
+
+   tailStart = (gint64)gDuration * US_PER_SEC * 3 / 4;
+   memset(&simulated, 0, sizeof simulated);
+   MetricsAdd(&simulated, 0, tailStart, gOffset + gLag);
+
+   /* Starts the loop, which synchronizes right away. */
+   SetOption(&ctx, plugin, TOOLSOPTION_SYNCTIME, "1");
+
+   while (gNow < (gint64)gDuration * US_PER_SEC) {
+      SimAdvance();
+      while (g_main_context_iteration(mainCtx, FALSE)) {
+      }
+      MetricsAdd(&simulated, gNow, tailStart, gOffset + gLag);
+   }
+   simulated.steps = gSteps;
+
+   if (gOutput != NULL) {
+      TimeSync_WriteSamples(gOutput);
+   }
+   Shutdown(&ctx, plugin);
+
+   printf("%-10s %12s %14s %14s %12s %6s\n", "trace", "converged s",
+          "overshoot us", "max error us", "rms tail us", "steps");
+   if (gReplay != NULL) {
+      MetricsPrint("recorded", &recorded);
+   }
+   MetricsPrint("simulated", &simulated);
+
+   g_main_loop_unref(ctx.mainLoop);
+   g_main_context_unref(mainCtx);
+   g_array_free(gDrift, TRUE);
+   g_rand_free(gRand);
+   return 0;
+}
@@ -0,0 +1,227 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * timelineReport.c --
+ *
+ *   Summarizes quiesce timelines written by the vmbackup plugin
+ *   (quiesce_timeline.txt, or the reply to the "vmbackup.timeline" RPC).
+ *   Spans with the same name are grouped across all runs found in the
+ *   given files and their median, 99th percentile and maximum durations
+ *   are printed, in the order the spans first appear.
+ *
+ *   Usage: vmware-vmbackup-timeline-report [file ...]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SPAN_NAME_LEN 64
+
+typedef struct SpanSeries {
+   char name[SPAN_NAME_LEN];
+   long long *durations;  // Microseconds
+   size_t count;
+   size_t capacity;
+} SpanSeries;
+
+static SpanSeries *series;
+static size_t seriesCount;
+static size_t seriesCapacity;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Grow --
+ *
+ *    Makes room for one more element in an array, exits if out of memory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+Grow(void *array,         // IN
+     size_t count,        // IN
+     size_t *capacity,    // IN/OUT
+     size_t elemSize)     // IN
+{
+   if (count == *capacity) {
+      *capacity = *capacity ? *capacity * 2 : 16;
+      array = realloc(array, *capacity * elemSize);
+      if (array == NULL) {
+         fprintf(stderr, "Out of memory\n");
+         exit(1);
+      }
+   }
+   return array;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * AddSpan --
+ *
+ *    Adds a duration to the series of the given span name.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+AddSpan(const char *name,    // IN
+        long long duration)  // IN
+{
+   SpanSeries *s = NULL;
+   size_t i;
+
+   for (i = 0; i < seriesCount; i++) {
+      if (strcmp(series[i].name, name) == 0) {
+         s = &series[i];
+         break;
+      }
+   }
+
+   if (s == NULL) {
+      series = Grow(series, seriesCount, &seriesCapacity, sizeof *series);
+      s = &series[seriesCount++];
+      memset(s, 0, sizeof *s);
+      snprintf(s->name, sizeof s->name, "%s", name);
+   }
+
+   s->durations = Grow(s->durations, s->count, &s->capacity,
+                       sizeof *s->durations);
+   s->durations[s->count++] = duration;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ReadTimeline --
+ *
+ *    Reads the spans of a timeline file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ReadTimeline(FILE *f)   // IN
+{
+   char line[256];
+
+   while (fgets(line, sizeof line, f) != NULL) {
+      unsigned int run;
+      long long start;
+      long long duration;
+      char name[SPAN_NAME_LEN];
+
+      if (line[0] == '#') {
+         continue;
+      }
+      if (sscanf(line, "%u %lld %lld %63[^\n]", &run, &start, &duration,
+                 name) == 4) {
+         AddSpan(name, duration);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CompareDuration --
+ *
+ *    qsort callback for durations.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+CompareDuration(const void *a,  // IN
+                const void *b)  // IN
+{
+   long long da = *(const long long *)a;
+   long long db = *(const long long *)b;
+
+   return da < db ? -1 : da > db;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Percentile --
+ *
+ *    Nearest rank percentile of a sorted series, in milliseconds.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+Percentile(const SpanSeries *s,  // IN
+           unsigned int p)       // IN
+{
+   size_t rank = (s->count * p + 99) / 100;
+
+   return s->durations[rank > 0 ? rank - 1 : 0] / 1000.0;
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   size_t i;
+   int arg;
+
+   if (argc < 2) {
+      ReadTimeline(stdin);
+   }
+   for (arg = 1; arg < argc; arg++) {
+      FILE *f = fopen(argv[arg], "r");
+
+      if (f == NULL) {
+         perror(argv[arg]);
+         return 1;
+      }
+      ReadTimeline(f);
+      fclose(f);
+   }
+
+   if (seriesCount == 0) {
+      fprintf(stderr, "No timeline entries found\n");
+      return 1;
+   }
+
+   printf("%-40s %6s %12s %12s %12s\n", "span", "count", "p50 ms", "p99 ms",
+          "max ms");
+   for (i = 0; i < seriesCount; i++) {
+      SpanSeries *s = &series[i];
+
+      qsort(s->durations, s->count, sizeof *s->durations, CompareDuration);
+      printf("%-40s %6lu %12.3f %12.3f %12.3f\n", s->name,
+             (unsigned long)s->count, Percentile(s, 50), Percentile(s, 99),
+             s->durations[s->count - 1] / 1000.0);
+      free(s->durations);
+   }
+   free(series);
+
+   return 0;
+}
@@ -0,0 +1,522 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * blockStress.c --
+ *
+ *   Stress test for the vmblock block table (modules/shared/vmblock/block.c)
+ *   as built for vmblock-fuse.  Several blocker threads concurrently add and
+ *   remove thousands of blocks while accessor threads keep looking up files,
+ *   and waiter threads sleep on blocked files until the blocks are lifted.
+ *   Unlike vmblocktest this does not need a mounted vmblock file system.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "os.h"
+#include "block.h"
+
+#define NUM_BLOCKERS              8
+#define NUM_ACCESSORS             8
+#define WAITERS_PER_BLOCKER       8
+#define DEFAULT_FILES_PER_BLOCKER 1000
+
+#define lprintf(...)                                                    \
+   do {                                                                 \
+      pthread_mutex_lock(&print_lock);                                  \
+      printf(__VA_ARGS__);                                              \
+      fflush(stdout);                                                   \
+      pthread_mutex_unlock(&print_lock);                                \
+   } while(0)
+
+#define lfprintf(stream, ...)                                           \
+   do {                                                                 \
+      pthread_mutex_lock(&print_lock);                                  \
+      fprintf(stream, __VA_ARGS__);                                     \
+      fflush(stream);                                                   \
+      pthread_mutex_unlock(&print_lock);                                \
+   } while(0)
+
+#define ERROR(fmt, args...)        lfprintf(stderr, fmt, ## args)
+
+/* Types */
+typedef struct BlockerInfo {
+   unsigned int id;
+   char blockerId[16];     // os_blocker_id_t is a pointer to this
+} BlockerInfo;
+
+typedef struct WaiterInfo {
+   unsigned int blocker;
+   unsigned int file;
+} WaiterInfo;
+
+/* Variables */
+int LOGLEVEL_THRESHOLD = 0;
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t phaseBarrier;
+static unsigned int filesPerBlocker = DEFAULT_FILES_PER_BLOCKER;
+static volatile Bool accessorsQuit = FALSE;
+static gint failures = 0;
+static gint wokenWaiters = 0;
+static gint lookups = 0;
+
+/* Thread entry points */
+static void *blocker(void *arg);
+static void *accessor(void *arg);
+static void *waiter(void *arg);
+
+/* Utility functions */
+static void fileName(char *buf, size_t bufSize,
+                     unsigned int blocker, unsigned int file);
+static void waitForWaiters(void);
+static void checkLateWaiters(void);
+static double now(void);
+
+#define FAIL(fmt, args...)                                              \
+   do {                                                                 \
+      ERROR("FAILED: " fmt, ## args);                                   \
+      g_atomic_int_inc(&failures);                                      \
+   } while (0)
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Runs the accessor threads for the whole test and the blocker threads
+ *    through the add and remove phases, then checks that nothing was lost.
+ *
+ *    The number of files blocked by each blocker can be given as the only
+ *    argument.
+ *
+ * Results:
+ *    EXIT_SUCCESS and EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   pthread_t blockers[NUM_BLOCKERS];
+   pthread_t accessors[NUM_ACCESSORS];
+   pthread_t waiters[NUM_BLOCKERS * WAITERS_PER_BLOCKER];
+   BlockerInfo blockerInfo[NUM_BLOCKERS];
+   WaiterInfo waiterInfo[NUM_BLOCKERS * WAITERS_PER_BLOCKER];
+   double start;
+   double elapsed;
+   unsigned int i;
+
+   if (argc > 1) {
+      filesPerBlocker = strtoul(argv[1], NULL, 10);
+      if (filesPerBlocker < 2 * WAITERS_PER_BLOCKER) {
+         ERROR("%s: need at least %u files per blocker\n", argv[0],
+               2 * WAITERS_PER_BLOCKER);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (BlockInit() != 0) {
+      ERROR("%s: BlockInit failed\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   /*
+    * The blockers and the main thread synchronize on the barrier: once the
+    * blocks are added, once the waiters are started and once the blocks are
+    * gone.
+    */
+   pthread_barrier_init(&phaseBarrier, NULL, NUM_BLOCKERS + 1);
+
+   for (i = 0; i < NUM_ACCESSORS; i++) {
+      pthread_create(&accessors[i], NULL, accessor,
+                     (void *)(uintptr_t)i);
+   }
+
+   start = now();
+   for (i = 0; i < NUM_BLOCKERS; i++) {
+      blockerInfo[i].id = i;
+      snprintf(blockerInfo[i].blockerId, sizeof blockerInfo[i].blockerId,
+               "blocker%u", i);
+      pthread_create(&blockers[i], NULL, blocker, &blockerInfo[i]);
+   }
+
+   pthread_barrier_wait(&phaseBarrier);
+   elapsed = now() - start;
+   lprintf("Added %u blocks in %.3fs\n", NUM_BLOCKERS * filesPerBlocker,
+           elapsed);
+
+   for (i = 0; i < NUM_BLOCKERS * WAITERS_PER_BLOCKER; i++) {
+      waiterInfo[i].blocker = i / WAITERS_PER_BLOCKER;
+      waiterInfo[i].file = i % WAITERS_PER_BLOCKER;
+      pthread_create(&waiters[i], NULL, waiter, &waiterInfo[i]);
+   }
+
+   /*
+    * Only let the blockers remove the blocks once every waiter sleeps on
+    * its block, otherwise a waiter could find its block already gone and
+    * the wakeup path would not be tested at all.
+    */
+   waitForWaiters();
+   pthread_barrier_wait(&phaseBarrier);
+
+   start = now();
+   pthread_barrier_wait(&phaseBarrier);
+   elapsed = now() - start;
+   lprintf("Removed %u blocks in %.3fs\n", NUM_BLOCKERS * filesPerBlocker,
+           elapsed);
+
+   for (i = 0; i < NUM_BLOCKERS; i++) {
+      pthread_join(blockers[i], NULL);
+   }
+   for (i = 0; i < NUM_BLOCKERS * WAITERS_PER_BLOCKER; i++) {
+      pthread_join(waiters[i], NULL);
+   }
+   checkLateWaiters();
+   accessorsQuit = TRUE;
+   for (i = 0; i < NUM_ACCESSORS; i++) {
+      pthread_join(accessors[i], NULL);
+   }
+
+   if (g_atomic_int_get(&wokenWaiters) != NUM_BLOCKERS * WAITERS_PER_BLOCKER) {
+      FAIL("only %d of %d waiters woke up\n",
+           g_atomic_int_get(&wokenWaiters),
+           NUM_BLOCKERS * WAITERS_PER_BLOCKER);
+   }
+
+   if (BlockRemoveAllBlocks(OS_UNKNOWN_BLOCKER) != 0) {
+      FAIL("blocks left over at the end of the test\n");
+   }
+
+   pthread_barrier_destroy(&phaseBarrier);
+   BlockCleanup();
+
+   lprintf("%d lookups by %d accessors, %d failures\n",
+           g_atomic_int_get(&lookups), NUM_ACCESSORS,
+           g_atomic_int_get(&failures));
+
+   return g_atomic_int_get(&failures) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * blocker --
+ *
+ *    Adds a block on each of this blocker's files and checks that each one
+ *    can be found.  After the waiters have been started, removes half of
+ *    the blocks one by one and the rest with BlockRemoveAllBlocks().
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+blocker(void *arg)  // IN
+{
+   BlockerInfo *info = arg;
+   char name[OS_PATH_MAX];
+   unsigned int removed;
+   unsigned int i;
+   int ret;
+
+   for (i = 0; i < filesPerBlocker; i++) {
+      fileName(name, sizeof name, info->id, i);
+      ret = BlockAddFileBlock(name, info->blockerId);
+      if (ret != 0) {
+         FAIL("BlockAddFileBlock(%s) returned %d\n", name, ret);
+      }
+   }
+
+   /* Every block must be visible, to any blocker. */
+   for (i = 0; i < filesPerBlocker; i++) {
+      fileName(name, sizeof name, info->id, i);
+      ret = BlockAddFileBlock(name, info->blockerId);
+      if (ret != OS_EEXIST) {
+         FAIL("duplicate BlockAddFileBlock(%s) returned %d\n", name, ret);
+      }
+   }
+
+   pthread_barrier_wait(&phaseBarrier);
+   pthread_barrier_wait(&phaseBarrier);
+
+   /*
+    * Only the blocker that added a block may remove it.  Start after the
+    * files the waiters are sleeping on, those go with the rest.
+    */
+   for (i = filesPerBlocker / 2; i < filesPerBlocker; i++) {
+      fileName(name, sizeof name, info->id, i);
+      ret = BlockRemoveFileBlock(name, "nobody");
+      if (ret != OS_ENOENT) {
+         FAIL("BlockRemoveFileBlock(%s) by wrong blocker returned %d\n",
+              name, ret);
+      }
+      ret = BlockRemoveFileBlock(name, info->blockerId);
+      if (ret != 0) {
+         FAIL("BlockRemoveFileBlock(%s) returned %d\n", name, ret);
+      }
+   }
+
+   removed = BlockRemoveAllBlocks(info->blockerId);
+   if (removed != filesPerBlocker / 2) {
+      FAIL("BlockRemoveAllBlocks(%s) removed %u blocks, expected %u\n",
+           info->blockerId, removed, filesPerBlocker / 2);
+   }
+
+   fileName(name, sizeof name, info->id, 0);
+   ret = BlockRemoveFileBlock(name, info->blockerId);
+   if (ret != OS_ENOENT) {
+      FAIL("BlockRemoveFileBlock(%s) after removal returned %d\n", name, ret);
+   }
+
+   pthread_barrier_wait(&phaseBarrier);
+
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * accessor --
+ *
+ *    Keeps looking up files that are never blocked, the way every access
+ *    through vmblock-fuse does, until told to stop.  Each lookup has to
+ *    return right away.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+accessor(void *arg)  // IN
+{
+   unsigned int id = (unsigned int)(uintptr_t)arg;
+   unsigned int seed = id;
+   char name[OS_PATH_MAX];
+   int count = 0;
+   int ret;
+
+   while (!accessorsQuit) {
+      /* Blocker ids past NUM_BLOCKERS are never used. */
+      fileName(name, sizeof name, NUM_BLOCKERS + id,
+               rand_r(&seed) % filesPerBlocker);
+      ret = BlockWaitOnFile(name, NULL);
+      if (ret != 0) {
+         FAIL("BlockWaitOnFile(%s) returned %d\n", name, ret);
+      }
+      if (BlockLookup(name, OS_UNKNOWN_BLOCKER) != NULL) {
+         FAIL("BlockLookup(%s) found a block\n", name);
+      }
+      count++;
+   }
+
+   g_atomic_int_add(&lookups, count);
+
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * waiter --
+ *
+ *    Sleeps on a blocked file until its block is removed.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+waiter(void *arg)  // IN
+{
+   WaiterInfo *info = arg;
+   char name[OS_PATH_MAX];
+   int ret;
+
+   fileName(name, sizeof name, info->blocker, info->file);
+   ret = BlockWaitOnFile(name, NULL);
+   if (ret != 0) {
+      FAIL("BlockWaitOnFile(%s) returned %d\n", name, ret);
+   }
+   g_atomic_int_inc(&wokenWaiters);
+
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * waitForWaiters --
+ *
+ *    Waits until one waiter sleeps on the block of each waiter's file.
+ *    Fails the test if that takes longer than 30 seconds.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+waitForWaiters(void)
+{
+   char name[OS_PATH_MAX];
+   double deadline = now() + 30;
+   unsigned int i;
+   int count;
+
+   for (i = 0; i < NUM_BLOCKERS * WAITERS_PER_BLOCKER; i++) {
+      fileName(name, sizeof name, i / WAITERS_PER_BLOCKER,
+               i % WAITERS_PER_BLOCKER);
+      while ((count = BlockWaiterCount(name)) != 1) {
+         if (count < 0 || count > 1) {
+            FAIL("%d waiters on %s, expected 1\n", count, name);
+            return;
+         }
+         if (now() > deadline) {
+            FAIL("timed out waiting for the waiter on %s\n", name);
+            return;
+         }
+         g_usleep(1000);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * checkLateWaiters --
+ *
+ *    Checks that a waiter arriving after the blocks are gone finds no block
+ *    on any of the waiters' files and returns right away.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+checkLateWaiters(void)
+{
+   char name[OS_PATH_MAX];
+   unsigned int i;
+   int ret;
+
+   for (i = 0; i < NUM_BLOCKERS * WAITERS_PER_BLOCKER; i++) {
+      fileName(name, sizeof name, i / WAITERS_PER_BLOCKER,
+               i % WAITERS_PER_BLOCKER);
+      if (BlockWaiterCount(name) != -1) {
+         FAIL("block on %s still present after removal\n", name);
+      }
+      if (BlockLookup(name, OS_UNKNOWN_BLOCKER) != NULL) {
+         FAIL("late BlockLookup(%s) found a block\n", name);
+      }
+      ret = BlockWaitOnFile(name, NULL);
+      if (ret != 0) {
+         FAIL("late BlockWaitOnFile(%s) returned %d\n", name, ret);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * fileName --
+ *
+ *    Builds the name of a file of the given blocker.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+fileName(char *buf,             // OUT: file name
+         size_t bufSize,        // IN: size of buf
+         unsigned int blocker,  // IN: blocker number
+         unsigned int file)     // IN: file number
+{
+   snprintf(buf, bufSize, "/tmp/VMwareDnD/%08x/stress/file%u", blocker, file);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * now --
+ *
+ *    Returns the current time in seconds.
+ *
+ * Results:
+ *    Time of day.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
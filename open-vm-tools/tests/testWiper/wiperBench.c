@@ -0,0 +1,327 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * wiperBench.c --
+ *
+ *   Benchmark for the zero-fill path of lib/wiper. The free space of a
+ *   scratch file system is filled twice: once with 64 KB buffered writes,
+ *   2 MB per step, the way the wiper used to, and once with the wiper
+ *   library itself. For each run the throughput, the longest step (which
+ *   bounds how quickly a wipe can be cancelled) and the growth of the page
+ *   cache are printed.
+ *
+ *   Use a small file system backed by a loop device, e.g.:
+ *
+ *      truncate -s 2G /tmp/wipe.img
+ *      mkfs.ext4 -q /tmp/wipe.img
+ *      mount -o loop /tmp/wipe.img /mnt/wipe
+ *      vmware-wiper-bench /mnt/wipe
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "wiper.h"
+
+#define LEGACY_WRITE_SIZE  (64 * 1024)
+#define LEGACY_STEP_SIZE   (2 << 20)
+#define MIN_FREE           (((uint64)5) << 20)
+
+typedef struct BenchResult {
+   uint64 bytes;
+   double secs;
+   double maxStepMs;
+   long long maxCacheKb;
+} BenchResult;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NowUs --
+ *
+ *    Current time in microseconds.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static double
+NowUs(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CachedKb --
+ *
+ *    Size of the page cache from /proc/meminfo, -1 if unavailable.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static long long
+CachedKb(void)
+{
+   FILE *f = fopen("/proc/meminfo", "r");
+   char line[128];
+   long long kb = -1;
+
+   if (f == NULL) {
+      return -1;
+   }
+   while (fgets(line, sizeof line, f) != NULL) {
+      if (sscanf(line, "Cached: %lld kB", &kb) == 1) {
+         break;
+      }
+   }
+   fclose(f);
+   return kb;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Sample --
+ *
+ *    Account for one step of a run.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Sample(BenchResult *res,        // IN/OUT
+       double stepStart,        // IN
+       long long baseCacheKb)   // IN
+{
+   double stepMs = (NowUs() - stepStart) / 1000.0;
+   long long cached = CachedKb();
+
+   if (stepMs > res->maxStepMs) {
+      res->maxStepMs = stepMs;
+   }
+   if (cached >= 0 && baseCacheKb >= 0 &&
+       cached - baseCacheKb > res->maxCacheKb) {
+      res->maxCacheKb = cached - baseCacheKb;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FreeBytes --
+ *
+ *    Free space of the file system, or 0 on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+FreeBytes(const char *mountPoint)   // IN
+{
+   struct statvfs st;
+
+   if (statvfs(mountPoint, &st) != 0) {
+      return 0;
+   }
+   return (uint64)st.f_bfree * st.f_frsize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunLegacy --
+ *
+ *    Fill the file system with 64 KB buffered writes.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+RunLegacy(const char *mountPoint,   // IN
+          BenchResult *res)         // OUT
+{
+   static unsigned char buf[LEGACY_WRITE_SIZE];
+   char path[NATIVE_MAX_PATH];
+   long long baseCacheKb = CachedKb();
+   double start;
+   Bool ok = TRUE;
+   int fd;
+
+   memset(res, 0, sizeof *res);
+   snprintf(path, sizeof path, "%s/wiper-bench", mountPoint);
+   fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (fd < 0) {
+      perror(path);
+      return FALSE;
+   }
+
+   start = NowUs();
+   while (ok && FreeBytes(mountPoint) > MIN_FREE) {
+      double stepStart = NowUs();
+      size_t step;
+
+      for (step = 0; step < LEGACY_STEP_SIZE; step += sizeof buf) {
+         if (write(fd, buf, sizeof buf) != sizeof buf) {
+            if (errno != ENOSPC) {
+               perror("write");
+            }
+            ok = FALSE;
+            break;
+         }
+         res->bytes += sizeof buf;
+      }
+      Sample(res, stepStart, baseCacheKb);
+   }
+   res->secs = (NowUs() - start) / 1e6;
+
+   close(fd);
+   unlink(path);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunWiper --
+ *
+ *    Fill the file system with the wiper library.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+RunWiper(const char *mountPoint,   // IN
+         BenchResult *res)         // OUT
+{
+   long long baseCacheKb = CachedKb();
+   WiperPartition *part;
+   Wiper_State *wiper;
+   WiperStats stats;
+   unsigned int progress = 0;
+   double start;
+
+   memset(res, 0, sizeof *res);
+   memset(&stats, 0, sizeof stats);
+
+   part = WiperSinglePartition_Open(mountPoint, FALSE);
+   if (part == NULL || part->type == PARTITION_UNSUPPORTED) {
+      fprintf(stderr, "%s: %s\n", mountPoint,
+              part != NULL ? part->comment : "not found");
+      WiperSinglePartition_Close(part);
+      return FALSE;
+   }
+
+   /* Exercise the zero-fill path even if the disk supports discard. */
+   part->attemptUnmaps = FALSE;
+
+   wiper = Wiper_Start(part, MAX_WIPER_FILE_SIZE);
+   if (wiper == NULL) {
+      fprintf(stderr, "Wiper_Start failed\n");
+      WiperSinglePartition_Close(part);
+      return FALSE;
+   }
+
+   start = NowUs();
+   while (progress < 100 && wiper != NULL) {
+      double stepStart = NowUs();
+      unsigned char *err = Wiper_NextWithStats(&wiper, &progress, &stats);
+
+      if (*err != '\0') {
+         fprintf(stderr, "Wiper_Next: %s\n", err);
+         break;
+      }
+      Sample(res, stepStart, baseCacheKb);
+   }
+   res->secs = (NowUs() - start) / 1e6;
+   res->bytes = stats.bytes[WIPER_METHOD_ZERO_FILL];
+
+   Wiper_Cancel(&wiper);
+   WiperSinglePartition_Close(part);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PrintResult --
+ *
+ *    Print one line of results.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PrintResult(const char *name,          // IN
+            const BenchResult *res)    // IN
+{
+   printf("%-8s %10.1f %10.1f %12.1f %14.1f\n", name,
+          res->bytes / (1024.0 * 1024.0),
+          res->secs > 0 ? res->bytes / res->secs / (1024 * 1024) : 0,
+          res->maxStepMs,
+          res->maxCacheKb / 1024.0);
+}
+
+
+int
+main(int argc,
+     char *argv[])
+{
+   BenchResult legacy;
+   BenchResult wiper;
+
+   if (argc != 2) {
+      fprintf(stderr, "Usage: %s <mount point>\n", argv[0]);
+      return 1;
+   }
+
+   Wiper_Init(NULL);
+
+   sync();
+   if (!RunLegacy(argv[1], &legacy)) {
+      return 1;
+   }
+   sync();
+   if (!RunWiper(argv[1], &wiper)) {
+      return 1;
+   }
+
+   printf("%-8s %10s %10s %12s %14s\n", "path", "MB", "MB/s",
+          "max step ms", "cache grow MB");
+   PrintResult("legacy", &legacy);
+   PrintResult("wiper", &wiper);
+   return 0;
+}
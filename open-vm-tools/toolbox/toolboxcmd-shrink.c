@@ -312,6 +312,52 @@ ShrinkDoAllDiskShrinkOnly(void)
 }
 
 
+#ifndef _WIN32
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ShrinkPrintWiperStats  --
+ *
+ *      Print how much of the free space was reclaimed by each method used
+ *      by the wiper, and how fast.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ShrinkPrintWiperStats(const WiperStats *stats)  // IN
+{
+   static const char *methodNames[WIPER_METHOD_MAX] = {
+      "zero-fill",
+      "discard",
+   };
+   int i;
+
+   for (i = 0; i < WIPER_METHOD_MAX; i++) {
+      double secs = stats->usecs[i] / 1000000.0;
+
+      if (stats->usecs[i] == 0) {
+         continue;
+      }
+      g_debug("%s: %"FMT64"u bytes in %.1f s\n", methodNames[i],
+              stats->bytes[i], secs);
+      g_print(SU_(disk.wiper.stats,
+                  "%s: reclaimed %.1f%% of free space at %.1f MB/s\n"),
+              methodNames[i],
+              stats->startFree > 0 ?
+                 MIN(100.0 * stats->bytes[i] / stats->startFree, 100.0) : 0.0,
+              secs > 0 ? stats->bytes[i] / secs / (1024 * 1024) : 0.0);
+   }
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -345,6 +391,9 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
    WiperPartition *part = NULL;
    WiperPartition_List plist;
    int rc;
+#ifndef _WIN32
+   WiperStats stats;
+#endif
 
 #if defined(_WIN32)
    DWORD currPriority = GetPriorityClass(GetCurrentProcess());
@@ -428,8 +477,16 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
    }
 #endif
 
+#ifndef _WIN32
+   memset(&stats, 0, sizeof stats);
+#endif
+
    while (progress < 100 && wiper != NULL) {
+#ifdef _WIN32
       err = Wiper_Next(&wiper, &progress);
+#else
+      err = Wiper_NextWithStats(&wiper, &progress, &stats);
+#endif
       if (strlen(err) > 0) {
          if (strcmp(err, "error.create") == 0) {
             ToolsCmd_PrintErr("%s",
@@ -463,6 +520,11 @@ ShrinkDoWipeAndShrink(char *mountPoint,         // IN: mount point
 
    rc = EXIT_SUCCESS;
    g_print("\n");
+#ifndef _WIN32
+   if (!quiet) {
+      ShrinkPrintWiperStats(&stats);
+   }
+#endif
    if (progress >= 100 && performShrink) {
       rc = ShrinkDiskSendRPC();
    } else if (progress < 100) {
@@ -87,6 +87,13 @@
  */
 #define VGAUTH_PROTOCOL_VERSION "1"
 
+/*
+ * Version 2 adds the optional binary encoding described at the end of
+ * this file.  Clients ask for it in the SessionRequest; the service
+ * answers with the version it agrees to use.
+ */
+#define VGAUTH_PROTOCOL_VERSION_BINARY "2"
+
 #define VGAUTH_REQUESTNAME_ELEMENT_NAME "requestName"
 #define VGAUTH_SEQUENCENO_ELEMENT_NAME "sequenceNumber"
 #define VGAUTH_USERNAME_ELEMENT_NAME "userName"
@@ -273,7 +280,7 @@
 #define VGAUTH_SESSION_REQUEST_FORMAT \
    VGAUTH_REQUEST_FORMAT_START \
        "<"VGAUTH_REQUESTNAME_ELEMENT_NAME">"VGAUTH_REQUESTSESSION_ELEMENT_NAME"</"VGAUTH_REQUESTNAME_ELEMENT_NAME">" \
-       "<"VGAUTH_VERSION_ELEMENT_NAME">"VGAUTH_PROTOCOL_VERSION"</"VGAUTH_VERSION_ELEMENT_NAME">" \
+       "<"VGAUTH_VERSION_ELEMENT_NAME">%d</"VGAUTH_VERSION_ELEMENT_NAME">" \
        "<"VGAUTH_USERNAME_ELEMENT_NAME">%s</"VGAUTH_USERNAME_ELEMENT_NAME">" \
    VGAUTH_REQUEST_FORMAT_END
 
@@ -281,7 +288,7 @@
 
 #define VGAUTH_SESSION_REPLY_FORMAT \
    VGAUTH_REPLY_FORMAT_START \
-       "<"VGAUTH_VERSION_ELEMENT_NAME">"VGAUTH_PROTOCOL_VERSION"</"VGAUTH_VERSION_ELEMENT_NAME">" \
+       "<"VGAUTH_VERSION_ELEMENT_NAME">%d</"VGAUTH_VERSION_ELEMENT_NAME">" \
        "<"VGAUTH_PIPENAME_ELEMENT_NAME">%s</"VGAUTH_PIPENAME_ELEMENT_NAME">" \
     VGAUTH_REPLY_FORMAT_END
 
@@ -637,4 +644,62 @@
    VGAUTH_USERHANDLESAMLINFO_FORMAT_END \
    VGAUTH_REPLY_FORMAT_END
 
+
+/*
+ * Binary encoding
+ *
+ * Once a session has negotiated VGAUTH_PROTOCOL_VERSION_BINARY, the
+ * client may send ValidateTicket and QueryMappedAliases as binary frames
+ * instead of XML.  Every other request is still XML.  The service tells
+ * the two apart by the first byte of the request, which can never start
+ * an XML document, and replies (including any error) using the same
+ * encoding as the request.
+ *
+ * A frame is a fixed header followed by a list of TLVs.  All integers
+ * are in network byte order.
+ *
+ *   header:  uint8   VGAUTH_BINARY_MAGIC
+ *            uint8   opcode (VGAUTH_BINARY_OP_*)
+ *            uint16  reserved, 0
+ *            uint32  sequence number
+ *            uint32  length of the TLV list
+ *
+ *   TLV:     uint16  tag (VGAUTH_BINARY_TAG_*)
+ *            uint32  length of the value
+ *            value   UTF-8 string without a NUL, or a uint64
+ *
+ * Unknown tags are skipped.  The values mirror the XML elements:
+ *
+ *   ValidateTicket request:      TICKET
+ *   ValidateTicket reply:        USERNAME TOKEN USERHANDLETYPE
+ *                                [SAMLSUBJECT SUBJECT|ANYSUBJECT COMMENT]
+ *   QueryMappedAliases request:  (empty)
+ *   QueryMappedAliases reply:    0 or more of
+ *                                MAPPEDALIAS USERNAME PEMCERT
+ *                                (SUBJECT|ANYSUBJECT)*
+ *   Error reply:                 ERRORCODE ERRORMSG
+ */
+
+#define VGAUTH_BINARY_MAGIC               0xB7
+#define VGAUTH_BINARY_HEADER_SIZE         12
+#define VGAUTH_BINARY_TLV_HEADER_SIZE     6
+#define VGAUTH_BINARY_MAX_FRAME_SIZE      (16 * 1024 * 1024)
+
+#define VGAUTH_BINARY_OP_ERROR               1
+#define VGAUTH_BINARY_OP_VALIDATETICKET      2
+#define VGAUTH_BINARY_OP_QUERYMAPPEDALIASES  3
+
+#define VGAUTH_BINARY_TAG_ERRORCODE       1
+#define VGAUTH_BINARY_TAG_ERRORMSG        2
+#define VGAUTH_BINARY_TAG_TICKET          3
+#define VGAUTH_BINARY_TAG_USERNAME        4
+#define VGAUTH_BINARY_TAG_TOKEN           5
+#define VGAUTH_BINARY_TAG_USERHANDLETYPE  6
+#define VGAUTH_BINARY_TAG_SAMLSUBJECT     7
+#define VGAUTH_BINARY_TAG_SUBJECT         8
+#define VGAUTH_BINARY_TAG_ANYSUBJECT      9
+#define VGAUTH_BINARY_TAG_COMMENT         10
+#define VGAUTH_BINARY_TAG_MAPPEDALIAS     11
+#define VGAUTH_BINARY_TAG_PEMCERT         12
+
 #endif   // _VGAUTHPROTO_H_
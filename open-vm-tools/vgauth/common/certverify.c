@@ -45,6 +45,38 @@ VGAuthError CertVerify_CheckSignature(VGAuthHashAlg hash,
                                       size_t signatureLen,
                                       const unsigned char *signature);
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+static GMutex *sslLocks = NULL;
+
+
+/*
+ ******************************************************************************
+ * CertVerifyLockingCallback --                                          */ /**
+ *
+ * Locking callback for OpenSSL releases older than 1.1.0, which are only
+ * thread safe if the application provides one.
+ *
+ * @param[in]  mode     CRYPTO_LOCK or CRYPTO_UNLOCK.
+ * @param[in]  n        Index of the lock.
+ * @param[in]  file     Source file of the caller (unused).
+ * @param[in]  line     Source line of the caller (unused).
+ *
+ ******************************************************************************
+ */
+
+static void
+CertVerifyLockingCallback(int mode,
+                          int n,
+                          const char *file,
+                          int line)
+{
+   if (mode & CRYPTO_LOCK) {
+      g_mutex_lock(&sslLocks[n]);
+   } else {
+      g_mutex_unlock(&sslLocks[n]);
+   }
+}
+#endif
 
 
 /*
@@ -73,6 +105,22 @@ CertVerify_Init(void)
     * can add a lot of bloat.
     */
    OpenSSL_add_all_digests();
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+   /*
+    * Certs may be verified by several threads at once.  The default
+    * thread id callback is fine since 1.0.0.
+    */
+   if (NULL == CRYPTO_get_locking_callback()) {
+      int i;
+
+      sslLocks = g_new(GMutex, CRYPTO_num_locks());
+      for (i = 0; i < CRYPTO_num_locks(); i++) {
+         g_mutex_init(&sslLocks[i]);
+      }
+      CRYPTO_set_locking_callback(CertVerifyLockingCallback);
+   }
+#endif
 }
 
 
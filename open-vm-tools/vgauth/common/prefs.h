@@ -136,6 +136,12 @@ msgCatalog = /etc/vmware-tools/vgauth/messages
 #define VGAUTH_PREF_ALIASSTORE_DIR         "aliasStoreDir"
 /** The number of seconds slack allowed in either direction in SAML token date checks. */
 #define VGAUTH_PREF_CLOCK_SKEW_SECS        "clockSkewAdjustment"
+/** Maximum number of verified SAML tokens remembered by the service.  0 disables the cache. */
+#define VGAUTH_PREF_SAML_TOKEN_CACHE_SIZE  "samlTokenCacheSize"
+/** Maximum number of seconds a verified SAML token is remembered. */
+#define VGAUTH_PREF_SAML_TOKEN_CACHE_TTL   "samlTokenCacheTTL"
+/** Number of threads verifying SAML tokens outside the main loop.  0 verifies them inline. */
+#define VGAUTH_PREF_SAML_VERIFY_THREADS    "samlVerifyThreads"
 
 /** Ticket group name. */
 #define VGAUTH_PREF_GROUP_NAME_TICKET      "ticket"
@@ -191,5 +197,11 @@ msgCatalog = /etc/vmware-tools/vgauth/messages
 
 #define VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS (300)
 
+#define VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE 256
+
+#define VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_TTL (5 * 60)
+
+#define VGAUTH_PREF_DEFAULT_SAML_VERIFY_THREADS 2
+
 #endif // _PREFS_H_
 
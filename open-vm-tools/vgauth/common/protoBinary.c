@@ -0,0 +1,488 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file protoBinary.c --
+ *
+ *    Encoding and decoding of the binary VGAuth wire format, shared by the
+ *    client library and the service.  See VGAuthProto.h for the layout.
+ */
+
+#include <string.h>
+
+#include "protoBinary.h"
+
+
+/*
+ ******************************************************************************
+ * ProtoBinaryPut16 --                                                   */ /**
+ *
+ * Stores a 16 bit value in network byte order.
+ *
+ * @param[out] p      Where to store the value.
+ * @param[in]  val    The value.
+ *
+ ******************************************************************************
+ */
+
+static void
+ProtoBinaryPut16(guint8 *p,
+                 guint16 val)
+{
+   p[0] = (guint8) (val >> 8);
+   p[1] = (guint8) val;
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinaryPut32 --                                                   */ /**
+ *
+ * Stores a 32 bit value in network byte order.
+ *
+ * @param[out] p      Where to store the value.
+ * @param[in]  val    The value.
+ *
+ ******************************************************************************
+ */
+
+static void
+ProtoBinaryPut32(guint8 *p,
+                 guint32 val)
+{
+   p[0] = (guint8) (val >> 24);
+   p[1] = (guint8) (val >> 16);
+   p[2] = (guint8) (val >> 8);
+   p[3] = (guint8) val;
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinaryGet16 --                                                   */ /**
+ *
+ * Loads a 16 bit value stored in network byte order.
+ *
+ * @param[in]  p      The stored value.
+ *
+ * @return The value.
+ *
+ ******************************************************************************
+ */
+
+static guint16
+ProtoBinaryGet16(const guint8 *p)
+{
+   return (guint16) ((p[0] << 8) | p[1]);
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinaryGet32 --                                                   */ /**
+ *
+ * Loads a 32 bit value stored in network byte order.
+ *
+ * @param[in]  p      The stored value.
+ *
+ * @return The value.
+ *
+ ******************************************************************************
+ */
+
+static guint32
+ProtoBinaryGet32(const guint8 *p)
+{
+   return ((guint32) p[0] << 24) | ((guint32) p[1] << 16) |
+          ((guint32) p[2] << 8) | (guint32) p[3];
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinaryAddTLV --                                                  */ /**
+ *
+ * Appends a TLV to a frame.
+ *
+ * @param[in]  frame     The frame being built.
+ * @param[in]  tag       The tag.
+ * @param[in]  value     The value.
+ * @param[in]  valueLen  The length of the value.
+ *
+ ******************************************************************************
+ */
+
+static void
+ProtoBinaryAddTLV(GByteArray *frame,
+                  guint16 tag,
+                  const guint8 *value,
+                  guint32 valueLen)
+{
+   guint8 hdr[VGAUTH_BINARY_TLV_HEADER_SIZE];
+
+   ProtoBinaryPut16(hdr, tag);
+   ProtoBinaryPut32(hdr + 2, valueLen);
+   g_byte_array_append(frame, hdr, sizeof hdr);
+   if (valueLen > 0) {
+      g_byte_array_append(frame, value, valueLen);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_NewFrame --                                               */ /**
+ *
+ * Starts a new frame.  The payload length is filled in by
+ * ProtoBinary_FinishFrame().
+ *
+ * @param[in]  opcode    The VGAUTH_BINARY_OP_* of the frame.
+ * @param[in]  seqNo     The sequence number of the request.
+ *
+ * @return The frame being built.
+ *
+ ******************************************************************************
+ */
+
+GByteArray *
+ProtoBinary_NewFrame(guint8 opcode,
+                     guint32 seqNo)
+{
+   GByteArray *frame;
+   guint8 hdr[VGAUTH_BINARY_HEADER_SIZE];
+
+   hdr[0] = VGAUTH_BINARY_MAGIC;
+   hdr[1] = opcode;
+   ProtoBinaryPut16(hdr + 2, 0);
+   ProtoBinaryPut32(hdr + 4, seqNo);
+   ProtoBinaryPut32(hdr + 8, 0);
+
+   frame = g_byte_array_sized_new(256);
+   g_byte_array_append(frame, hdr, sizeof hdr);
+
+   return frame;
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_AddString --                                              */ /**
+ *
+ * Appends a string TLV to a frame.  A NULL string is sent as an empty one.
+ *
+ * @param[in]  frame     The frame being built.
+ * @param[in]  tag       The tag.
+ * @param[in]  val       The string.
+ *
+ ******************************************************************************
+ */
+
+void
+ProtoBinary_AddString(GByteArray *frame,
+                      guint16 tag,
+                      const gchar *val)
+{
+   ProtoBinaryAddTLV(frame, tag, (const guint8 *) val,
+                     (NULL == val) ? 0 : (guint32) strlen(val));
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_AddUint64 --                                              */ /**
+ *
+ * Appends an integer TLV to a frame.
+ *
+ * @param[in]  frame     The frame being built.
+ * @param[in]  tag       The tag.
+ * @param[in]  val       The value.
+ *
+ ******************************************************************************
+ */
+
+void
+ProtoBinary_AddUint64(GByteArray *frame,
+                      guint16 tag,
+                      guint64 val)
+{
+   guint8 buf[8];
+
+   ProtoBinaryPut32(buf, (guint32) (val >> 32));
+   ProtoBinaryPut32(buf + 4, (guint32) val);
+   ProtoBinaryAddTLV(frame, tag, buf, sizeof buf);
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_FinishFrame --                                            */ /**
+ *
+ * Fills in the payload length and releases the frame data to the caller.
+ *
+ * @param[in]  frame     The frame being built.  Freed.
+ * @param[out] len       The length of the frame.
+ *
+ * @return The frame data.  Should be g_free()d by caller.
+ *
+ ******************************************************************************
+ */
+
+gchar *
+ProtoBinary_FinishFrame(GByteArray *frame,
+                        gsize *len)
+{
+   ProtoBinaryPut32(frame->data + 8, frame->len - VGAUTH_BINARY_HEADER_SIZE);
+   *len = frame->len;
+
+   return (gchar *) g_byte_array_free(frame, FALSE);
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_IsFrame --                                                */ /**
+ *
+ * Checks whether the first chunk of a request or reply is a binary frame
+ * rather than an XML document.
+ *
+ * @param[in]  data      The data read so far.
+ * @param[in]  len       The length of the data.
+ *
+ * @return TRUE if the data starts a binary frame.
+ *
+ ******************************************************************************
+ */
+
+gboolean
+ProtoBinary_IsFrame(const gchar *data,
+                    gsize len)
+{
+   return len > 0 && (guint8) data[0] == VGAUTH_BINARY_MAGIC;
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_FrameLength --                                            */ /**
+ *
+ * Returns the total length of a complete frame built by
+ * ProtoBinary_FinishFrame().
+ *
+ * @param[in]  frame     The frame.
+ *
+ * @return The length of the frame, header included.
+ *
+ ******************************************************************************
+ */
+
+gsize
+ProtoBinary_FrameLength(const gchar *frame)
+{
+   return VGAUTH_BINARY_HEADER_SIZE +
+          ProtoBinaryGet32((const guint8 *) frame + 8);
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_CheckFrame --                                             */ /**
+ *
+ * Checks the data received so far.  A frame is complete once the whole
+ * payload announced by the header has arrived.  Since there is only one
+ * outstanding request on a connection, any data past the end of the frame
+ * is a protocol error.
+ *
+ * @param[in]  data      The data received so far.
+ * @param[in]  len       The length of the data.
+ * @param[out] complete  Set to TRUE if the frame is complete.
+ * @param[out] opcode    The opcode of a complete frame.
+ * @param[out] seqNo     The sequence number of a complete frame.
+ *
+ * @return VGAUTH_E_OK on success, VGAUTH_E_COMM if the data is not a
+ *         valid frame.
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+ProtoBinary_CheckFrame(const guint8 *data,
+                       gsize len,
+                       gboolean *complete,
+                       guint8 *opcode,
+                       guint32 *seqNo)
+{
+   gsize payloadLen;
+
+   *complete = FALSE;
+
+   if (len < VGAUTH_BINARY_HEADER_SIZE) {
+      return VGAUTH_E_OK;
+   }
+
+   payloadLen = ProtoBinaryGet32(data + 8);
+   if (data[0] != VGAUTH_BINARY_MAGIC ||
+       ProtoBinaryGet16(data + 2) != 0 ||
+       payloadLen > VGAUTH_BINARY_MAX_FRAME_SIZE) {
+      return VGAUTH_E_COMM;
+   }
+
+   if (len < VGAUTH_BINARY_HEADER_SIZE + payloadLen) {
+      return VGAUTH_E_OK;
+   } else if (len > VGAUTH_BINARY_HEADER_SIZE + payloadLen) {
+      return VGAUTH_E_COMM;
+   }
+
+   *opcode = data[1];
+   *seqNo = ProtoBinaryGet32(data + 4);
+   *complete = TRUE;
+
+   return VGAUTH_E_OK;
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_InitReader --                                             */ /**
+ *
+ * Prepares to walk the TLVs of a complete frame.
+ *
+ * @param[out] reader    The reader.
+ * @param[in]  frame     The frame, as validated by ProtoBinary_CheckFrame().
+ * @param[in]  len       The length of the frame.
+ *
+ ******************************************************************************
+ */
+
+void
+ProtoBinary_InitReader(ProtoBinaryReader *reader,
+                       const guint8 *frame,
+                       gsize len)
+{
+   reader->data = frame;
+   reader->len = len;
+   reader->pos = VGAUTH_BINARY_HEADER_SIZE;
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_NextTLV --                                                */ /**
+ *
+ * Returns the next TLV of the frame.  The value points into the frame.
+ *
+ * @param[in]  reader    The reader.
+ * @param[out] tag       The tag, or 0 at the end of the frame.
+ * @param[out] value     The value.
+ * @param[out] valueLen  The length of the value.
+ *
+ * @return VGAUTH_E_OK on success, VGAUTH_E_COMM if the TLV overruns
+ *         the frame.
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+ProtoBinary_NextTLV(ProtoBinaryReader *reader,
+                    guint16 *tag,
+                    const guint8 **value,
+                    guint32 *valueLen)
+{
+   const guint8 *p = reader->data + reader->pos;
+   gsize left = reader->len - reader->pos;
+
+   *tag = 0;
+   *value = NULL;
+   *valueLen = 0;
+
+   if (0 == left) {
+      return VGAUTH_E_OK;
+   }
+
+   if (left < VGAUTH_BINARY_TLV_HEADER_SIZE ||
+       left - VGAUTH_BINARY_TLV_HEADER_SIZE < ProtoBinaryGet32(p + 2) ||
+       0 == ProtoBinaryGet16(p)) {
+      return VGAUTH_E_COMM;
+   }
+
+   *tag = ProtoBinaryGet16(p);
+   *valueLen = ProtoBinaryGet32(p + 2);
+   *value = p + VGAUTH_BINARY_TLV_HEADER_SIZE;
+   reader->pos += VGAUTH_BINARY_TLV_HEADER_SIZE + *valueLen;
+
+   return VGAUTH_E_OK;
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_GetString --                                              */ /**
+ *
+ * Copies a string value.  The value must be valid UTF-8 without embedded
+ * NULs, which is the same guarantee the XML parser gives.
+ *
+ * @param[in]  value     The value.
+ * @param[in]  valueLen  The length of the value.
+ *
+ * @return The string, or NULL if the value is not a valid string.  Should
+ *         be g_free()d by caller.
+ *
+ ******************************************************************************
+ */
+
+gchar *
+ProtoBinary_GetString(const guint8 *value,
+                      guint32 valueLen)
+{
+   if (memchr(value, '\0', valueLen) != NULL ||
+       !g_utf8_validate((const gchar *) value, valueLen, NULL)) {
+      return NULL;
+   }
+
+   return g_strndup((const gchar *) value, valueLen);
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinary_GetUint64 --                                              */ /**
+ *
+ * Decodes an integer value.
+ *
+ * @param[in]  value     The value.
+ * @param[in]  valueLen  The length of the value.
+ * @param[out] val       The decoded integer.
+ *
+ * @return TRUE on success, FALSE if the value has the wrong size.
+ *
+ ******************************************************************************
+ */
+
+gboolean
+ProtoBinary_GetUint64(const guint8 *value,
+                      guint32 valueLen,
+                      guint64 *val)
+{
+   if (valueLen != 8) {
+      return FALSE;
+   }
+
+   *val = ((guint64) ProtoBinaryGet32(value) << 32) |
+          ProtoBinaryGet32(value + 4);
+
+   return TRUE;
+}
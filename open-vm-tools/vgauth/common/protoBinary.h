@@ -0,0 +1,65 @@
+/*********************************************************
+ * Copyright (C) 2018 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+#ifndef _PROTOBINARY_H_
+#define _PROTOBINARY_H_
+
+/*
+ * @file protoBinary.h
+ *
+ * Encoding and decoding of the binary VGAuth wire format.
+ */
+
+#include <glib.h>
+#include "VGAuthError.h"
+#include "VGAuthProto.h"
+
+typedef struct ProtoBinaryReader {
+   const guint8 *data;
+   gsize len;
+   gsize pos;
+} ProtoBinaryReader;
+
+GByteArray *ProtoBinary_NewFrame(guint8 opcode, guint32 seqNo);
+
+void ProtoBinary_AddString(GByteArray *frame, guint16 tag, const gchar *val);
+
+void ProtoBinary_AddUint64(GByteArray *frame, guint16 tag, guint64 val);
+
+gchar *ProtoBinary_FinishFrame(GByteArray *frame, gsize *len);
+
+gboolean ProtoBinary_IsFrame(const gchar *data, gsize len);
+
+gsize ProtoBinary_FrameLength(const gchar *frame);
+
+VGAuthError ProtoBinary_CheckFrame(const guint8 *data, gsize len,
+                                   gboolean *complete, guint8 *opcode,
+                                   guint32 *seqNo);
+
+void ProtoBinary_InitReader(ProtoBinaryReader *reader,
+                            const guint8 *frame, gsize len);
+
+VGAuthError ProtoBinary_NextTLV(ProtoBinaryReader *reader, guint16 *tag,
+                                const guint8 **value, guint32 *valueLen);
+
+gchar *ProtoBinary_GetString(const guint8 *value, guint32 valueLen);
+
+gboolean ProtoBinary_GetUint64(const guint8 *value, guint32 valueLen,
+                               guint64 *val);
+
+#endif // _PROTOBINARY_H_
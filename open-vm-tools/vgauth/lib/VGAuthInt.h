@@ -78,6 +78,8 @@ typedef struct VCAGComm {
    unsigned int sequenceNumber;
    gchar *userName;           // the user we're runing as, used for
                               // setting up the comm pipe permissions
+   gboolean wantBinary;       // VGAUTH_PARAM_BINARY_PROTOCOL was set
+   gboolean binary;           // the service agreed to the binary encoding
 #ifdef UNITTEST
    gboolean fileTest;
    gboolean bufTest;
@@ -204,6 +206,10 @@ VGAuthError VGAuth_CloseConnection(VGAuthContext *ctx);
 VGAuthError VGAuth_CommSendData(VGAuthContext *ctx,
                                 gchar *request);
 
+VGAuthError VGAuth_CommSendBytes(VGAuthContext *ctx,
+                                 gsize len,
+                                 gchar *request);
+
 VGAuthError VGAuth_CommReadData(VGAuthContext *ctx,
                                 gsize *len,
                                 gchar **response);
@@ -212,6 +218,7 @@ VGAuthError VGAuth_SendConnectRequest(VGAuthContext *ctx);
 
 VGAuthError VGAuth_SendSessionRequest(VGAuthContext *ctx,
                                       const char *userName,
+                                      int *version,               // IN/OUT
                                       char **pipeName);           // OUT
 
 VGAuthError VGAuth_SendCreateTicketRequest(VGAuthContext *ctx,
@@ -104,6 +104,7 @@ VGAuth_InitConnection(VGAuthContext *ctx)
 
    ctx->comm.connected = FALSE;
    ctx->comm.sequenceNumber = 0;
+   ctx->comm.binary = FALSE;
 
    return VGAUTH_E_OK;
 }
@@ -133,6 +134,7 @@ VGAuth_CloseConnection(VGAuthContext *ctx)
 
 
    ctx->comm.sequenceNumber = 0;
+   ctx->comm.binary = FALSE;
 
    g_free(ctx->comm.userName);
    ctx->comm.userName = NULL;
@@ -185,6 +187,7 @@ VGAuth_ConnectToServiceAsUser(VGAuthContext *ctx,
    VGAuthError err = VGAUTH_E_OK;
    gchar *pipeName = NULL;
    VGAuthContext *pubCtx = NULL;
+   int version;
 
    if (VGAuth_IsConnectedToServiceAsUser(ctx, userName)) {
       Debug("%s: already connected as '%s'\n", __FUNCTION__, userName);
@@ -236,9 +239,13 @@ VGAuth_ConnectToServiceAsUser(VGAuthContext *ctx,
    }
 
    /*
-    * SessionRequest will get back a user-specific pipeName.
+    * SessionRequest will get back a user-specific pipeName.  The binary
+    * encoding is only asked for if the application opted in; a service
+    * that doesn't know it answers with version 1 and we stay with XML.
     */
-   err = VGAuth_SendSessionRequest(pubCtx, userName, &pipeName);
+   version = atoi(ctx->comm.wantBinary ? VGAUTH_PROTOCOL_VERSION_BINARY :
+                                         VGAUTH_PROTOCOL_VERSION);
+   err = VGAuth_SendSessionRequest(pubCtx, userName, &version, &pipeName);
    if (err != VGAUTH_E_OK) {
       Warning("%s: Failed to initiate session "VGAUTHERR_FMT64X"\n",
               __FUNCTION__, err);
@@ -271,6 +278,7 @@ VGAuth_ConnectToServiceAsUser(VGAuthContext *ctx,
    /*
     * The user-private connection is good to go.
     */
+   ctx->comm.binary = version >= atoi(VGAUTH_PROTOCOL_VERSION_BINARY);
 
 done:
    VGAuth_CloseConnection(pubCtx);
@@ -341,6 +349,31 @@ VGAuth_CommSendData(VGAuthContext *ctx,
 }
 
 
+/*
+ ******************************************************************************
+ * VGAuth_CommSendBytes --                                               */ /**
+ *
+ * Sends a packet that may contain NULs, such as a binary frame, to the
+ * service.
+ *
+ * @param[in]  ctx        The VGAuthContext.
+ * @param[in]  len        The length of the packet.
+ * @param[in]  packet     The data to be sent.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+VGAuth_CommSendBytes(VGAuthContext *ctx,
+                     gsize len,
+                     gchar *packet)
+{
+   return VGAuth_NetworkWriteBytes(ctx, len, packet);
+}
+
+
 /*
  ******************************************************************************
  * VGAuth_CommReadData --                                                */ /**
@@ -178,8 +178,8 @@ VGAuthGetBoolExtraParamImpl(const char *funcName,
  * @param[in]  applicationName   The name of the application.
  * @param[in]  numExtraParams    The number of elements in extraParams.
  * @param[in]  extraParams       Any optional, additional paramaters to the
- *                               function. Currently none are supported, so
- *                               this must be NULL.
+ *                               function. Currently only
+ *                               VGAUTH_PARAM_BINARY_PROTOCOL is supported.
  * @param[out] ctx               The new VGAuthContext.
  *
  * @retval VGAUTH_E_INVALID_ARGUMENT For a bad argument.
@@ -198,6 +198,7 @@ VGAuth_Init(const char *applicationName,
    VGAuthContext *newCtx = NULL;
    VGAuthError err = VGAUTH_E_OK;
    static gboolean firstTime = TRUE;
+   gboolean binary;
    int i;
 
    /*
@@ -222,6 +223,13 @@ VGAuth_Init(const char *applicationName,
       return err;
    }
 
+   err = VGAuthGetBoolExtraParam(numExtraParams, extraParams,
+                                 VGAUTH_PARAM_BINARY_PROTOCOL, FALSE,
+                                 &binary);
+   if (VGAUTH_E_OK != err) {
+      return err;
+   }
+
    newCtx = g_malloc0(sizeof(VGAuthContext));
    if (NULL == newCtx) {
       return VGAUTH_E_OUT_OF_MEMORY;
@@ -267,6 +275,7 @@ VGAuth_Init(const char *applicationName,
    if (VGAUTH_E_OK != err) {
       return err;
    }
+   newCtx->comm.wantBinary = binary;
 
    err = VGAuthInitAuthentication(newCtx);
    if (VGAUTH_E_OK != err) {
@@ -33,6 +33,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <string.h>
 #include <errno.h>
 #include <signal.h>
 #include "VGAuthInt.h"
@@ -226,7 +227,13 @@ VGAuth_NetworkReadBytes(VGAuthContext *ctx,
       return VGAUTH_E_COMM;
    }
 
-   *buffer = g_strndup(buf, ret);
+   /*
+    * Binary frames may contain NULs, so copy the whole buffer instead of
+    * using g_strndup().  It is still NUL-terminated for the XML parser.
+    */
+   *buffer = g_malloc(ret + 1);
+   memcpy(*buffer, buf, ret);
+   (*buffer)[ret] = '\0';
    *len = ret;
 
    return err;
@@ -33,6 +33,7 @@
 #include "VGAuthInt.h"
 #include "VGAuthProto.h"
 #include "VGAuthLog.h"
+#include "protoBinary.h"
 #include "VGAuthUtil.h"
 #include "usercheck.h"
 
@@ -768,6 +769,36 @@ Proto_EndElement(GMarkupParseContext *parseContext,
 }
 
 
+/*
+ ******************************************************************************
+ * ProtoUserHandleTypeFromString --                                      */ /**
+ *
+ * Converts the wire name of a userHandle type to a VGAuthUserHandleType.
+ *
+ * @param[in]  typeStr      The userHandle type as sent by the service.
+ *
+ * @return The VGAuthUserHandleType, or VGAUTH_AUTH_TYPE_UNKNOWN.
+ *
+ ******************************************************************************
+ */
+
+static VGAuthUserHandleType
+ProtoUserHandleTypeFromString(const gchar *typeStr)
+{
+   if (g_strcmp0(typeStr, VGAUTH_USERHANDLE_TYPE_NAMEPASSWORD) == 0) {
+      return VGAUTH_AUTH_TYPE_NAMEPASSWORD;
+   } else if (g_strcmp0(typeStr, VGAUTH_USERHANDLE_TYPE_SSPI) == 0) {
+      return VGAUTH_AUTH_TYPE_SSPI;
+   } else if (g_strcmp0(typeStr, VGAUTH_USERHANDLE_TYPE_SAML) == 0) {
+      return VGAUTH_AUTH_TYPE_SAML;
+   } else if (g_strcmp0(typeStr, VGAUTH_USERHANDLE_TYPE_SAML_INFO_ONLY) == 0) {
+      return VGAUTH_AUTH_TYPE_SAML_INFO_ONLY;
+   }
+
+   return VGAUTH_AUTH_TYPE_UNKNOWN;
+}
+
+
 /*
  ******************************************************************************
  * Proto_TextContents --                                                 */ /**
@@ -794,7 +825,7 @@ Proto_TextContents(GMarkupParseContext *parseContext,
 {
    ProtoReply *reply = (ProtoReply *) userData;
    gchar *val;
-   VGAuthUserHandleType t = VGAUTH_AUTH_TYPE_UNKNOWN;
+   VGAuthUserHandleType t;
 
 #if VGAUTH_PROTO_TRACE
    Debug("%s: parseState %d, text '%*s'\n", __FUNCTION__, reply->parseState, (int) textSize, text);
@@ -927,15 +958,8 @@ Proto_TextContents(GMarkupParseContext *parseContext,
       break;
    case PARSE_STATE_USERHANDLETYPE:
       if (PROTO_REPLY_VALIDATETICKET == reply->expectedReplyType) {
-         if (g_strcmp0(val, VGAUTH_USERHANDLE_TYPE_NAMEPASSWORD) == 0) {
-            t = VGAUTH_AUTH_TYPE_NAMEPASSWORD;
-         } else if (g_strcmp0(val, VGAUTH_USERHANDLE_TYPE_SSPI) == 0) {
-            t = VGAUTH_AUTH_TYPE_SSPI;
-         } else if (g_strcmp0(val, VGAUTH_USERHANDLE_TYPE_SAML) == 0) {
-            t = VGAUTH_AUTH_TYPE_SAML;
-         } else if (g_strcmp0(val, VGAUTH_USERHANDLE_TYPE_SAML_INFO_ONLY) == 0) {
-            t = VGAUTH_AUTH_TYPE_SAML_INFO_ONLY;
-         } else {
+         t = ProtoUserHandleTypeFromString(val);
+         if (VGAUTH_AUTH_TYPE_UNKNOWN == t) {
             g_set_error(error, G_MARKUP_ERROR_PARSE, VGAUTH_E_INVALID_ARGUMENT,
                         "Found unrecognized userHandle type %s", val);
          }
@@ -1027,6 +1051,278 @@ static GMarkupParser wireParser = {
 };
 
 
+/*
+ ******************************************************************************
+ * ProtoBinarySetString --                                               */ /**
+ *
+ * Decodes a string TLV value into a reply field, replacing any previous
+ * value.
+ *
+ * @param[in]  field        The field to set.
+ * @param[in]  value        The TLV value.
+ * @param[in]  valueLen     The length of the value.
+ *
+ * @return TRUE on success, FALSE if the value isn't a valid string.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ProtoBinarySetString(gchar **field,
+                     const guint8 *value,
+                     guint32 valueLen)
+{
+   gchar *val = ProtoBinary_GetString(value, valueLen);
+
+   if (NULL == val) {
+      return FALSE;
+   }
+   g_free(*field);
+   *field = val;
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinaryValidateTicketTLV --                                       */ /**
+ *
+ * Decodes one TLV of a binary ValidateTicket reply.
+ *
+ * @param[in]  reply        The reply being filled in.
+ * @param[in]  tag          The TLV tag.
+ * @param[in]  value        The TLV value.
+ * @param[in]  valueLen     The length of the value.
+ *
+ * @return TRUE on success, FALSE if the TLV is malformed.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ProtoBinaryValidateTicketTLV(ProtoReply *reply,
+                             guint16 tag,
+                             const guint8 *value,
+                             guint32 valueLen)
+{
+   gchar *val = NULL;
+   gboolean ret;
+
+   switch (tag) {
+   case VGAUTH_BINARY_TAG_USERNAME:
+      return ProtoBinarySetString(&reply->replyData.validateTicket.userName,
+                                  value, valueLen);
+   case VGAUTH_BINARY_TAG_TOKEN:
+      return ProtoBinarySetString(&reply->replyData.validateTicket.token,
+                                  value, valueLen);
+   case VGAUTH_BINARY_TAG_USERHANDLETYPE:
+      if (!ProtoBinarySetString(&val, value, valueLen)) {
+         return FALSE;
+      }
+      reply->replyData.validateTicket.type = ProtoUserHandleTypeFromString(val);
+      ret = reply->replyData.validateTicket.type != VGAUTH_AUTH_TYPE_UNKNOWN;
+      if (!ret) {
+         Warning("%s: Found unrecognized userHandle type %s\n",
+                 __FUNCTION__, val);
+      }
+      g_free(val);
+      return ret;
+   case VGAUTH_BINARY_TAG_SAMLSUBJECT:
+      return ProtoBinarySetString(&reply->replyData.validateTicket.samlSubject,
+                                  value, valueLen);
+   case VGAUTH_BINARY_TAG_SUBJECT:
+      reply->replyData.validateTicket.aliasInfo.subject.type = VGAUTH_SUBJECT_NAMED;
+      return ProtoBinarySetString(&reply->replyData.validateTicket.aliasInfo.subject.val.name,
+                                  value, valueLen);
+   case VGAUTH_BINARY_TAG_ANYSUBJECT:
+      reply->replyData.validateTicket.aliasInfo.subject.type = VGAUTH_SUBJECT_ANY;
+      return TRUE;
+   case VGAUTH_BINARY_TAG_COMMENT:
+      return ProtoBinarySetString(&reply->replyData.validateTicket.aliasInfo.comment,
+                                  value, valueLen);
+   default:
+      return TRUE;
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * ProtoBinaryMappedAliasTLV --                                          */ /**
+ *
+ * Decodes one TLV of a binary QueryMappedAliases reply.  Each
+ * VGAUTH_BINARY_TAG_MAPPEDALIAS starts a new VGAuthMappedAlias, and the
+ * TLVs that follow it fill it in.
+ *
+ * @param[in]  reply        The reply being filled in.
+ * @param[in]  tag          The TLV tag.
+ * @param[in]  value        The TLV value.
+ * @param[in]  valueLen     The length of the value.
+ *
+ * @return TRUE on success, FALSE if the TLV is malformed.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ProtoBinaryMappedAliasTLV(ProtoReply *reply,
+                          guint16 tag,
+                          const guint8 *value,
+                          guint32 valueLen)
+{
+   VGAuthMappedAlias *ma = NULL;
+   int n;
+
+   if (VGAUTH_BINARY_TAG_MAPPEDALIAS == tag) {
+      n = ++(reply->replyData.queryMappedAliases.num);
+      reply->replyData.queryMappedAliases.maList =
+         g_realloc_n(reply->replyData.queryMappedAliases.maList,
+                     n, sizeof(VGAuthMappedAlias));
+      memset(&reply->replyData.queryMappedAliases.maList[n - 1], 0,
+             sizeof(VGAuthMappedAlias));
+      return TRUE;
+   }
+
+   if (reply->replyData.queryMappedAliases.num > 0) {
+      ma = &reply->replyData.queryMappedAliases.maList[reply->replyData.queryMappedAliases.num - 1];
+   }
+
+   switch (tag) {
+   case VGAUTH_BINARY_TAG_USERNAME:
+      return NULL != ma &&
+             ProtoBinarySetString(&ma->userName, value, valueLen);
+   case VGAUTH_BINARY_TAG_PEMCERT:
+      return NULL != ma &&
+             ProtoBinarySetString(&ma->pemCert, value, valueLen);
+   case VGAUTH_BINARY_TAG_SUBJECT:
+   case VGAUTH_BINARY_TAG_ANYSUBJECT:
+      if (NULL == ma) {
+         return FALSE;
+      }
+      n = ++(ma->numSubjects);
+      ma->subjects = g_realloc_n(ma->subjects, n, sizeof(VGAuthSubject));
+      ma->subjects[n - 1].val.name = NULL;
+      if (VGAUTH_BINARY_TAG_ANYSUBJECT == tag) {
+         ma->subjects[n - 1].type = VGAUTH_SUBJECT_ANY;
+         return TRUE;
+      }
+      ma->subjects[n - 1].type = VGAUTH_SUBJECT_NAMED;
+      return ProtoBinarySetString(&ma->subjects[n - 1].val.name,
+                                  value, valueLen);
+   default:
+      return TRUE;
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * Proto_ParseBinaryReply --                                             */ /**
+ *
+ * Checks the binary reply data read so far, and decodes it into the
+ * reply once the whole frame has arrived.
+ *
+ * @param[in]  reply        The reply being filled in.
+ * @param[in]  frame        The data read so far.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+Proto_ParseBinaryReply(ProtoReply *reply,
+                       GByteArray *frame)
+{
+   VGAuthError err;
+   ProtoBinaryReader reader;
+   gboolean complete;
+   gboolean ok = TRUE;
+   guint8 opcode;
+   guint32 seqNo;
+   guint16 tag;
+   const guint8 *value;
+   guint32 valueLen;
+   guint64 code;
+
+   err = ProtoBinary_CheckFrame(frame->data, frame->len, &complete,
+                                &opcode, &seqNo);
+   if (VGAUTH_E_OK != err) {
+      Warning("%s: malformed binary reply\n", __FUNCTION__);
+      return err;
+   }
+   if (!complete) {
+      return VGAUTH_E_OK;
+   }
+
+   switch (opcode) {
+   case VGAUTH_BINARY_OP_ERROR:
+      reply->actualReplyType = PROTO_REPLY_ERROR;
+      break;
+   case VGAUTH_BINARY_OP_VALIDATETICKET:
+      reply->actualReplyType = PROTO_REPLY_VALIDATETICKET;
+      break;
+   case VGAUTH_BINARY_OP_QUERYMAPPEDALIASES:
+      reply->actualReplyType = PROTO_REPLY_QUERYMAPPEDALIASES;
+      break;
+   default:
+      Warning("%s: unexpected binary reply opcode %d\n",
+              __FUNCTION__, opcode);
+      return VGAUTH_E_COMM;
+   }
+
+   /*
+    * Don't fill in the wrong member of replyData;
+    * Proto_SanityCheckReply() reports the mismatch.
+    */
+   reply->sequenceNumber = seqNo;
+   reply->complete = TRUE;
+   if (PROTO_REPLY_ERROR != reply->actualReplyType &&
+       reply->actualReplyType != reply->expectedReplyType) {
+      return VGAUTH_E_OK;
+   }
+
+   ProtoBinary_InitReader(&reader, frame->data, frame->len);
+   while (ok) {
+      err = ProtoBinary_NextTLV(&reader, &tag, &value, &valueLen);
+      if (VGAUTH_E_OK != err || 0 == tag) {
+         break;
+      }
+
+      switch (reply->actualReplyType) {
+      case PROTO_REPLY_ERROR:
+         if (VGAUTH_BINARY_TAG_ERRORCODE == tag) {
+            ok = ProtoBinary_GetUint64(value, valueLen, &code);
+            if (ok) {
+               reply->errorCode = (VGAuthError) code;
+            }
+         } else if (VGAUTH_BINARY_TAG_ERRORMSG == tag) {
+            ok = ProtoBinarySetString(&reply->replyData.error.errorMsg,
+                                      value, valueLen);
+         }
+         break;
+      case PROTO_REPLY_VALIDATETICKET:
+         ok = ProtoBinaryValidateTicketTLV(reply, tag, value, valueLen);
+         break;
+      case PROTO_REPLY_QUERYMAPPEDALIASES:
+         ok = ProtoBinaryMappedAliasTLV(reply, tag, value, valueLen);
+         break;
+      default:
+         ASSERT(0);
+         break;
+      }
+   }
+
+   if (VGAUTH_E_OK != err || !ok) {
+      Warning("%s: malformed binary reply\n", __FUNCTION__);
+      return VGAUTH_E_COMM;
+   }
+
+   return VGAUTH_E_OK;
+}
+
+
 /*
  ******************************************************************************
  * Proto_NewReply --                                                     */ /**
@@ -1147,7 +1443,8 @@ Proto_SanityCheckReply(ProtoReply *reply,
                        int expectedSequenceNumber)
 {
 #if VGAUTH_PROTO_TRACE
-   ASSERT(strncmp(reply->rawData, VGAUTH_XML_PREAMBLE,
+   ASSERT(NULL == reply->rawData ||
+          strncmp(reply->rawData, VGAUTH_XML_PREAMBLE,
                   strlen(VGAUTH_XML_PREAMBLE)) == 0);
 #endif
    if (PROTO_REPLY_ERROR != reply->actualReplyType) {
@@ -1182,6 +1479,7 @@ Proto_SanityCheckReply(ProtoReply *reply,
  * VGAuth_ReadAndParseResponse --                                        */ /**
  *
  * Reads the next reply off the wire and returns it in wireReply.
+ * The reply is either XML or, if the request was, a binary frame.
  *
  * @param[in]  ctx                       The VGAuthContext.
  * @param[in]  expectedReplyType         The expected reply type.
@@ -1206,6 +1504,8 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
    ProtoReply *reply = NULL;
    gboolean bRet;
    GError *gErr = NULL;
+   GByteArray *frame = NULL;
+   gboolean started = FALSE;
 
    reply = Proto_NewReply(expectedReplyType);
 
@@ -1228,6 +1528,19 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
       if (VGAUTH_E_OK != err) {
          goto abort;
       }
+      if (!started && ProtoBinary_IsFrame(rawReply, len)) {
+         frame = g_byte_array_new();
+      }
+      started = TRUE;
+      if (NULL != frame) {
+         g_byte_array_append(frame, (guint8 *) rawReply, len);
+         g_free(rawReply);
+         err = Proto_ParseBinaryReply(reply, frame);
+         if (VGAUTH_E_OK != err) {
+            goto abort;
+         }
+         continue;
+      }
 #if VGAUTH_PROTO_TRACE
       if (reply->rawData) {
          reply->rawData = g_strdup_printf("%s%s", reply->rawData, rawReply);
@@ -1282,6 +1595,9 @@ abort:
 done:
    *wireReply = reply;
    g_markup_parse_context_free(parseContext);
+   if (NULL != frame) {
+      g_byte_array_free(frame, TRUE);
+   }
    return err;
 }
 
@@ -1295,6 +1611,9 @@ done:
  *
  * @param[in]  ctx                       The VGAuthContext.
  * @param[in]  userName                  The name of the user.
+ * @param[in/out] version                The protocol version to ask for;
+ *                                       set to the one the service chose.
+ * @param[out] pipeName                  The user-specific pipe.
  *
  * @return VGAUTH_E_OK on success, VGAuthError on failure
  *
@@ -1304,6 +1623,7 @@ done:
 VGAuthError
 VGAuth_SendSessionRequest(VGAuthContext *ctx,
                           const char *userName,
+                          int *version,                     // IN/OUT
                           char **pipeName)                  // OUT
 {
    VGAuthError err = VGAUTH_E_OK;
@@ -1312,6 +1632,7 @@ VGAuth_SendSessionRequest(VGAuthContext *ctx,
 
    packet = g_markup_printf_escaped(VGAUTH_SESSION_REQUEST_FORMAT,
                                     ctx->comm.sequenceNumber,
+                                    *version,
                                     userName);
 
    err = VGAuth_CommSendData(ctx, packet);
@@ -1326,12 +1647,23 @@ VGAuth_SendSessionRequest(VGAuthContext *ctx,
       goto abort;
    }
 
-   /* version # check */
-   if (reply->replyData.sessionReq.version != atoi(VGAUTH_PROTOCOL_VERSION)) {
-      Warning("%s: version mismatch client is %d, service %d\n",
-              __FUNCTION__, atoi(VGAUTH_PROTOCOL_VERSION),
-              reply->replyData.sessionReq.version);
-      /* XXX error out, or pretend?  */
+   /*
+    * Version # check.  The service may pick an older version than the
+    * one asked for, in which case we use that.
+    */
+   if (reply->replyData.sessionReq.version != *version) {
+      Debug("%s: client asked for version %d, service chose %d\n",
+            __FUNCTION__, *version, reply->replyData.sessionReq.version);
+      if (reply->replyData.sessionReq.version < *version &&
+          reply->replyData.sessionReq.version >= atoi(VGAUTH_PROTOCOL_VERSION)) {
+         *version = reply->replyData.sessionReq.version;
+      } else {
+         Warning("%s: version mismatch client is %d, service %d\n",
+                 __FUNCTION__, *version,
+                 reply->replyData.sessionReq.version);
+         /* XXX error out, or pretend?  */
+         *version = atoi(VGAUTH_PROTOCOL_VERSION);
+      }
    }
 
    *pipeName = g_strdup(reply->replyData.sessionReq.pipeName);
@@ -1715,6 +2047,7 @@ VGAuth_SendQueryMappedAliasesRequest(VGAuthContext *ctx,
 {
    VGAuthError err = VGAUTH_E_OK;
    gchar *packet = NULL;
+   gsize packetLen;
    ProtoReply *reply = NULL;
 
    *num = 0;
@@ -1731,10 +2064,18 @@ VGAuth_SendQueryMappedAliasesRequest(VGAuthContext *ctx,
       }
    }
 
-   packet = g_markup_printf_escaped(VGAUTH_QUERYMAPPEDALIASES_REQUEST_FORMAT,
-                                    ctx->comm.sequenceNumber);
+   if (ctx->comm.binary) {
+      packet = ProtoBinary_FinishFrame(
+                  ProtoBinary_NewFrame(VGAUTH_BINARY_OP_QUERYMAPPEDALIASES,
+                                       ctx->comm.sequenceNumber),
+                  &packetLen);
+   } else {
+      packet = g_markup_printf_escaped(VGAUTH_QUERYMAPPEDALIASES_REQUEST_FORMAT,
+                                       ctx->comm.sequenceNumber);
+      packetLen = strlen(packet);
+   }
 
-   err = VGAuth_CommSendData(ctx, packet);
+   err = VGAuth_CommSendBytes(ctx, packetLen, packet);
    if (VGAUTH_E_OK != err) {
       Warning("%s: failed to send packet\n", __FUNCTION__);
       goto abort;
@@ -1883,6 +2224,7 @@ VGAuth_SendValidateTicketRequest(VGAuthContext *ctx,
    VGAuthError retCode = VGAUTH_E_FAIL;
    VGAuthUserHandle *newHandle = NULL;
    gchar *packet = NULL;
+   gsize packetLen;
    ProtoReply *reply = NULL;
    HANDLE token = NULL;
 #ifdef _WIN32
@@ -1902,14 +2244,24 @@ VGAuth_SendValidateTicketRequest(VGAuthContext *ctx,
       }
    }
 
-   packet = g_markup_printf_escaped(VGAUTH_VALIDATETICKET_REQUEST_FORMAT,
-                                    ctx->comm.sequenceNumber,
-                                    ticket);
+   if (ctx->comm.binary) {
+      GByteArray *frame;
 
-   err = VGAuth_CommSendData(ctx, packet);
+      frame = ProtoBinary_NewFrame(VGAUTH_BINARY_OP_VALIDATETICKET,
+                                   ctx->comm.sequenceNumber);
+      ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_TICKET, ticket);
+      packet = ProtoBinary_FinishFrame(frame, &packetLen);
+   } else {
+      packet = g_markup_printf_escaped(VGAUTH_VALIDATETICKET_REQUEST_FORMAT,
+                                       ctx->comm.sequenceNumber,
+                                       ticket);
+      packetLen = strlen(packet);
+   }
+
+   err = VGAuth_CommSendBytes(ctx, packetLen, packet);
    if (VGAUTH_E_OK != err) {
       retCode = err;
-      VGAUTH_LOG_WARNING("%s", "VGAuth_CommSendData() failed");
+      VGAUTH_LOG_WARNING("%s", "VGAuth_CommSendBytes() failed");
       goto done;
    }
 
@@ -67,6 +67,13 @@ typedef struct VGAuthExtraParams {
 #define VGAUTH_PARAM_VALUE_TRUE  "true"
 #define VGAUTH_PARAM_VALUE_FALSE "false"
 
+/*
+ * Extra parameter for VGAuth_Init().  When set to VGAUTH_PARAM_VALUE_TRUE,
+ * ticket validation and mapped alias queries use a compact binary encoding
+ * if the service supports it, and XML otherwise.
+ */
+#define VGAUTH_PARAM_BINARY_PROTOCOL "binaryProtocol"
+
 /*
  * Initalizes library, and specifies any configuration information.
  */
@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
 #ifdef _WIN32
 #include <io.h>
 #include <windows.h>
@@ -67,6 +68,54 @@
 
 static gchar *aliasStoreRootDir = DEFAULT_ALIASSTORE_ROOT_DIR;
 
+/*
+ * Cert fingerprints, keyed by PEM text.  The cache is simply flushed when
+ * it grows past ALIAS_CERT_FINGERPRINT_CACHE_MAX entries.
+ */
+#define ALIAS_CERT_FINGERPRINT_CACHE_MAX  1024
+
+static GHashTable *certFingerprintCache = NULL;
+G_LOCK_DEFINE_STATIC(certFingerprintCache);
+
+#ifndef _WIN32
+/*
+ * Parsed alias and mapping files, keyed by file name.  An entry is used
+ * only while the file's identity, size, timestamps, owner and mode match
+ * what they were when it was loaded, so external edits and permission
+ * changes are still noticed, at the cost of one lstat() per load.
+ *
+ * Timestamps only have a resolution of a second, so a file modified in
+ * the same second it was loaded could change again without its mtime
+ * changing.  Such entries are not trusted, and the file is re-read until
+ * it has been loaded a second or more after its last change.
+ *
+ * An entry also keeps the fingerprint index of its list, so cert chain
+ * verification only indexes a file again when the file changes.  The
+ * index is never modified once built and is shared by reference.
+ */
+typedef struct AliasStoreCacheEntry {
+   dev_t dev;
+   ino_t ino;
+   off_t size;
+   time_t mtime;
+   time_t ctime;
+   mode_t mode;
+   uid_t uid;
+   gid_t gid;
+   time_t loadTime;
+   gboolean isMapFile;
+   int num;
+   ServiceAlias *aList;             // for a user's alias file
+   ServiceMappedAlias *maList;      // for the mapping file
+   GHashTable *index;               // fingerprint index, built on first use
+} AliasStoreCacheEntry;
+
+#define ALIASSTORE_CACHE_MAX_FILES  256
+
+static GHashTable *aliasStoreCache = NULL;
+G_LOCK_DEFINE_STATIC(aliasStoreCache);
+#endif
+
 #ifdef _WIN32
 /*
  * Still used to create the Alias directory; passed through to
@@ -300,6 +349,78 @@ ServiceAliasIsSubjectEqual(ServiceSubjectType t1,
 }
 
 
+/*
+ ******************************************************************************
+ * ServiceCertFingerprint --                                             */ /**
+ *
+ * Computes the SHA-256 fingerprint of the DER encoding of a PEM cert.
+ * PEM text can carry extraneous whitespace or the openssl
+ * -----BEGIN CERTIFICATE----- and -----END CERTIFICATE----- delimiters,
+ * so two equal certs do not always have equal PEM strings.
+ *
+ * Stripping and decoding a cert is expensive compared to the lookups done
+ * with the result, and the same certs are fingerprinted over and over, so
+ * results are remembered by PEM text.
+ *
+ * @param[in]   pemCert       The cert.
+ * @param[out]  fingerprint   SERVICE_CERT_FINGERPRINT_LEN bytes.
+ *
+ ******************************************************************************
+ */
+
+void
+ServiceCertFingerprint(const gchar *pemCert,
+                       guchar *fingerprint)
+{
+   gchar *cleanCert;
+   guchar *binCert;
+   gsize len;
+   gsize digestLen = SERVICE_CERT_FINGERPRINT_LEN;
+   GChecksum *sum;
+   guchar *cached;
+
+   G_LOCK(certFingerprintCache);
+   if (NULL == certFingerprintCache) {
+      certFingerprintCache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                   g_free, g_free);
+   }
+   cached = g_hash_table_lookup(certFingerprintCache, pemCert);
+   if (NULL != cached) {
+      memcpy(fingerprint, cached, SERVICE_CERT_FINGERPRINT_LEN);
+      G_UNLOCK(certFingerprintCache);
+      return;
+   }
+   G_UNLOCK(certFingerprintCache);
+
+   /*
+    * First pull off any openssl headers.  The base64 decoder
+    * will ignore anything non-base64 (like whitespace) in the
+    * text, but it'll treat the 'BEGIN/END' text in the delimiter
+    * as real data.
+    */
+   cleanCert = CertVerify_StripPEMCert(pemCert);
+   binCert = g_base64_decode(cleanCert, &len);
+
+   sum = g_checksum_new(G_CHECKSUM_SHA256);
+   g_checksum_update(sum, binCert, len);
+   g_checksum_get_digest(sum, fingerprint, &digestLen);
+   ASSERT(digestLen == SERVICE_CERT_FINGERPRINT_LEN);
+   g_checksum_free(sum);
+
+   g_free(cleanCert);
+   g_free(binCert);
+
+   G_LOCK(certFingerprintCache);
+   if (g_hash_table_size(certFingerprintCache) >=
+       ALIAS_CERT_FINGERPRINT_CACHE_MAX) {
+      g_hash_table_remove_all(certFingerprintCache);
+   }
+   g_hash_table_replace(certFingerprintCache, g_strdup(pemCert),
+                        g_memdup(fingerprint, SERVICE_CERT_FINGERPRINT_LEN));
+   G_UNLOCK(certFingerprintCache);
+}
+
+
 /*
  ******************************************************************************
  * ServiceComparePEMCerts --                                             */ /**
@@ -322,40 +443,190 @@ gboolean
 ServiceComparePEMCerts(const gchar *pemCert1,
                        const gchar *pemCert2)
 {
-   gchar *cleanCert1;
-   gchar *cleanCert2;
-   guchar *binCert1;
-   guchar *binCert2;
-   gsize len1;
-   gsize len2;
-   gboolean bRet;
+   guchar fp1[SERVICE_CERT_FINGERPRINT_LEN];
+   guchar fp2[SERVICE_CERT_FINGERPRINT_LEN];
 
-   /*
-    * First pull off any openssl headers.  The base64 decoder
-    * will ignore anything non-base64 (like whitespace) in the
-    * text, but it'll treat the 'BEGIN/END' text in the delimiter
-    * as real data.
-    */
-   cleanCert1 = CertVerify_StripPEMCert(pemCert1);
-   cleanCert2 = CertVerify_StripPEMCert(pemCert2);
+   ServiceCertFingerprint(pemCert1, fp1);
+   ServiceCertFingerprint(pemCert2, fp2);
 
-   binCert1 = g_base64_decode(cleanCert1, &len1);
-   binCert2 = g_base64_decode(cleanCert2, &len2);
+   return memcmp(fp1, fp2, sizeof fp1) == 0;
+}
 
-   if (len1 != len2) {
-      bRet = FALSE;
-      goto done;
+
+/*
+ ******************************************************************************
+ * ServiceCertFingerprintHash --                                         */ /**
+ *
+ * GHashFunc for fingerprint keys.  A SHA-256 digest is already uniformly
+ * distributed, so its first bytes make a fine hash.
+ *
+ * @param[in]   key     The fingerprint.
+ *
+ * @return The hash value.
+ *
+ ******************************************************************************
+ */
+
+static guint
+ServiceCertFingerprintHash(gconstpointer key)
+{
+   guint hash;
+
+   memcpy(&hash, key, sizeof hash);
+   return hash;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceCertFingerprintEqual --                                        */ /**
+ *
+ * GEqualFunc for fingerprint keys.
+ *
+ * @param[in]   a     The first fingerprint.
+ * @param[in]   b     The second fingerprint.
+ *
+ * @return TRUE if they are the same.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ServiceCertFingerprintEqual(gconstpointer a,
+                            gconstpointer b)
+{
+   return memcmp(a, b, SERVICE_CERT_FINGERPRINT_LEN) == 0;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceCertIndexAdd --                                                */ /**
+ *
+ * Appends a store position to the list kept for a cert's fingerprint.
+ * Callers walk their store in order, so each list is in store order,
+ * matching what a linear search would find.
+ *
+ * @param[in]   index     The index.
+ * @param[in]   pemCert   The cert.
+ * @param[in]   i         Its position in the store.
+ *
+ ******************************************************************************
+ */
+
+static void
+ServiceCertIndexAdd(GHashTable *index,
+                    const gchar *pemCert,
+                    int i)
+{
+   guchar fp[SERVICE_CERT_FINGERPRINT_LEN];
+   GSList *l;
+
+   ServiceCertFingerprint(pemCert, fp);
+   l = g_hash_table_lookup(index, fp);
+   if (NULL != l) {
+      /* appending to a non-empty list never changes its head */
+      l = g_slist_append(l, GINT_TO_POINTER(i));
+   } else {
+      g_hash_table_insert(index,
+                          g_memdup(fp, SERVICE_CERT_FINGERPRINT_LEN),
+                          g_slist_prepend(NULL, GINT_TO_POINTER(i)));
    }
+}
 
-   bRet = memcmp(binCert1, binCert2, len1) == 0;
 
-done:
-   g_free(cleanCert1);
-   g_free(cleanCert2);
-   g_free(binCert1);
-   g_free(binCert2);
+/*
+ ******************************************************************************
+ * ServiceAliasIndexAliases --                                           */ /**
+ *
+ * Builds a fingerprint index of an alias list, so that certs can be
+ * matched against it with a single lookup.
+ *
+ * @param[in]   num     The number of aliases.
+ * @param[in]   aList   The aliases.
+ *
+ * @return A GHashTable to pass to ServiceAliasLookupCertIndex().
+ *         Release it with g_hash_table_unref().
+ *
+ ******************************************************************************
+ */
 
-   return bRet;
+static GHashTable *
+ServiceAliasIndexAliases(int num,
+                         const ServiceAlias *aList)
+{
+   GHashTable *index;
+   int i;
+
+   index = g_hash_table_new_full(ServiceCertFingerprintHash,
+                                 ServiceCertFingerprintEqual,
+                                 g_free, (GDestroyNotify) g_slist_free);
+   for (i = 0; i < num; i++) {
+      ServiceCertIndexAdd(index, aList[i].pemCert, i);
+   }
+
+   return index;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceAliasIndexMappedAliases --                                     */ /**
+ *
+ * Builds a fingerprint index of a mapped alias list, so that certs can be
+ * matched against it with a single lookup.
+ *
+ * @param[in]   num      The number of mapped aliases.
+ * @param[in]   maList   The mapped aliases.
+ *
+ * @return A GHashTable to pass to ServiceAliasLookupCertIndex().
+ *         Release it with g_hash_table_unref().
+ *
+ ******************************************************************************
+ */
+
+static GHashTable *
+ServiceAliasIndexMappedAliases(int num,
+                               const ServiceMappedAlias *maList)
+{
+   GHashTable *index;
+   int i;
+
+   index = g_hash_table_new_full(ServiceCertFingerprintHash,
+                                 ServiceCertFingerprintEqual,
+                                 g_free, (GDestroyNotify) g_slist_free);
+   for (i = 0; i < num; i++) {
+      ServiceCertIndexAdd(index, maList[i].pemCert, i);
+   }
+
+   return index;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceAliasLookupCertIndex --                                        */ /**
+ *
+ * Finds the store entries whose cert matches @a pemCert.
+ *
+ * @param[in]   index     An index from ServiceAliasQueryAliases() or
+ *                        ServiceAliasQueryMappedAliases().
+ * @param[in]   pemCert   The cert to look up.
+ *
+ * @return A list of store positions (GPOINTER_TO_INT), in store order,
+ *         or NULL if there is no match.  The list belongs to the index.
+ *
+ ******************************************************************************
+ */
+
+GSList *
+ServiceAliasLookupCertIndex(GHashTable *index,
+                            const gchar *pemCert)
+{
+   guchar fp[SERVICE_CERT_FINGERPRINT_LEN];
+
+   ServiceCertFingerprint(pemCert, fp);
+   return g_hash_table_lookup(index, fp);
 }
 
 
@@ -865,6 +1136,289 @@ ServiceLoadFileContents(const gchar *fileName,
 }
 
 
+#ifndef _WIN32
+/*
+ ******************************************************************************
+ * AliasCopyAliasList --                                                 */ /**
+ *
+ * Makes a deep copy of an alias list.
+ *
+ * @param[in]   num     The number of entries.
+ * @param[in]   src     The list to copy.
+ *
+ * @return The copy.  Free with ServiceAliasFreeAliasList().
+ *
+ ******************************************************************************
+ */
+
+static ServiceAlias *
+AliasCopyAliasList(int num,
+                   const ServiceAlias *src)
+{
+   ServiceAlias *dst;
+   int i;
+   int j;
+
+   dst = g_malloc0_n(num, sizeof(*dst));
+   for (i = 0; i < num; i++) {
+      dst[i].pemCert = g_strdup(src[i].pemCert);
+      dst[i].num = src[i].num;
+      dst[i].infos = g_malloc0_n(src[i].num, sizeof(*dst[i].infos));
+      for (j = 0; j < src[i].num; j++) {
+         ServiceAliasCopyAliasInfoContents(&(src[i].infos[j]),
+                                           &(dst[i].infos[j]));
+      }
+   }
+
+   return dst;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCopyMappedAliasList --                                           */ /**
+ *
+ * Makes a deep copy of a mapped alias list.
+ *
+ * @param[in]   num     The number of entries.
+ * @param[in]   src     The list to copy.
+ *
+ * @return The copy.  Free with ServiceAliasFreeMappedAliasList().
+ *
+ ******************************************************************************
+ */
+
+static ServiceMappedAlias *
+AliasCopyMappedAliasList(int num,
+                         const ServiceMappedAlias *src)
+{
+   ServiceMappedAlias *dst;
+   int i;
+   int j;
+
+   dst = g_malloc0_n(num, sizeof(*dst));
+   for (i = 0; i < num; i++) {
+      dst[i].pemCert = g_strdup(src[i].pemCert);
+      dst[i].userName = g_strdup(src[i].userName);
+      dst[i].num = src[i].num;
+      dst[i].subjects = g_malloc0_n(src[i].num, sizeof(*dst[i].subjects));
+      for (j = 0; j < src[i].num; j++) {
+         dst[i].subjects[j].type = src[i].subjects[j].type;
+         if (SUBJECT_TYPE_NAMED == src[i].subjects[j].type) {
+            dst[i].subjects[j].name = g_strdup(src[i].subjects[j].name);
+         }
+      }
+   }
+
+   return dst;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasStoreCacheEntryFree --                                           */ /**
+ *
+ * GDestroyNotify for alias store cache entries.
+ *
+ * @param[in]   data    The AliasStoreCacheEntry.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasStoreCacheEntryFree(gpointer data)
+{
+   AliasStoreCacheEntry *entry = data;
+
+   if (entry->isMapFile) {
+      ServiceAliasFreeMappedAliasList(entry->num, entry->maList);
+   } else {
+      ServiceAliasFreeAliasList(entry->num, entry->aList);
+   }
+   if (NULL != entry->index) {
+      g_hash_table_unref(entry->index);
+   }
+   g_free(entry);
+}
+
+
+/*
+ ******************************************************************************
+ * AliasStoreCacheLookup --                                              */ /**
+ *
+ * Looks for an up to date parse of an alias or mapping file.
+ *
+ * @param[in]   fileName    The file.
+ * @param[out]  st          The file's current lstat() data, for
+ *                          AliasStoreCacheAdd() after a miss.
+ * @param[out]  loadTime    When @a st was taken.
+ * @param[out]  num         The number of entries on a hit.
+ * @param[out]  aList       A copy of the aliases on a hit.  NULL for the
+ *                          mapping file.
+ * @param[out]  maList      A copy of the mapped aliases on a hit.  NULL
+ *                          for an alias file.
+ * @param[out]  index       Optional.  A reference to the fingerprint index
+ *                          of the list on a hit.
+ *
+ * @return TRUE on a hit.  FALSE if the file has to be loaded, in which case
+ *         @a st is only valid if @a loadTime is non-zero.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+AliasStoreCacheLookup(const gchar *fileName,
+                      struct stat *st,
+                      time_t *loadTime,
+                      int *num,
+                      ServiceAlias **aList,
+                      ServiceMappedAlias **maList,
+                      GHashTable **index)
+{
+   AliasStoreCacheEntry *entry;
+   gboolean hit = FALSE;
+   time_t now = time(NULL);
+
+   *loadTime = 0;
+   if (g_lstat(fileName, st) != 0) {
+      return FALSE;
+   }
+   *loadTime = now;
+
+   G_LOCK(aliasStoreCache);
+   if (NULL == aliasStoreCache) {
+      goto done;
+   }
+   entry = g_hash_table_lookup(aliasStoreCache, fileName);
+   if (NULL == entry ||
+       entry->dev != st->st_dev ||
+       entry->ino != st->st_ino ||
+       entry->size != st->st_size ||
+       entry->mtime != st->st_mtime ||
+       entry->ctime != st->st_ctime ||
+       entry->mode != st->st_mode ||
+       entry->uid != st->st_uid ||
+       entry->gid != st->st_gid ||
+       entry->mtime >= entry->loadTime ||
+       entry->ctime >= entry->loadTime ||
+       entry->isMapFile != (NULL != maList)) {
+      goto done;
+   }
+
+   *num = entry->num;
+   if (entry->isMapFile) {
+      *maList = AliasCopyMappedAliasList(entry->num, entry->maList);
+   } else {
+      *aList = AliasCopyAliasList(entry->num, entry->aList);
+   }
+   if (NULL != index) {
+      if (NULL == entry->index) {
+         entry->index = entry->isMapFile ?
+            ServiceAliasIndexMappedAliases(entry->num, entry->maList) :
+            ServiceAliasIndexAliases(entry->num, entry->aList);
+      }
+      *index = g_hash_table_ref(entry->index);
+   }
+   hit = TRUE;
+
+done:
+   G_UNLOCK(aliasStoreCache);
+   return hit;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasStoreCacheAdd --                                                 */ /**
+ *
+ * Remembers the parse of an alias or mapping file.
+ *
+ * @param[in]   fileName    The file.
+ * @param[in]   st          The lstat() data taken before the file was read.
+ * @param[in]   loadTime    When @a st was taken.
+ * @param[in]   isMapFile   Whether this is the mapping file.
+ * @param[in]   num         The number of entries.
+ * @param[in]   aList       The aliases, for an alias file.
+ * @param[in]   maList      The mapped aliases, for the mapping file.
+ * @param[in]   index       Optional.  The fingerprint index of the list.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasStoreCacheAdd(const gchar *fileName,
+                   const struct stat *st,
+                   time_t loadTime,
+                   gboolean isMapFile,
+                   int num,
+                   const ServiceAlias *aList,
+                   const ServiceMappedAlias *maList,
+                   GHashTable *index)
+{
+   AliasStoreCacheEntry *entry;
+
+   entry = g_malloc0(sizeof *entry);
+   entry->dev = st->st_dev;
+   entry->ino = st->st_ino;
+   entry->size = st->st_size;
+   entry->mtime = st->st_mtime;
+   entry->ctime = st->st_ctime;
+   entry->mode = st->st_mode;
+   entry->uid = st->st_uid;
+   entry->gid = st->st_gid;
+   entry->loadTime = loadTime;
+   entry->isMapFile = isMapFile;
+   entry->num = num;
+   if (isMapFile) {
+      entry->maList = AliasCopyMappedAliasList(num, maList);
+   } else {
+      entry->aList = AliasCopyAliasList(num, aList);
+   }
+   /* the copy keeps the order, so the index applies to it as well */
+   if (NULL != index) {
+      entry->index = g_hash_table_ref(index);
+   }
+
+   G_LOCK(aliasStoreCache);
+   if (NULL == aliasStoreCache) {
+      aliasStoreCache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              g_free,
+                                              AliasStoreCacheEntryFree);
+   }
+   if (g_hash_table_size(aliasStoreCache) >= ALIASSTORE_CACHE_MAX_FILES) {
+      g_hash_table_remove_all(aliasStoreCache);
+   }
+   g_hash_table_replace(aliasStoreCache, g_strdup(fileName), entry);
+   G_UNLOCK(aliasStoreCache);
+}
+#endif   // !_WIN32
+
+
+/*
+ ******************************************************************************
+ * AliasStoreCacheInvalidate --                                          */ /**
+ *
+ * Forgets the parse of an alias or mapping file.  Called whenever the
+ * service itself replaces or removes one.
+ *
+ * @param[in]   fileName    The file.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasStoreCacheInvalidate(const gchar *fileName)
+{
+#ifndef _WIN32
+   G_LOCK(aliasStoreCache);
+   if (NULL != aliasStoreCache) {
+      g_hash_table_remove(aliasStoreCache, fileName);
+   }
+   G_UNLOCK(aliasStoreCache);
+#endif
+}
+
+
 /*
  ******************************************************************************
  * AliasDumpAliases --                                                   */ /**
@@ -1410,6 +1964,9 @@ AliasCheckMapFilePerms(const gchar *fileName)
  * @param[out]  num             The number of certs read.
  * @param[out]  aList           The Aliases read.  The caller should
  *                              call ServiceAliasFreeAliasList() when done.
+ * @param[out]  index           Optional.  The fingerprint index of @a aList.
+ *                              The caller should call g_hash_table_unref()
+ *                              when done.
  *
  * @return VGAUTH_E_OK on success, VGAuthError on failure
  *
@@ -1419,7 +1976,8 @@ AliasCheckMapFilePerms(const gchar *fileName)
 static VGAuthError
 AliasLoadAliases(const gchar *userName,
                  int *num,
-                 ServiceAlias **aList)
+                 ServiceAlias **aList,
+                 GHashTable **index)
 {
    static const GMarkupParser aliasParser = {
       AliasStartElement,
@@ -1436,12 +1994,42 @@ AliasLoadAliases(const gchar *userName,
    AliasParseList list;
    VGAuthError err;
    GError *gErr = NULL;
+#ifndef _WIN32
+   struct stat st;
+   time_t loadTime;
+#endif
 
    ASSERT(num);
    ASSERT(aList);
 
    *num = 0;
    *aList = NULL;
+   if (NULL != index) {
+      *index = NULL;
+   }
+
+   aliasFilename = ServiceUserNameToAliasStoreFileName(userName);
+
+#ifndef _WIN32
+   if (AliasStoreCacheLookup(aliasFilename, &st, &loadTime,
+                             num, aList, NULL, index)) {
+      /*
+       * The owner check depends on the user's current uid, not just on the
+       * file, so it is redone even for a cached parse.
+       */
+      if (AliasCheckAliasFilePerms(aliasFilename, userName) != VGAUTH_E_OK) {
+         ServiceAliasFreeAliasList(*num, *aList);
+         *num = 0;
+         *aList = NULL;
+         if (NULL != index) {
+            g_hash_table_unref(*index);
+            *index = ServiceAliasIndexAliases(0, NULL);
+         }
+      }
+      g_free(aliasFilename);
+      return VGAUTH_E_OK;
+   }
+#endif
 
    list.state = ALIAS_PARSE_STATE_NONE;
    list.aList = NULL;
@@ -1449,8 +2037,6 @@ AliasLoadAliases(const gchar *userName,
 
    context = g_markup_parse_context_new(&aliasParser, 0, &list, NULL);
 
-   aliasFilename = ServiceUserNameToAliasStoreFileName(userName);
-
    /*
     * If it's not there, then we have nothing to read.
     */
@@ -1477,12 +2063,27 @@ AliasLoadAliases(const gchar *userName,
       goto cleanup;
    }
 
+   if (NULL != index) {
+      *index = ServiceAliasIndexAliases(list.num, list.aList);
+   }
+
+#ifndef _WIN32
+   if (loadTime != 0) {
+      AliasStoreCacheAdd(aliasFilename, &st, loadTime, FALSE,
+                         list.num, list.aList, NULL,
+                         (NULL != index) ? *index : NULL);
+   }
+#endif
+
 done:
    /*
     * We're just transferring the data to the caller to free.
     */
    *num = list.num;
    *aList = list.aList;
+   if (NULL != index && NULL == *index) {
+      *index = ServiceAliasIndexAliases(list.num, list.aList);
+   }
    err = VGAUTH_E_OK;
 
 cleanup:
@@ -1747,6 +2348,9 @@ MappedEndElement(GMarkupParseContext *parseContext,
  * @param[out]  maList          The ServiceMappedAliases read.  The caller
  *                              should call ServiceAliasFreeMappedAliasList()
  *                              when done.
+ * @param[out]  index           Optional.  The fingerprint index of
+ *                              @a maList.  The caller should call
+ *                              g_hash_table_unref() when done.
  *
  * @return VGAUTH_E_OK on success, VGAuthError on failure
  *
@@ -1755,7 +2359,8 @@ MappedEndElement(GMarkupParseContext *parseContext,
 
 static VGAuthError
 AliasLoadMapped(int *num,
-                ServiceMappedAlias **maList)
+                ServiceMappedAlias **maList,
+                GHashTable **index)
 {
    static const GMarkupParser mappedIdParser = {
       MappedStartElement,
@@ -1772,12 +2377,40 @@ AliasLoadMapped(int *num,
    MappedAliasParseList list;
    VGAuthError err;
    GError *gErr = NULL;
+#ifndef _WIN32
+   struct stat st;
+   time_t loadTime;
+#endif
 
    ASSERT(num);
    ASSERT(maList);
 
    *num = 0;
    *maList = NULL;
+   if (NULL != index) {
+      *index = NULL;
+   }
+
+   mapFilename = g_strdup_printf("%s"DIRSEP"%s",
+                                 aliasStoreRootDir,
+                                 ALIASSTORE_MAPFILE_NAME);
+
+#ifndef _WIN32
+   if (AliasStoreCacheLookup(mapFilename, &st, &loadTime,
+                             num, NULL, maList, index)) {
+      if (AliasCheckMapFilePerms(mapFilename) != VGAUTH_E_OK) {
+         ServiceAliasFreeMappedAliasList(*num, *maList);
+         *num = 0;
+         *maList = NULL;
+         if (NULL != index) {
+            g_hash_table_unref(*index);
+            *index = ServiceAliasIndexMappedAliases(0, NULL);
+         }
+      }
+      g_free(mapFilename);
+      return VGAUTH_E_OK;
+   }
+#endif
 
    list.state = MAP_PARSE_STATE_NONE;
    list.maList = NULL;
@@ -1785,10 +2418,6 @@ AliasLoadMapped(int *num,
 
    context = g_markup_parse_context_new(&mappedIdParser, 0, &list, NULL);
 
-   mapFilename = g_strdup_printf("%s"DIRSEP"%s",
-                                 aliasStoreRootDir,
-                                 ALIASSTORE_MAPFILE_NAME);
-
    /*
     * If its not there, then we have nothing to read.
     */
@@ -1815,12 +2444,27 @@ AliasLoadMapped(int *num,
       goto cleanup;
    }
 
+   if (NULL != index) {
+      *index = ServiceAliasIndexMappedAliases(list.num, list.maList);
+   }
+
+#ifndef _WIN32
+   if (loadTime != 0) {
+      AliasStoreCacheAdd(mapFilename, &st, loadTime, TRUE,
+                         list.num, NULL, list.maList,
+                         (NULL != index) ? *index : NULL);
+   }
+#endif
+
 done:
    /*
     * We're just transferring the certs to the caller to free.
     */
    *num = list.num;
    *maList = list.maList;
+   if (NULL != index && NULL == *index) {
+      *index = ServiceAliasIndexMappedAliases(list.num, list.maList);
+   }
    err = VGAUTH_E_OK;
 
 cleanup:
@@ -2027,6 +2671,7 @@ AliasSaveAliasesAndMapped(const gchar *userName,
    int fd;
    gchar *tmpAliasFilename = NULL;
    gchar *tmpMapFilename = NULL;
+   gchar *cachedFilename;
    int rc;
    gboolean emptyAliasFile = (num == 0);
 
@@ -2346,6 +2991,21 @@ cleanup:
    }
 
 done:
+   /*
+    * Whatever happened above, drop the parsed copies of the files that may
+    * have been replaced.  The next load re-reads them.
+    */
+   cachedFilename = ServiceUserNameToAliasStoreFileName(userName);
+   AliasStoreCacheInvalidate(cachedFilename);
+   g_free(cachedFilename);
+   if (updateMap) {
+      cachedFilename = g_strdup_printf("%s"DIRSEP"%s",
+                                       aliasStoreRootDir,
+                                       ALIASSTORE_MAPFILE_NAME);
+      AliasStoreCacheInvalidate(cachedFilename);
+      g_free(cachedFilename);
+   }
+
    g_free(tmpAliasFilename);
    g_free(tmpMapFilename);
    return err;
@@ -2559,7 +3219,7 @@ ServiceAliasAddAlias(const gchar *reqUserName,
    /*
     * Load any that already exist.
     */
-   err = AliasLoadAliases(userName, &num, &aList);
+   err = AliasLoadAliases(userName, &num, &aList, NULL);
    if (VGAUTH_E_OK != err) {
       return err;
    }
@@ -2619,7 +3279,7 @@ ServiceAliasAddAlias(const gchar *reqUserName,
 
 check_map:
    if (addMapped) {
-      err = AliasLoadMapped(&numMapped, &maList);
+      err = AliasLoadMapped(&numMapped, &maList, NULL);
 
       /*
        * Do a dup check -- be sure the cert/subject combo
@@ -2795,7 +3455,7 @@ ServiceAliasRemoveAlias(const gchar *reqUserName,
    /*
     * Load user's store.
     */
-   err = AliasLoadAliases(userName, &numIds, &aList);
+   err = AliasLoadAliases(userName, &numIds, &aList, NULL);
    if (VGAUTH_E_OK != err) {
       return err;
    }
@@ -2869,7 +3529,7 @@ ServiceAliasRemoveAlias(const gchar *reqUserName,
    /*
     * Now clear out any mapped alias.  This may fail to find a match.
     */
-   err = AliasLoadMapped(&numMapped, &maList);
+   err = AliasLoadMapped(&numMapped, &maList, NULL);
    if (VGAUTH_E_OK != err) {
       goto done;
    }
@@ -2974,6 +3634,11 @@ done:
  * @param[in]   userName        The user whose store is to be used.
  * @param[out]  num             The number of entries being returned.
  * @param[out]  aList           The entries being returned.
+ * @param[out]  index           Optional.  A fingerprint index of @a aList
+ *                              for ServiceAliasLookupCertIndex().  It is
+ *                              only rebuilt when the store changes and must
+ *                              not be modified.  Release it with
+ *                              g_hash_table_unref().
  *
  * @return VGAUTH_E_OK on success, VGAuthError on failure
  *
@@ -2983,7 +3648,8 @@ done:
 VGAuthError
 ServiceAliasQueryAliases(const gchar *userName,
                          int *num,
-                         ServiceAlias **aList)
+                         ServiceAlias **aList,
+                         GHashTable **index)
 {
    VGAuthError err;
 
@@ -3006,7 +3672,7 @@ ServiceAliasQueryAliases(const gchar *userName,
    }
 #endif
 
-   err = AliasLoadAliases(userName, num, aList);
+   err = AliasLoadAliases(userName, num, aList, index);
    if (VGAUTH_E_OK != err) {
       Warning("%s: failed to load Aliases for '%s'\n", __FUNCTION__, userName);
    }
@@ -3023,6 +3689,11 @@ ServiceAliasQueryAliases(const gchar *userName,
  *
  * @param[out]  num             The number of entries being returned.
  * @param[out]  maList          The ServiceMappedAliases being returned.
+ * @param[out]  index           Optional.  A fingerprint index of @a maList
+ *                              for ServiceAliasLookupCertIndex().  It is
+ *                              only rebuilt when the mapping file changes
+ *                              and must not be modified.  Release it with
+ *                              g_hash_table_unref().
  *
  * @return VGAUTH_E_OK on success, VGAuthError on failure
  *
@@ -3031,14 +3702,15 @@ ServiceAliasQueryAliases(const gchar *userName,
 
 VGAuthError
 ServiceAliasQueryMappedAliases(int *num,
-                               ServiceMappedAlias **maList)
+                               ServiceMappedAlias **maList,
+                               GHashTable **index)
 {
    VGAuthError err;
 
    *num = 0;
    *maList = NULL;
 
-   err = AliasLoadMapped(num, maList);
+   err = AliasLoadMapped(num, maList, index);
    if (VGAUTH_E_OK != err) {
       Warning("%s: failed to load mapped aliases\n", __FUNCTION__);
    }
@@ -3177,7 +3849,7 @@ ServiceValidateAliases(void)
    int l;
    gboolean foundMatch;
 
-   err = AliasLoadMapped(&numMapped, &maList);
+   err = AliasLoadMapped(&numMapped, &maList, NULL);
    if (VGAUTH_E_OK != err) {
       goto done;
    }
@@ -3190,7 +3862,7 @@ ServiceValidateAliases(void)
    for (i = 0; i < numMapped; i++) {
       foundMatch = FALSE;
       badSubj = NULL;
-      err = AliasLoadAliases(maList[i].userName, &numIds, &aList);
+      err = AliasLoadAliases(maList[i].userName, &numIds, &aList, NULL);
       if (err != VGAUTH_E_OK) {
          Warning("%s: Failed to load alias for user '%s'\n",
                  __FUNCTION__, maList[i].userName);
@@ -33,6 +33,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <string.h>
 #include "serviceInt.h"
 #include "VGAuthProto.h"
 
@@ -355,7 +356,12 @@ ServiceNetworkReadData(ServiceConnection *conn,
       return VGAUTH_E_COMM;
    }
 
-   *data = g_strndup(buf, ret);
+   /*
+    * A binary request can contain NULs; keep every byte.
+    */
+   *data = g_malloc(ret + 1);
+   memcpy(*data, buf, ret);
+   (*data)[ret] = '\0';
    *len = ret;
 
    return err;
@@ -30,6 +30,7 @@
 #include "VGAuthLog.h"
 #include "serviceInt.h"
 #include "VGAuthProto.h"
+#include "protoBinary.h"
 #ifdef _WIN32
 #include "winToken.h"
 #include "winDupHandle.h"
@@ -90,6 +91,10 @@ struct ProtoRequest {
    gboolean complete;
    int sequenceNumber;
 
+   gboolean started;          // some data has been read
+   gboolean binary;           // sent as a binary frame; reply the same way
+   GByteArray *frame;         // the binary frame read so far
+
    ProtoRequestType reqType;
 
    ProtoParseState parseState;
@@ -156,6 +161,31 @@ struct ProtoRequest {
 };
 
 
+/*
+ * A ValidateSamlBearerToken request handed off to a worker thread.
+ */
+struct ProtoSamlVerify {
+   ServiceConnection *conn;      // NULL once the connection is gone
+   ProtoRequest *req;
+
+   VGAuthError err;
+   char *userName;
+   char *subjectName;
+   ServiceAliasInfo *ai;
+};
+
+/*
+ * Threads verifying SAML tokens, so a slow verification doesn't hold up
+ * the main loop.
+ */
+static GThreadPool *samlVerifyPool = NULL;
+
+/*
+ * Validations whose reply has yet to be sent from the main loop.
+ */
+static GAsyncQueue *samlVerifyDoneQueue = NULL;
+
+
 static VGAuthError ServiceProtoValidateSamlBearerToken(ServiceConnection *conn,
                                                        ProtoRequest *req);
 
@@ -989,6 +1019,10 @@ Proto_FreeRequest(ProtoRequest *req)
    g_free(req->rawData);
 #endif
 
+   if (NULL != req->frame) {
+      g_byte_array_free(req->frame, TRUE);
+   }
+
    switch (req->reqType) {
    case PROTO_REQUEST_UNKNOWN:
       // partial/empty request -- no-op
@@ -1065,13 +1099,93 @@ Proto_SanityCheckRequest(ProtoRequest *request)
     * care about sequence numbers, or matching a request to a reply.
     */
 #if VGAUTH_PROTO_TRACE
-   ASSERT(strncmp(request->rawData, VGAUTH_XML_PREAMBLE,
+   ASSERT(request->binary ||
+          strncmp(request->rawData, VGAUTH_XML_PREAMBLE,
                   strlen(VGAUTH_XML_PREAMBLE)) == 0);
 #endif
    return VGAUTH_E_OK;
 }
 
 
+/*
+ ******************************************************************************
+ * Proto_ParseBinaryRequest --                                           */ /**
+ *
+ * Adds data to a binary request, and decodes the request once the whole
+ * frame has arrived.  Only ValidateTicket and QueryMappedAliases can be
+ * sent this way.
+ *
+ * @param[in]  req           The request being read.
+ * @param[in]  data          The data just read.
+ * @param[in]  len           The length of the data.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+Proto_ParseBinaryRequest(ProtoRequest *req,
+                         const gchar *data,
+                         gsize len)
+{
+   VGAuthError err;
+   ProtoBinaryReader reader;
+   gboolean complete;
+   guint8 opcode;
+   guint32 seqNo;
+   guint16 tag;
+   const guint8 *value;
+   guint32 valueLen;
+
+   g_byte_array_append(req->frame, (const guint8 *) data, len);
+
+   err = ProtoBinary_CheckFrame(req->frame->data, req->frame->len,
+                                &complete, &opcode, &seqNo);
+   if (err != VGAUTH_E_OK || !complete) {
+      return err;
+   }
+
+   switch (opcode) {
+   case VGAUTH_BINARY_OP_VALIDATETICKET:
+      req->reqType = PROTO_REQUEST_VALIDATETICKET;
+      break;
+   case VGAUTH_BINARY_OP_QUERYMAPPEDALIASES:
+      req->reqType = PROTO_REQUEST_QUERYMAPPEDALIASES;
+      break;
+   default:
+      Warning("%s: unsupported binary request opcode %d\n",
+              __FUNCTION__, opcode);
+      return VGAUTH_E_COMM;
+   }
+   req->sequenceNumber = seqNo;
+
+   ProtoBinary_InitReader(&reader, req->frame->data, req->frame->len);
+   while ((err = ProtoBinary_NextTLV(&reader, &tag,
+                                     &value, &valueLen)) == VGAUTH_E_OK &&
+          tag != 0) {
+      if (PROTO_REQUEST_VALIDATETICKET == req->reqType &&
+          VGAUTH_BINARY_TAG_TICKET == tag) {
+         g_free(req->reqData.validateTicket.ticket);
+         req->reqData.validateTicket.ticket =
+            ProtoBinary_GetString(value, valueLen);
+         if (NULL == req->reqData.validateTicket.ticket) {
+            err = VGAUTH_E_COMM;
+            break;
+         }
+      }
+   }
+   if (err != VGAUTH_E_OK) {
+      Warning("%s: malformed binary request\n", __FUNCTION__);
+      return err;
+   }
+
+   req->complete = TRUE;
+
+   return VGAUTH_E_OK;
+}
+
+
 /*
  ******************************************************************************
  * ServiceProtoReadAndProcessRequest --                                  */ /**
@@ -1124,24 +1238,42 @@ ServiceProtoReadAndProcessRequest(ServiceConnection *conn)
       if (err != VGAUTH_E_OK) {
          goto abort;
       }
-#if VGAUTH_PROTO_TRACE
-      if (req->rawData) {
-         req->rawData = g_strdup_printf("%s%s", req->rawData, data);
-      } else {
-         req->rawData = g_strdup(data);
+
+      /*
+       * The first byte tells a binary frame from an XML document.
+       */
+      if (!req->started && ProtoBinary_IsFrame(data, len)) {
+         req->binary = TRUE;
+         req->frame = g_byte_array_new();
       }
+      req->started = TRUE;
+
+      if (req->binary) {
+         err = Proto_ParseBinaryRequest(req, data, len);
+         g_free(data);
+         if (err != VGAUTH_E_OK) {
+            goto abort;
+         }
+      } else {
+#if VGAUTH_PROTO_TRACE
+         if (req->rawData) {
+            req->rawData = g_strdup_printf("%s%s", req->rawData, data);
+         } else {
+            req->rawData = g_strdup(data);
+         }
 #endif
-      bRet = g_markup_parse_context_parse(conn->parseContext,
-                                          data,
-                                          len,
-                                          &gErr);
-      g_free(data);
-      if (!bRet) {
-         err = VGAUTH_E_COMM;
-         Warning("%s: g_markup_parse_context_parse() failed: %s\n",
-                 __FUNCTION__, gErr->message);
-         g_error_free(gErr);
-         goto abort;
+         bRet = g_markup_parse_context_parse(conn->parseContext,
+                                             data,
+                                             len,
+                                             &gErr);
+         g_free(data);
+         if (!bRet) {
+            err = VGAUTH_E_COMM;
+            Warning("%s: g_markup_parse_context_parse() failed: %s\n",
+                    __FUNCTION__, gErr->message);
+            g_error_free(gErr);
+            goto abort;
+         }
       }
    }
 
@@ -1155,6 +1287,16 @@ ServiceProtoReadAndProcessRequest(ServiceConnection *conn)
          Warning("%s: request sanity check failed\n", __FUNCTION__);
       }
 
+      /*
+       * Clients wait for the reply before sending the next request, so
+       * nothing should arrive while a token is being verified.
+       */
+      if (err == VGAUTH_E_OK && conn->pendingVerify != NULL) {
+         Warning("%s: request received while another is in progress "
+                 "on connection %d\n", __FUNCTION__, conn->connId);
+         err = VGAUTH_E_COMM;
+      }
+
       // only try to handle it if the sanity check passed
       if (err == VGAUTH_E_OK) {
          err = ServiceProtoDispatchRequest(conn, req);
@@ -1340,10 +1482,51 @@ Proto_MakeErrorReply(ServiceConnection *conn,
                      VGAuthError err,
                      const char *errMsg)
 {
+   if (req->binary) {
+      GByteArray *frame;
+      gsize len;
+
+      frame = ProtoBinary_NewFrame(VGAUTH_BINARY_OP_ERROR,
+                                   req->sequenceNumber);
+      ProtoBinary_AddUint64(frame, VGAUTH_BINARY_TAG_ERRORCODE, err);
+      ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_ERRORMSG, errMsg);
+
+      Log("Returning error "VGAUTHERR_FMT64" '%s'\n", err, errMsg);
+
+      return ProtoBinary_FinishFrame(frame, &len);
+   }
+
    return ProtoMakeErrorReplyInt(conn, req->sequenceNumber, err, errMsg);
 }
 
 
+/*
+ ******************************************************************************
+ * Proto_SendReply --                                                    */ /**
+ *
+ * Sends a reply built for the request, which is a binary frame if the
+ * request was, and an XML string otherwise.
+ *
+ * @param[in]   conn          The ServiceConnection.
+ * @param[in]   req           The request being answered.
+ * @param[in]   packet        The reply.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+Proto_SendReply(ServiceConnection *conn,
+                ProtoRequest *req,
+                gchar *packet)
+{
+   gsize len = req->binary ? ProtoBinary_FrameLength(packet) : strlen(packet);
+
+   return ServiceNetworkWriteData(conn, len, packet);
+}
+
+
 /*
  ******************************************************************************
  * ServiceProtoDispatchRequest --                                        */ /**
@@ -1468,7 +1651,7 @@ sendError:
        * Don't really care if it works since we're about to
        * shut it down anyways.
        */
-      (void) ServiceNetworkWriteData(conn, strlen(packet), packet);
+      (void) Proto_SendReply(conn, req, packet);
       g_free(packet);
       break;
    }
@@ -1505,19 +1688,21 @@ ServiceProtoHandleSessionRequest(ServiceConnection *conn,
    VGAuthError err;
    gchar *packet;
    gchar *pipeName = NULL;
+   int version;
 
    /*
-    * Do any argument checking.  For now, the version number must
-    * match.
+    * Do any argument checking.  The client asks for the newest version
+    * it speaks; we answer with the version we'll use, which is the
+    * client's unless it's newer than ours.
     */
-
-   if (req->reqData.sessionReq.version != atoi(VGAUTH_PROTOCOL_VERSION)) {
-      err = VGAUTH_E_VERSION_MISMATCH;
+   version = req->reqData.sessionReq.version;
+   if (version > atoi(VGAUTH_PROTOCOL_VERSION_BINARY)) {
+      version = atoi(VGAUTH_PROTOCOL_VERSION_BINARY);
+   } else if (version < atoi(VGAUTH_PROTOCOL_VERSION)) {
       Warning("%s: version mismatch.  Client is %d, want %d\n",
               __FUNCTION__, req->reqData.sessionReq.version,
               atoi(VGAUTH_PROTOCOL_VERSION));
-      packet = Proto_MakeErrorReply(conn, req, err,
-                                    "sessionRequest failed; version mismatch");
+      version = atoi(VGAUTH_PROTOCOL_VERSION);
    }
 
    err = ServiceStartUserConnection(req->reqData.sessionReq.userName,
@@ -1527,6 +1712,7 @@ ServiceProtoHandleSessionRequest(ServiceConnection *conn,
    } else {
       packet = g_markup_printf_escaped(VGAUTH_SESSION_REPLY_FORMAT,
                                        req->sequenceNumber,
+                                       version,
                                        pipeName);
    }
 
@@ -1753,7 +1939,8 @@ ServiceProtoQueryAliases(ServiceConnection *conn,
     */
    err = ServiceAliasQueryAliases(req->reqData.queryAliases.userName,
                                   &num,
-                                  &aList);
+                                  &aList,
+                                  NULL);
 
    if (err != VGAUTH_E_OK) {
       packet = Proto_MakeErrorReply(conn, req, err, "queryAliases failed");
@@ -1838,10 +2025,38 @@ ServiceProtoQueryMappedAliases(ServiceConnection *conn,
     * The alias code will do argument validation.
     */
    err = ServiceAliasQueryMappedAliases(&num,
-                                        &maList);
+                                        &maList,
+                                        NULL);
 
    if (err != VGAUTH_E_OK) {
       packet = Proto_MakeErrorReply(conn, req, err, "queryMappedIds failed");
+   } else if (req->binary) {
+      GByteArray *frame;
+      gsize len;
+
+      frame = ProtoBinary_NewFrame(VGAUTH_BINARY_OP_QUERYMAPPEDALIASES,
+                                   req->sequenceNumber);
+      for (i = 0; i < num; i++) {
+         ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_MAPPEDALIAS, NULL);
+         ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_USERNAME,
+                               maList[i].userName);
+         ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_PEMCERT,
+                               maList[i].pemCert);
+         for (j = 0; j < maList[i].num; j++) {
+            if (maList[i].subjects[j].type == SUBJECT_TYPE_ANY) {
+               ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_ANYSUBJECT,
+                                     NULL);
+            } else if (maList[i].subjects[j].type == SUBJECT_TYPE_NAMED) {
+               ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_SUBJECT,
+                                     maList[i].subjects[j].name);
+            } else {
+               ASSERT(0);
+            }
+         }
+      }
+      packet = ProtoBinary_FinishFrame(frame, &len);
+
+      ServiceAliasFreeMappedAliasList(num, maList);
    } else {
       packet = g_markup_printf_escaped(VGAUTH_QUERYMAPPEDALIASES_REPLY_FORMAT_START,
                                        req->sequenceNumber);
@@ -1875,7 +2090,7 @@ ServiceProtoQueryMappedAliases(ServiceConnection *conn,
       ServiceAliasFreeMappedAliasList(num, maList);
    }
 
-   err = ServiceNetworkWriteData(conn, strlen(packet), packet);
+   err = Proto_SendReply(conn, req, packet);
    if (err != VGAUTH_E_OK) {
       Warning("%s: failed to send QueryAliases reply\n", __FUNCTION__);
    }
@@ -1992,6 +2207,29 @@ ServiceProtoValidateTicket(ServiceConnection *conn,
 
    if (err != VGAUTH_E_OK) {
       packet = Proto_MakeErrorReply(conn, req, err, "validateTicket failed");
+   } else if (req->binary) {
+      GByteArray *frame;
+      gsize len;
+
+      frame = ProtoBinary_NewFrame(VGAUTH_BINARY_OP_VALIDATETICKET,
+                                   req->sequenceNumber);
+      ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_USERNAME, userName);
+      ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_TOKEN, token);
+      ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_USERHANDLETYPE,
+                            ProtoValidationTypeString(type));
+      if (VALIDATION_RESULTS_TYPE_SAML == type) {
+         ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_SAMLSUBJECT,
+                               svd->samlSubject);
+         if (SUBJECT_TYPE_NAMED == svd->aliasInfo.type) {
+            ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_SUBJECT,
+                                  svd->aliasInfo.name);
+         } else {
+            ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_ANYSUBJECT, NULL);
+         }
+         ProtoBinary_AddString(frame, VGAUTH_BINARY_TAG_COMMENT,
+                               svd->aliasInfo.comment);
+      }
+      packet = ProtoBinary_FinishFrame(frame, &len);
    } else {
       packet = g_markup_printf_escaped(VGAUTH_VALIDATETICKET_REPLY_FORMAT_START,
                                        req->sequenceNumber,
@@ -2017,7 +2255,7 @@ ServiceProtoValidateTicket(ServiceConnection *conn,
       packet = Proto_ConcatXMLStrings(packet, g_strdup(VGAUTH_VALIDATETICKET_REPLY_FORMAT_END));
    }
 
-   err = ServiceNetworkWriteData(conn, strlen(packet), packet);
+   err = Proto_SendReply(conn, req, packet);
    if (err != VGAUTH_E_OK) {
       VGAUTH_LOG_WARNING("ServiceNetWorkWriteData() failed, pipe = %s",
                          conn->pipeName);
@@ -2079,13 +2317,17 @@ ServiceProtoRevokeTicket(ServiceConnection *conn,
 
 /*
  ******************************************************************************
- * ServiceProtoValidateSamlBearerToken --                                */ /**
+ * ServiceProtoSendSamlBearerTokenReply --                               */ /**
  *
- * Protocol layer for ValidateSamlBearerToken.  Calls to validate code
- * to validate the token, sends reply.
+ * Sends the reply to a ValidateSamlBearerToken request once the token
+ * has been validated.
  *
  * @param[in]   conn          The ServiceConnection.
- * @param[in]   req           The ValidateSamlToken request to process.
+ * @param[in]   req           The ValidateSamlToken request being answered.
+ * @param[in]   err           The result of the validation.
+ * @param[in]   userName      The user the token authenticated as.
+ * @param[in]   subjectName   The subject in the token.
+ * @param[in]   ai            The alias info used to verify the token.
  *
  * @return VGAUTH_E_OK on success, VGAuthError on failure
  *
@@ -2093,26 +2335,17 @@ ServiceProtoRevokeTicket(ServiceConnection *conn,
  */
 
 static VGAuthError
-ServiceProtoValidateSamlBearerToken(ServiceConnection *conn,
-                                    ProtoRequest *req)
+ServiceProtoSendSamlBearerTokenReply(ServiceConnection *conn,
+                                     ProtoRequest *req,
+                                     VGAuthError err,
+                                     const char *userName,
+                                     const char *subjectName,
+                                     const ServiceAliasInfo *ai)
 {
-   VGAuthError err = VGAUTH_E_FAIL;
    gchar *packet;
    gchar *sPacket;
-   char *userName = NULL;
-   char *subjectName = NULL;
-   char *comment = NULL;
    char *tokenStr = NULL;
-   ServiceAliasInfo *ai = NULL;
 
-   /*
-    * The validate code will do argument validation.
-    */
-   err = SAML_VerifyBearerTokenAndChain(req->reqData.validateSamlBToken.samlToken,
-                                        req->reqData.validateSamlBToken.userName,
-                                        &userName,
-                                        &subjectName,
-                                        &ai);
 #ifdef _WIN32
    /*
     * Only create a token in the non-info-only mode
@@ -2189,17 +2422,295 @@ ServiceProtoValidateSamlBearerToken(ServiceConnection *conn,
    }
 
 done:
-   g_free(userName);
-   g_free(subjectName);
    g_free(packet);
-   g_free(comment);
    g_free(tokenStr);
+
+   return err;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoSamlVerifyFree --                                         */ /**
+ *
+ * Frees a ProtoSamlVerify and the request it holds.
+ *
+ * @param[in]   verify        The ProtoSamlVerify to free.
+ *
+ ******************************************************************************
+ */
+
+static void
+ServiceProtoSamlVerifyFree(ProtoSamlVerify *verify)
+{
+   g_free(verify->userName);
+   g_free(verify->subjectName);
+   ServiceAliasFreeAliasInfo(verify->ai);
+   Proto_FreeRequest(verify->req);
+   g_free(verify);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoSamlVerifyDone --                                         */ /**
+ *
+ * Sends the reply for a validated token, unless the connection went away
+ * in the meantime.
+ *
+ * @param[in]   verify        The ProtoSamlVerify.  It is freed.
+ *
+ ******************************************************************************
+ */
+
+static void
+ServiceProtoSamlVerifyDone(ProtoSamlVerify *verify)
+{
+   ServiceConnection *conn = verify->conn;
+   VGAuthError err;
+
+   if (NULL == conn) {
+      Debug("%s: connection closed before the SAML token was validated\n",
+            __FUNCTION__);
+      ServiceProtoSamlVerifyFree(verify);
+      return;
+   }
+
+   conn->pendingVerify = NULL;
+   err = ServiceProtoSendSamlBearerTokenReply(conn, verify->req, verify->err,
+                                              verify->userName,
+                                              verify->subjectName,
+                                              verify->ai);
+   Log("%s: processed reqType %d(%s REQ), returning "
+       VGAUTHERR_FMT64" on connection %d\n", __FUNCTION__,
+       verify->req->reqType, ProtoRequestTypeText(verify->req->reqType),
+       err, conn->connId);
+   ServiceProtoSamlVerifyFree(verify);
+
+   if (err != VGAUTH_E_OK) {
+      ServiceConnectionShutdown(conn);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoSamlVerifyDispatch --                                     */ /**
+ *
+ * Main loop callback run once a worker thread has validated a token.
+ * Takes the next validation off the done queue and replies to it.
+ *
+ * @param[in]   userData      Unused.
+ *
+ * @return FALSE, so the callback is not run again.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ServiceProtoSamlVerifyDispatch(gpointer userData)
+{
+   ProtoSamlVerify *verify = g_async_queue_try_pop(samlVerifyDoneQueue);
+
+   /* ServiceProtoStopVerifyThreads() may have replied already */
+   if (NULL != verify) {
+      ServiceProtoSamlVerifyDone(verify);
+   }
+
+   return FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoSamlVerifyWorker --                                       */ /**
+ *
+ * GThreadPool function validating a SAML token off the main loop.
+ *
+ * @param[in]   data          The ProtoSamlVerify.
+ * @param[in]   userData      Unused.
+ *
+ ******************************************************************************
+ */
+
+static void
+ServiceProtoSamlVerifyWorker(gpointer data,
+                             gpointer userData)
+{
+   ProtoSamlVerify *verify = (ProtoSamlVerify *) data;
+   ProtoRequest *req = verify->req;
+
+   verify->err =
+      SAML_VerifyBearerTokenAndChain(req->reqData.validateSamlBToken.samlToken,
+                                     req->reqData.validateSamlBToken.userName,
+                                     &verify->userName,
+                                     &verify->subjectName,
+                                     &verify->ai);
+
+   g_async_queue_push(samlVerifyDoneQueue, verify);
+   g_idle_add_full(G_PRIORITY_DEFAULT, ServiceProtoSamlVerifyDispatch,
+                   NULL, NULL);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoGetVerifyPool --                                          */ /**
+ *
+ * Returns the pool of SAML verification threads, creating it or updating
+ * its size from the prefs as needed.
+ *
+ * @return The thread pool, or NULL if tokens are to be validated on the
+ *         main loop.
+ *
+ ******************************************************************************
+ */
+
+static GThreadPool *
+ServiceProtoGetVerifyPool(void)
+{
+   int numThreads = SAML_GetVerifyThreads();
+   GError *gErr = NULL;
+
+   if (numThreads <= 0) {
+      return NULL;
+   }
+
+   if (NULL == samlVerifyDoneQueue) {
+      samlVerifyDoneQueue = g_async_queue_new();
+   }
+
+   if (NULL == samlVerifyPool) {
+      samlVerifyPool = g_thread_pool_new(ServiceProtoSamlVerifyWorker, NULL,
+                                         numThreads, FALSE, &gErr);
+      if (NULL == samlVerifyPool) {
+         Warning("%s: g_thread_pool_new() failed: %s\n", __FUNCTION__,
+                 gErr->message);
+         g_error_free(gErr);
+      }
+   } else if (g_thread_pool_get_max_threads(samlVerifyPool) != numThreads) {
+      g_thread_pool_set_max_threads(samlVerifyPool, numThreads, NULL);
+   }
+
+   return samlVerifyPool;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoValidateSamlBearerToken --                                */ /**
+ *
+ * Protocol layer for ValidateSamlBearerToken.  Calls to validate code
+ * to validate the token, sends reply.
+ *
+ * Validation is done by a worker thread when there are any, in which
+ * case the connection takes ownership of the request and the reply is
+ * sent later from the main loop.
+ *
+ * @param[in]   conn          The ServiceConnection.
+ * @param[in]   req           The ValidateSamlToken request to process.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+ServiceProtoValidateSamlBearerToken(ServiceConnection *conn,
+                                    ProtoRequest *req)
+{
+   VGAuthError err = VGAUTH_E_FAIL;
+   char *userName = NULL;
+   char *subjectName = NULL;
+   ServiceAliasInfo *ai = NULL;
+   GThreadPool *pool;
+   ProtoSamlVerify *verify;
+
+   pool = ServiceProtoGetVerifyPool();
+   if (NULL != pool) {
+      ASSERT(conn->curRequest == req);
+      ASSERT(conn->pendingVerify == NULL);
+
+      verify = g_new0(ProtoSamlVerify, 1);
+      verify->conn = conn;
+      verify->req = req;
+      conn->curRequest = NULL;
+      conn->pendingVerify = verify;
+
+      g_thread_pool_push(pool, verify, NULL);
+      return VGAUTH_E_OK;
+   }
+
+   /*
+    * The validate code will do argument validation.
+    */
+   err = SAML_VerifyBearerTokenAndChain(req->reqData.validateSamlBToken.samlToken,
+                                        req->reqData.validateSamlBToken.userName,
+                                        &userName,
+                                        &subjectName,
+                                        &ai);
+   err = ServiceProtoSendSamlBearerTokenReply(conn, req, err, userName,
+                                              subjectName, ai);
+
+   g_free(userName);
+   g_free(subjectName);
    ServiceAliasFreeAliasInfo(ai);
 
    return err;
 }
 
 
+/*
+ ******************************************************************************
+ * ServiceProtoAbandonPendingRequest --                                  */ /**
+ *
+ * Detaches a connection that is going away from the token validation it
+ * is waiting for.  The result is then discarded.
+ *
+ * @param[in]  conn                       The connection.
+ *
+ ******************************************************************************
+ */
+
+void
+ServiceProtoAbandonPendingRequest(ServiceConnection *conn)
+{
+   if (NULL != conn->pendingVerify) {
+      conn->pendingVerify->conn = NULL;
+      conn->pendingVerify = NULL;
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoStopVerifyThreads --                                      */ /**
+ *
+ * Stops the SAML verification threads.  Queued validations are still
+ * run, and the replies that the main loop did not get to send yet are
+ * sent here, so no request is left without an answer.
+ *
+ ******************************************************************************
+ */
+
+void
+ServiceProtoStopVerifyThreads(void)
+{
+   ProtoSamlVerify *verify;
+
+   if (NULL != samlVerifyPool) {
+      g_thread_pool_free(samlVerifyPool, FALSE, TRUE);
+      samlVerifyPool = NULL;
+   }
+
+   if (NULL != samlVerifyDoneQueue) {
+      while (NULL != (verify = g_async_queue_try_pop(samlVerifyDoneQueue))) {
+         ServiceProtoSamlVerifyDone(verify);
+      }
+   }
+}
+
+
 /*
  ******************************************************************************
  * ServiceProtoCleanupParseState --                                      */ /**
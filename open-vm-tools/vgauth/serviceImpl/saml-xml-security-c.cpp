@@ -384,6 +384,27 @@ SAML_Reload()
 }
 
 
+/*
+ ******************************************************************************
+ * SAML_GetVerifyThreads --                                              */ /**
+ *
+ * Returns how many threads may verify tokens at the same time.
+ *
+ * The shared grammar pool is replaced by SAML_Reload() without any
+ * locking, so tokens are always verified on the main loop.
+ *
+ * @return 0.
+ *
+ ******************************************************************************
+ */
+
+int
+SAML_GetVerifyThreads(void)
+{
+   return 0;
+}
+
+
 /*
  ******************************************************************************
  * SAMLLoadSchema --                                                     */ /**
@@ -47,7 +47,36 @@
 
 static int gClockSkewAdjustment = VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS;
 static xmlSchemaPtr gParsedSchemas = NULL;
-static xmlSchemaValidCtxtPtr gSchemaValidateCtx = NULL;
+
+/*
+ * Tokens may be verified by several threads at once.  The schemas and the
+ * catalog are only replaced while no verification is running.
+ */
+static GRWLock gSchemaLock;
+
+static int gVerifyThreads = VGAUTH_PREF_DEFAULT_SAML_VERIFY_THREADS;
+
+/*
+ * Tokens that passed verification, keyed by the SHA-256 of their text.
+ *
+ * Only what depends on the token alone (schema, Subject, Conditions and
+ * signature) is remembered.  The trust check of the cert chain against the
+ * alias store is always redone, so alias and cert changes take effect
+ * immediately.
+ */
+typedef struct SAMLTokenCacheEntry {
+   glong expireTime;
+   gchar *subject;
+   int numCerts;
+   gchar **certChain;
+} SAMLTokenCacheEntry;
+
+static GHashTable *gTokenCache = NULL;
+static int gTokenCacheSize = VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE;
+static int gTokenCacheTTL = VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_TTL;
+G_LOCK_DEFINE_STATIC(gTokenCache);
+
+static void TokenCacheFlush(void);
 
 #define CATALOG_FILENAME            "catalog.xml"
 #define SAML_SCHEMA_FILENAME        "saml-schema-assertion-2.0.xsd"
@@ -238,20 +267,6 @@ LoadCatalogAndSchema(void)
       goto done;
    }
 
-   /*
-    * Set up the validaton context for later use.
-    */
-   gSchemaValidateCtx = xmlSchemaNewValidCtxt(gParsedSchemas);
-   if (NULL == gSchemaValidateCtx) {
-      g_warning("Failed to create schema validation context\n");
-      retVal = FALSE;
-      goto done;
-   }
-   xmlSchemaSetValidErrors(gSchemaValidateCtx,
-                           XmlErrorHandler,
-                           XmlErrorHandler,
-                           NULL);
-
    retVal = TRUE;
 done:
    if (NULL != ctx) {
@@ -277,10 +292,6 @@ done:
 static void
 FreeSchemas(void)
 {
-   if (NULL != gSchemaValidateCtx) {
-      xmlSchemaFreeValidCtxt(gSchemaValidateCtx);
-      gSchemaValidateCtx = NULL;
-   }
    if (NULL != gParsedSchemas) {
       xmlSchemaFree(gParsedSchemas);
       gParsedSchemas = NULL;
@@ -305,6 +316,16 @@ LoadPrefs(void)
                                       VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS);
     Log("%s: Allowing %d of clock skew for SAML date validation\n",
         __FUNCTION__, gClockSkewAdjustment);
+
+   gTokenCacheSize = Pref_GetInt(gPrefs, VGAUTH_PREF_SAML_TOKEN_CACHE_SIZE,
+                                 VGAUTH_PREF_GROUP_NAME_SERVICE,
+                                 VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE);
+   gTokenCacheTTL = Pref_GetInt(gPrefs, VGAUTH_PREF_SAML_TOKEN_CACHE_TTL,
+                                VGAUTH_PREF_GROUP_NAME_SERVICE,
+                                VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_TTL);
+   gVerifyThreads = Pref_GetInt(gPrefs, VGAUTH_PREF_SAML_VERIFY_THREADS,
+                                VGAUTH_PREF_GROUP_NAME_SERVICE,
+                                VGAUTH_PREF_DEFAULT_SAML_VERIFY_THREADS);
 }
 
 
@@ -346,6 +367,14 @@ SAML_Init(void)
    /* set up the xml2 error handler */
    xmlSetGenericErrorFunc(NULL, XmlErrorHandler);
 
+   /*
+    * The settings above are per thread; make the verification
+    * threads start out with the same ones.
+    */
+   xmlThrDefLoadExtDtdDefaultValue(XML_DETECT_IDS | XML_COMPLETE_ATTRS);
+   xmlThrDefSubstituteEntitiesDefaultValue(1);
+   xmlThrDefSetGenericErrorFunc(NULL, XmlErrorHandler);
+
    /*
     * Load schemas
     */
@@ -431,6 +460,7 @@ SAML_Init(void)
 void
 SAML_Shutdown()
 {
+   TokenCacheFlush();
    FreeSchemas();
    xmlSecCryptoShutdown();
    xmlSecCryptoAppShutdown();
@@ -460,9 +490,37 @@ SAML_Shutdown()
 void
 SAML_Reload()
 {
+   g_rw_lock_writer_lock(&gSchemaLock);
    FreeSchemas();
    LoadPrefs();
    LoadCatalogAndSchema();
+
+   /*
+    * The schemas or the clock skew may have changed.  Flush before
+    * dropping the lock so no verification can run against the new state
+    * while results from the old one are still cached.
+    */
+   TokenCacheFlush();
+   g_rw_lock_writer_unlock(&gSchemaLock);
+}
+
+
+/*
+ ******************************************************************************
+ * SAML_GetVerifyThreads --                                              */ /**
+ *
+ * Returns how many threads may verify tokens at the same time.
+ *
+ * @return The number of verification threads.  0 means tokens must be
+ *         verified on the calling thread.
+ *
+ ******************************************************************************
+ */
+
+int
+SAML_GetVerifyThreads(void)
+{
+   return MAX(gVerifyThreads, 0);
 }
 
 
@@ -490,6 +548,213 @@ FreeCertArray(int num,
 }
 
 
+/*
+ ******************************************************************************
+ * CopyCertArray --                                                      */ /**
+ *
+ * Duplicates a simple array of pemCert.
+ *
+ * @param[in]  num      Number of certs in array.
+ * @param[in]  certs    Array of certs to copy.
+ *
+ * @return The copy.  Free with FreeCertArray().
+ *
+ ******************************************************************************
+ */
+
+static gchar **
+CopyCertArray(int num,
+              gchar **certs)
+{
+   gchar **copy;
+   int i;
+
+   copy = g_new0(gchar *, num + 1);
+   for (i = 0; i < num; i++) {
+      copy[i] = g_strdup(certs[i]);
+   }
+
+   return copy;
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheEntryFree --                                                */ /**
+ *
+ * Frees a token cache entry.
+ *
+ * @param[in]  data     The SAMLTokenCacheEntry to free.
+ *
+ ******************************************************************************
+ */
+
+static void
+TokenCacheEntryFree(gpointer data)
+{
+   SAMLTokenCacheEntry *entry = data;
+
+   g_free(entry->subject);
+   FreeCertArray(entry->numCerts, entry->certChain);
+   g_free(entry);
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheEntryExpired --                                             */ /**
+ *
+ * GHRFunc to drop the expired entries from the token cache.
+ *
+ * @param[in]  key       The token digest.
+ * @param[in]  value     The SAMLTokenCacheEntry.
+ * @param[in]  userData  Pointer to the current time in seconds.
+ *
+ * @return TRUE if the entry has expired.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+TokenCacheEntryExpired(gpointer key,
+                       gpointer value,
+                       gpointer userData)
+{
+   SAMLTokenCacheEntry *entry = value;
+
+   return entry->expireTime <= *(glong *) userData;
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheLookup --                                                   */ /**
+ *
+ * Looks up a previously verified token.
+ *
+ * @param[in]  key       The token digest.
+ * @param[out] subject   Subject of the token.  Caller must g_free().
+ * @param[out] numCerts  Number of certs in the token.
+ * @param[out] certChain Certs in the token.  Caller should g_free() array
+ *                       and contents.
+ *
+ * @return TRUE if the token was found and is still valid.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+TokenCacheLookup(const gchar *key,
+                 gchar **subject,
+                 int *numCerts,
+                 gchar ***certChain)
+{
+   SAMLTokenCacheEntry *entry;
+   GTimeVal now;
+   gboolean found = FALSE;
+
+   g_get_current_time(&now);
+
+   G_LOCK(gTokenCache);
+   if (NULL != gTokenCache) {
+      entry = g_hash_table_lookup(gTokenCache, key);
+      if (NULL != entry && entry->expireTime <= now.tv_sec) {
+         g_hash_table_remove(gTokenCache, key);
+      } else if (NULL != entry) {
+         *subject = g_strdup(entry->subject);
+         *numCerts = entry->numCerts;
+         *certChain = CopyCertArray(entry->numCerts, entry->certChain);
+         found = TRUE;
+      }
+   }
+   G_UNLOCK(gTokenCache);
+
+   return found;
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheAdd --                                                      */ /**
+ *
+ * Remembers a verified token until the given time.  When the cache is
+ * full, expired entries are dropped first; if that does not help the
+ * whole cache is flushed.
+ *
+ * @param[in]  key        The token digest.
+ * @param[in]  expireTime Time in seconds at which the token may no longer
+ *                        be trusted without verifying it again.
+ * @param[in]  subject    Subject of the token.
+ * @param[in]  numCerts   Number of certs in the token.
+ * @param[in]  certChain  Certs in the token.
+ *
+ ******************************************************************************
+ */
+
+static void
+TokenCacheAdd(const gchar *key,
+              glong expireTime,
+              const gchar *subject,
+              int numCerts,
+              gchar **certChain)
+{
+   SAMLTokenCacheEntry *entry;
+   GTimeVal now;
+
+   if (gTokenCacheSize <= 0) {
+      return;
+   }
+
+   g_get_current_time(&now);
+   if (expireTime <= now.tv_sec) {
+      return;
+   }
+
+   entry = g_new0(SAMLTokenCacheEntry, 1);
+   entry->expireTime = expireTime;
+   entry->subject = g_strdup(subject);
+   entry->numCerts = numCerts;
+   entry->certChain = CopyCertArray(numCerts, certChain);
+
+   G_LOCK(gTokenCache);
+   if (NULL == gTokenCache) {
+      gTokenCache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          g_free, TokenCacheEntryFree);
+   }
+   if (g_hash_table_size(gTokenCache) >= gTokenCacheSize) {
+      g_hash_table_foreach_remove(gTokenCache, TokenCacheEntryExpired,
+                                  &now.tv_sec);
+      if (g_hash_table_size(gTokenCache) >= gTokenCacheSize) {
+         g_debug("%s: token cache full, flushing\n", __FUNCTION__);
+         g_hash_table_remove_all(gTokenCache);
+      }
+   }
+   g_hash_table_replace(gTokenCache, g_strdup(key), entry);
+   G_UNLOCK(gTokenCache);
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheFlush --                                                    */ /**
+ *
+ * Forgets all verified tokens.
+ *
+ ******************************************************************************
+ */
+
+static void
+TokenCacheFlush(void)
+{
+   G_LOCK(gTokenCache);
+   if (NULL != gTokenCache) {
+      g_hash_table_destroy(gTokenCache);
+      gTokenCache = NULL;
+   }
+   G_UNLOCK(gTokenCache);
+}
+
+
 /*
  ******************************************************************************
  * FindAttrValue --                                                      */ /**
@@ -688,12 +953,33 @@ FindAllNodesByName(xmlNodePtr root,
 static gboolean
 ValidateDoc(xmlDocPtr doc)
 {
-   int ret;
+   xmlSchemaValidCtxtPtr ctx;
+   int ret = -1;
+
+   /*
+    * A validation context cannot be shared between threads, so each
+    * verification gets its own.  The caller holds gSchemaLock.
+    */
+   if (NULL == gParsedSchemas) {
+      g_warning("No schemas loaded\n");
+      return FALSE;
+   }
+
+   ctx = xmlSchemaNewValidCtxt(gParsedSchemas);
+   if (NULL == ctx) {
+      g_warning("Failed to create schema validation context\n");
+      return FALSE;
+   }
+   xmlSchemaSetValidErrors(ctx,
+                           XmlErrorHandler,
+                           XmlErrorHandler,
+                           NULL);
 
-   ret = xmlSchemaValidateDoc(gSchemaValidateCtx, doc);
+   ret = xmlSchemaValidateDoc(ctx, doc);
    if (ret < 0) {
       g_warning("Failed to validate doc against schema\n");
    }
+   xmlSchemaFreeValidCtxt(ctx);
 
    return (ret == 0) ? TRUE : FALSE;
 }
@@ -1035,6 +1321,99 @@ VerifyConditions(xmlDocPtr doc)
 }
 
 
+/*
+ ******************************************************************************
+ * LimitExpireTime --                                                    */ /**
+ *
+ * Lowers a cache expiration time to the end of the validity period given
+ * by a NotOnOrAfter attribute, allowing for the clock skew that
+ * CheckTimeAttr() accepts.
+ *
+ * @param[in]     node        The node that may carry a NotOnOrAfter.
+ * @param[in,out] expireTime  The expiration time to limit.
+ *
+ ******************************************************************************
+ */
+
+static void
+LimitExpireTime(const xmlNodePtr node,
+                glong *expireTime)
+{
+   xmlChar *timeAttr;
+   GTimeVal attrTime;
+
+   timeAttr = FindAttrValue(node, "NotOnOrAfter");
+   if ((NULL != timeAttr) && (0 != *timeAttr) &&
+       g_time_val_from_iso8601(timeAttr, &attrTime)) {
+      *expireTime = MIN(*expireTime, attrTime.tv_sec + gClockSkewAdjustment);
+   }
+   xmlFree(timeAttr);
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheExpireTime --                                               */ /**
+ *
+ * Works out how long a verified token may be remembered.  This is the
+ * earliest NotOnOrAfter of its Conditions and SubjectConfirmationData,
+ * capped by the cache TTL.
+ *
+ * @param[in]  doc  The parsed and verified SAML token.
+ *
+ * @return Time in seconds until which the token may be cached, or 0 if it
+ *         must not be cached at all.
+ *
+ ******************************************************************************
+ */
+
+static glong
+TokenCacheExpireTime(xmlDocPtr doc)
+{
+   xmlNodePtr root = xmlDocGetRootElement(doc);
+   xmlNodePtr condNode;
+   xmlNodePtr subjNode;
+   xmlNodePtr child;
+   xmlNodePtr subjConfirmData;
+   GTimeVal now;
+   glong expireTime;
+
+   if (gTokenCacheSize <= 0 || gTokenCacheTTL <= 0) {
+      return 0;
+   }
+
+   g_get_current_time(&now);
+   expireTime = now.tv_sec + gTokenCacheTTL;
+
+   condNode = FindNodeByName(root, "Conditions");
+   if (NULL != condNode) {
+      /*
+       * The issuer asked for the assertion to be used only once.
+       */
+      if (FindNodeByName(condNode, "OneTimeUse") != NULL) {
+         return 0;
+      }
+      LimitExpireTime(condNode, &expireTime);
+   }
+
+   subjNode = FindNodeByName(root, "Subject");
+   if (NULL != subjNode) {
+      for (child = subjNode->children; child != NULL; child = child->next) {
+         if (child->type != XML_ELEMENT_NODE ||
+             !xmlStrEqual(child->name, "SubjectConfirmation")) {
+            continue;
+         }
+         subjConfirmData = FindNodeByName(child, "SubjectConfirmationData");
+         if (NULL != subjConfirmData) {
+            LimitExpireTime(subjConfirmData, &expireTime);
+         }
+      }
+   }
+
+   return expireTime;
+}
+
+
 /*
  ******************************************************************************
  * BuildCertChain --                                                     */ /**
@@ -1296,6 +1675,8 @@ done:
  * @param[out] numCerts  Number of certs in the token.
  * @param[out] certChain Certs in the token. Caller should g_free() array and
  *                       contents.
+ * @param[out] expireTime Time until which the verified token may be cached,
+ *                       0 if it must not be.  Optional.
  *
  * @return matching TRUE on success.
  *
@@ -1306,11 +1687,19 @@ static gboolean
 VerifySAMLToken(const gchar *token,
                 gchar **subject,
                 int *numCerts,
-                gchar ***certChain)
+                gchar ***certChain,
+                glong *expireTime)
 {
    xmlDocPtr doc = NULL;
    int retCode = FALSE;
    gboolean bRet;
+
+   if (NULL != expireTime) {
+      *expireTime = 0;
+   }
+
+   g_rw_lock_reader_lock(&gSchemaLock);
+
    /*
     * If we want to set extra options, use this path.
     */
@@ -1366,6 +1755,10 @@ VerifySAMLToken(const gchar *token,
       goto done;
    }
 
+   if (NULL != expireTime) {
+      *expireTime = TokenCacheExpireTime(doc);
+   }
+
    retCode = TRUE;
 done:
 #if PARSE_WITH_OPTIONS
@@ -1380,6 +1773,7 @@ done:
    if (doc) {
       xmlFreeDoc(doc);
    }
+   g_rw_lock_reader_unlock(&gSchemaLock);
 
    return retCode;
 }
@@ -1421,7 +1815,8 @@ SAML_VerifyBearerToken(const char *xmlText,
    ret = VerifySAMLToken(xmlText,
                          subjNameOut,
                          &num,
-                         &certChain);
+                         &certChain,
+                         NULL);
 
    // clean up -- this code doesn't look at the chain
    FreeCertArray(num, certChain);
@@ -1464,19 +1859,38 @@ SAML_VerifyBearerTokenAndChain(const char *xmlText,
    int num;
    gchar **certChain = NULL;
    ServiceSubject subj;
+   gchar *key;
+   glong expireTime;
 
    *userNameOut = NULL;
    *subjNameOut = NULL;
    *verifyAi = NULL;
 
-   bRet = VerifySAMLToken(xmlText,
-                          subjNameOut,
-                          &num,
-                          &certChain);
+   /*
+    * A token that was already verified only needs its cert chain to be
+    * checked against the alias store again.
+    */
+   key = g_compute_checksum_for_string(G_CHECKSUM_SHA256, xmlText, -1);
+   if ((NULL != key) &&
+       TokenCacheLookup(key, subjNameOut, &num, &certChain)) {
+      g_debug("%s: using cached verification of token\n", __FUNCTION__);
+   } else {
+      bRet = VerifySAMLToken(xmlText,
+                             subjNameOut,
+                             &num,
+                             &certChain,
+                             &expireTime);
+
+      if (FALSE == bRet) {
+         g_free(key);
+         return VGAUTH_E_AUTHENTICATION_DENIED;
+      }
 
-   if (FALSE == bRet) {
-      return VGAUTH_E_AUTHENTICATION_DENIED;
+      if ((NULL != key) && (0 != expireTime)) {
+         TokenCacheAdd(key, expireTime, *subjNameOut, num, certChain);
+      }
    }
+   g_free(key);
 
    subj.type = SUBJECT_TYPE_NAMED;
    subj.name = *subjNameOut;
@@ -409,6 +409,8 @@ ServiceConnectionShutdown(ServiceConnection *conn)
 
    ServiceProtoCleanupParseState(conn);
 
+   ServiceProtoAbandonPendingRequest(conn);
+
    if (conn->isListener) {
       ServiceNetworkRemoveListenPipe(conn);
    }
@@ -788,6 +790,7 @@ Service_ReloadPrefs(void)
 void
 Service_Shutdown(void)
 {
+   ServiceProtoStopVerifyThreads();
    SAML_Shutdown();
 }
 
@@ -83,6 +83,7 @@ enum { BUFSIZE = 4096 };
 #define  NETWORK_FORCE_TINY_PACKETS 0
 
 typedef struct ProtoRequest ProtoRequest;
+typedef struct ProtoSamlVerify ProtoSamlVerify;
 
 #ifdef _WIN32
 typedef enum _IOState {
@@ -148,6 +149,11 @@ typedef struct _ServiceConnection {
     */
    GTimeVal lastUse;
    gboolean dataConnectionIncremented;
+
+   /*
+    * A SAML token being verified by a worker thread for this connection.
+    */
+   ProtoSamlVerify *pendingVerify;
 } ServiceConnection;
 
 
@@ -319,10 +325,12 @@ VGAuthError ServiceAliasRemoveAlias(const gchar *reqUserName,
 
 VGAuthError ServiceAliasQueryAliases(const gchar *userName,
                                      int *num,
-                                     ServiceAlias **aList);
+                                     ServiceAlias **aList,
+                                     GHashTable **index);
 
 VGAuthError ServiceAliasQueryMappedAliases(int *num,
-                                           ServiceMappedAlias **maList);
+                                           ServiceMappedAlias **maList,
+                                           GHashTable **index);
 
 void ServiceAliasFreeAliasList(int num, ServiceAlias *aList);
 
@@ -343,6 +351,15 @@ gboolean ServiceAliasIsSubjectEqual(ServiceSubjectType t1,
 gboolean ServiceComparePEMCerts(const gchar *pemCert1,
                                 const gchar *pemCert2);
 
+/* SHA-256 of the DER encoding of a cert */
+#define SERVICE_CERT_FINGERPRINT_LEN 32
+
+void ServiceCertFingerprint(const gchar *pemCert,
+                            guchar *fingerprint);
+
+GSList *ServiceAliasLookupCertIndex(GHashTable *index,
+                                    const gchar *pemCert);
+
 /*
  * Connection functions
  */
@@ -367,6 +384,10 @@ VGAuthError ServiceProtoDispatchRequest(ServiceConnection *conn,
 
 void ServiceProtoCleanupParseState(ServiceConnection *conn);
 
+void ServiceProtoAbandonPendingRequest(ServiceConnection *conn);
+
+void ServiceProtoStopVerifyThreads(void);
+
 VGAuthError ServiceStartUserConnection(const char *userName,
                                        char **pipeName);       // OUT
 
@@ -491,6 +512,7 @@ VGAuthError SAML_VerifyBearerTokenAndChain(const char *xmlText,
                                            ServiceAliasInfo **verifyAi);
 void SAML_Shutdown(void);
 void SAML_Reload(void);
+int SAML_GetVerifyThreads(void);
 
 void ServiceFreeValidationResultsData(ServiceValidationResultsData *samlData);
 
@@ -36,6 +36,8 @@
  *    - clear out any existing aliases
  *    - add an alias using the built-in cert
  *    - validate the SAML token
+ *    - with -b, time ValidateTicket and QueryMappedAliases round trips
+ *      using the XML and the binary encodings
  *
  *    Possible reasons for failure:
  *    - VGAuthService wasn't started
@@ -198,7 +200,7 @@ static const gchar *token =
 static void
 Usage(void)
 {
-   fprintf(stderr, "Usage: %s\n", appName);
+   fprintf(stderr, "Usage: %s [-b iterations]\n", appName);
    exit(-1);
 }
 
@@ -321,6 +323,7 @@ CleanAliases(VGAuthContext *ctx,
  * @param[in]  user       The user whose alias store is to be updated.
  * @param[in]  subject    The Subject for the alias.
  * @param[in]  comment    The Comment for the alias.
+ * @param[in]  addMapped  Whether to also add it to the mapping file.
  *
  * @return A SAMl token on success, NULL failure.
  *
@@ -332,7 +335,8 @@ AddAlias(VGAuthContext *ctx,
          const gchar *cert,
          const gchar *user,
          const gchar *subject,
-         const gchar *comment)
+         const gchar *comment,
+         gboolean addMapped)
 {
    VGAuthError err;
    VGAuthAliasInfo ai;
@@ -340,7 +344,7 @@ AddAlias(VGAuthContext *ctx,
    ai.subject.type = VGAUTH_SUBJECT_NAMED;
    ai.subject.val.name = (gchar *)subject;
    ai.comment = (gchar *)comment;
-   err = VGAuth_AddAlias(ctx, user, FALSE, cert, &ai, 0, NULL);
+   err = VGAuth_AddAlias(ctx, user, addMapped, cert, &ai, 0, NULL);
    if (err != VGAUTH_E_OK) {
       g_printerr("VGAuth_AddAlias() failed "VGAUTHERR_FMT64"\n",
                  err);
@@ -419,6 +423,107 @@ done:
 }
 
 
+/*
+ ******************************************************************************
+ * Benchmark --                                                          */ /**
+ *
+ * Times ValidateTicket and QueryMappedAliases round trips to the service,
+ * using a context set up for either the XML or the binary encoding.
+ *
+ * @param[in]  userName    The user associated with the token.
+ * @param[in]  token       A SAML token, used to get a ticket.
+ * @param[in]  iterations  The number of round trips of each kind.
+ * @param[in]  binary      Whether to ask for the binary encoding.
+ *
+ * @return VGAUTH_E_OK on success, an error on failure.
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+Benchmark(const gchar *userName,
+          const gchar *token,
+          int iterations,
+          gboolean binary)
+{
+   VGAuthError err;
+   VGAuthContext *ctx;
+   VGAuthExtraParams initParams[1];
+   VGAuthExtraParams extraParams[1];
+   VGAuthUserHandle *userHandle = NULL;
+   VGAuthUserHandle *ticketHandle;
+   VGAuthMappedAlias *maList;
+   char *ticket = NULL;
+   GTimer *timer;
+   int num;
+   int i;
+
+   initParams[0].name = VGAUTH_PARAM_BINARY_PROTOCOL;
+   initParams[0].value = binary ? VGAUTH_PARAM_VALUE_TRUE :
+                                  VGAUTH_PARAM_VALUE_FALSE;
+   err = VGAuth_Init(appName, 1, initParams, &ctx);
+   if (VGAUTH_E_OK != err) {
+      g_printerr("Failed to init VGAuth");
+      return err;
+   }
+
+   extraParams[0].name = VGAUTH_PARAM_VALIDATE_INFO_ONLY;
+   extraParams[0].value = VGAUTH_PARAM_VALUE_TRUE;
+   err = VGAuth_ValidateSamlBearerToken(ctx, token, userName,
+                                        1, extraParams, &userHandle);
+   if (VGAUTH_E_OK != err) {
+      g_printerr("Failed to validate token");
+      goto done;
+   }
+
+   err = VGAuth_CreateTicket(ctx, userHandle, 0, NULL, &ticket);
+   if (VGAUTH_E_OK != err) {
+      g_printerr("VGAuth_CreateTicket() failed "VGAUTHERR_FMT64"\n", err);
+      goto done;
+   }
+
+   timer = g_timer_new();
+   for (i = 0; i < iterations; i++) {
+      err = VGAuth_ValidateTicket(ctx, ticket, 0, NULL, &ticketHandle);
+      if (VGAUTH_E_OK != err) {
+         g_printerr("VGAuth_ValidateTicket() failed "VGAUTHERR_FMT64"\n",
+                    err);
+         g_timer_destroy(timer);
+         goto done;
+      }
+      VGAuth_UserHandleFree(ticketHandle);
+   }
+   printf("%-6s ValidateTicket:     %8.1f usec/call\n",
+          binary ? "binary" : "xml",
+          g_timer_elapsed(timer, NULL) * G_USEC_PER_SEC / iterations);
+
+   g_timer_start(timer);
+   for (i = 0; i < iterations; i++) {
+      err = VGAuth_QueryMappedAliases(ctx, 0, NULL, &num, &maList);
+      if (VGAUTH_E_OK != err) {
+         g_printerr("VGAuth_QueryMappedAliases() failed "VGAUTHERR_FMT64"\n",
+                    err);
+         g_timer_destroy(timer);
+         goto done;
+      }
+      VGAuth_FreeMappedAliasList(num, maList);
+   }
+   printf("%-6s QueryMappedAliases: %8.1f usec/call (%d aliases)\n",
+          binary ? "binary" : "xml",
+          g_timer_elapsed(timer, NULL) * G_USEC_PER_SEC / iterations, num);
+   g_timer_destroy(timer);
+
+done:
+   if (NULL != ticket) {
+      (void) VGAuth_RevokeTicket(ctx, ticket, 0, NULL);
+      g_free(ticket);
+   }
+   VGAuth_UserHandleFree(userHandle);
+   VGAuth_Shutdown(ctx);
+   return err;
+}
+
+
 /*
  ******************************************************************************
  * main --                                                               */ /**
@@ -440,9 +545,15 @@ main(int argc,
 {
    VGAuthError err;
    VGAuthContext *ctx;
+   int iterations = 0;
 
    appName = g_path_get_basename(argv[0]);
-   if (argc != 1) {
+   if (argc == 3 && strcmp(argv[1], "-b") == 0) {
+      iterations = atoi(argv[2]);
+      if (iterations <= 0) {
+         Usage();
+      }
+   } else if (argc != 1) {
       Usage();
    }
 
@@ -461,8 +572,11 @@ main(int argc,
       return -1;
    }
 
+   /*
+    * The benchmark wants a non-empty mapping file to query.
+    */
    err = AddAlias(ctx, smoketestPEMCert,
-                  ALIAS_USER_NAME, SUBJECT_NAME, COMMENT);
+                  ALIAS_USER_NAME, SUBJECT_NAME, COMMENT, iterations > 0);
    if (VGAUTH_E_OK != err) {
       g_printerr("Failed to add alias");
       return -1;
@@ -476,6 +590,17 @@ main(int argc,
 
    printf("PASSED!\n");
 
+   if (iterations > 0) {
+      err = Benchmark(ALIAS_USER_NAME, token, iterations, FALSE);
+      if (VGAUTH_E_OK == err) {
+         err = Benchmark(ALIAS_USER_NAME, token, iterations, TRUE);
+      }
+      if (VGAUTH_E_OK != err) {
+         g_printerr("Benchmark failed");
+         return -1;
+      }
+   }
+
    // make sure we end with a clean slate
    err = CleanAliases(ctx, ALIAS_USER_NAME);
    if (VGAUTH_E_OK != err) {
@@ -63,7 +63,7 @@ typedef char *                          os_blocker_id_t;
    abort();                             \
 })
 
-#define os_rwlock_init(lock)            pthread_rwlock_init(lock, NULL)
+#define os_rwlock_init(lock)            os_rwlock_init_fuse(lock)
 #define os_rwlock_destroy(lock)         pthread_rwlock_destroy(lock)
 
 /*
@@ -155,5 +155,6 @@ extern int LOGLEVEL_THRESHOLD;
  */
 
 size_t strlcpy(char *dest, const char *src, size_t count);
+int os_rwlock_init_fuse(os_rwlock_t *lock);
 
 #endif /* __OS_H__ */
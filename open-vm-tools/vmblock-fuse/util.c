@@ -16,7 +16,10 @@
  *
  *********************************************************/
 
+/* For pthread_rwlockattr_setkind_np(). */
+#define _GNU_SOURCE
 #include <string.h>
+#include <pthread.h>
 
 /*
  *----------------------------------------------------------------------------
@@ -51,3 +54,42 @@ strlcpy(char *dest,         // OUT: destination to copy string to
    dest[len] = '\0';
    return ret;
 }
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * os_rwlock_init_fuse --
+ *
+ *    Initializes a read/write lock.  glibc read/write locks prefer readers
+ *    by default, so a steady stream of block lookups from file system
+ *    accesses could keep the blocker from ever adding or removing a block;
+ *    ask for writers to be preferred instead.
+ *
+ * Results:
+ *    Zero on success, error code on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+os_rwlock_init_fuse(pthread_rwlock_t *lock)  // OUT: lock to initialize
+{
+#if defined(__GLIBC__)
+   pthread_rwlockattr_t attr;
+   int ret;
+
+   pthread_rwlockattr_init(&attr);
+   pthread_rwlockattr_setkind_np(&attr,
+                                 PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+   ret = pthread_rwlock_init(lock, &attr);
+   pthread_rwlockattr_destroy(&attr);
+
+   return ret;
+#else
+   return pthread_rwlock_init(lock, NULL);
+#endif
+}